@@ -6,16 +6,29 @@
 #include <SDL_image.h>
 
 #include "libcommon/Math.h"
+#include "libcommon/Clock.h"
 #include "libcommon/Texture.h"
 
 #include "HelperFunctions.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "GLTrace.h"
 
 using namespace Common;
 
+InputLatencyStats::InputLatencyStats()
+	: total(0.0),
+	max(0.0),
+	frames(0)
+{
+}
+
 App::App(int screenWidth, int screenHeight)
 	: mInit(false),
 	mScreenWidth(screenWidth),
-	mScreenHeight(screenHeight)
+	mScreenHeight(screenHeight),
+	mInputTime(0.0),
+	mSwapMode(SwapMode::Immediate)
 {
 	if (SDL_Init(SDL_INIT_EVERYTHING) == -1) {
 		std::cerr << "Unable to init SDL: " << SDL_GetError() << "\n";
@@ -39,10 +52,6 @@ App::App(int screenWidth, int screenHeight)
 
 void App::init()
 {
-	GLuint vshader;
-	GLuint fshader;
-	GLint linked;
-
 	GLenum glewerr = glewInit();
 	if (glewerr != GLEW_OK) {
 		std::cerr << "Unable to initialise GLEW.\n";
@@ -52,40 +61,19 @@ void App::init()
 		std::cerr << "OpenGL 2.1 not supported.\n";
 		exit(1);
 	}
-
-	vshader = HelperFunctions::loadShaderFromFile(GL_VERTEX_SHADER, getVertexShaderFilename());
-	fshader = HelperFunctions::loadShaderFromFile(GL_FRAGMENT_SHADER, getFragmentShaderFilename());
-
-	mProgramObject = glCreateProgram();
-
-	if(mProgramObject == 0) {
-		std::cerr << "Unable to create program.\n";
-		exit(1);
+	if(mSwapMode != SwapMode::Immediate && !mPacer.setSwapMode(mSwapMode)) {
+		std::cerr << "Requested swap interval not supported.\n";
 	}
 
-	glAttachShader(mProgramObject, vshader);
-	glAttachShader(mProgramObject, fshader);
-
-	bindAttributes();
-	glLinkProgram(mProgramObject);
-
-	glGetProgramiv(mProgramObject, GL_LINK_STATUS, &linked);
-
-	if(!linked) {
-		GLint infoLen = 0;
-		glGetProgramiv(mProgramObject, GL_INFO_LOG_LENGTH, &infoLen);
-		if(infoLen > 1) {
-			char* infoLog = new char[infoLen];
-			glGetProgramInfoLog(mProgramObject, infoLen, NULL, infoLog);
-			std::cerr << "Error linking program: " << infoLog << "\n";
-			delete[] infoLog;
-		} else {
-			std::cerr << "Unknown error when linking program.\n";
-		}
-
-		glDeleteProgram(mProgramObject);
+	mProgramObject = ShaderCache::loadProgram(getVertexShaderFilename(), getFragmentShaderFilename(), getShaderDefines(),
+			[&] (GLuint program) {
+				mProgramObject = program;
+				bindAttributes();
+			});
+	if(!mProgramObject) {
 		exit(1);
 	}
+	ShaderCache::printStats(std::cout);
 
 	postInit();
 
@@ -104,15 +92,50 @@ void App::run()
 	if(!mInit) {
 		mInit = true;
 		init();
+		mPacer.resetStats();
 	}
 
 	while(1) {
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		if(handleInput()) {
-			break;
+		{
+			PROFILE_SCOPE("FramePacer::waitForNextFrame");
+			mPacer.waitForNextFrame();
+		}
+		{
+			PROFILE_SCOPE("App::handleInput");
+			if(handleInput()) {
+				break;
+			}
+		}
+		if(mInputTime != 0.0 || needsRedraw()) {
+			mPacer.requestRedraw();
+		}
+		if(!mPacer.shouldDraw()) {
+			mPacer.idle();
+			continue;
+		}
+
+		{
+			PROFILE_GPU_SCOPE("App::run");
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			{
+				PROFILE_SCOPE("App::draw");
+				draw();
+			}
+		}
+		{
+			PROFILE_SCOPE("SDL_GL_SwapBuffers");
+			SDL_GL_SwapBuffers();
+		}
+		GLTrace::endFrame();
+		if(mInputTime != 0.0) {
+			double latency = Clock::getTime() - mInputTime;
+			mInputLatency.total += latency;
+			mInputLatency.max = std::max(mInputLatency.max, latency);
+			mInputLatency.frames++;
+			mInputTime = 0.0;
 		}
-		draw();
-		SDL_GL_SwapBuffers();
+		mPacer.frameDrawn();
+		Profiler::endFrame();
 	}
 
 }
@@ -140,17 +163,70 @@ bool App::handleEvent(const SDL_Event& ev)
 	return false;
 }
 
+const InputLatencyStats& App::getInputLatency() const
+{
+	return mInputLatency;
+}
+
+FramePacer& App::getFramePacer()
+{
+	return mPacer;
+}
+
+/* Applied once the GL context is initialised in run(). */
+void App::setSwapMode(SwapMode mode)
+{
+	mSwapMode = mode;
+	if(mInit && !mPacer.setSwapMode(mode)) {
+		std::cerr << "Requested swap interval not supported.\n";
+	}
+}
+
+/* Consecutive mouse motion events are merged into one so that the
+ * handlers see a single delta per frame. Other events are passed on in
+ * order, after any motion before them. */
 bool App::handleInput()
 {
 	SDL_Event event;
+	SDL_Event motion;
+	bool motionPending = false;
 
 	while(SDL_PollEvent(&event)) {
-		if(handleEvent(event)) {
+		if(mInputTime == 0.0) {
+			mInputTime = Clock::getTime();
+		}
+		if(dispatchEvent(event, motion, motionPending)) {
 			return true;
 		}
 	}
 
+	if(motionPending) {
+		return handleEvent(motion);
+	}
+
 	return false;
 }
 
+bool App::dispatchEvent(SDL_Event& ev, SDL_Event& motion, bool& motionPending)
+{
+	if(ev.type == SDL_MOUSEMOTION) {
+		if(motionPending) {
+			ev.motion.xrel += motion.motion.xrel;
+			ev.motion.yrel += motion.motion.yrel;
+		}
+		motion = ev;
+		motionPending = true;
+		return false;
+	}
+
+	if(motionPending) {
+		motionPending = false;
+		if(handleEvent(motion)) {
+			return true;
+		}
+	}
+
+	return handleEvent(ev);
+}
+
 
@@ -11,6 +11,17 @@
 #include "libcommon/Vector3.h"
 #include "libcommon/Matrix44.h"
 
+#include "FramePacer.h"
+
+/* Time from polling the first input event of a frame until the frame
+ * with its effect has been swapped. */
+struct InputLatencyStats {
+	InputLatencyStats();
+	double total;
+	double max;
+	unsigned int frames;
+};
+
 class App {
 	public:
 		App(int screenWidth, int screenHeight);
@@ -18,10 +29,17 @@ class App {
 		void run();
 		virtual const char* getVertexShaderFilename() = 0;
 		virtual const char* getFragmentShaderFilename() = 0;
+		virtual std::string getShaderDefines() { return ""; }
 		virtual void bindAttributes() = 0;
 		virtual void draw() = 0;
 		virtual void postInit() { }
 		virtual bool handleEvent(const SDL_Event& ev);
+		/* In on-demand mode, return true when the scene has changed
+		 * without any input. */
+		virtual bool needsRedraw() { return false; }
+		const InputLatencyStats& getInputLatency() const;
+		FramePacer& getFramePacer();
+		void setSwapMode(SwapMode mode);
 
 	protected:
 
@@ -31,11 +49,16 @@ class App {
 	private:
 		void init();
 		bool handleInput();
+		bool dispatchEvent(SDL_Event& ev, SDL_Event& motion, bool& motionPending);
 
 		SDL_Surface* mScreen;
 		bool mInit;
 		int mScreenWidth;
 		int mScreenHeight;
+		double mInputTime;
+		InputLatencyStats mInputLatency;
+		FramePacer mPacer;
+		SwapMode mSwapMode;
 };
 
 #endif
@@ -0,0 +1,307 @@
+#include "AssetPack.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Model.h"
+#include "Hash.h"
+
+using namespace AssetPackFormat;
+
+/* blobs start on a cache line, the arrays inside them on 16 bytes */
+static const uint64_t BlobAlignment = 64;
+static const uint32_t ArrayAlignment = 16;
+
+static boost::shared_ptr<AssetPack> gCurrent;
+
+uint64_t AssetPackFormat::hash(const char* name)
+{
+	return fnv1a(name, strlen(name));
+}
+
+static uint32_t appendArray(std::vector<unsigned char>& blob, const void* data, size_t bytes)
+{
+	uint32_t offset = (blob.size() + ArrayAlignment - 1) / ArrayAlignment * ArrayAlignment;
+	blob.resize(offset + bytes);
+	if(bytes)
+		memcpy(&blob[offset], data, bytes);
+	return offset;
+}
+
+void AssetPackDescription::addMesh(const std::string& name, const Model& model)
+{
+	const auto& vertices = model.getVertexCoords();
+	const auto& texcoords = model.getTexCoords();
+	const auto& normals = model.getNormals();
+	const auto& indices = model.getIndices();
+
+	MeshHeader h;
+	memset(&h, 0, sizeof(h));
+	h.vertexCount = vertices.size() / 3;
+	h.indexCount = indices.size();
+	h.boundingRadius = model.getBoundingRadius();
+	h.hasNormals = !normals.empty();
+
+	Asset a;
+	a.name = name;
+	a.type = AssetMesh;
+	a.data.resize(sizeof(h));
+	h.vertexOffset = appendArray(a.data, vertices.data(), vertices.size() * sizeof(GLfloat));
+	h.texCoordOffset = appendArray(a.data, texcoords.data(), texcoords.size() * sizeof(GLfloat));
+	h.normalOffset = appendArray(a.data, normals.data(), normals.size() * sizeof(GLfloat));
+	h.indexOffset = appendArray(a.data, indices.data(), indices.size() * sizeof(GLushort));
+	memcpy(&a.data[0], &h, sizeof(h));
+	assets.push_back(a);
+}
+
+void AssetPackDescription::addTexture(const std::string& name, uint32_t width, uint32_t height,
+		const unsigned char* rgba)
+{
+	TextureHeader h;
+	memset(&h, 0, sizeof(h));
+	h.width = width;
+	h.height = height;
+
+	Asset a;
+	a.name = name;
+	a.type = AssetTexture;
+	a.data.resize(sizeof(h));
+	h.pixelOffset = appendArray(a.data, rgba, size_t(width) * height * 4);
+	memcpy(&a.data[0], &h, sizeof(h));
+	assets.push_back(a);
+}
+
+void AssetPackDescription::addShader(const std::string& name, const std::string& source)
+{
+	Asset a;
+	a.name = name;
+	a.type = AssetShader;
+	a.data.assign(source.begin(), source.end());
+	assets.push_back(a);
+}
+
+AssetPack::AssetPack(const std::string& filename)
+	: mData(nullptr),
+	mSize(0),
+	mHeader(nullptr),
+	mEntries(nullptr)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		std::cerr << "Unable to open asset pack " << filename << ".\n";
+		throw std::runtime_error("Error loading asset pack");
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+		close(fd);
+		std::cerr << filename << " is too short for an asset pack.\n";
+		throw std::runtime_error("Error loading asset pack");
+	}
+
+	mSize = st.st_size;
+	void* p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) {
+		std::cerr << "Unable to map asset pack " << filename << ".\n";
+		throw std::runtime_error("Error loading asset pack");
+	}
+	mData = static_cast<const unsigned char*>(p);
+	mHeader = reinterpret_cast<const Header*>(mData);
+
+	try {
+		validate(filename);
+	} catch(...) {
+		munmap(const_cast<unsigned char*>(mData), mSize);
+		throw;
+	}
+	mEntries = reinterpret_cast<const Entry*>(mData + mHeader->directoryOffset);
+	/* assets are looked up by name, not read front to back */
+	madvise(p, mSize, MADV_RANDOM);
+}
+
+AssetPack::~AssetPack()
+{
+	munmap(const_cast<unsigned char*>(mData), mSize);
+}
+
+static bool inside(uint64_t offset, uint64_t count, uint64_t size, uint64_t total)
+{
+	return offset <= total && (size == 0 || count <= (total - offset) / size);
+}
+
+void AssetPack::validate(const std::string& filename) const
+{
+	const Header& h = *mHeader;
+	if(memcmp(h.magic, Magic, sizeof(Magic)) || h.version != Version) {
+		std::cerr << filename << " is not an asset pack of version " << Version << ".\n";
+		throw std::runtime_error("Error loading asset pack");
+	}
+
+	if(h.directoryOffset % alignof(Entry) ||
+			!inside(h.directoryOffset, h.entryCount, sizeof(Entry), mSize) ||
+			!inside(h.stringOffset, h.stringSize, 1, mSize) ||
+			h.stringSize == 0 || mData[h.stringOffset + h.stringSize - 1] != '\0') {
+		std::cerr << filename << " is truncated or corrupt.\n";
+		throw std::runtime_error("Error loading asset pack");
+	}
+
+	const Entry* entries = reinterpret_cast<const Entry*>(mData + h.directoryOffset);
+	for(uint32_t i = 0; i < h.entryCount; i++) {
+		const Entry& e = entries[i];
+		bool ok = e.name < h.stringSize && e.offset % BlobAlignment == 0 &&
+			inside(e.offset, e.size, 1, mSize) &&
+			(i == 0 || entries[i - 1].hash <= e.hash);
+
+		const unsigned char* blob = mData + e.offset;
+		if(ok && e.type == AssetMesh) {
+			const MeshHeader* m = reinterpret_cast<const MeshHeader*>(blob);
+			ok = e.size >= sizeof(MeshHeader) &&
+				m->vertexOffset % ArrayAlignment == 0 &&
+				m->texCoordOffset % ArrayAlignment == 0 &&
+				m->normalOffset % ArrayAlignment == 0 &&
+				m->indexOffset % ArrayAlignment == 0 &&
+				inside(m->vertexOffset, m->vertexCount, 3 * sizeof(float), e.size) &&
+				inside(m->texCoordOffset, m->vertexCount, 2 * sizeof(float), e.size) &&
+				(!m->hasNormals ||
+				 inside(m->normalOffset, m->vertexCount, 3 * sizeof(float), e.size)) &&
+				inside(m->indexOffset, m->indexCount, sizeof(uint16_t), e.size) &&
+				m->indexCount % 3 == 0;
+			const uint16_t* indices = reinterpret_cast<const uint16_t*>(blob + m->indexOffset);
+			for(uint32_t j = 0; ok && j < m->indexCount; j++)
+				ok = indices[j] < m->vertexCount;
+		} else if(ok && e.type == AssetTexture) {
+			const TextureHeader* t = reinterpret_cast<const TextureHeader*>(blob);
+			ok = e.size >= sizeof(TextureHeader) &&
+				t->pixelOffset % ArrayAlignment == 0 &&
+				inside(t->pixelOffset, uint64_t(t->width) * t->height, 4, e.size);
+		} else if(ok) {
+			ok = e.type == AssetShader;
+		}
+
+		if(!ok) {
+			std::cerr << filename << ": asset " << i << " is corrupt.\n";
+			throw std::runtime_error("Error loading asset pack");
+		}
+	}
+}
+
+static void writeBlob(std::ofstream& f, uint64_t& offset, const void* data, size_t bytes,
+		uint64_t alignment)
+{
+	static const char zeros[BlobAlignment] = { 0 };
+	offset = (uint64_t(f.tellp()) + alignment - 1) / alignment * alignment;
+	f.write(zeros, offset - f.tellp());
+	if(bytes)
+		f.write(static_cast<const char*>(data), bytes);
+}
+
+void AssetPack::write(const std::string& filename, const AssetPackDescription& pack)
+{
+	std::string strings(1, '\0');
+	std::vector<Entry> entries;
+	for(auto& a : pack.assets) {
+		Entry e;
+		memset(&e, 0, sizeof(e));
+		e.hash = hash(a.name.c_str());
+		e.type = a.type;
+		e.name = strings.size();
+		e.size = a.data.size();
+		strings.append(a.name.c_str(), a.name.size() + 1);
+		entries.push_back(e);
+	}
+
+	std::ofstream f(filename.c_str(), std::ios::binary);
+	if(!f) {
+		std::cerr << "Unable to open " << filename << " for writing.\n";
+		throw std::runtime_error("Error writing asset pack");
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, Magic, sizeof(Magic));
+	h.version = Version;
+	h.entryCount = entries.size();
+	h.stringSize = strings.size();
+
+	/* the header is written again once the offsets are known */
+	f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	for(size_t i = 0; i < entries.size(); i++) {
+		const auto& data = pack.assets[i].data;
+		writeBlob(f, entries[i].offset, data.data(), data.size(), BlobAlignment);
+	}
+
+	std::stable_sort(entries.begin(), entries.end(),
+			[] (const Entry& a, const Entry& b) { return a.hash < b.hash; });
+	writeBlob(f, h.directoryOffset, entries.data(), entries.size() * sizeof(Entry), alignof(Entry));
+	writeBlob(f, h.stringOffset, strings.data(), strings.size(), 1);
+	f.seekp(0);
+	f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+	if(!f) {
+		std::cerr << "Unable to write asset pack to " << filename << ".\n";
+		throw std::runtime_error("Error writing asset pack");
+	}
+}
+
+void AssetPack::setCurrent(const boost::shared_ptr<AssetPack>& pack)
+{
+	gCurrent = pack;
+}
+
+AssetPack* AssetPack::getCurrent()
+{
+	return gCurrent.get();
+}
+
+const Entry* AssetPack::find(const std::string& name, AssetType type) const
+{
+	uint64_t h = hash(name.c_str());
+	const Entry* end = mEntries + mHeader->entryCount;
+	const Entry* e = std::lower_bound(mEntries, end, h,
+			[] (const Entry& a, uint64_t h) { return a.hash < h; });
+	for(; e != end && e->hash == h; ++e) {
+		if(e->type == uint32_t(type) && name == getName(*e))
+			return e;
+	}
+	return nullptr;
+}
+
+uint32_t AssetPack::getEntryCount() const
+{
+	return mHeader->entryCount;
+}
+
+const Entry& AssetPack::getEntry(uint32_t i) const
+{
+	return mEntries[i];
+}
+
+const char* AssetPack::getName(const Entry& e) const
+{
+	return reinterpret_cast<const char*>(mData + mHeader->stringOffset) + e.name;
+}
+
+const unsigned char* AssetPack::getData(const Entry& e) const
+{
+	return mData + e.offset;
+}
+
+const MeshHeader& AssetPack::getMesh(const Entry& e) const
+{
+	return *reinterpret_cast<const MeshHeader*>(getData(e));
+}
+
+const TextureHeader& AssetPack::getTexture(const Entry& e) const
+{
+	return *reinterpret_cast<const TextureHeader*>(getData(e));
+}
+
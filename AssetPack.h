@@ -0,0 +1,128 @@
+#ifndef SCENE_ASSETPACK_H
+#define SCENE_ASSETPACK_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <boost/shared_ptr.hpp>
+
+class Model;
+
+/* Asset pack: a header, the cooked assets and a directory sorted by the
+ * hash of the asset name. Every blob and every array inside a blob
+ * starts at an aligned offset and is in native byte order, so assets
+ * can be handed to GL straight from a read-only mapping. Assets are
+ * named by the file they were cooked from, so a pack can stand in for
+ * the loose files. */
+namespace AssetPackFormat {
+
+static const char Magic[4] = { 'A', 'P', 'K', '1' };
+static const uint32_t Version = 1;
+
+enum AssetType {
+	AssetMesh = 1,
+	AssetTexture = 2,
+	AssetShader = 3
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+	/* byte offsets from the start of the file */
+	uint64_t directoryOffset;
+	uint64_t stringOffset;
+	uint64_t stringSize;
+};
+
+/* Sorted by hash; equal hashes are told apart by the name. */
+struct Entry {
+	uint64_t hash;
+	uint32_t type;
+	uint32_t name;  /* offset into the string table */
+	uint64_t offset;
+	uint64_t size;
+};
+
+/* Offsets are from the start of the blob. Normals are optional. */
+struct MeshHeader {
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	float boundingRadius;
+	uint32_t hasNormals;
+	uint32_t vertexOffset;   /* 3 floats per vertex */
+	uint32_t texCoordOffset; /* 2 floats per vertex */
+	uint32_t normalOffset;   /* 3 floats per vertex */
+	uint32_t indexOffset;    /* uint16_t per index */
+};
+
+/* Followed by width * height RGBA8 pixels, top row first. */
+struct TextureHeader {
+	uint32_t width;
+	uint32_t height;
+	uint32_t pixelOffset;
+	uint32_t reserved;
+};
+
+/* Shaders are the source text without a terminating NUL. */
+
+uint64_t hash(const char* name);
+
+}
+
+/* The assets for writing a pack. */
+struct AssetPackDescription {
+	struct Asset {
+		std::string name;
+		AssetPackFormat::AssetType type;
+		std::vector<unsigned char> data;
+	};
+
+	void addMesh(const std::string& name, const Model& model);
+	void addTexture(const std::string& name, uint32_t width, uint32_t height,
+			const unsigned char* rgba);
+	void addShader(const std::string& name, const std::string& source);
+
+	std::vector<Asset> assets;
+};
+
+/* An asset pack mapped into memory. The constructor checks that every
+ * blob is inside the file and the cooked headers describe arrays inside
+ * their blobs, so the accessors need no checks. */
+class AssetPack {
+	public:
+		AssetPack(const std::string& filename);
+		~AssetPack();
+		static void write(const std::string& filename, const AssetPackDescription& pack);
+
+		/* The pack that Model, HelperFunctions and ShaderCache look in
+		 * before falling back to loose files, or null. */
+		static void setCurrent(const boost::shared_ptr<AssetPack>& pack);
+		static AssetPack* getCurrent();
+
+		const AssetPackFormat::Entry* find(const std::string& name,
+				AssetPackFormat::AssetType type) const;
+		uint32_t getEntryCount() const;
+		const AssetPackFormat::Entry& getEntry(uint32_t i) const;
+		const char* getName(const AssetPackFormat::Entry& e) const;
+		const unsigned char* getData(const AssetPackFormat::Entry& e) const;
+
+		const AssetPackFormat::MeshHeader& getMesh(const AssetPackFormat::Entry& e) const;
+		const AssetPackFormat::TextureHeader& getTexture(const AssetPackFormat::Entry& e) const;
+
+	private:
+		AssetPack(const AssetPack&) = delete;
+		AssetPack& operator=(const AssetPack&) = delete;
+
+		void validate(const std::string& filename) const;
+
+		const unsigned char* mData;
+		size_t mSize;
+		const AssetPackFormat::Header* mHeader;
+		const AssetPackFormat::Entry* mEntries;
+};
+
+#endif
+
@@ -0,0 +1,141 @@
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "AssetPack.h"
+#include "Model.h"
+#include "Benchmark.h"
+
+using namespace AssetPackFormat;
+
+static bool hasSuffix(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void addTexture(AssetPackDescription& pack, const std::string& filename)
+{
+	SDL_Surface* img = IMG_Load(filename.c_str());
+	if(!img) {
+		std::cerr << "Unable to load texture " << filename << ": " << IMG_GetError() << "\n";
+		throw std::runtime_error("Error while loading texture");
+	}
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	SDL_Surface* fmt = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+			0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+#else
+	SDL_Surface* fmt = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+			0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+#endif
+	SDL_Surface* rgba = fmt ? SDL_ConvertSurface(img, fmt->format, SDL_SWSURFACE) : nullptr;
+	SDL_FreeSurface(img);
+	if(fmt)
+		SDL_FreeSurface(fmt);
+	if(!rgba) {
+		std::cerr << "Unable to convert texture " << filename << ": " << SDL_GetError() << "\n";
+		throw std::runtime_error("Error while loading texture");
+	}
+
+	std::vector<unsigned char> pixels(rgba->w * rgba->h * 4);
+	SDL_LockSurface(rgba);
+	for(int y = 0; y < rgba->h; y++) {
+		memcpy(&pixels[y * rgba->w * 4],
+				static_cast<const unsigned char*>(rgba->pixels) + y * rgba->pitch,
+				rgba->w * 4);
+	}
+	SDL_UnlockSurface(rgba);
+	pack.addTexture(filename, rgba->w, rgba->h, pixels.data());
+	SDL_FreeSurface(rgba);
+}
+
+static void addShader(AssetPackDescription& pack, const std::string& filename)
+{
+	std::ifstream ifs(filename.c_str());
+	if(!ifs.is_open()) {
+		std::cerr << "Unable to open " << filename << ".\n";
+		throw std::runtime_error("Error while loading shader");
+	}
+	pack.addShader(filename, std::string((std::istreambuf_iterator<char>(ifs)),
+				std::istreambuf_iterator<char>()));
+}
+
+static const char* typeName(uint32_t type)
+{
+	switch(type) {
+		case AssetMesh:
+			return "mesh";
+		case AssetTexture:
+			return "texture";
+		case AssetShader:
+			return "shader";
+	}
+	return "unknown";
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " build <pack file> <asset file>...\n"
+		<< "       " << p << " list <pack file>\n"
+		<< "Assets are named by their file name. Files ending in .vert or .frag\n"
+		<< "are shaders, .jpg, .png, .bmp and .tga textures and anything else\n"
+		<< "a model.\n";
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 3) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	try {
+		if(!strcmp(argv[1], "build") && argc >= 4) {
+			AssetPackDescription pack;
+			for(int i = 3; i < argc; i++) {
+				std::string filename = argv[i];
+				if(hasSuffix(filename, ".vert") || hasSuffix(filename, ".frag")) {
+					addShader(pack, filename);
+				} else if(hasSuffix(filename, ".jpg") || hasSuffix(filename, ".png") ||
+						hasSuffix(filename, ".bmp") || hasSuffix(filename, ".tga")) {
+					addTexture(pack, filename);
+				} else {
+					Model model(filename);
+					pack.addMesh(filename, model);
+				}
+			}
+			AssetPack::write(argv[2], pack);
+			std::cout << "Wrote " << pack.assets.size() << " assets to " << argv[2] << "\n";
+		} else if(!strcmp(argv[1], "list") && argc == 3) {
+			double start = Benchmark::now();
+			AssetPack pack(argv[2]);
+			std::cerr << "Mapped " << pack.getEntryCount() << " assets in "
+				<< (Benchmark::now() - start) * 1000.0 << " ms\n";
+			for(uint32_t i = 0; i < pack.getEntryCount(); i++) {
+				const Entry& e = pack.getEntry(i);
+				std::cout << std::hex << std::setw(16) << std::setfill('0') << e.hash
+					<< std::dec << std::setfill(' ') << "  " << std::setw(8) << typeName(e.type)
+					<< std::setw(12) << e.offset << std::setw(10) << e.size
+					<< "  " << pack.getName(e) << "\n";
+			}
+		} else {
+			usage(argv[0]);
+			exit(1);
+		}
+	} catch(std::exception& e) {
+		std::cerr << "std::exception: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
+
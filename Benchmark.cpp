@@ -0,0 +1,112 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <iostream>
+
+const double Benchmark::MinSampleTime = 0.01;
+
+BenchmarkStats::BenchmarkStats()
+	: samples(0),
+	mean(0.0),
+	stddev(0.0),
+	min(0.0),
+	max(0.0),
+	p50(0.0),
+	p95(0.0),
+	p99(0.0)
+{
+}
+
+double Benchmark::now()
+{
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::duration<double>>(t).count();
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	/* nearest rank */
+	size_t rank = size_t(ceil(p / 100.0 * sorted.size()));
+	if(rank < 1)
+		rank = 1;
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+BenchmarkStats Benchmark::calculate(std::vector<double> samples)
+{
+	BenchmarkStats s;
+	if(samples.empty())
+		return s;
+
+	std::sort(samples.begin(), samples.end());
+	s.samples = samples.size();
+	s.min = samples.front();
+	s.max = samples.back();
+
+	double sum = 0.0;
+	for(auto v : samples)
+		sum += v;
+	s.mean = sum / samples.size();
+
+	double var = 0.0;
+	for(auto v : samples)
+		var += (v - s.mean) * (v - s.mean);
+	s.stddev = samples.size() > 1 ? sqrt(var / (samples.size() - 1)) : 0.0;
+
+	s.p50 = percentile(samples, 50.0);
+	s.p95 = percentile(samples, 95.0);
+	s.p99 = percentile(samples, 99.0);
+	return s;
+}
+
+void Benchmark::print(std::ostream& os, const std::string& name,
+		const BenchmarkStats& stats, double scale, const char* unit)
+{
+	std::ios::fmtflags flags(os.flags());
+	os << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+		<< " p50 " << std::setw(10) << stats.p50 * scale << " " << unit
+		<< "  mean " << std::setw(10) << stats.mean * scale
+		<< "  sd " << std::setw(8) << stats.stddev * scale
+		<< "  min " << std::setw(10) << stats.min * scale
+		<< "  (" << stats.samples << " samples)\n";
+	os.flags(flags);
+}
+
+bool Benchmark::loadBaseline(const std::string& filename, std::map<std::string, double>& baseline)
+{
+	std::ifstream in(filename.c_str());
+	if(!in.is_open()) {
+		std::cerr << "Unable to open baseline " << filename << ".\n";
+		return false;
+	}
+
+	std::string line;
+	while(std::getline(in, line)) {
+		size_t tab = line.find('\t');
+		if(tab == std::string::npos)
+			continue;
+		baseline[line.substr(0, tab)] = atof(line.c_str() + tab + 1);
+	}
+	return true;
+}
+
+bool Benchmark::saveBaseline(const std::string& filename, const std::map<std::string, double>& baseline)
+{
+	std::ofstream out(filename.c_str());
+	if(!out.is_open()) {
+		std::cerr << "Unable to open " << filename << " for writing.\n";
+		return false;
+	}
+
+	out << std::scientific << std::setprecision(9);
+	for(auto& p : baseline) {
+		out << p.first << "\t" << p.second << "\n";
+	}
+	return true;
+}
+
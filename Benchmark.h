@@ -0,0 +1,88 @@
+#ifndef SCENE_BENCHMARK_H
+#define SCENE_BENCHMARK_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <ostream>
+
+struct BenchmarkStats {
+	BenchmarkStats();
+	unsigned int samples;
+	double mean;
+	double stddev;
+	double min;
+	double max;
+	double p50;
+	double p95;
+	double p99;
+};
+
+class Benchmark {
+	public:
+		static double now();
+		static BenchmarkStats calculate(std::vector<double> samples);
+		static void print(std::ostream& os, const std::string& name,
+				const BenchmarkStats& stats, double scale, const char* unit);
+
+		/* Times f(i) for i in [0, iterations) per sample and returns
+		 * the statistics of the time per call. With iterations 0 the
+		 * count is chosen so that a sample takes at least MinSampleTime.
+		 * WarmupSamples samples are run and discarded first. */
+		template<typename F>
+		static BenchmarkStats measure(unsigned int samples, unsigned int iterations, F f);
+
+		/* Keeps the compiler from optimising away the computation of v. */
+		template<typename T>
+		static void doNotOptimize(const T& v);
+
+		/* Baselines are saved as tab separated names and p50 times. */
+		static bool loadBaseline(const std::string& filename, std::map<std::string, double>& baseline);
+		static bool saveBaseline(const std::string& filename, const std::map<std::string, double>& baseline);
+
+		static const unsigned int WarmupSamples = 3;
+		static const double MinSampleTime;
+
+	private:
+		template<typename F>
+		static double runSample(unsigned int iterations, F& f);
+};
+
+template<typename T>
+inline void Benchmark::doNotOptimize(const T& v)
+{
+	asm volatile("" : : "r"(&v) : "memory");
+}
+
+template<typename F>
+double Benchmark::runSample(unsigned int iterations, F& f)
+{
+	double start = now();
+	for(unsigned int i = 0; i < iterations; i++) {
+		f(i);
+	}
+	return now() - start;
+}
+
+template<typename F>
+BenchmarkStats Benchmark::measure(unsigned int samples, unsigned int iterations, F f)
+{
+	if(iterations == 0) {
+		iterations = 1;
+		while(runSample(iterations, f) < MinSampleTime && iterations < (1u << 30))
+			iterations *= 2;
+	}
+
+	for(unsigned int i = 0; i < WarmupSamples; i++) {
+		runSample(iterations, f);
+	}
+
+	std::vector<double> times;
+	for(unsigned int i = 0; i < samples; i++) {
+		times.push_back(runSample(iterations, f) / iterations);
+	}
+	return calculate(times);
+}
+
+#endif
+
@@ -0,0 +1,393 @@
+#include "FrameCapture.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cctype>
+
+#include <zlib.h>
+
+#include "MemoryTracker.h"
+#include "Profiler.h"
+
+static void put32(std::vector<unsigned char>& out, uint32_t v)
+{
+	out.push_back(v >> 24);
+	out.push_back(v >> 16);
+	out.push_back(v >> 8);
+	out.push_back(v);
+}
+
+/* Splits a file name pattern around its one integer conversion, which
+ * may have a width and the 0 flag, such as %05u. %% is a literal %. */
+static bool splitPattern(const std::string& pattern, std::string& prefix,
+		std::string& suffix, int& width, bool& zeroPad)
+{
+	bool found = false;
+	std::string* part = &prefix;
+	prefix.clear();
+	suffix.clear();
+	for(size_t i = 0; i < pattern.size(); i++) {
+		if(pattern[i] != '%') {
+			*part += pattern[i];
+			continue;
+		}
+		if(++i < pattern.size() && pattern[i] == '%') {
+			*part += '%';
+			continue;
+		}
+		if(found)
+			return false;
+		zeroPad = i < pattern.size() && pattern[i] == '0';
+		if(zeroPad)
+			i++;
+		width = 0;
+		while(i < pattern.size() && isdigit((unsigned char)pattern[i]) && width < 100)
+			width = width * 10 + (pattern[i++] - '0');
+		if(i == pattern.size() || width > 20 || !strchr("diu", pattern[i]))
+			return false;
+		found = true;
+		part = &suffix;
+	}
+	return found;
+}
+
+static void pngChunk(std::vector<unsigned char>& out, const char* type,
+		const unsigned char* data, size_t length)
+{
+	put32(out, length);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + length);
+	put32(out, crc32(0, &out[start], out.size() - start));
+}
+
+FrameCaptureStats::FrameCaptureStats()
+	: captured(0),
+	written(0),
+	dropped(0),
+	stalls(0),
+	wallTime(0.0),
+	fps(0.0),
+	bytesWritten(0)
+{
+}
+
+bool FrameCapture::isSupported()
+{
+	return GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+}
+
+FrameCapture::FrameCapture(int width, int height, CaptureFormat format,
+		const std::string& path, unsigned int fps, unsigned int workers)
+	: mWidth(width),
+	mHeight(height),
+	mFormat(format),
+	mPath(path),
+	mIndexWidth(0),
+	mIndexZeroPad(false),
+	mUseFences(GLEW_VERSION_3_2 || GLEW_ARB_sync),
+	mFrame(0),
+	mNextIndex(0),
+	mNextWrite(0),
+	mBusy(0),
+	mQuit(false),
+	mStartTime(0.0),
+	mLastWrite(0.0)
+{
+	if(format == CaptureFormat::Y4M) {
+		mStream.open(path.c_str(), std::ios::binary | std::ios::trunc);
+		if(!mStream.is_open()) {
+			std::cerr << "Unable to open " << path << " for writing.\n";
+			throw std::runtime_error("Error opening capture file");
+		}
+		mStream << "YUV4MPEG2 W" << width << " H" << height << " F" << fps
+			<< ":1 Ip A1:1 C420jpeg\n";
+	} else if(!splitPattern(path, mPrefix, mSuffix, mIndexWidth, mIndexZeroPad)) {
+		std::cerr << "The capture path " << path
+			<< " needs exactly one frame number conversion such as %05u.\n";
+		throw std::runtime_error("Error in capture path");
+	}
+
+	glGenBuffers(RingSize, mBuffers);
+	for(int i = 0; i < RingSize; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		MemoryTracker::setBufferSize(mBuffers[i], MemoryCategory::StreamBuffers, width * height * 4);
+		mFences[i] = 0;
+		mPending[i] = false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if(!workers)
+		workers = std::max(1u, std::thread::hardware_concurrency() / 2);
+	for(unsigned int i = 0; i < workers; i++) {
+		mWorkers.push_back(std::thread(&FrameCapture::work, this));
+	}
+}
+
+FrameCapture::~FrameCapture()
+{
+	finish();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for(auto& t : mWorkers) {
+		t.join();
+	}
+
+	for(int i = 0; i < RingSize; i++) {
+		if(mFences[i])
+			glDeleteSync(mFences[i]);
+	}
+	glDeleteBuffers(RingSize, mBuffers);
+	MemoryTracker::deleteBuffers(RingSize, mBuffers);
+}
+
+void FrameCapture::capture()
+{
+	if(mStartTime == 0.0)
+		mStartTime = Profiler::now();
+
+	int slot = mFrame % RingSize;
+	if(mPending[slot])
+		readBack(slot, false);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[slot]);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if(mUseFences)
+		mFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mPending[slot] = true;
+	mFrame++;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mStats.captured++;
+}
+
+void FrameCapture::finish()
+{
+	for(int i = 0; i < RingSize; i++) {
+		int slot = (mFrame + i) % RingSize;
+		if(mPending[slot])
+			readBack(slot, true);
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDone.wait(lock, [&] () { return mQueue.empty() && mBusy == 0; });
+	if(mStream.is_open())
+		mStream.flush();
+}
+
+/* Without wait, a frame is dropped when the queue is full. */
+void FrameCapture::readBack(int slot, bool wait)
+{
+	if(mFences[slot]) {
+		if(glClientWaitSync(mFences[slot], 0, 0) == GL_TIMEOUT_EXPIRED) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStats.stalls++;
+		}
+		glDeleteSync(mFences[slot]);
+		mFences[slot] = 0;
+	}
+	mPending[slot] = false;
+
+	Frame f;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if(wait) {
+			mDone.wait(lock, [&] () { return mQueue.size() < MaxQueued; });
+		} else if(mQueue.size() >= MaxQueued) {
+			mStats.dropped++;
+			return;
+		}
+		if(!mFreeBuffers.empty()) {
+			f.pixels = std::move(mFreeBuffers.back());
+			mFreeBuffers.pop_back();
+		}
+	}
+
+	size_t size = mWidth * mHeight * 4;
+	f.pixels.resize(size);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mBuffers[slot]);
+	const void* p = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	bool mapped = p != nullptr;
+	if(mapped) {
+		memcpy(&f.pixels[0], p, size);
+		mapped = glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(!mapped) {
+		mStats.dropped++;
+		mFreeBuffers.push_back(std::move(f.pixels));
+		return;
+	}
+	f.index = mNextIndex++;
+	mQueue.push_back(std::move(f));
+	mWake.notify_one();
+}
+
+void FrameCapture::work()
+{
+	std::vector<unsigned char> buf;
+	while(true) {
+		Frame f;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [&] () { return mQuit || !mQueue.empty(); });
+			if(mQueue.empty())
+				return;
+			f = std::move(mQueue.front());
+			mQueue.pop_front();
+			mBusy++;
+		}
+		mDone.notify_all();
+
+		size_t bytes = mFormat == CaptureFormat::PNG ? writePNG(f, buf) : writeY4M(f, buf);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if(bytes) {
+				mStats.written++;
+				mStats.bytesWritten += bytes;
+			}
+			mLastWrite = Profiler::now();
+			mFreeBuffers.push_back(std::move(f.pixels));
+			mBusy--;
+		}
+		mDone.notify_all();
+	}
+}
+
+/* RGB with no row filtering, compressed for speed rather than size. */
+size_t FrameCapture::writePNG(const Frame& f, std::vector<unsigned char>& buf)
+{
+	static const unsigned char signature[] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+	/* GL rows are bottom up */
+	size_t stride = mWidth * 3 + 1;
+	buf.resize(stride * mHeight);
+	for(int y = 0; y < mHeight; y++) {
+		unsigned char* row = &buf[y * stride];
+		const unsigned char* src = &f.pixels[(mHeight - 1 - y) * mWidth * 4];
+		*row++ = 0;
+		for(int x = 0; x < mWidth; x++) {
+			*row++ = src[x * 4];
+			*row++ = src[x * 4 + 1];
+			*row++ = src[x * 4 + 2];
+		}
+	}
+
+	uLongf zlength = compressBound(buf.size());
+	std::vector<unsigned char> zdata(zlength);
+	if(compress2(&zdata[0], &zlength, &buf[0], buf.size(), Z_BEST_SPEED) != Z_OK) {
+		std::cerr << "Unable to compress frame " << f.index << ".\n";
+		return 0;
+	}
+
+	std::vector<unsigned char> header;
+	put32(header, mWidth);
+	put32(header, mHeight);
+	/* 8 bits per channel, RGB, deflate, no filtering, no interlacing */
+	const unsigned char format[] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), format, format + sizeof(format));
+
+	std::vector<unsigned char> out(signature, signature + sizeof(signature));
+	pngChunk(out, "IHDR", &header[0], header.size());
+	pngChunk(out, "IDAT", &zdata[0], zlength);
+	pngChunk(out, "IEND", nullptr, 0);
+
+	char index[32];
+	snprintf(index, sizeof(index), mIndexZeroPad ? "%0*u" : "%*u", mIndexWidth, f.index);
+	std::string filename = mPrefix + index + mSuffix;
+	std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+	if(!file.is_open() || !file.write(reinterpret_cast<const char*>(&out[0]), out.size())) {
+		std::cerr << "Unable to write " << filename << ".\n";
+		return 0;
+	}
+	return out.size();
+}
+
+/* Full range BT.601 as C420jpeg says, with each chroma sample the mean
+ * of a 2x2 block. */
+size_t FrameCapture::writeY4M(const Frame& f, std::vector<unsigned char>& buf)
+{
+	int cw = (mWidth + 1) / 2;
+	int ch = (mHeight + 1) / 2;
+	buf.resize(mWidth * mHeight + 2 * cw * ch);
+	unsigned char* yplane = &buf[0];
+	unsigned char* uplane = yplane + mWidth * mHeight;
+	unsigned char* vplane = uplane + cw * ch;
+
+	for(int y = 0; y < mHeight; y++) {
+		const unsigned char* src = &f.pixels[(mHeight - 1 - y) * mWidth * 4];
+		for(int x = 0; x < mWidth; x++) {
+			int r = src[x * 4], g = src[x * 4 + 1], b = src[x * 4 + 2];
+			yplane[y * mWidth + x] = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+		}
+	}
+
+	for(int cy = 0; cy < ch; cy++) {
+		for(int cx = 0; cx < cw; cx++) {
+			int r = 0, g = 0, b = 0, n = 0;
+			for(int y = cy * 2; y < std::min(cy * 2 + 2, mHeight); y++) {
+				const unsigned char* src = &f.pixels[(mHeight - 1 - y) * mWidth * 4];
+				for(int x = cx * 2; x < std::min(cx * 2 + 2, mWidth); x++) {
+					r += src[x * 4];
+					g += src[x * 4 + 1];
+					b += src[x * 4 + 2];
+					n++;
+				}
+			}
+			r /= n;
+			g /= n;
+			b /= n;
+			int u = (-11059 * r - 21709 * g + 32768 * b + (128 << 16) + 32768) >> 16;
+			int v = (32768 * r - 27439 * g - 5329 * b + (128 << 16) + 32768) >> 16;
+			uplane[cy * cw + cx] = std::min(u, 255);
+			vplane[cy * cw + cx] = std::min(v, 255);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(mWriteMutex);
+	mTurn.wait(lock, [&] () { return mNextWrite == f.index; });
+	mStream << "FRAME\n";
+	mStream.write(reinterpret_cast<const char*>(&buf[0]), buf.size());
+	bool ok = mStream.good();
+	mNextWrite++;
+	lock.unlock();
+	mTurn.notify_all();
+
+	if(!ok) {
+		std::cerr << "Unable to write frame " << f.index << " to " << mPath << ".\n";
+		return 0;
+	}
+	return buf.size() + 6;
+}
+
+FrameCaptureStats FrameCapture::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	FrameCaptureStats s = mStats;
+	if(mStartTime != 0.0 && mLastWrite > mStartTime) {
+		s.wallTime = mLastWrite - mStartTime;
+		s.fps = s.written / s.wallTime;
+	}
+	return s;
+}
+
+void FrameCapture::printStats(std::ostream& os) const
+{
+	auto s = getStats();
+	os << "Capture: " << s.written << "/" << s.captured << " frames written in "
+		<< s.wallTime << " s (" << s.fps << " fps, " << s.bytesWritten / (1024.0 * 1024.0)
+		<< " MB), " << s.dropped << " dropped, " << s.stalls << " readback stalls\n";
+}
+
@@ -0,0 +1,110 @@
+#ifndef SCENE_FRAMECAPTURE_H
+#define SCENE_FRAMECAPTURE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <fstream>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+enum class CaptureFormat {
+	/* one file per frame, named by a pattern */
+	PNG,
+	/* a single raw YUV 4:2:0 stream */
+	Y4M
+};
+
+struct FrameCaptureStats {
+	FrameCaptureStats();
+	unsigned int captured;
+	unsigned int written;
+	/* frames dropped because the writers fell behind */
+	unsigned int dropped;
+	/* readbacks that weren't done when their buffer came round again */
+	unsigned int stalls;
+	double wallTime;
+	double fps;
+	size_t bytesWritten;
+};
+
+/* Captures the rendered frames without waiting on the GPU. capture()
+ * reads the frame into one of a ring of pixel buffers and maps the one
+ * read RingSize frames ago, by when the transfer is normally done. The
+ * pixels are copied out and encoded and written by worker threads. If
+ * the workers fall more than MaxQueued frames behind, frames are
+ * dropped rather than slowing down rendering. */
+class FrameCapture {
+	public:
+		/* For PNG the path is a pattern such as "frame%05u.png" with
+		 * exactly one integer conversion, which takes the frame
+		 * number; throws if it has none or several. */
+		FrameCapture(int width, int height, CaptureFormat format,
+				const std::string& path, unsigned int fps = 30,
+				unsigned int workers = 0);
+		~FrameCapture();
+		static bool isSupported();
+		/* Call after drawing, before the buffers are swapped. */
+		void capture();
+		/* Writes out every frame captured so far. */
+		void finish();
+		FrameCaptureStats getStats() const;
+		void printStats(std::ostream& os) const;
+
+	private:
+		static const int RingSize = 3;
+		static const size_t MaxQueued = 16;
+
+		struct Frame {
+			unsigned int index;
+			std::vector<unsigned char> pixels;
+		};
+
+		void readBack(int slot, bool wait);
+		void work();
+		size_t writePNG(const Frame& f, std::vector<unsigned char>& buf);
+		size_t writeY4M(const Frame& f, std::vector<unsigned char>& buf);
+
+		int mWidth;
+		int mHeight;
+		CaptureFormat mFormat;
+		std::string mPath;
+		/* the PNG file names around the frame number */
+		std::string mPrefix;
+		std::string mSuffix;
+		int mIndexWidth;
+		bool mIndexZeroPad;
+		std::ofstream mStream;
+
+		GLuint mBuffers[RingSize];
+		bool mUseFences;
+		GLsync mFences[RingSize];
+		bool mPending[RingSize];
+		unsigned int mFrame;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		/* keeps the frames of a stream in order */
+		std::mutex mWriteMutex;
+		std::condition_variable mTurn;
+		std::deque<Frame> mQueue;
+		std::vector<std::vector<unsigned char>> mFreeBuffers;
+		std::vector<std::thread> mWorkers;
+		unsigned int mNextIndex;
+		unsigned int mNextWrite;
+		unsigned int mBusy;
+		bool mQuit;
+
+		double mStartTime;
+		double mLastWrite;
+		FrameCaptureStats mStats;
+};
+
+#endif
+
@@ -0,0 +1,245 @@
+#include "FramePacer.h"
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+
+#include <sys/resource.h>
+
+#include <GL/glew.h>
+#include <GL/glxew.h>
+
+#include "Profiler.h"
+
+/* Sleeps are cut short by this much and the rest is spun. */
+static const double SpinTime = 0.002;
+
+/* How often on-demand mode polls for input without a target frame rate. */
+static const double IdlePeriod = 0.01;
+
+static const char* RAPLEnergy = "/sys/class/powercap/intel-rapl:0/energy_uj";
+static const char* RAPLRange = "/sys/class/powercap/intel-rapl:0/max_energy_range_uj";
+
+static double cpuTime()
+{
+	struct rusage ru;
+	if(getrusage(RUSAGE_SELF, &ru))
+		return 0.0;
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1.0e-6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1.0e-6;
+}
+
+static double readJoules(const char* filename)
+{
+	std::ifstream in(filename);
+	double microjoules;
+	if(!(in >> microjoules))
+		return -1.0;
+	return microjoules * 1.0e-6;
+}
+
+FramePacerStats::FramePacerStats()
+	: frames(0),
+	idleFrames(0),
+	wallTime(0.0),
+	cpuTime(0.0),
+	cpuUsage(0.0),
+	meanFrameTime(0.0),
+	maxFrameTime(0.0),
+	jitter(0.0),
+	energy(-1.0),
+	power(0.0)
+{
+}
+
+FramePacer::FramePacer()
+	: mFramePeriod(0.0),
+	mOnDemand(false),
+	mRedraw(true),
+	mSwapMode(SwapMode::Immediate),
+	mNextFrame(0.0)
+{
+	resetStats();
+}
+
+void FramePacer::setTargetFPS(double fps)
+{
+	mFramePeriod = fps > 0.0 ? 1.0 / fps : 0.0;
+	mNextFrame = 0.0;
+}
+
+double FramePacer::getTargetFPS() const
+{
+	return mFramePeriod > 0.0 ? 1.0 / mFramePeriod : 0.0;
+}
+
+void FramePacer::setOnDemand(bool on)
+{
+	mOnDemand = on;
+	mRedraw = true;
+}
+
+bool FramePacer::isOnDemand() const
+{
+	return mOnDemand;
+}
+
+bool FramePacer::setSwapMode(SwapMode mode)
+{
+	int interval = 0;
+	switch(mode) {
+		case SwapMode::Immediate:     interval = 0; break;
+		case SwapMode::VSync:         interval = 1; break;
+		case SwapMode::AdaptiveVSync: interval = -1; break;
+	}
+
+	/* adaptive vsync swaps late frames immediately instead of waiting
+	 * for the next vblank, and needs GLX_EXT_swap_control_tear */
+	if(GLXEW_EXT_swap_control) {
+		if(mode == SwapMode::AdaptiveVSync && !GLXEW_EXT_swap_control_tear)
+			return false;
+		Display* dpy = glXGetCurrentDisplay();
+		GLXDrawable drawable = glXGetCurrentDrawable();
+		if(!dpy || !drawable)
+			return false;
+		glXSwapIntervalEXT(dpy, drawable, interval);
+	} else if(GLXEW_MESA_swap_control && interval >= 0) {
+		if(glXSwapIntervalMESA(interval))
+			return false;
+	} else if(GLXEW_SGI_swap_control && interval > 0) {
+		if(glXSwapIntervalSGI(interval))
+			return false;
+	} else {
+		return false;
+	}
+
+	mSwapMode = mode;
+	return true;
+}
+
+SwapMode FramePacer::getSwapMode() const
+{
+	return mSwapMode;
+}
+
+void FramePacer::requestRedraw()
+{
+	mRedraw = true;
+}
+
+bool FramePacer::shouldDraw() const
+{
+	return !mOnDemand || mRedraw;
+}
+
+void FramePacer::waitUntil(double deadline)
+{
+	double sleepTime = deadline - Profiler::now() - SpinTime;
+	if(sleepTime > 0.0) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(sleepTime));
+	}
+	while(Profiler::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+void FramePacer::waitForNextFrame()
+{
+	if(mFramePeriod <= 0.0)
+		return;
+
+	double t = Profiler::now();
+	if(mNextFrame == 0.0 || t > mNextFrame + mFramePeriod) {
+		/* first frame or fell more than a frame behind; don't try to
+		 * catch up with a burst of frames */
+		mNextFrame = t + mFramePeriod;
+		return;
+	}
+
+	waitUntil(mNextFrame);
+	mNextFrame += mFramePeriod;
+}
+
+void FramePacer::frameDrawn()
+{
+	double t = Profiler::now();
+	if(mLastFrame != 0.0) {
+		double interval = t - mLastFrame;
+		mIntervals++;
+		mIntervalSum += interval;
+		mIntervalSquareSum += interval * interval;
+		mIntervalMax = std::max(mIntervalMax, interval);
+	}
+	mLastFrame = t;
+	mFrames++;
+	mRedraw = false;
+}
+
+void FramePacer::idle()
+{
+	/* the time spent idle isn't a frame interval */
+	mLastFrame = 0.0;
+	mIdleFrames++;
+	double period = mFramePeriod > 0.0 ? mFramePeriod : IdlePeriod;
+	std::this_thread::sleep_for(std::chrono::duration<double>(period));
+	mNextFrame = 0.0;
+}
+
+FramePacerStats FramePacer::getStats() const
+{
+	FramePacerStats s;
+	s.frames = mFrames;
+	s.idleFrames = mIdleFrames;
+	s.wallTime = Profiler::now() - mStatsStart;
+	s.cpuTime = cpuTime() - mCPUStart;
+	if(s.wallTime > 0.0)
+		s.cpuUsage = s.cpuTime / s.wallTime;
+	if(mIntervals) {
+		s.meanFrameTime = mIntervalSum / mIntervals;
+		s.maxFrameTime = mIntervalMax;
+		double var = mIntervalSquareSum / mIntervals - s.meanFrameTime * s.meanFrameTime;
+		s.jitter = sqrt(std::max(0.0, var));
+	}
+	if(mEnergyStart >= 0.0) {
+		double energy = readJoules(RAPLEnergy);
+		if(energy >= 0.0) {
+			if(energy < mEnergyStart) {
+				/* the counter wrapped */
+				energy += readJoules(RAPLRange);
+			}
+			s.energy = energy - mEnergyStart;
+			if(s.wallTime > 0.0)
+				s.power = s.energy / s.wallTime;
+		}
+	}
+	return s;
+}
+
+void FramePacer::resetStats()
+{
+	mStatsStart = Profiler::now();
+	mCPUStart = cpuTime();
+	mEnergyStart = readJoules(RAPLEnergy);
+	mLastFrame = 0.0;
+	mFrames = 0;
+	mIdleFrames = 0;
+	mIntervals = 0;
+	mIntervalSum = 0.0;
+	mIntervalSquareSum = 0.0;
+	mIntervalMax = 0.0;
+}
+
+void FramePacer::printStats(std::ostream& os) const
+{
+	auto s = getStats();
+	os << "Frames: " << s.frames << " drawn, " << s.idleFrames << " idle in "
+		<< s.wallTime << " s, CPU " << s.cpuUsage * 100.0 << "%, frame time "
+		<< s.meanFrameTime * 1000.0 << " ms average, " << s.maxFrameTime * 1000.0
+		<< " ms max, " << s.jitter * 1000.0 << " ms jitter";
+	if(s.energy >= 0.0)
+		os << ", " << s.power << " W";
+	os << "\n";
+}
+
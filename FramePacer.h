@@ -0,0 +1,77 @@
+#ifndef SCENE_FRAMEPACER_H
+#define SCENE_FRAMEPACER_H
+
+#include <ostream>
+
+enum class SwapMode {
+	Immediate,
+	VSync,
+	AdaptiveVSync
+};
+
+struct FramePacerStats {
+	FramePacerStats();
+	unsigned int frames;
+	unsigned int idleFrames;
+	double wallTime;
+	/* user and system time of the whole process */
+	double cpuTime;
+	double cpuUsage;
+	double meanFrameTime;
+	double maxFrameTime;
+	/* standard deviation of the time between consecutive frames */
+	double jitter;
+	/* package energy from RAPL; negative when it can't be read */
+	double energy;
+	double power;
+};
+
+/* Paces the main loop. With a target frame rate the pacer sleeps until
+ * shortly before the frame is due and spins for the rest, since sleeps
+ * overshoot by up to a scheduler tick. In on-demand mode a frame is
+ * only drawn after requestRedraw(); the loop calls idle() instead. */
+class FramePacer {
+	public:
+		FramePacer();
+		void setTargetFPS(double fps);
+		double getTargetFPS() const;
+		void setOnDemand(bool on);
+		bool isOnDemand() const;
+		/* Needs a current GL context. Returns false if the mode isn't
+		 * supported. */
+		bool setSwapMode(SwapMode mode);
+		SwapMode getSwapMode() const;
+
+		void requestRedraw();
+		bool shouldDraw() const;
+		void waitForNextFrame();
+		void frameDrawn();
+		void idle();
+
+		FramePacerStats getStats() const;
+		void resetStats();
+		void printStats(std::ostream& os) const;
+
+	private:
+		void waitUntil(double deadline);
+
+		double mFramePeriod;
+		bool mOnDemand;
+		bool mRedraw;
+		SwapMode mSwapMode;
+		double mNextFrame;
+
+		double mStatsStart;
+		double mCPUStart;
+		double mEnergyStart;
+		double mLastFrame;
+		unsigned int mFrames;
+		unsigned int mIdleFrames;
+		unsigned int mIntervals;
+		double mIntervalSum;
+		double mIntervalSquareSum;
+		double mIntervalMax;
+};
+
+#endif
+
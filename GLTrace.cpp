@@ -0,0 +1,1239 @@
+#include "GLTrace.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <set>
+
+#include <dlfcn.h>
+#include <zlib.h>
+
+#include "ShaderCache.h"
+
+using namespace GLTraceFormat;
+
+static bool gRecording = false;
+static std::string gFilename;
+static unsigned int gFrames = 0;
+static unsigned int gFramesLeft = 0;
+static int gWidth = 0;
+static int gHeight = 0;
+static std::vector<unsigned char> gData;
+static bool gSetup = false;
+static bool gWarnedClientArrays = false;
+
+/* objects already written to the trace */
+static std::set<GLuint> gBuffers;
+static std::set<GLuint> gTextures;
+static std::set<GLuint> gPrograms;
+static std::set<GLuint> gFramebuffers;
+
+static void put(const void* p, size_t n)
+{
+	const unsigned char* c = static_cast<const unsigned char*>(p);
+	gData.insert(gData.end(), c, c + n);
+}
+
+template<typename T>
+static void put(T v)
+{
+	put(&v, sizeof(v));
+}
+
+static void putBlob(const void* p, size_t n)
+{
+	put<uint32_t>(n);
+	if(n)
+		put(p, n);
+}
+
+static void putString(const std::string& s)
+{
+	putBlob(s.data(), s.size());
+}
+
+static void putOp(Op op)
+{
+	put<uint16_t>(uint16_t(op) | (gSetup ? SetupFlag : 0));
+}
+
+/* Writes setup records while in scope. */
+class SetupScope {
+	public:
+		SetupScope() : mPrevious(gSetup) { gSetup = true; }
+		~SetupScope() { gSetup = mPrevious; }
+	private:
+		bool mPrevious;
+};
+
+/* The OpenGL 1.1 entry points defined below call the driver through
+ * these, as does the recorder when it mustn't record its own calls. */
+#define REAL_GL(name) \
+	static decltype(&::name) real_##name() \
+	{ \
+		static decltype(&::name) f = reinterpret_cast<decltype(&::name)>(dlsym(RTLD_NEXT, #name)); \
+		return f; \
+	}
+
+REAL_GL(glClear)
+REAL_GL(glBindTexture)
+
+/* The GLEW entry points that are swapped while recording. */
+#define GLEW_HOOKS(F) \
+	F(UseProgram, USEPROGRAM) \
+	F(Uniform1i, UNIFORM1I) \
+	F(Uniform1f, UNIFORM1F) \
+	F(Uniform2f, UNIFORM2F) \
+	F(Uniform3f, UNIFORM3F) \
+	F(Uniform3fv, UNIFORM3FV) \
+	F(Uniform4fv, UNIFORM4FV) \
+	F(UniformMatrix4fv, UNIFORMMATRIX4FV) \
+	F(ActiveTexture, ACTIVETEXTURE) \
+	F(BindBuffer, BINDBUFFER) \
+	F(BufferData, BUFFERDATA) \
+	F(BufferSubData, BUFFERSUBDATA) \
+	F(BindBufferRange, BINDBUFFERRANGE) \
+	F(DeleteBuffers, DELETEBUFFERS) \
+	F(EnableVertexAttribArray, ENABLEVERTEXATTRIBARRAY) \
+	F(DisableVertexAttribArray, DISABLEVERTEXATTRIBARRAY) \
+	F(VertexAttribPointer, VERTEXATTRIBPOINTER) \
+	F(BeginQuery, BEGINQUERY) \
+	F(EndQuery, ENDQUERY) \
+	F(QueryCounter, QUERYCOUNTER) \
+	F(BindFramebuffer, BINDFRAMEBUFFER) \
+	F(BindRenderbuffer, BINDRENDERBUFFER) \
+	F(RenderbufferStorage, RENDERBUFFERSTORAGE) \
+	F(FramebufferTexture2D, FRAMEBUFFERTEXTURE2D) \
+	F(FramebufferRenderbuffer, FRAMEBUFFERRENDERBUFFER) \
+	F(BlitFramebuffer, BLITFRAMEBUFFER) \
+	F(GenerateMipmap, GENERATEMIPMAP)
+
+#define DECLARE_REAL(name, NAME) static PFNGL##NAME##PROC real##name = nullptr;
+GLEW_HOOKS(DECLARE_REAL)
+
+static void recordBindBuffer(GLenum target, GLuint buffer)
+{
+	putOp(Op::BindBuffer);
+	put(target);
+	put(buffer);
+}
+
+static void recordBindTexture(GLenum target, GLuint texture)
+{
+	putOp(Op::BindTexture);
+	put(target);
+	put(texture);
+}
+
+static void recordBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	putOp(Op::BindFramebuffer);
+	put(target);
+	put(framebuffer);
+}
+
+static void recordTexParameter(GLenum target, GLenum pname, GLint param)
+{
+	putOp(Op::TexParameteri);
+	put(target);
+	put(pname);
+	put(param);
+}
+
+static void recordTexImage(GLenum target, GLint level, GLint internalFormat,
+		GLsizei width, GLsizei height, GLint border, GLenum format,
+		GLenum type, const void* pixels, size_t size)
+{
+	putOp(Op::TexImage2D);
+	put(target);
+	put(level);
+	put(internalFormat);
+	put(width);
+	put(height);
+	put(border);
+	put(format);
+	put(type);
+	putBlob(pixels, pixels ? size : 0);
+}
+
+/* Writes the size, usage and contents of a buffer that hasn't been seen
+ * yet, using the array buffer binding. */
+static void snapshotBuffer(GLuint buffer)
+{
+	if(!buffer || gBuffers.count(buffer))
+		return;
+	gBuffers.insert(buffer);
+
+	SetupScope setup;
+	GLint previous = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous);
+	realBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	GLint size = 0;
+	GLint usage = GL_STATIC_DRAW;
+	GLint mapped = GL_FALSE;
+	GLint flags = 0;
+	glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+	glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_USAGE, &usage);
+	glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_MAPPED, &mapped);
+	if(mapped && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage))
+		glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_ACCESS_FLAGS, &flags);
+
+	std::vector<unsigned char> data;
+	if(size > 0 && (!mapped || (flags & GL_MAP_PERSISTENT_BIT))) {
+		data.resize(size);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, size, &data[0]);
+	}
+
+	recordBindBuffer(GL_ARRAY_BUFFER, buffer);
+	putOp(Op::BufferData);
+	put(GL_ARRAY_BUFFER);
+	put<uint64_t>(size);
+	putBlob(data.empty() ? nullptr : &data[0], data.size());
+	put<GLenum>(usage);
+
+	realBindBuffer(GL_ARRAY_BUFFER, previous);
+	recordBindBuffer(GL_ARRAY_BUFFER, previous);
+}
+
+/* Writes the levels and sampling parameters of a 2D texture that hasn't
+ * been seen yet, using the current texture unit. The levels are read
+ * back as RGBA. */
+static void snapshotTexture(GLuint texture)
+{
+	if(!texture || gTextures.count(texture))
+		return;
+	gTextures.insert(texture);
+
+	SetupScope setup;
+	GLint previous = 0;
+	GLint pack = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack);
+	if(pack)
+		realBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	real_glBindTexture()(GL_TEXTURE_2D, texture);
+	recordBindTexture(GL_TEXTURE_2D, texture);
+
+	GLint maxSize = 1;
+	GLint levels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	while(maxSize >> levels)
+		levels++;
+
+	std::vector<unsigned char> pixels;
+	for(GLint level = 0; level < levels; level++) {
+		GLint width = 0;
+		GLint height = 0;
+		GLint internalFormat = GL_RGBA;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		if(width <= 0 || height <= 0)
+			continue;
+
+		/* rows of RGBA pixels are aligned for any unpack alignment up to 4 */
+		pixels.resize(width * height * 4);
+		glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		recordTexImage(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0], pixels.size());
+	}
+
+	const GLenum params[] = { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER,
+		GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_BASE_LEVEL, GL_TEXTURE_MAX_LEVEL };
+	for(GLenum p : params) {
+		GLint value = 0;
+		glGetTexParameteriv(GL_TEXTURE_2D, p, &value);
+		recordTexParameter(GL_TEXTURE_2D, p, value);
+	}
+
+	real_glBindTexture()(GL_TEXTURE_2D, previous);
+	recordBindTexture(GL_TEXTURE_2D, previous);
+	if(pack)
+		realBindBuffer(GL_PIXEL_PACK_BUFFER, pack);
+}
+
+/* Writes the sources and interface of a program that hasn't been seen
+ * yet. Returns true if it was written. */
+static bool snapshotProgram(GLuint program)
+{
+	if(!program || gPrograms.count(program))
+		return false;
+	gPrograms.insert(program);
+
+	std::string vertexSource;
+	std::string fragmentSource;
+	if(!ShaderCache::getSources(program, vertexSource, fragmentSource)) {
+		std::cerr << "Program " << program << " wasn't built by the shader cache and can't be traced.\n";
+	}
+
+	SetupScope setup;
+	char name[256];
+	putOp(Op::Program);
+	put(program);
+	putString(vertexSource);
+	putString(fragmentSource);
+
+	GLint count = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+	put<uint32_t>(count);
+	for(GLint i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveAttrib(program, i, sizeof(name), &length, &size, &type, name);
+		putString(std::string(name, length));
+		put<GLint>(glGetAttribLocation(program, name));
+	}
+
+	count = 0;
+	if(GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object)
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	put<uint32_t>(count);
+	for(GLint i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint binding = 0;
+		glGetActiveUniformBlockName(program, i, sizeof(name), &length, name);
+		glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_BINDING, &binding);
+		putString(std::string(name, length));
+		put<GLint>(binding);
+	}
+
+	count = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	put<uint32_t>(count);
+	for(GLint i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		putString(std::string(name, length));
+		put<GLint>(glGetUniformLocation(program, name));
+	}
+	return true;
+}
+
+/* Writes the current values of the default block uniforms of the
+ * program; it must be current on replay. */
+static void snapshotUniforms(GLuint program)
+{
+	SetupScope setup;
+	char name[256];
+	GLint count = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	for(GLint i = 0; i < count; i++) {
+		GLsizei length = 0;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+		GLint location = glGetUniformLocation(program, name);
+		if(location < 0 || size != 1)
+			continue;
+
+		GLfloat f[16];
+		GLint v = 0;
+		switch(type) {
+			case GL_FLOAT:
+				glGetUniformfv(program, location, f);
+				putOp(Op::Uniform1f);
+				put(location);
+				put(f[0]);
+				break;
+			case GL_FLOAT_VEC2:
+				glGetUniformfv(program, location, f);
+				putOp(Op::Uniform2fv);
+				put(location);
+				put<GLsizei>(1);
+				put(f, sizeof(GLfloat) * 2);
+				break;
+			case GL_FLOAT_VEC3:
+				glGetUniformfv(program, location, f);
+				putOp(Op::Uniform3fv);
+				put(location);
+				put<GLsizei>(1);
+				put(f, sizeof(GLfloat) * 3);
+				break;
+			case GL_FLOAT_VEC4:
+				glGetUniformfv(program, location, f);
+				putOp(Op::Uniform4fv);
+				put(location);
+				put<GLsizei>(1);
+				put(f, sizeof(GLfloat) * 4);
+				break;
+			case GL_FLOAT_MAT4:
+				glGetUniformfv(program, location, f);
+				putOp(Op::UniformMatrix4fv);
+				put(location);
+				put<GLsizei>(1);
+				put<GLboolean>(GL_FALSE);
+				put(f, sizeof(GLfloat) * 16);
+				break;
+			case GL_INT:
+			case GL_BOOL:
+			case GL_SAMPLER_2D:
+				glGetUniformiv(program, location, &v);
+				putOp(Op::Uniform1i);
+				put(location);
+				put(v);
+				break;
+		}
+	}
+}
+
+static void snapshotRenderbuffer(GLuint renderbuffer)
+{
+	GLint previous = 0;
+	GLint width = 0;
+	GLint height = 0;
+	GLint internalFormat = GL_RGBA;
+	glGetIntegerv(GL_RENDERBUFFER_BINDING, &previous);
+	realBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_WIDTH, &width);
+	glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_HEIGHT, &height);
+	glGetRenderbufferParameteriv(GL_RENDERBUFFER, GL_RENDERBUFFER_INTERNAL_FORMAT, &internalFormat);
+	realBindRenderbuffer(GL_RENDERBUFFER, previous);
+
+	putOp(Op::BindRenderbuffer);
+	put(GL_RENDERBUFFER);
+	put(renderbuffer);
+	putOp(Op::RenderbufferStorage);
+	put(GL_RENDERBUFFER);
+	put<GLenum>(internalFormat);
+	put(width);
+	put(height);
+	putOp(Op::BindRenderbuffer);
+	put(GL_RENDERBUFFER);
+	put<GLuint>(previous);
+}
+
+/* Writes the colour and depth attachments of a framebuffer that hasn't
+ * been seen yet. */
+static void snapshotFramebuffer(GLuint framebuffer)
+{
+	if(!framebuffer || gFramebuffers.count(framebuffer))
+		return;
+	gFramebuffers.insert(framebuffer);
+
+	SetupScope setup;
+	GLint draw = 0;
+	GLint read = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+	realBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+	const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_DEPTH_ATTACHMENT };
+	GLint type[2] = { GL_NONE, GL_NONE };
+	GLint object[2] = { 0, 0 };
+	GLint level[2] = { 0, 0 };
+	for(int i = 0; i < 2; i++) {
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i],
+				GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type[i]);
+		if(type[i] == GL_NONE)
+			continue;
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i],
+				GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &object[i]);
+		if(type[i] == GL_TEXTURE)
+			glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachments[i],
+					GL_FRAMEBUFFER_ATTACHMENT_TEXTURE_LEVEL, &level[i]);
+	}
+	realBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw);
+	realBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+
+	for(int i = 0; i < 2; i++) {
+		if(type[i] == GL_TEXTURE)
+			snapshotTexture(object[i]);
+		else if(type[i] == GL_RENDERBUFFER)
+			snapshotRenderbuffer(object[i]);
+	}
+
+	recordBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	for(int i = 0; i < 2; i++) {
+		if(type[i] == GL_TEXTURE) {
+			putOp(Op::FramebufferTexture2D);
+			put(GL_FRAMEBUFFER);
+			put(attachments[i]);
+			put(GL_TEXTURE_2D);
+			put<GLuint>(object[i]);
+			put(level[i]);
+		} else if(type[i] == GL_RENDERBUFFER) {
+			putOp(Op::FramebufferRenderbuffer);
+			put(GL_FRAMEBUFFER);
+			put(attachments[i]);
+			put(GL_RENDERBUFFER);
+			put<GLuint>(object[i]);
+		}
+	}
+	recordBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw);
+	recordBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+}
+
+static void recordCapability(GLenum cap)
+{
+	putOp(glIsEnabled(cap) ? Op::Enable : Op::Disable);
+	put(cap);
+}
+
+/* Writes the state the recording starts from. */
+static void snapshotState()
+{
+	SetupScope setup;
+	GLint v[4];
+	GLfloat f[4];
+	GLboolean b[4];
+
+	glGetIntegerv(GL_VIEWPORT, v);
+	putOp(Op::Viewport);
+	put(v, sizeof(GLint) * 4);
+	glGetIntegerv(GL_SCISSOR_BOX, v);
+	putOp(Op::Scissor);
+	put(v, sizeof(GLint) * 4);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, f);
+	putOp(Op::ClearColor);
+	put(f, sizeof(GLfloat) * 4);
+
+	const GLenum caps[] = { GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_BLEND, GL_CULL_FACE, GL_TEXTURE_2D };
+	for(GLenum cap : caps)
+		recordCapability(cap);
+
+	glGetIntegerv(GL_BLEND_SRC, v);
+	glGetIntegerv(GL_BLEND_DST, v + 1);
+	putOp(Op::BlendFunc);
+	put<GLenum>(v[0]);
+	put<GLenum>(v[1]);
+
+	glGetIntegerv(GL_DEPTH_FUNC, v);
+	putOp(Op::DepthFunc);
+	put<GLenum>(v[0]);
+	glGetBooleanv(GL_DEPTH_WRITEMASK, b);
+	putOp(Op::DepthMask);
+	put(b[0]);
+	glGetBooleanv(GL_COLOR_WRITEMASK, b);
+	putOp(Op::ColorMask);
+	put(b, sizeof(GLboolean) * 4);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, v);
+	putOp(Op::PixelStorei);
+	put(GL_UNPACK_ALIGNMENT);
+	put(v[0]);
+
+	GLint active = GL_TEXTURE0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+	for(int unit = 0; unit < 4; unit++) {
+		GLint texture = 0;
+		realActiveTexture(GL_TEXTURE0 + unit);
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+		snapshotTexture(texture);
+		putOp(Op::ActiveTexture);
+		put<GLenum>(GL_TEXTURE0 + unit);
+		recordBindTexture(GL_TEXTURE_2D, texture);
+	}
+	realActiveTexture(active);
+	putOp(Op::ActiveTexture);
+	put<GLenum>(active);
+
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	if(snapshotProgram(program)) {
+		putOp(Op::UseProgram);
+		put<GLuint>(program);
+		snapshotUniforms(program);
+	}
+
+	GLint buffer = 0;
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffer);
+	snapshotBuffer(buffer);
+	recordBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &buffer);
+	snapshotBuffer(buffer);
+	recordBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+
+	for(GLuint i = 0; i < 8; i++) {
+		GLint enabled = 0;
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+		glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+		if(buffer) {
+			GLint size = 4;
+			GLint type = GL_FLOAT;
+			GLint normalized = GL_FALSE;
+			GLint stride = 0;
+			void* pointer = nullptr;
+			glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_SIZE, &size);
+			glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_TYPE, &type);
+			glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &normalized);
+			glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &stride);
+			glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &pointer);
+			snapshotBuffer(buffer);
+			recordBindBuffer(GL_ARRAY_BUFFER, buffer);
+			putOp(Op::VertexAttribPointer);
+			put(i);
+			put(size);
+			put<GLenum>(type);
+			put<GLboolean>(normalized);
+			put<GLsizei>(stride);
+			put<uint64_t>(reinterpret_cast<uintptr_t>(pointer));
+		}
+		putOp(enabled && buffer ? Op::EnableVertexAttribArray : Op::DisableVertexAttribArray);
+		put(i);
+	}
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buffer);
+	snapshotBuffer(buffer);
+	recordBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	if(realBindFramebuffer) {
+		GLint draw = 0;
+		GLint read = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read);
+		snapshotFramebuffer(draw);
+		snapshotFramebuffer(read);
+		recordBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw);
+		recordBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+	}
+}
+
+/* OpenGL 1.1 entry points; these take the place of the driver's in the
+ * executables that link GLTraceEntryPoints.o. */
+
+#ifdef GLTRACE_ENTRY_POINTS
+
+REAL_GL(glClearColor)
+REAL_GL(glViewport)
+REAL_GL(glScissor)
+REAL_GL(glEnable)
+REAL_GL(glDisable)
+REAL_GL(glDepthFunc)
+REAL_GL(glDepthMask)
+REAL_GL(glColorMask)
+REAL_GL(glPixelStorei)
+REAL_GL(glTexParameteri)
+REAL_GL(glTexParameterf)
+REAL_GL(glTexImage2D)
+REAL_GL(glDeleteTextures)
+REAL_GL(glDrawElements)
+REAL_GL(glDrawArrays)
+REAL_GL(glBlendFunc)
+
+static size_t imageSize(GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+	size_t components = 1;
+	switch(format) {
+		case GL_RGBA:
+		case GL_BGRA:
+			components = 4;
+			break;
+		case GL_RGB:
+		case GL_BGR:
+			components = 3;
+			break;
+		case GL_RG:
+		case GL_LUMINANCE_ALPHA:
+			components = 2;
+			break;
+	}
+
+	size_t pixelSize = components;
+	switch(type) {
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			pixelSize = components * 2;
+			break;
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			pixelSize = components * 4;
+			break;
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+			pixelSize = 2;
+			break;
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+			pixelSize = 4;
+			break;
+	}
+
+	if(width <= 0 || height <= 0)
+		return 0;
+	GLint alignment = 4;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	size_t row = width * pixelSize;
+	size_t stride = (row + alignment - 1) / alignment * alignment;
+	return stride * (height - 1) + row;
+}
+
+extern "C" {
+
+GLAPI void GLAPIENTRY glClear(GLbitfield mask)
+{
+	if(gRecording) {
+		putOp(Op::Clear);
+		put(mask);
+	}
+	real_glClear()(mask);
+}
+
+GLAPI void GLAPIENTRY glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	if(gRecording) {
+		putOp(Op::ClearColor);
+		put(red);
+		put(green);
+		put(blue);
+		put(alpha);
+	}
+	real_glClearColor()(red, green, blue, alpha);
+}
+
+GLAPI void GLAPIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if(gRecording) {
+		putOp(Op::Viewport);
+		put(x);
+		put(y);
+		put(width);
+		put(height);
+	}
+	real_glViewport()(x, y, width, height);
+}
+
+GLAPI void GLAPIENTRY glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if(gRecording) {
+		putOp(Op::Scissor);
+		put(x);
+		put(y);
+		put(width);
+		put(height);
+	}
+	real_glScissor()(x, y, width, height);
+}
+
+GLAPI void GLAPIENTRY glEnable(GLenum cap)
+{
+	if(gRecording) {
+		putOp(Op::Enable);
+		put(cap);
+	}
+	real_glEnable()(cap);
+}
+
+GLAPI void GLAPIENTRY glDisable(GLenum cap)
+{
+	if(gRecording) {
+		putOp(Op::Disable);
+		put(cap);
+	}
+	real_glDisable()(cap);
+}
+
+GLAPI void GLAPIENTRY glDepthFunc(GLenum func)
+{
+	if(gRecording) {
+		putOp(Op::DepthFunc);
+		put(func);
+	}
+	real_glDepthFunc()(func);
+}
+
+GLAPI void GLAPIENTRY glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+	if(gRecording) {
+		putOp(Op::BlendFunc);
+		put(sfactor);
+		put(dfactor);
+	}
+	real_glBlendFunc()(sfactor, dfactor);
+}
+
+GLAPI void GLAPIENTRY glDepthMask(GLboolean flag)
+{
+	if(gRecording) {
+		putOp(Op::DepthMask);
+		put(flag);
+	}
+	real_glDepthMask()(flag);
+}
+
+GLAPI void GLAPIENTRY glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	if(gRecording) {
+		putOp(Op::ColorMask);
+		put(red);
+		put(green);
+		put(blue);
+		put(alpha);
+	}
+	real_glColorMask()(red, green, blue, alpha);
+}
+
+GLAPI void GLAPIENTRY glPixelStorei(GLenum pname, GLint param)
+{
+	if(gRecording) {
+		putOp(Op::PixelStorei);
+		put(pname);
+		put(param);
+	}
+	real_glPixelStorei()(pname, param);
+}
+
+GLAPI void GLAPIENTRY glBindTexture(GLenum target, GLuint texture)
+{
+	if(gRecording && target == GL_TEXTURE_2D) {
+		snapshotTexture(texture);
+		recordBindTexture(target, texture);
+	}
+	real_glBindTexture()(target, texture);
+}
+
+GLAPI void GLAPIENTRY glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+	if(gRecording)
+		recordTexParameter(target, pname, param);
+	real_glTexParameteri()(target, pname, param);
+}
+
+GLAPI void GLAPIENTRY glTexParameterf(GLenum target, GLenum pname, GLfloat param)
+{
+	if(gRecording) {
+		putOp(Op::TexParameterf);
+		put(target);
+		put(pname);
+		put(param);
+	}
+	real_glTexParameterf()(target, pname, param);
+}
+
+GLAPI void GLAPIENTRY glTexImage2D(GLenum target, GLint level, GLint internalFormat,
+		GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type,
+		const GLvoid* pixels)
+{
+	if(gRecording) {
+		size_t size = imageSize(width, height, format, type);
+		GLint unpack = 0;
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack);
+		if(unpack) {
+			/* the pixels come from the buffer, which may have been
+			 * written through a mapping */
+			std::vector<unsigned char> data(size);
+			if(size)
+				glGetBufferSubData(GL_PIXEL_UNPACK_BUFFER,
+						reinterpret_cast<GLintptr>(pixels), size, &data[0]);
+			recordTexImage(target, level, internalFormat, width, height, border,
+					format, type, size ? &data[0] : nullptr, size);
+		} else {
+			recordTexImage(target, level, internalFormat, width, height, border,
+					format, type, pixels, size);
+		}
+	}
+	real_glTexImage2D()(target, level, internalFormat, width, height, border,
+			format, type, pixels);
+}
+
+GLAPI void GLAPIENTRY glDeleteTextures(GLsizei n, const GLuint* textures)
+{
+	if(gRecording) {
+		putOp(Op::DeleteTextures);
+		putBlob(textures, sizeof(GLuint) * n);
+		for(GLsizei i = 0; i < n; i++)
+			gTextures.erase(textures[i]);
+	}
+	real_glDeleteTextures()(n, textures);
+}
+
+GLAPI void GLAPIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type,
+		const GLvoid* indices)
+{
+	if(gRecording) {
+		GLint buffer = 0;
+		glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffer);
+		if(buffer) {
+			putOp(Op::DrawElements);
+			put(mode);
+			put(count);
+			put(type);
+			put<uint64_t>(reinterpret_cast<uintptr_t>(indices));
+		} else if(!gWarnedClientArrays) {
+			std::cerr << "Draws from client memory aren't traced.\n";
+			gWarnedClientArrays = true;
+		}
+	}
+	real_glDrawElements()(mode, count, type, indices);
+}
+
+/* client arrays are caught by glVertexAttribPointer */
+GLAPI void GLAPIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	if(gRecording) {
+		putOp(Op::DrawArrays);
+		put(mode);
+		put(first);
+		put(count);
+	}
+	real_glDrawArrays()(mode, first, count);
+}
+
+}
+
+#endif
+
+/* GLEW entry points */
+
+static void GLAPIENTRY traceUseProgram(GLuint program)
+{
+	bool added = snapshotProgram(program);
+	putOp(Op::UseProgram);
+	put(program);
+	realUseProgram(program);
+	if(added)
+		snapshotUniforms(program);
+}
+
+static void GLAPIENTRY traceUniform1i(GLint location, GLint v0)
+{
+	putOp(Op::Uniform1i);
+	put(location);
+	put(v0);
+	realUniform1i(location, v0);
+}
+
+static void GLAPIENTRY traceUniform1f(GLint location, GLfloat v0)
+{
+	putOp(Op::Uniform1f);
+	put(location);
+	put(v0);
+	realUniform1f(location, v0);
+}
+
+static void GLAPIENTRY traceUniform2f(GLint location, GLfloat v0, GLfloat v1)
+{
+	putOp(Op::Uniform2fv);
+	put(location);
+	put<GLsizei>(1);
+	put(v0);
+	put(v1);
+	realUniform2f(location, v0, v1);
+}
+
+static void GLAPIENTRY traceUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
+{
+	putOp(Op::Uniform3fv);
+	put(location);
+	put<GLsizei>(1);
+	put(v0);
+	put(v1);
+	put(v2);
+	realUniform3f(location, v0, v1, v2);
+}
+
+static void GLAPIENTRY traceUniform3fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	putOp(Op::Uniform3fv);
+	put(location);
+	put(count);
+	put(value, sizeof(GLfloat) * 3 * count);
+	realUniform3fv(location, count, value);
+}
+
+static void GLAPIENTRY traceUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	putOp(Op::Uniform4fv);
+	put(location);
+	put(count);
+	put(value, sizeof(GLfloat) * 4 * count);
+	realUniform4fv(location, count, value);
+}
+
+static void GLAPIENTRY traceUniformMatrix4fv(GLint location, GLsizei count,
+		GLboolean transpose, const GLfloat* value)
+{
+	putOp(Op::UniformMatrix4fv);
+	put(location);
+	put(count);
+	put(transpose);
+	put(value, sizeof(GLfloat) * 16 * count);
+	realUniformMatrix4fv(location, count, transpose, value);
+}
+
+static void GLAPIENTRY traceActiveTexture(GLenum texture)
+{
+	putOp(Op::ActiveTexture);
+	put(texture);
+	realActiveTexture(texture);
+}
+
+static void GLAPIENTRY traceBindBuffer(GLenum target, GLuint buffer)
+{
+	snapshotBuffer(buffer);
+	recordBindBuffer(target, buffer);
+	realBindBuffer(target, buffer);
+}
+
+static void GLAPIENTRY traceBufferData(GLenum target, GLsizeiptr size,
+		const GLvoid* data, GLenum usage)
+{
+	putOp(Op::BufferData);
+	put(target);
+	put<uint64_t>(size);
+	putBlob(data, data ? size : 0);
+	put(usage);
+	realBufferData(target, size, data, usage);
+}
+
+static void GLAPIENTRY traceBufferSubData(GLenum target, GLintptr offset,
+		GLsizeiptr size, const GLvoid* data)
+{
+	putOp(Op::BufferSubData);
+	put(target);
+	put<uint64_t>(offset);
+	putBlob(data, size);
+	realBufferSubData(target, offset, size, data);
+}
+
+static void GLAPIENTRY traceBindBufferRange(GLenum target, GLuint index,
+		GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	snapshotBuffer(buffer);
+	putOp(Op::BindBufferRange);
+	put(target);
+	put(index);
+	put(buffer);
+	put<uint64_t>(offset);
+	put<uint64_t>(size);
+	realBindBufferRange(target, index, buffer, offset, size);
+}
+
+static void GLAPIENTRY traceDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	putOp(Op::DeleteBuffers);
+	putBlob(buffers, sizeof(GLuint) * n);
+	for(GLsizei i = 0; i < n; i++)
+		gBuffers.erase(buffers[i]);
+	realDeleteBuffers(n, buffers);
+}
+
+static void GLAPIENTRY traceEnableVertexAttribArray(GLuint index)
+{
+	putOp(Op::EnableVertexAttribArray);
+	put(index);
+	realEnableVertexAttribArray(index);
+}
+
+static void GLAPIENTRY traceDisableVertexAttribArray(GLuint index)
+{
+	putOp(Op::DisableVertexAttribArray);
+	put(index);
+	realDisableVertexAttribArray(index);
+}
+
+static void GLAPIENTRY traceVertexAttribPointer(GLuint index, GLint size, GLenum type,
+		GLboolean normalized, GLsizei stride, const GLvoid* pointer)
+{
+	GLint buffer = 0;
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &buffer);
+	if(buffer) {
+		putOp(Op::VertexAttribPointer);
+		put(index);
+		put(size);
+		put(type);
+		put(normalized);
+		put(stride);
+		put<uint64_t>(reinterpret_cast<uintptr_t>(pointer));
+	} else if(!gWarnedClientArrays) {
+		std::cerr << "Draws from client memory aren't traced.\n";
+		gWarnedClientArrays = true;
+	}
+	realVertexAttribPointer(index, size, type, normalized, stride, pointer);
+}
+
+static void GLAPIENTRY traceBeginQuery(GLenum target, GLuint id)
+{
+	putOp(Op::BeginQuery);
+	put(target);
+	put(id);
+	realBeginQuery(target, id);
+}
+
+static void GLAPIENTRY traceEndQuery(GLenum target)
+{
+	putOp(Op::EndQuery);
+	put(target);
+	realEndQuery(target);
+}
+
+static void GLAPIENTRY traceQueryCounter(GLuint id, GLenum target)
+{
+	putOp(Op::QueryCounter);
+	put(id);
+	put(target);
+	realQueryCounter(id, target);
+}
+
+static void GLAPIENTRY traceBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	snapshotFramebuffer(framebuffer);
+	recordBindFramebuffer(target, framebuffer);
+	realBindFramebuffer(target, framebuffer);
+}
+
+static void GLAPIENTRY traceBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+	putOp(Op::BindRenderbuffer);
+	put(target);
+	put(renderbuffer);
+	realBindRenderbuffer(target, renderbuffer);
+}
+
+static void GLAPIENTRY traceRenderbufferStorage(GLenum target, GLenum internalFormat,
+		GLsizei width, GLsizei height)
+{
+	putOp(Op::RenderbufferStorage);
+	put(target);
+	put(internalFormat);
+	put(width);
+	put(height);
+	realRenderbufferStorage(target, internalFormat, width, height);
+}
+
+static void GLAPIENTRY traceFramebufferTexture2D(GLenum target, GLenum attachment,
+		GLenum textarget, GLuint texture, GLint level)
+{
+	snapshotTexture(texture);
+	putOp(Op::FramebufferTexture2D);
+	put(target);
+	put(attachment);
+	put(textarget);
+	put(texture);
+	put(level);
+	realFramebufferTexture2D(target, attachment, textarget, texture, level);
+}
+
+static void GLAPIENTRY traceFramebufferRenderbuffer(GLenum target, GLenum attachment,
+		GLenum renderbufferTarget, GLuint renderbuffer)
+{
+	putOp(Op::FramebufferRenderbuffer);
+	put(target);
+	put(attachment);
+	put(renderbufferTarget);
+	put(renderbuffer);
+	realFramebufferRenderbuffer(target, attachment, renderbufferTarget, renderbuffer);
+}
+
+static void GLAPIENTRY traceBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1,
+		GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+	const GLint v[8] = { srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1 };
+	putOp(Op::BlitFramebuffer);
+	put(v, sizeof(v));
+	put(mask);
+	put(filter);
+	realBlitFramebuffer(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+}
+
+static void GLAPIENTRY traceGenerateMipmap(GLenum target)
+{
+	putOp(Op::GenerateMipmap);
+	put(target);
+	realGenerateMipmap(target);
+}
+
+static void installHooks()
+{
+#define INSTALL(name, NAME) \
+	real##name = __glew##name; \
+	if(real##name) \
+		__glew##name = trace##name;
+	GLEW_HOOKS(INSTALL)
+#undef INSTALL
+}
+
+static void removeHooks()
+{
+#define REMOVE(name, NAME) \
+	if(real##name) \
+		__glew##name = real##name;
+	GLEW_HOOKS(REMOVE)
+#undef REMOVE
+}
+
+bool GLTrace::start(const std::string& filename, unsigned int frames,
+		int width, int height)
+{
+	if(gRecording || !frames)
+		return false;
+#ifndef GLTRACE_ENTRY_POINTS
+	std::cerr << "GL tracing needs GLTraceEntryPoints.o linked into the executable.\n";
+	return false;
+#endif
+	if(!real_glClear() || !__glewUseProgram || !__glewBindBuffer) {
+		std::cerr << "GL tracing needs OpenGL 2.0 and the driver's entry points.\n";
+		return false;
+	}
+
+	gFilename = filename;
+	gFrames = frames;
+	gFramesLeft = frames;
+	gWidth = width;
+	gHeight = height;
+	gData.clear();
+	gBuffers.clear();
+	gTextures.clear();
+	gPrograms.clear();
+	gFramebuffers.clear();
+	gWarnedClientArrays = false;
+
+	installHooks();
+	gRecording = true;
+	snapshotState();
+	return true;
+}
+
+void GLTrace::endFrame()
+{
+	if(!gRecording)
+		return;
+	putOp(Op::EndFrame);
+	if(--gFramesLeft == 0)
+		stop();
+}
+
+bool GLTrace::stop()
+{
+	if(!gRecording)
+		return false;
+	removeHooks();
+	gRecording = false;
+
+	uLongf compressedSize = compressBound(gData.size());
+	std::vector<unsigned char> compressed(compressedSize);
+	if(compress2(&compressed[0], &compressedSize, gData.empty() ? nullptr : &gData[0],
+				gData.size(), Z_BEST_SPEED) != Z_OK) {
+		std::cerr << "Unable to compress GL trace.\n";
+		return false;
+	}
+
+	std::ofstream f(gFilename.c_str(), std::ios::binary);
+	uint32_t header[4] = { Version, uint32_t(gWidth), uint32_t(gHeight), gFrames - gFramesLeft };
+	uint64_t size = gData.size();
+	f.write(Magic, sizeof(Magic));
+	f.write(reinterpret_cast<const char*>(header), sizeof(header));
+	f.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	f.write(reinterpret_cast<const char*>(&compressed[0]), compressedSize);
+	if(!f) {
+		std::cerr << "Unable to write GL trace to " << gFilename << ".\n";
+		return false;
+	}
+
+	std::cout << "Wrote " << header[3] << " frames of GL calls to " << gFilename
+		<< " (" << compressedSize / 1024 << " kB).\n";
+	gData.clear();
+	gData.shrink_to_fit();
+	return true;
+}
+
+bool GLTrace::isRecording()
+{
+	return gRecording;
+}
+
@@ -0,0 +1,115 @@
+#ifndef SCENE_GLTRACE_H
+#define SCENE_GLTRACE_H
+
+#include <string>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+/* Trace file: the magic, the format version, the viewport size, the
+ * frame count and the size of the record stream, followed by the
+ * zlib-compressed record stream. Each record is an opcode and its
+ * arguments in native byte order; variable length data is a 32 bit
+ * length and the bytes. GL object names are the ones seen when
+ * recording and are mapped to new objects on replay. */
+namespace GLTraceFormat {
+
+static const char Magic[4] = { 'G', 'L', 'T', '1' };
+static const uint32_t Version = 1;
+
+/* Set on records that recreate state which existed before the
+ * recording started; a replay loop only needs them once. */
+static const uint16_t SetupFlag = 0x8000;
+
+enum class Op : uint16_t {
+	EndFrame,
+	/* name, vertex and fragment source, then attribute locations,
+	 * uniform block bindings and uniform locations as name/value
+	 * lists */
+	Program,
+	UseProgram,
+	Uniform1i,
+	Uniform1f,
+	Uniform3fv,
+	Uniform4fv,
+	UniformMatrix4fv,
+	Clear,
+	ClearColor,
+	Viewport,
+	Scissor,
+	Enable,
+	Disable,
+	DepthFunc,
+	DepthMask,
+	ColorMask,
+	PixelStorei,
+	ActiveTexture,
+	BindTexture,
+	TexParameteri,
+	/* pixels from client memory; an empty blob means NULL */
+	TexImage2D,
+	DeleteTextures,
+	BindBuffer,
+	BufferData,
+	BufferSubData,
+	BindBufferRange,
+	DeleteBuffers,
+	EnableVertexAttribArray,
+	DisableVertexAttribArray,
+	/* the pointer is an offset into the bound array buffer */
+	VertexAttribPointer,
+	/* the indices are an offset into the bound element buffer */
+	DrawElements,
+	BeginQuery,
+	EndQuery,
+	QueryCounter,
+	BindFramebuffer,
+	BindRenderbuffer,
+	RenderbufferStorage,
+	FramebufferTexture2D,
+	FramebufferRenderbuffer,
+	BlitFramebuffer,
+	GenerateMipmap,
+	/* from the bound array buffers */
+	DrawArrays,
+	BlendFunc,
+	Uniform2fv,
+	TexParameterf
+};
+
+}
+
+/* Records the GL calls made by the application to a trace file that
+ * TraceReplay runs again offscreen.
+ *
+ * Calls through GLEW are caught by swapping the GLEW function pointers
+ * while recording. The OpenGL 1.1 entry points, which GLEW doesn't
+ * load, are defined in GLTrace.cpp when it is built with
+ * GLTRACE_ENTRY_POINTS and forward to the driver. The Makefile builds
+ * that as GLTraceEntryPoints.o, which only the executables that record
+ * link in; everywhere else start() fails and GL calls go straight to
+ * the driver. Programs,
+ * buffers, textures and framebuffers that existed before the recording
+ * are written out when first used, along with the state from the start
+ * of the recording. Buffer contents written through mapped pointers
+ * aren't seen, so UploadRing falls back to glBufferSubData while
+ * recording, and texture uploads from a pixel unpack buffer are stored
+ * with their pixels. Query results and sync objects aren't recorded.
+ *
+ * Only the calls this code base makes are recorded; other calls go to
+ * the driver without being traced. */
+class GLTrace {
+	public:
+		/* Starts recording the next frames to filename; endFrame()
+		 * must be called after each frame. */
+		static bool start(const std::string& filename, unsigned int frames,
+				int width, int height);
+		static void endFrame();
+		/* Writes the file; called by endFrame() after the last frame. */
+		static bool stop();
+		static bool isRecording();
+};
+
+#endif
+
@@ -0,0 +1,21 @@
+#ifndef SCENE_HASH_H
+#define SCENE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* 64 bit FNV-1a. Pass the previous result as h to hash data in parts.
+ * Fast but not collision resistant; keys that decide two things are the
+ * same must be checked against the data. */
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t h = 14695981039346656037ULL)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for(size_t i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+#endif
+
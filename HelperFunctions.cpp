@@ -1,6 +1,11 @@
 #include "HelperFunctions.h"
 
 #include <fstream>
+#include <cstring>
+
+#include "MatrixKernels.h"
+#include "AssetPack.h"
+#include "MemoryTracker.h"
 
 #include "libcommon/Math.h"
 #include "libcommon/Texture.h"
@@ -44,18 +49,34 @@ Matrix44 HelperFunctions::cameraRotationMatrix(const Vector3& tgt, const Vector3
 	return m;
 }
 
-GLuint HelperFunctions::loadShaderFromFile(GLenum type, const char* filename)
+GLuint HelperFunctions::loadShaderFromFile(GLenum type, const char* filename,
+		const std::string& defines)
 {
+	AssetPack* pack = AssetPack::getCurrent();
+	const AssetPackFormat::Entry* e = pack ? pack->find(filename, AssetPackFormat::AssetShader) : nullptr;
+	if(e) {
+		/* compile straight from the mapping */
+		const GLchar* srcs[] = { defines.c_str(), reinterpret_cast<const GLchar*>(pack->getData(*e)) };
+		GLint lengths[] = { GLint(defines.size()), GLint(e->size) };
+		return loadShader(type, 2, srcs, lengths);
+	}
+
 	std::ifstream ifs(filename);
 	if(ifs.bad()) {
 		return 0;
 	}
 	std::string content((std::istreambuf_iterator<char>(ifs)),
 			(std::istreambuf_iterator<char>()));
-	return loadShader(type, content.c_str());
+	return loadShader(type, (defines + content).c_str());
 }
 
 GLuint HelperFunctions::loadShader(GLenum type, const char* src)
+{
+	return loadShader(type, 1, &src, NULL);
+}
+
+GLuint HelperFunctions::loadShader(GLenum type, GLsizei count, const GLchar** srcs,
+		const GLint* lengths)
 {
 	GLuint shader;
 	GLint compiled;
@@ -65,7 +86,7 @@ GLuint HelperFunctions::loadShader(GLenum type, const char* src)
 	if(shader == 0)
 		return 0;
 
-	glShaderSource(shader, 1, &src, NULL);
+	glShaderSource(shader, count, srcs, lengths);
 
 	glCompileShader(shader);
 
@@ -99,8 +120,14 @@ boost::shared_ptr<Texture> HelperFunctions::loadTexture(const std::string& filen
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	boost::shared_ptr<Texture> texture(new Texture(filename.c_str()));
 	glBindTexture(GL_TEXTURE_2D, texture->getTexture());
+	/* libcommon uploads level 0 as RGBA */
+	GLint width = 0, height = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	MemoryTracker::setTextureLevel(texture->getTexture(), 0, width, height, 4);
 	if (GLEW_VERSION_3_0) {
 		glGenerateMipmap(GL_TEXTURE_2D);
+		MemoryTracker::generateMipmaps(texture->getTexture());
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	} else {
@@ -111,6 +138,30 @@ boost::shared_ptr<Texture> HelperFunctions::loadTexture(const std::string& filen
 	return texture;
 }
 
+/* The pixels are uploaded from the pack mapping without a copy. The
+ * caller owns the returned texture. */
+GLuint HelperFunctions::loadTexture(const AssetPack& pack, const AssetPackFormat::Entry& e)
+{
+	const AssetPackFormat::TextureHeader& h = pack.getTexture(e);
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, h.width, h.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			pack.getData(e) + h.pixelOffset);
+	MemoryTracker::setTextureLevel(texture, 0, h.width, h.height, 4);
+	if (GLEW_VERSION_3_0) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		MemoryTracker::generateMipmaps(texture);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	} else {
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	return texture;
+}
+
 Matrix44 HelperFunctions::translationMatrix(const Vector3& v)
 {
 	Matrix44 translation = Matrix44::Identity;
@@ -143,4 +194,23 @@ Matrix44 HelperFunctions::rotationMatrixFromEuler(const Vector3& v)
 	return rotation;
 }
 
+void HelperFunctions::rotationMatricesFromEuler(const std::vector<Vector3>& v,
+		std::vector<Matrix44>& out)
+{
+	std::vector<float> angles(v.size() * 3);
+	for(size_t i = 0; i < v.size(); i++) {
+		angles[i * 3 + 0] = v[i].x;
+		angles[i * 3 + 1] = v[i].y;
+		angles[i * 3 + 2] = v[i].z;
+	}
+
+	std::vector<float> matrices(v.size() * 16);
+	if(!v.empty())
+		MatrixKernels::eulerToMatrix(&angles[0], &matrices[0], v.size());
+
+	out.resize(v.size());
+	for(size_t i = 0; i < v.size(); i++) {
+		memcpy(out[i].m, &matrices[i * 16], 16 * sizeof(float));
+	}
+}
 
@@ -2,6 +2,7 @@
 #define SCENE_HELPERFUNCTIONS_H
 
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -12,17 +13,29 @@
 #include "libcommon/Matrix44.h"
 #include "libcommon/Texture.h"
 
+class AssetPack;
+namespace AssetPackFormat {
+struct Entry;
+}
+
 class HelperFunctions {
 	public:
 		static Common::Matrix44 translationMatrix(const Common::Vector3& v);
 		static Common::Matrix44 rotationMatrixFromEuler(const Common::Vector3& v);
+		static void rotationMatricesFromEuler(const std::vector<Common::Vector3>& v,
+				std::vector<Common::Matrix44>& out);
 		static Common::Matrix44 perspectiveMatrix(float fov, int screenwidth, int screenheight);
 		static Common::Matrix44 cameraRotationMatrix(const Common::Vector3& tgt, const Common::Vector3& up);
 
 		static GLuint loadShader(GLenum type, const char* src);
-		static GLuint loadShaderFromFile(GLenum type, const char* filename);
+		static GLuint loadShader(GLenum type, GLsizei count, const GLchar** srcs,
+				const GLint* lengths);
+		/* Reads the shader from the current asset pack if it has it. */
+		static GLuint loadShaderFromFile(GLenum type, const char* filename,
+				const std::string& defines = "");
 
 		static boost::shared_ptr<Common::Texture> loadTexture(const std::string& filename);
+		static GLuint loadTexture(const AssetPack& pack, const AssetPackFormat::Entry& e);
 
 		static void enableDepthTest();
 };
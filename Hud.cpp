@@ -0,0 +1,385 @@
+#include "Hud.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "Scene.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "MemoryTracker.h"
+
+namespace Scene {
+
+/* in pixels */
+static const int Margin = 8;
+static const int Padding = 6;
+static const int BarWidth = 2;
+static const int GraphHeight = 60;
+static const int AtlasWidth = 256;
+
+/* the top of the graph; frames above it are cut off */
+static const double GraphMaxTime = 1.0 / 30.0;
+static const double LayoutInterval = 0.25;
+
+static const unsigned int BackgroundColor = 0x000000a0;
+static const unsigned int TextColor = 0xffffffff;
+static const unsigned int LineColor = 0xffffff60;
+
+static unsigned int frameTimeColor(double t)
+{
+	if(t <= 1.0 / 60.0)
+		return 0x40e040ff;
+	if(t <= 1.0 / 30.0)
+		return 0xe0e040ff;
+	return 0xe04040ff;
+}
+
+Hud::Hud(const std::string& fontFile, int fontSize, int screenWidth, int screenHeight)
+	: mEnabled(false),
+	mScreenWidth(screenWidth),
+	mScreenHeight(screenHeight),
+	mProgram(0),
+	mScreenSizeLocation(-1),
+	mAtlasLocation(-1),
+	mAtlas(0),
+	mLineHeight(0),
+	mWhiteS(0.0f),
+	mWhiteT(0.0f),
+	mFrameIndex(0),
+	mLastFrame(0.0),
+	mLastLayout(0.0),
+	mFrameTimeSum(0.0),
+	mFrames(0),
+	mDrawTime(0.0)
+{
+	std::fill(mFrameTimes, mFrameTimes + GraphFrames, 0.0f);
+
+	mProgram = ShaderCache::loadProgram("hud.vert", "hud.frag", "",
+			[] (GLuint program) {
+				glBindAttribLocation(program, 0, "a_Position");
+				glBindAttribLocation(program, 1, "a_Texcoord");
+				glBindAttribLocation(program, 2, "a_Color");
+			});
+	if(!mProgram) {
+		std::cerr << "Unable to load the HUD shaders.\n";
+		throw std::runtime_error("Error while loading shader");
+	}
+
+	try {
+		buildAtlas(fontFile, fontSize);
+	} catch(...) {
+		glDeleteProgram(mProgram);
+		throw;
+	}
+
+	/* uniforms stay with the program */
+	GLint program;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glUseProgram(mProgram);
+	mScreenSizeLocation = glGetUniformLocation(mProgram, "u_screenSize");
+	mAtlasLocation = glGetUniformLocation(mProgram, "u_atlas");
+	glUniform2f(mScreenSizeLocation, mScreenWidth, mScreenHeight);
+	glUniform1i(mAtlasLocation, 0);
+	glUseProgram(program);
+
+	mRing = boost::shared_ptr<UploadRing>(new UploadRing(GL_ARRAY_BUFFER, sizeof(GLfloat)));
+}
+
+Hud::~Hud()
+{
+	glDeleteTextures(1, &mAtlas);
+	MemoryTracker::deleteTextures(1, &mAtlas);
+	glDeleteProgram(mProgram);
+}
+
+/* Rows of glyphs as SDL_ttf renders them, each the full font height
+ * with a gap of one texel around it so that nothing bleeds in. */
+void Hud::buildAtlas(const std::string& fontFile, int fontSize)
+{
+	bool init = !TTF_WasInit();
+	if(init && TTF_Init() < 0) {
+		std::cerr << "Unable to initialise SDL_ttf: " << TTF_GetError() << "\n";
+		throw std::runtime_error("Error while loading font");
+	}
+
+	TTF_Font* font = TTF_OpenFont(fontFile.c_str(), fontSize);
+	if(!font) {
+		std::cerr << "Unable to open font " << fontFile << ": " << TTF_GetError() << "\n";
+		if(init)
+			TTF_Quit();
+		throw std::runtime_error("Error while loading font");
+	}
+
+	const int numGlyphs = LastGlyph - FirstGlyph + 1;
+	SDL_Surface* surfaces[numGlyphs];
+	int x[numGlyphs];
+	int y[numGlyphs];
+	mLineHeight = TTF_FontHeight(font);
+
+	/* the white texel used for solid quads is at the origin */
+	const SDL_Color white = { 255, 255, 255, 0 };
+	int penX = 2;
+	int penY = 0;
+	for(int i = 0; i < numGlyphs; i++) {
+		char text[2] = { char(FirstGlyph + i), '\0' };
+		int minx, maxx, miny, maxy, advance;
+		if(TTF_GlyphMetrics(font, FirstGlyph + i, &minx, &maxx, &miny, &maxy, &advance) < 0)
+			advance = 0;
+
+		/* may fail for glyphs that leave no ink, such as the space */
+		surfaces[i] = TTF_RenderText_Blended(font, text, white);
+		int w = surfaces[i] ? std::min(surfaces[i]->w, AtlasWidth - 2) : 0;
+		if(penX + w + 1 > AtlasWidth) {
+			penX = 0;
+			penY += mLineHeight + 1;
+		}
+		x[i] = penX;
+		y[i] = penY;
+		penX += w + 1;
+
+		mGlyphs[i].width = w;
+		mGlyphs[i].advance = advance;
+	}
+	TTF_CloseFont(font);
+	if(init)
+		TTF_Quit();
+
+	int height = 1;
+	while(height < penY + mLineHeight)
+		height *= 2;
+
+	std::vector<unsigned char> pixels(AtlasWidth * height, 0);
+	pixels[0] = 255;
+	mWhiteS = 0.5f / AtlasWidth;
+	mWhiteT = 0.5f / height;
+
+	for(int i = 0; i < numGlyphs; i++) {
+		Glyph& g = mGlyphs[i];
+		g.s0 = float(x[i]) / AtlasWidth;
+		g.t0 = float(y[i]) / height;
+		g.s1 = float(x[i] + g.width) / AtlasWidth;
+		g.t1 = float(y[i] + mLineHeight) / height;
+
+		SDL_Surface* s = surfaces[i];
+		if(!s)
+			continue;
+
+		/* blended glyphs are 32 bit with the coverage in alpha */
+		SDL_LockSurface(s);
+		int rows = std::min(s->h, mLineHeight);
+		for(int r = 0; r < rows; r++) {
+			const Uint32* src = reinterpret_cast<const Uint32*>(
+					static_cast<const unsigned char*>(s->pixels) + r * s->pitch);
+			unsigned char* dst = &pixels[(y[i] + r) * AtlasWidth + x[i]];
+			for(int c = 0; c < g.width; c++) {
+				dst[c] = (src[c] & s->format->Amask) >> s->format->Ashift;
+			}
+		}
+		SDL_UnlockSurface(s);
+		SDL_FreeSurface(s);
+	}
+
+	glGenTextures(1, &mAtlas);
+	glBindTexture(GL_TEXTURE_2D, mAtlas);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, AtlasWidth, height, 0, GL_ALPHA, GL_UNSIGNED_BYTE,
+			pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	MemoryTracker::setTextureLevel(mAtlas, 0, AtlasWidth, height, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void Hud::setEnabled(bool enabled)
+{
+	if(enabled && !mEnabled) {
+		/* the time it was off isn't a frame */
+		std::fill(mFrameTimes, mFrameTimes + GraphFrames, 0.0f);
+		mLastFrame = 0.0;
+		mLastLayout = 0.0;
+		mFrameTimeSum = 0.0;
+		mFrames = 0;
+	}
+	mEnabled = enabled;
+}
+
+bool Hud::isEnabled() const
+{
+	return mEnabled;
+}
+
+double Hud::getDrawTime() const
+{
+	return mDrawTime;
+}
+
+void Hud::addQuad(std::vector<Vertex>& v, float x0, float y0, float x1, float y1,
+		float s0, float t0, float s1, float t1, unsigned int color) const
+{
+	const GLubyte c[4] = { GLubyte(color >> 24), GLubyte(color >> 16), GLubyte(color >> 8), GLubyte(color) };
+	const Vertex corners[4] = {
+		{ x0, y0, s0, t0, { c[0], c[1], c[2], c[3] } },
+		{ x1, y0, s1, t0, { c[0], c[1], c[2], c[3] } },
+		{ x1, y1, s1, t1, { c[0], c[1], c[2], c[3] } },
+		{ x0, y1, s0, t1, { c[0], c[1], c[2], c[3] } },
+	};
+	static const int order[] = { 0, 1, 2, 0, 2, 3 };
+	for(int i : order)
+		v.push_back(corners[i]);
+}
+
+void Hud::addRect(std::vector<Vertex>& v, float x0, float y0, float x1, float y1,
+		unsigned int color) const
+{
+	addQuad(v, x0, y0, x1, y1, mWhiteS, mWhiteT, mWhiteS, mWhiteT, color);
+}
+
+/* Returns the width of the text. */
+float Hud::addText(std::vector<Vertex>& v, float x, float y, const std::string& text,
+		unsigned int color) const
+{
+	float start = x;
+	for(char ch : text) {
+		int i = (ch < FirstGlyph || ch > LastGlyph ? '?' : ch) - FirstGlyph;
+		const Glyph& g = mGlyphs[i];
+		if(g.width)
+			addQuad(v, x, y, x + g.width, y + mLineHeight, g.s0, g.t0, g.s1, g.t1, color);
+		x += g.advance;
+	}
+	return x - start;
+}
+
+float Hud::textWidth(const std::string& text) const
+{
+	float width = 0.0f;
+	for(char ch : text) {
+		int i = (ch < FirstGlyph || ch > LastGlyph ? '?' : ch) - FirstGlyph;
+		width += mGlyphs[i].advance;
+	}
+	return width;
+}
+
+/* The background goes first so that the graph, added every frame after
+ * the text, is drawn over it. */
+void Hud::layoutText(const RenderStats& stats)
+{
+	double frameTime = mFrames ? mFrameTimeSum / mFrames : 0.0;
+	MemoryStats cpu = MemoryTracker::getCPUTotal();
+	MemoryStats gpu = MemoryTracker::getGPUTotal();
+
+	char lines[6][64];
+	snprintf(lines[0], sizeof(lines[0]), "%.1f fps  %.2f ms",
+			frameTime > 0.0 ? 1.0 / frameTime : 0.0, frameTime * 1000.0);
+	snprintf(lines[1], sizeof(lines[1]), "draws %u  tris %u", stats.drawCalls, stats.triangles);
+	snprintf(lines[2], sizeof(lines[2]), "culled %u/%u instances",
+			stats.culledInstances, stats.instances);
+	snprintf(lines[3], sizeof(lines[3]), "state changes %u", stats.stateChanges);
+	snprintf(lines[4], sizeof(lines[4]), "cpu %.1f MB  gpu %.1f MB",
+			cpu.current / (1024.0 * 1024.0), gpu.current / (1024.0 * 1024.0));
+	snprintf(lines[5], sizeof(lines[5]), "hud %.3f ms", mDrawTime * 1000.0);
+
+	float x = Margin + Padding;
+	float y = Margin + Padding + GraphHeight + Padding;
+	float width = GraphFrames * BarWidth;
+	for(auto& line : lines)
+		width = std::max(width, textWidth(line));
+	float height = sizeof(lines) / sizeof(lines[0]) * mLineHeight;
+
+	mTextVertices.clear();
+	addRect(mTextVertices, Margin, Margin, x + width + Padding, y + height + Padding,
+			BackgroundColor);
+	for(auto& line : lines) {
+		addText(mTextVertices, x, y, line, TextColor);
+		y += mLineHeight;
+	}
+}
+
+void Hud::draw(const RenderStats& stats)
+{
+	if(!mEnabled)
+		return;
+
+	PROFILE_SCOPE("Hud::draw");
+	double start = Benchmark::now();
+	double frameTime = mLastFrame != 0.0 ? start - mLastFrame : 0.0;
+	mLastFrame = start;
+	mFrameTimes[mFrameIndex] = frameTime;
+	mFrameIndex = (mFrameIndex + 1) % GraphFrames;
+	mFrameTimeSum += frameTime;
+	mFrames++;
+
+	if(start - mLastLayout >= LayoutInterval) {
+		layoutText(stats);
+		mLastLayout = start;
+		mFrameTimeSum = 0.0;
+		mFrames = 0;
+	}
+
+	/* oldest frame on the left, with lines at 60 and 30 fps */
+	mVertices = mTextVertices;
+	const float left = Margin + Padding;
+	const float bottom = Margin + Padding + GraphHeight;
+	for(int i = 0; i < GraphFrames; i++) {
+		double t = mFrameTimes[(mFrameIndex + i) % GraphFrames];
+		float h = std::min(t / GraphMaxTime, 1.0) * GraphHeight;
+		if(h > 0.0f)
+			addRect(mVertices, left + i * BarWidth, bottom - h, left + (i + 1) * BarWidth - 1,
+					bottom, frameTimeColor(t));
+	}
+	for(double t : { 1.0 / 60.0, 1.0 / 30.0 }) {
+		float y = bottom - float(t / GraphMaxTime) * GraphHeight;
+		addRect(mVertices, left, y, left + GraphFrames * BarWidth, y + 1, LineColor);
+	}
+
+	size_t bytes = mVertices.size() * sizeof(Vertex);
+	size_t offset;
+	mRing->beginFrame(bytes);
+	void* p = mRing->allocate(bytes, offset);
+	if(p) {
+		memcpy(p, mVertices.data(), bytes);
+		mRing->commit();
+
+		GLint program;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+		GLboolean blend = glIsEnabled(GL_BLEND);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		glUseProgram(mProgram);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mAtlas);
+		glBindBuffer(GL_ARRAY_BUFFER, mRing->getBuffer());
+		const char* base = reinterpret_cast<const char*>(offset);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, x));
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + offsetof(Vertex, s));
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), base + offsetof(Vertex, color));
+		glDrawArrays(GL_TRIANGLES, 0, mVertices.size());
+
+		glUseProgram(program);
+		if(depthTest)
+			glEnable(GL_DEPTH_TEST);
+		if(!blend)
+			glDisable(GL_BLEND);
+	}
+	mRing->endFrame();
+
+	mDrawTime = Benchmark::now() - start;
+}
+
+}
+
@@ -0,0 +1,96 @@
+#ifndef SCENE_HUD_H
+#define SCENE_HUD_H
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "UploadRing.h"
+
+namespace Scene {
+
+struct RenderStats;
+
+/* Performance overlay in the top left corner: a graph of the recent
+ * frame times and the frame rate, render statistics and memory use as
+ * text. The printable ASCII glyphs of the font are rendered with SDL_ttf
+ * once into an alpha texture, which also holds a white texel for the
+ * solid quads, so the whole overlay is one draw call from one stream
+ * buffer. The text is only laid out again a few times a second.
+ *
+ * draw() changes the program, the array buffer, the texture bound to
+ * unit 0 and the vertex attributes 0 to 2; the program and the depth
+ * test and blending state are restored afterwards. */
+class Hud {
+	public:
+		Hud(const std::string& fontFile, int fontSize, int screenWidth, int screenHeight);
+		~Hud();
+		void setEnabled(bool enabled);
+		bool isEnabled() const;
+		/* Adds the time since the previous call to the graph and draws
+		 * the overlay. Does nothing while disabled. */
+		void draw(const RenderStats& stats);
+		/* CPU time of the last draw(), in seconds */
+		double getDrawTime() const;
+
+	private:
+		static const int FirstGlyph = 32;
+		static const int LastGlyph = 126;
+		static const int GraphFrames = 120;
+
+		struct Glyph {
+			float s0, t0, s1, t1;
+			int width;
+			int advance;
+		};
+
+		struct Vertex {
+			GLfloat x, y;
+			GLfloat s, t;
+			GLubyte color[4];
+		};
+
+		void buildAtlas(const std::string& fontFile, int fontSize);
+		void layoutText(const RenderStats& stats);
+		void addQuad(std::vector<Vertex>& v, float x0, float y0, float x1, float y1,
+				float s0, float t0, float s1, float t1, unsigned int color) const;
+		void addRect(std::vector<Vertex>& v, float x0, float y0, float x1, float y1,
+				unsigned int color) const;
+		float addText(std::vector<Vertex>& v, float x, float y, const std::string& text,
+				unsigned int color) const;
+		float textWidth(const std::string& text) const;
+
+		bool mEnabled;
+		int mScreenWidth;
+		int mScreenHeight;
+
+		GLuint mProgram;
+		GLint mScreenSizeLocation;
+		GLint mAtlasLocation;
+		GLuint mAtlas;
+		Glyph mGlyphs[LastGlyph - FirstGlyph + 1];
+		int mLineHeight;
+		float mWhiteS;
+		float mWhiteT;
+
+		boost::shared_ptr<UploadRing> mRing;
+		std::vector<Vertex> mVertices;
+		std::vector<Vertex> mTextVertices;
+
+		float mFrameTimes[GraphFrames];
+		int mFrameIndex;
+		double mLastFrame;
+		double mLastLayout;
+		double mFrameTimeSum;
+		unsigned int mFrames;
+		double mDrawTime;
+};
+
+}
+
+#endif
+
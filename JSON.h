@@ -0,0 +1,27 @@
+#ifndef SCENE_JSON_H
+#define SCENE_JSON_H
+
+#include <ostream>
+#include <string>
+#include <cstdio>
+
+/* Writes s as a quoted JSON string. */
+inline void writeJSONString(std::ostream& os, const std::string& s)
+{
+	os << '"';
+	for(unsigned char c : s) {
+		if(c == '"' || c == '\\') {
+			os << '\\' << c;
+		} else if(c < 0x20) {
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			os << esc;
+		} else {
+			os << c;
+		}
+	}
+	os << '"';
+}
+
+#endif
+
@@ -0,0 +1,313 @@
+#include "JobSystem.h"
+
+#include <cassert>
+#include <algorithm>
+
+namespace Scene {
+
+static thread_local const JobSystem* tOwner = nullptr;
+static thread_local unsigned int tWorkerIndex = 0;
+
+WorkStealingQueue::WorkStealingQueue()
+	: mTop(0),
+	mBottom(0)
+{
+	for(long i = 0; i < Size; i++) {
+		mJobs[i].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+bool WorkStealingQueue::push(Job* job)
+{
+	long b = mBottom.load(std::memory_order_relaxed);
+	long t = mTop.load(std::memory_order_acquire);
+	if(b - t >= Size)
+		return false;
+
+	mJobs[b & Mask].store(job, std::memory_order_relaxed);
+	mBottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job* WorkStealingQueue::pop()
+{
+	long b = mBottom.load(std::memory_order_relaxed) - 1;
+	mBottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long t = mTop.load(std::memory_order_relaxed);
+
+	if(t > b) {
+		/* empty */
+		mBottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = mJobs[b & Mask].load(std::memory_order_relaxed);
+	if(t == b) {
+		/* last job, race against thieves for it */
+		if(!mTop.compare_exchange_strong(t, t + 1,
+					std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			job = nullptr;
+		}
+		mBottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkStealingQueue::steal()
+{
+	long t = mTop.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long b = mBottom.load(std::memory_order_acquire);
+
+	if(t >= b)
+		return nullptr;
+
+	Job* job = mJobs[t & Mask].load(std::memory_order_relaxed);
+	if(!mTop.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed)) {
+		return nullptr;
+	}
+	return job;
+}
+
+JobSystem::Worker::Worker()
+	: pool(JobPoolSize),
+	allocated(0)
+{
+}
+
+JobSystem::JobSystem(unsigned int threads)
+	: mExternalPool(JobPoolSize),
+	mExternalAllocated(0),
+	mSleeping(0),
+	mQuit(false),
+	mMainThread(std::this_thread::get_id())
+{
+	if(threads < 1)
+		threads = 1;
+
+	for(unsigned int i = 0; i < threads; i++) {
+		mWorkers.push_back(new Worker());
+	}
+	for(unsigned int i = 1; i < threads; i++) {
+		mThreads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for(auto& t : mThreads) {
+		t.join();
+	}
+	for(auto w : mWorkers) {
+		delete w;
+	}
+}
+
+unsigned int JobSystem::getNumWorkers() const
+{
+	return mWorkers.size();
+}
+
+unsigned int JobSystem::getWorkerIndex() const
+{
+	if(std::this_thread::get_id() == mMainThread)
+		return 0;
+	if(tOwner == this)
+		return tWorkerIndex;
+	return NoWorker;
+}
+
+Job* JobSystem::create(const Function& f, Job* parent)
+{
+	Job* job;
+	unsigned int index = getWorkerIndex();
+	if(index == NoWorker) {
+		std::lock_guard<std::mutex> lock(mExternalMutex);
+		job = &mExternalPool[mExternalAllocated++ % JobPoolSize];
+	} else {
+		Worker* w = mWorkers[index];
+		job = &w->pool[w->allocated++ % JobPoolSize];
+	}
+
+	job->mFunction = f;
+	job->mParent = parent;
+	job->mUnfinished.store(1, std::memory_order_relaxed);
+	/* the submit() call counts as one dependency */
+	job->mDependencies.store(1, std::memory_order_relaxed);
+	job->mNumContinuations.store(0, std::memory_order_relaxed);
+	if(parent) {
+		parent->mUnfinished.fetch_add(1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+void JobSystem::addDependency(Job* before, Job* after)
+{
+	int n = before->mNumContinuations.fetch_add(1, std::memory_order_relaxed);
+	assert(n < Job::MaxContinuations);
+	after->mDependencies.fetch_add(1, std::memory_order_relaxed);
+	before->mContinuations[n] = after;
+}
+
+void JobSystem::submit(Job* job)
+{
+	if(job->mDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		push(job);
+	}
+}
+
+void JobSystem::push(Job* job)
+{
+	unsigned int index = getWorkerIndex();
+	if(index == NoWorker || !mWorkers[index]->queue.push(job)) {
+		std::lock_guard<std::mutex> lock(mExternalMutex);
+		mExternalQueue.push_back(job);
+	}
+
+	if(mSleeping.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mWake.notify_one();
+	}
+}
+
+Job* JobSystem::getJob()
+{
+	unsigned int index = getWorkerIndex();
+	if(index != NoWorker) {
+		Job* job = mWorkers[index]->queue.pop();
+		if(job)
+			return job;
+	} else {
+		index = 0;
+	}
+
+	unsigned int n = mWorkers.size();
+	for(unsigned int i = 1; i < n; i++) {
+		Job* job = mWorkers[(index + i) % n]->queue.steal();
+		if(job)
+			return job;
+	}
+
+	std::lock_guard<std::mutex> lock(mExternalMutex);
+	if(!mExternalQueue.empty()) {
+		Job* job = mExternalQueue.back();
+		mExternalQueue.pop_back();
+		return job;
+	}
+	return nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+	job->mFunction();
+	finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+	if(job->mUnfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	int n = job->mNumContinuations.load(std::memory_order_acquire);
+	for(int i = 0; i < n; i++) {
+		submit(job->mContinuations[i]);
+	}
+	if(job->mParent) {
+		finish(job->mParent);
+	}
+}
+
+bool JobSystem::isDone(const Job* job) const
+{
+	return job->mUnfinished.load(std::memory_order_acquire) == 0;
+}
+
+void JobSystem::wait(Job* job)
+{
+	bool mainThread = std::this_thread::get_id() == mMainThread;
+	while(!isDone(job)) {
+		if(mainThread)
+			processMainThreadQueue();
+
+		Job* next = getJob();
+		if(next) {
+			execute(next);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+size_t JobSystem::parallelFor(size_t count, size_t grain, const RangeFunction& f)
+{
+	/* keep the number of jobs in flight well within the job pool */
+	grain = std::max(grain, count / (JobPoolSize / 2) + 1);
+	size_t chunks = (count + grain - 1) / grain;
+	if(chunks == 0)
+		return 0;
+	if(chunks == 1) {
+		f(0, 0, count);
+		return chunks;
+	}
+
+	Job* root = create([] () { });
+	for(size_t i = 0; i < chunks; i++) {
+		size_t begin = i * grain;
+		size_t end = std::min(count, begin + grain);
+		submit(create([=, &f] () { f(i, begin, end); }, root));
+	}
+	submit(root);
+	wait(root);
+	return chunks;
+}
+
+void JobSystem::runOnMainThread(const Function& f)
+{
+	std::lock_guard<std::mutex> lock(mMainMutex);
+	mMainQueue.push_back(f);
+}
+
+void JobSystem::processMainThreadQueue()
+{
+	assert(std::this_thread::get_id() == mMainThread);
+	std::vector<Function> queue;
+	{
+		std::lock_guard<std::mutex> lock(mMainMutex);
+		queue.swap(mMainQueue);
+	}
+	for(auto& f : queue) {
+		f();
+	}
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+	tOwner = this;
+	tWorkerIndex = index;
+
+	unsigned int idle = 0;
+	while(!mQuit.load(std::memory_order_relaxed)) {
+		Job* job = getJob();
+		if(job) {
+			execute(job);
+			idle = 0;
+		} else if(++idle < 64) {
+			std::this_thread::yield();
+		} else {
+			std::unique_lock<std::mutex> lock(mSleepMutex);
+			mSleeping++;
+			mWake.wait_for(lock, std::chrono::milliseconds(1));
+			mSleeping--;
+		}
+	}
+}
+
+}
+
@@ -0,0 +1,118 @@
+#ifndef SCENE_JOBSYSTEM_H
+#define SCENE_JOBSYSTEM_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace Scene {
+
+class JobSystem;
+
+class Job {
+	public:
+		static const int MaxContinuations = 8;
+
+	private:
+		friend class JobSystem;
+
+		std::function<void ()> mFunction;
+		Job* mParent;
+		std::atomic<int> mUnfinished;
+		std::atomic<int> mDependencies;
+		Job* mContinuations[MaxContinuations];
+		std::atomic<int> mNumContinuations;
+};
+
+/* Chase-Lev work-stealing deque of fixed size. The owning worker pushes
+ * and pops at the bottom; other workers steal from the top. */
+class WorkStealingQueue {
+	public:
+		WorkStealingQueue();
+		bool push(Job* job);
+		Job* pop();
+		Job* steal();
+
+	private:
+		static const long Size = 4096;
+		static const long Mask = Size - 1;
+
+		std::atomic<long> mTop;
+		std::atomic<long> mBottom;
+		std::atomic<Job*> mJobs[Size];
+};
+
+/* Work-stealing task scheduler. The thread that creates the JobSystem is
+ * worker 0 and only runs jobs while waiting on one; the remaining
+ * workers are threads of their own. Jobs are taken from per-worker ring
+ * pools, so a job must have finished before its slot is reused, i.e.
+ * a worker may have at most JobPoolSize jobs in flight.
+ *
+ * Dependencies are declared with addDependency() before either job is
+ * submitted; a job runs once it has been submitted and all jobs it
+ * depends on have finished. Work that must run on the main (GL) thread
+ * is queued with runOnMainThread() and executed by
+ * processMainThreadQueue(), or while the main thread waits on a job. */
+class JobSystem {
+	public:
+		typedef std::function<void ()> Function;
+		typedef std::function<void (size_t chunk, size_t begin, size_t end)> RangeFunction;
+
+		JobSystem(unsigned int threads = std::thread::hardware_concurrency());
+		~JobSystem();
+		Job* create(const Function& f, Job* parent = nullptr);
+		void addDependency(Job* before, Job* after);
+		void submit(Job* job);
+		void wait(Job* job);
+		bool isDone(const Job* job) const;
+		/* Returns the number of chunks f was called for, none if count
+		 * is 0. */
+		size_t parallelFor(size_t count, size_t grain, const RangeFunction& f);
+		void runOnMainThread(const Function& f);
+		void processMainThreadQueue();
+		unsigned int getNumWorkers() const;
+		unsigned int getWorkerIndex() const;
+
+	private:
+		static const unsigned int JobPoolSize = 4096;
+		static const unsigned int NoWorker = ~0u;
+
+		struct Worker {
+			Worker();
+			WorkStealingQueue queue;
+			std::vector<Job> pool;
+			unsigned int allocated;
+		};
+
+		void workerLoop(unsigned int index);
+		void push(Job* job);
+		Job* getJob();
+		void execute(Job* job);
+		void finish(Job* job);
+
+		std::vector<Worker*> mWorkers;
+		std::vector<std::thread> mThreads;
+
+		/* jobs created and submitted from threads that aren't workers */
+		std::mutex mExternalMutex;
+		std::vector<Job> mExternalPool;
+		unsigned int mExternalAllocated;
+		std::vector<Job*> mExternalQueue;
+
+		std::mutex mMainMutex;
+		std::vector<Function> mMainQueue;
+
+		std::mutex mSleepMutex;
+		std::condition_variable mWake;
+		std::atomic<int> mSleeping;
+		std::atomic<bool> mQuit;
+		std::thread::id mMainThread;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,299 @@
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+
+#include "HelperFunctions.h"
+#include "MatrixKernels.h"
+#include "Model.h"
+#include "Benchmark.h"
+
+#include "libcommon/Vector3.h"
+#include "libcommon/Matrix44.h"
+
+using namespace Common;
+
+struct MathBenchOptions {
+	MathBenchOptions();
+	unsigned int samples;
+	std::vector<std::string> models;
+	std::string baseline;
+	std::string saveBaseline;
+	double threshold;
+};
+
+MathBenchOptions::MathBenchOptions()
+	: samples(30),
+	threshold(5.0)
+{
+}
+
+class MathBench {
+	public:
+		MathBench(const MathBenchOptions& options);
+		template<typename F>
+		void run(const std::string& name, unsigned int iterations, F f);
+		int finish();
+
+	private:
+		const MathBenchOptions& mOptions;
+		std::map<std::string, double> mBaseline;
+		std::map<std::string, double> mResults;
+		unsigned int mRegressions;
+};
+
+MathBench::MathBench(const MathBenchOptions& options)
+	: mOptions(options),
+	mRegressions(0)
+{
+	if(!mOptions.baseline.empty() && !Benchmark::loadBaseline(mOptions.baseline, mBaseline)) {
+		exit(1);
+	}
+}
+
+template<typename F>
+void MathBench::run(const std::string& name, unsigned int iterations, F f)
+{
+	auto stats = Benchmark::measure(mOptions.samples, iterations, f);
+	bool slow = stats.p50 >= 1.0e-3;
+	Benchmark::print(std::cout, name, stats, slow ? 1.0e3 : 1.0e9, slow ? "ms" : "ns");
+	mResults[name] = stats.p50;
+
+	auto it = mBaseline.find(name);
+	if(it != mBaseline.end() && it->second > 0.0) {
+		double change = (stats.p50 - it->second) / it->second * 100.0;
+		std::cout << "    " << std::showpos << std::fixed << std::setprecision(1)
+			<< change << std::noshowpos << "% vs baseline";
+		if(change > mOptions.threshold) {
+			std::cout << "  REGRESSION";
+			mRegressions++;
+		}
+		std::cout << "\n";
+	}
+}
+
+int MathBench::finish()
+{
+	if(!mOptions.saveBaseline.empty()) {
+		Benchmark::saveBaseline(mOptions.saveBaseline, mResults);
+	}
+	if(!mBaseline.empty()) {
+		std::cout << mRegressions << " regression" << (mRegressions == 1 ? "" : "s")
+			<< " over " << mOptions.threshold << "%\n";
+	}
+	return mRegressions ? 2 : 0;
+}
+
+/* Inputs vary with the iteration so the calls can't be hoisted out of
+ * the loop. */
+static Vector3 input(unsigned int i)
+{
+	return Vector3(i * 0.001f, i * 0.002f, i * 0.003f);
+}
+
+static void benchmarkMath(MathBench& bench, const Model& model)
+{
+	bench.run("translationMatrix", 0, [] (unsigned int i) {
+			Benchmark::doNotOptimize(HelperFunctions::translationMatrix(input(i)));
+			});
+
+	bench.run("rotationMatrixFromEuler", 0, [] (unsigned int i) {
+			Benchmark::doNotOptimize(HelperFunctions::rotationMatrixFromEuler(input(i)));
+			});
+
+	bench.run("cameraRotationMatrix", 0, [] (unsigned int i) {
+			Benchmark::doNotOptimize(HelperFunctions::cameraRotationMatrix(input(i) + Vector3(1, 0, 0),
+						Vector3(0, 1, 0)));
+			});
+
+	bench.run("perspectiveMatrix", 0, [] (unsigned int i) {
+			Benchmark::doNotOptimize(HelperFunctions::perspectiveMatrix(60.0f + (i & 15), 800, 600));
+			});
+
+	Matrix44 a = HelperFunctions::rotationMatrixFromEuler(Vector3(0.1f, 0.2f, 0.3f));
+	Matrix44 b = HelperFunctions::translationMatrix(Vector3(1, 2, 3));
+	bench.run("Matrix44 multiply", 0, [&] (unsigned int i) {
+			a.m[12] = i;
+			Benchmark::doNotOptimize(a * b);
+			});
+
+	bench.run("Matrix44 transpose", 0, [&] (unsigned int i) {
+			a.m[12] = i;
+			Benchmark::doNotOptimize(a.transposed());
+			});
+
+	/* the per-frame chain of Scene::updateFrameMatrices */
+	Matrix44 viewPerspective;
+	bench.run("view-perspective matrix", 0, [&] (unsigned int i) {
+			auto pers = HelperFunctions::perspectiveMatrix(90.0f, 800, 600);
+			auto camrot = HelperFunctions::cameraRotationMatrix(Vector3(1, 0, 0), Vector3(0, 1, 0));
+			auto camtrans = HelperFunctions::translationMatrix(input(i).negated());
+			viewPerspective = camtrans * camrot * pers;
+			Benchmark::doNotOptimize(viewPerspective);
+			});
+
+	Quaternion q1 = Quaternion::fromEuler(Vector3(0.4f, 0.5f, 0.6f));
+	Quaternion q2 = Quaternion::fromAxisAngle(Vector3(0, 1, 0), 0.01f);
+	bench.run("Quaternion compose", 0, [&] (unsigned int i) {
+			q1.w += i * 1.0e-9f;
+			Benchmark::doNotOptimize(q2 * q1);
+			});
+
+	bench.run("Quaternion slerp", 0, [&] (unsigned int i) {
+			Benchmark::doNotOptimize(Quaternion::slerp(q1, q2, (i & 255) / 255.0f));
+			});
+
+	bench.run("Quaternion fromEuler", 0, [] (unsigned int i) {
+			Benchmark::doNotOptimize(Quaternion::fromEuler(input(i)));
+			});
+
+	/* the per-instance chain of Scene::buildDrawPackets */
+	MeshInstance instance(model);
+	instance.setOrientation(q1);
+	bench.run("instance MVP and inverse", 0, [&] (unsigned int i) {
+			float modelMatrix[16];
+			float mvp[16];
+			float inverse[16];
+			instance.setPosition(input(i));
+			instance.getModelMatrix(modelMatrix);
+			MatrixKernels::multiply(modelMatrix, viewPerspective.m, mvp);
+			MatrixKernels::affineInverse(modelMatrix, inverse);
+			Benchmark::doNotOptimize(mvp);
+			Benchmark::doNotOptimize(inverse);
+			});
+}
+
+static void benchmarkKernels(MathBench& bench)
+{
+	const MatrixKernels::ISA isas[] = {
+		MatrixKernels::ISA::Scalar,
+		MatrixKernels::ISA::SSE,
+		MatrixKernels::ISA::AVX,
+		MatrixKernels::ISA::NEON
+	};
+	auto selected = MatrixKernels::getISA();
+
+	Matrix44 a = HelperFunctions::rotationMatrixFromEuler(Vector3(0.1f, 0.2f, 0.3f));
+	Matrix44 b = HelperFunctions::perspectiveMatrix(90.0f, 800, 600);
+	const size_t batch = 256;
+	std::vector<float> angles(batch * 3);
+	std::vector<float> rotations(batch * 16);
+	for(size_t i = 0; i < angles.size(); i++) {
+		angles[i] = i * 0.01f;
+	}
+
+	for(auto isa : isas) {
+		if(!MatrixKernels::setISA(isa))
+			continue;
+		std::string suffix = std::string(" [") + MatrixKernels::getISAName(isa) + "]";
+		float out[16];
+
+		bench.run("kernel multiply" + suffix, 0, [&] (unsigned int i) {
+				a.m[12] = i;
+				MatrixKernels::multiply(a.m, b.m, out);
+				Benchmark::doNotOptimize(out);
+				});
+
+		bench.run("kernel transpose" + suffix, 0, [&] (unsigned int i) {
+				a.m[12] = i;
+				MatrixKernels::transpose(a.m, out);
+				Benchmark::doNotOptimize(out);
+				});
+
+		bench.run("kernel affineInverse" + suffix, 0, [&] (unsigned int i) {
+				a.m[12] = i;
+				MatrixKernels::affineInverse(a.m, out);
+				Benchmark::doNotOptimize(out);
+				});
+
+		bench.run("kernel eulerToMatrix x256" + suffix, 0, [&] (unsigned int i) {
+				angles[0] = i * 0.001f;
+				MatrixKernels::eulerToMatrix(&angles[0], &rotations[0], batch);
+				Benchmark::doNotOptimize(rotations[0]);
+				});
+	}
+
+	MatrixKernels::setISA(selected);
+}
+
+static void benchmarkModels(MathBench& bench, const std::vector<std::string>& models)
+{
+	for(auto& filename : models) {
+		bench.run("Model import " + filename, 1, [&] (unsigned int) {
+				/* Model reports vertex and face counts on every import */
+				std::ostringstream discard;
+				auto buf = std::cout.rdbuf(discard.rdbuf());
+				try {
+					Model m(filename);
+					Benchmark::doNotOptimize(m.getIndices().size());
+				} catch(...) {
+					std::cout.rdbuf(buf);
+					throw;
+				}
+				std::cout.rdbuf(buf);
+				});
+	}
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " [options]\n"
+		<< "\t--samples <n>           samples per benchmark (default 30)\n"
+		<< "\t--model <file>          model to time importing, may be repeated\n"
+		<< "\t                        (default textured-cube.obj)\n"
+		<< "\t--save-baseline <file>  save the median times to file\n"
+		<< "\t--baseline <file>       compare against a saved baseline\n"
+		<< "\t--threshold <percent>   slowdown reported as a regression (default 5)\n";
+}
+
+int main(int argc, char** argv)
+{
+	MathBenchOptions options;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--samples") && i + 1 < argc) {
+			options.samples = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--model") && i + 1 < argc) {
+			options.models.push_back(argv[++i]);
+		} else if(!strcmp(argv[i], "--save-baseline") && i + 1 < argc) {
+			options.saveBaseline = argv[++i];
+		} else if(!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+			options.baseline = argv[++i];
+		} else if(!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			options.threshold = atof(argv[++i]);
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if(options.models.empty()) {
+		options.models.push_back("textured-cube.obj");
+	}
+
+	std::cout << "Matrix kernels: " << MatrixKernels::getISAName(MatrixKernels::getISA()) << "\n";
+	if(!MatrixKernels::validate(std::cout)) {
+		std::cerr << "Matrix kernels don't match the scalar versions.\n";
+		return 1;
+	}
+
+	MathBench bench(options);
+	try {
+		Model model(options.models[0]);
+		benchmarkMath(bench, model);
+		benchmarkKernels(bench);
+		benchmarkModels(bench, options.models);
+	} catch(std::exception& e) {
+		std::cerr << "std::exception: " << e.what() << "\n";
+		return 1;
+	}
+
+	return bench.finish();
+}
+
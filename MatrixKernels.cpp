@@ -0,0 +1,639 @@
+#include "MatrixKernels.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <random>
+
+#include "HelperFunctions.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATRIXKERNELS_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATRIXKERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace Common;
+
+const float MatrixKernels::EulerTolerance = 2.0e-6f;
+
+struct KernelTable {
+	MatrixKernels::ISA isa;
+	void (*multiply)(const float* a, const float* b, float* out);
+	void (*transpose)(const float* a, float* out);
+	void (*affineInverse)(const float* a, float* out);
+	void (*eulerToMatrix)(const float* angles, float* out, size_t count);
+};
+
+/* Writes the rotation matrix of HelperFunctions::rotationMatrixFromEuler
+ * from the sines and cosines of the three angles. */
+static void storeEulerMatrix(float* m, float sx, float cx, float sy, float cy, float sz, float cz)
+{
+	m[0 * 4 + 0] = cy * cz;
+	m[1 * 4 + 0] = -cx * sz + sx * sy * cz;
+	m[2 * 4 + 0] = sx * sz + cx * sy * cz;
+	m[3 * 4 + 0] = 0.0f;
+	m[0 * 4 + 1] = cy * sz;
+	m[1 * 4 + 1] = cx * cz + sx * sy * sz;
+	m[2 * 4 + 1] = -sx * cz + cx * sy * sz;
+	m[3 * 4 + 1] = 0.0f;
+	m[0 * 4 + 2] = -sy;
+	m[1 * 4 + 2] = sx * cy;
+	m[2 * 4 + 2] = cx * cy;
+	m[3 * 4 + 2] = 0.0f;
+	m[0 * 4 + 3] = 0.0f;
+	m[1 * 4 + 3] = 0.0f;
+	m[2 * 4 + 3] = 0.0f;
+	m[3 * 4 + 3] = 1.0f;
+}
+
+static void multiplyScalar(const float* a, const float* b, float* out)
+{
+	float r[16];
+	for(int i = 0; i < 4; i++) {
+		for(int j = 0; j < 4; j++) {
+			r[i * 4 + j] = a[i * 4 + 0] * b[0 * 4 + j] + a[i * 4 + 1] * b[1 * 4 + j] +
+				a[i * 4 + 2] * b[2 * 4 + j] + a[i * 4 + 3] * b[3 * 4 + j];
+		}
+	}
+	memcpy(out, r, sizeof(r));
+}
+
+static void transposeScalar(const float* a, float* out)
+{
+	float r[16];
+	for(int i = 0; i < 4; i++) {
+		for(int j = 0; j < 4; j++) {
+			r[j * 4 + i] = a[i * 4 + j];
+		}
+	}
+	memcpy(out, r, sizeof(r));
+}
+
+static void cross(const float* a, const float* b, float* out)
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/* The inverse of the upper 3x3 has the cross products of its rows as
+ * columns, divided by the determinant; the translation is then
+ * -t * inverse. */
+static void affineInverseScalar(const float* a, float* out)
+{
+	float c[3][3];
+	cross(a + 4, a + 8, c[0]);
+	cross(a + 8, a + 0, c[1]);
+	cross(a + 0, a + 4, c[2]);
+	float det = a[0] * c[0][0] + a[1] * c[0][1] + a[2] * c[0][2];
+	float invDet = 1.0f / det;
+
+	float r[16];
+	for(int i = 0; i < 3; i++) {
+		for(int j = 0; j < 3; j++) {
+			r[i * 4 + j] = c[j][i] * invDet;
+		}
+		r[i * 4 + 3] = 0.0f;
+	}
+	for(int j = 0; j < 4; j++) {
+		r[12 + j] = -(a[12] * r[j] + a[13] * r[4 + j] + a[14] * r[8 + j]);
+	}
+	r[15] = 1.0f;
+	memcpy(out, r, sizeof(r));
+}
+
+static void eulerToMatrixScalar(const float* angles, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++) {
+		const float* v = angles + i * 3;
+		storeEulerMatrix(out + i * 16, sin(v[0]), cos(v[0]), sin(v[1]), cos(v[1]), sin(v[2]), cos(v[2]));
+	}
+}
+
+static const KernelTable ScalarKernels = {
+	MatrixKernels::ISA::Scalar,
+	multiplyScalar,
+	transposeScalar,
+	affineInverseScalar,
+	eulerToMatrixScalar
+};
+
+/* Coefficients of the Cephes single precision sin and cos. The argument
+ * is reduced to [-pi/4, pi/4] by subtracting multiples of pi/4 in three
+ * parts; accurate for |x| < 8192. */
+static const float FourOverPi = 1.27323954473516f;
+static const float PiOver4Part1 = 0.78515625f;
+static const float PiOver4Part2 = 2.4187564849853515625e-4f;
+static const float PiOver4Part3 = 3.77489497744594108e-8f;
+static const float SinCoeff0 = -1.9515295891e-4f;
+static const float SinCoeff1 = 8.3321608736e-3f;
+static const float SinCoeff2 = -1.6666654611e-1f;
+static const float CosCoeff0 = 2.443315711809948e-5f;
+static const float CosCoeff1 = -1.388731625493765e-3f;
+static const float CosCoeff2 = 4.166664568298827e-2f;
+
+#ifdef MATRIXKERNELS_X86
+
+static void multiplySSE(const float* a, const float* b, float* out)
+{
+	__m128 b0 = _mm_loadu_ps(b + 0);
+	__m128 b1 = _mm_loadu_ps(b + 4);
+	__m128 b2 = _mm_loadu_ps(b + 8);
+	__m128 b3 = _mm_loadu_ps(b + 12);
+	__m128 r[4];
+	for(int i = 0; i < 4; i++) {
+		__m128 s = _mm_mul_ps(_mm_set1_ps(a[i * 4 + 0]), b0);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 1]), b1));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 2]), b2));
+		r[i] = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(a[i * 4 + 3]), b3));
+	}
+	for(int i = 0; i < 4; i++) {
+		_mm_storeu_ps(out + i * 4, r[i]);
+	}
+}
+
+static void transposeSSE(const float* a, float* out)
+{
+	__m128 r0 = _mm_loadu_ps(a + 0);
+	__m128 r1 = _mm_loadu_ps(a + 4);
+	__m128 r2 = _mm_loadu_ps(a + 8);
+	__m128 r3 = _mm_loadu_ps(a + 12);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(out + 0, r0);
+	_mm_storeu_ps(out + 4, r1);
+	_mm_storeu_ps(out + 8, r2);
+	_mm_storeu_ps(out + 12, r3);
+}
+
+static inline __m128 crossSSE(__m128 a, __m128 b)
+{
+	__m128 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 azxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+	__m128 byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bzxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+	return _mm_sub_ps(_mm_mul_ps(ayzx, bzxy), _mm_mul_ps(azxy, byzx));
+}
+
+static void affineInverseSSE(const float* a, float* out)
+{
+	__m128 r0 = _mm_loadu_ps(a + 0);
+	__m128 r1 = _mm_loadu_ps(a + 4);
+	__m128 r2 = _mm_loadu_ps(a + 8);
+
+	__m128 c0 = crossSSE(r1, r2);
+	__m128 c1 = crossSSE(r2, r0);
+	__m128 c2 = crossSSE(r0, r1);
+
+	__m128 m = _mm_mul_ps(r0, c0);
+	__m128 d = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+	d = _mm_add_ss(d, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+	__m128 invDet = _mm_div_ss(_mm_set_ss(1.0f), d);
+	invDet = _mm_shuffle_ps(invDet, invDet, 0);
+
+	c0 = _mm_mul_ps(c0, invDet);
+	c1 = _mm_mul_ps(c1, invDet);
+	c2 = _mm_mul_ps(c2, invDet);
+	__m128 c3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	__m128 t = _mm_mul_ps(_mm_set1_ps(a[12]), c0);
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(a[13]), c1));
+	t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(a[14]), c2));
+	t = _mm_xor_ps(t, _mm_set1_ps(-0.0f));
+
+	_mm_storeu_ps(out + 0, c0);
+	_mm_storeu_ps(out + 4, c1);
+	_mm_storeu_ps(out + 8, c2);
+	_mm_storeu_ps(out + 12, t);
+	out[15] = 1.0f;
+}
+
+static inline __m128 truncSSE(__m128 x)
+{
+	return _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+}
+
+static inline __m128 selectSSE(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static void sincosSSE(__m128 x, __m128& s, __m128& c)
+{
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 sign = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	/* octant, rounded up to even */
+	__m128 j = truncSSE(_mm_mul_ps(x, _mm_set1_ps(FourOverPi)));
+	__m128 odd = _mm_sub_ps(j, _mm_mul_ps(_mm_set1_ps(2.0f), truncSSE(_mm_mul_ps(j, _mm_set1_ps(0.5f)))));
+	j = _mm_add_ps(j, odd);
+	__m128 q = _mm_sub_ps(j, _mm_mul_ps(_mm_set1_ps(8.0f), truncSSE(_mm_mul_ps(j, _mm_set1_ps(0.125f)))));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PiOver4Part1)));
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PiOver4Part2)));
+	x = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PiOver4Part3)));
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SinCoeff0), z), _mm_set1_ps(SinCoeff1));
+	ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SinCoeff2));
+	ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+
+	__m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(CosCoeff0), z), _mm_set1_ps(CosCoeff1));
+	pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(CosCoeff2));
+	pc = _mm_mul_ps(_mm_mul_ps(pc, z), z);
+	pc = _mm_add_ps(_mm_sub_ps(pc, _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.0f));
+
+	__m128 q2 = _mm_cmpeq_ps(q, _mm_set1_ps(2.0f));
+	__m128 q4 = _mm_cmpeq_ps(q, _mm_set1_ps(4.0f));
+	__m128 q6 = _mm_cmpeq_ps(q, _mm_set1_ps(6.0f));
+	__m128 swap = _mm_or_ps(q2, q6);
+
+	s = selectSSE(swap, pc, ps);
+	c = selectSSE(swap, ps, pc);
+	s = _mm_xor_ps(s, _mm_xor_ps(sign, _mm_and_ps(_mm_or_ps(q4, q6), signMask)));
+	c = _mm_xor_ps(c, _mm_and_ps(_mm_or_ps(q2, q4), signMask));
+}
+
+static void eulerToMatrixSSE(const float* angles, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i += 4) {
+		size_t n = count - i < 4 ? count - i : 4;
+		float in[3][4] = { { 0.0f } };
+		for(size_t k = 0; k < n; k++) {
+			in[0][k] = angles[(i + k) * 3 + 0];
+			in[1][k] = angles[(i + k) * 3 + 1];
+			in[2][k] = angles[(i + k) * 3 + 2];
+		}
+
+		__m128 sx, cx, sy, cy, sz, cz;
+		sincosSSE(_mm_loadu_ps(in[0]), sx, cx);
+		sincosSSE(_mm_loadu_ps(in[1]), sy, cy);
+		sincosSSE(_mm_loadu_ps(in[2]), sz, cz);
+
+		float s[3][4];
+		float c[3][4];
+		_mm_storeu_ps(s[0], sx);
+		_mm_storeu_ps(s[1], sy);
+		_mm_storeu_ps(s[2], sz);
+		_mm_storeu_ps(c[0], cx);
+		_mm_storeu_ps(c[1], cy);
+		_mm_storeu_ps(c[2], cz);
+		for(size_t k = 0; k < n; k++) {
+			storeEulerMatrix(out + (i + k) * 16, s[0][k], c[0][k], s[1][k], c[1][k], s[2][k], c[2][k]);
+		}
+	}
+}
+
+static const KernelTable SSEKernels = {
+	MatrixKernels::ISA::SSE,
+	multiplySSE,
+	transposeSSE,
+	affineInverseSSE,
+	eulerToMatrixSSE
+};
+
+/* Two rows at a time; _mm256_shuffle_ps broadcasts an element within
+ * each 128-bit lane, i.e. within each row. */
+__attribute__((target("avx")))
+static void multiplyAVX(const float* a, const float* b, float* out)
+{
+	__m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 0));
+	__m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 4));
+	__m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 8));
+	__m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(b + 12));
+	__m256 r[2];
+	for(int i = 0; i < 2; i++) {
+		__m256 rows = _mm256_loadu_ps(a + i * 8);
+		__m256 s = _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+		s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+		s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+		r[i] = _mm256_add_ps(s, _mm256_mul_ps(_mm256_shuffle_ps(rows, rows, _MM_SHUFFLE(3, 3, 3, 3)), b3));
+	}
+	_mm256_storeu_ps(out + 0, r[0]);
+	_mm256_storeu_ps(out + 8, r[1]);
+}
+
+__attribute__((target("avx")))
+static inline __m256 truncAVX(__m256 x)
+{
+	return _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+}
+
+__attribute__((target("avx")))
+static inline __m256 selectAVX(__m256 mask, __m256 a, __m256 b)
+{
+	return _mm256_blendv_ps(b, a, mask);
+}
+
+__attribute__((target("avx")))
+static void sincosAVX(__m256 x, __m256& s, __m256& c)
+{
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 sign = _mm256_and_ps(x, signMask);
+	x = _mm256_andnot_ps(signMask, x);
+
+	__m256 j = truncAVX(_mm256_mul_ps(x, _mm256_set1_ps(FourOverPi)));
+	__m256 odd = _mm256_sub_ps(j, _mm256_mul_ps(_mm256_set1_ps(2.0f), truncAVX(_mm256_mul_ps(j, _mm256_set1_ps(0.5f)))));
+	j = _mm256_add_ps(j, odd);
+	__m256 q = _mm256_sub_ps(j, _mm256_mul_ps(_mm256_set1_ps(8.0f), truncAVX(_mm256_mul_ps(j, _mm256_set1_ps(0.125f)))));
+
+	x = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(PiOver4Part1)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(PiOver4Part2)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(PiOver4Part3)));
+	__m256 z = _mm256_mul_ps(x, x);
+
+	__m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SinCoeff0), z), _mm256_set1_ps(SinCoeff1));
+	ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(SinCoeff2));
+	ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), x), x);
+
+	__m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(CosCoeff0), z), _mm256_set1_ps(CosCoeff1));
+	pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(CosCoeff2));
+	pc = _mm256_mul_ps(_mm256_mul_ps(pc, z), z);
+	pc = _mm256_add_ps(_mm256_sub_ps(pc, _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.0f));
+
+	__m256 q2 = _mm256_cmp_ps(q, _mm256_set1_ps(2.0f), _CMP_EQ_OQ);
+	__m256 q4 = _mm256_cmp_ps(q, _mm256_set1_ps(4.0f), _CMP_EQ_OQ);
+	__m256 q6 = _mm256_cmp_ps(q, _mm256_set1_ps(6.0f), _CMP_EQ_OQ);
+	__m256 swap = _mm256_or_ps(q2, q6);
+
+	s = selectAVX(swap, pc, ps);
+	c = selectAVX(swap, ps, pc);
+	s = _mm256_xor_ps(s, _mm256_xor_ps(sign, _mm256_and_ps(_mm256_or_ps(q4, q6), signMask)));
+	c = _mm256_xor_ps(c, _mm256_and_ps(_mm256_or_ps(q2, q4), signMask));
+}
+
+__attribute__((target("avx")))
+static void eulerToMatrixAVX(const float* angles, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i += 8) {
+		size_t n = count - i < 8 ? count - i : 8;
+		float in[3][8] = { { 0.0f } };
+		for(size_t k = 0; k < n; k++) {
+			in[0][k] = angles[(i + k) * 3 + 0];
+			in[1][k] = angles[(i + k) * 3 + 1];
+			in[2][k] = angles[(i + k) * 3 + 2];
+		}
+
+		__m256 sx, cx, sy, cy, sz, cz;
+		sincosAVX(_mm256_loadu_ps(in[0]), sx, cx);
+		sincosAVX(_mm256_loadu_ps(in[1]), sy, cy);
+		sincosAVX(_mm256_loadu_ps(in[2]), sz, cz);
+
+		float s[3][8];
+		float c[3][8];
+		_mm256_storeu_ps(s[0], sx);
+		_mm256_storeu_ps(s[1], sy);
+		_mm256_storeu_ps(s[2], sz);
+		_mm256_storeu_ps(c[0], cx);
+		_mm256_storeu_ps(c[1], cy);
+		_mm256_storeu_ps(c[2], cz);
+		for(size_t k = 0; k < n; k++) {
+			storeEulerMatrix(out + (i + k) * 16, s[0][k], c[0][k], s[1][k], c[1][k], s[2][k], c[2][k]);
+		}
+	}
+}
+
+/* transpose and inverse gain nothing from the wider registers */
+static const KernelTable AVXKernels = {
+	MatrixKernels::ISA::AVX,
+	multiplyAVX,
+	transposeSSE,
+	affineInverseSSE,
+	eulerToMatrixAVX
+};
+
+#endif
+
+#ifdef MATRIXKERNELS_NEON
+
+static void multiplyNEON(const float* a, const float* b, float* out)
+{
+	float32x4_t b0 = vld1q_f32(b + 0);
+	float32x4_t b1 = vld1q_f32(b + 4);
+	float32x4_t b2 = vld1q_f32(b + 8);
+	float32x4_t b3 = vld1q_f32(b + 12);
+	float32x4_t r[4];
+	for(int i = 0; i < 4; i++) {
+		/* separate multiplies and adds, as vmlaq may be fused */
+		float32x4_t s = vmulq_n_f32(b0, a[i * 4 + 0]);
+		s = vaddq_f32(s, vmulq_n_f32(b1, a[i * 4 + 1]));
+		s = vaddq_f32(s, vmulq_n_f32(b2, a[i * 4 + 2]));
+		r[i] = vaddq_f32(s, vmulq_n_f32(b3, a[i * 4 + 3]));
+	}
+	for(int i = 0; i < 4; i++) {
+		vst1q_f32(out + i * 4, r[i]);
+	}
+}
+
+static void transposeNEON(const float* a, float* out)
+{
+	float32x4x4_t cols = vld4q_f32(a);
+	vst1q_f32(out + 0, cols.val[0]);
+	vst1q_f32(out + 4, cols.val[1]);
+	vst1q_f32(out + 8, cols.val[2]);
+	vst1q_f32(out + 12, cols.val[3]);
+}
+
+static const KernelTable NEONKernels = {
+	MatrixKernels::ISA::NEON,
+	multiplyNEON,
+	transposeNEON,
+	affineInverseScalar,
+	eulerToMatrixScalar
+};
+
+#endif
+
+static const KernelTable* getKernelTable(MatrixKernels::ISA isa)
+{
+	switch(isa) {
+#ifdef MATRIXKERNELS_X86
+		case MatrixKernels::ISA::SSE:
+			return &SSEKernels;
+		case MatrixKernels::ISA::AVX:
+			return &AVXKernels;
+#endif
+#ifdef MATRIXKERNELS_NEON
+		case MatrixKernels::ISA::NEON:
+			return &NEONKernels;
+#endif
+		default:
+			return &ScalarKernels;
+	}
+}
+
+static const KernelTable* selectKernels()
+{
+	const MatrixKernels::ISA preferred[] = {
+		MatrixKernels::ISA::AVX,
+		MatrixKernels::ISA::SSE,
+		MatrixKernels::ISA::NEON
+	};
+	for(auto isa : preferred) {
+		if(MatrixKernels::isSupported(isa))
+			return getKernelTable(isa);
+	}
+	return &ScalarKernels;
+}
+
+static const KernelTable*& currentKernels()
+{
+	static const KernelTable* kernels = selectKernels();
+	return kernels;
+}
+
+bool MatrixKernels::isSupported(ISA isa)
+{
+	switch(isa) {
+		case ISA::Scalar:
+			return true;
+#ifdef MATRIXKERNELS_X86
+		case ISA::SSE:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+		case ISA::AVX:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx");
+#endif
+#ifdef MATRIXKERNELS_NEON
+		case ISA::NEON:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+MatrixKernels::ISA MatrixKernels::getISA()
+{
+	return currentKernels()->isa;
+}
+
+const char* MatrixKernels::getISAName(ISA isa)
+{
+	switch(isa) {
+		case ISA::Scalar:
+			return "scalar";
+		case ISA::SSE:
+			return "SSE";
+		case ISA::AVX:
+			return "AVX";
+		case ISA::NEON:
+			return "NEON";
+	}
+	return "unknown";
+}
+
+bool MatrixKernels::setISA(ISA isa)
+{
+	if(!isSupported(isa))
+		return false;
+	currentKernels() = getKernelTable(isa);
+	return true;
+}
+
+void MatrixKernels::multiply(const float* a, const float* b, float* out)
+{
+	currentKernels()->multiply(a, b, out);
+}
+
+void MatrixKernels::transpose(const float* a, float* out)
+{
+	currentKernels()->transpose(a, out);
+}
+
+void MatrixKernels::affineInverse(const float* a, float* out)
+{
+	currentKernels()->affineInverse(a, out);
+}
+
+void MatrixKernels::eulerToMatrix(const float* angles, float* out, size_t count)
+{
+	currentKernels()->eulerToMatrix(angles, out, count);
+}
+
+bool MatrixKernels::validate(std::ostream& os)
+{
+	const size_t count = 1000;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> angle(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	std::vector<float> angles(count * 3);
+	std::vector<float> general(count * 16);
+	std::vector<float> affine(count * 16);
+	for(size_t i = 0; i < count; i++) {
+		for(int k = 0; k < 3; k++)
+			angles[i * 3 + k] = angle(rng);
+		for(int k = 0; k < 16; k++)
+			general[i * 16 + k] = value(rng);
+
+		float* m = &affine[i * 16];
+		eulerToMatrixScalar(&angles[i * 3], m, 1);
+		float s = scale(rng);
+		for(int k = 0; k < 12; k++)
+			m[k] *= s;
+		for(int k = 12; k < 15; k++)
+			m[k] = value(rng);
+	}
+
+	std::vector<float> refMultiply(count * 16);
+	std::vector<float> refTranspose(count * 16);
+	std::vector<float> refInverse(count * 16);
+	std::vector<float> refEuler(count * 16);
+	for(size_t i = 0; i < count; i++) {
+		multiplyScalar(&general[i * 16], &general[((i + 1) % count) * 16], &refMultiply[i * 16]);
+		transposeScalar(&general[i * 16], &refTranspose[i * 16]);
+		affineInverseScalar(&affine[i * 16], &refInverse[i * 16]);
+		auto rot = HelperFunctions::rotationMatrixFromEuler(Vector3(angles[i * 3],
+					angles[i * 3 + 1], angles[i * 3 + 2]));
+		memcpy(&refEuler[i * 16], rot.m, 16 * sizeof(float));
+	}
+
+	bool ok = true;
+	const ISA isas[] = { ISA::Scalar, ISA::SSE, ISA::AVX, ISA::NEON };
+	for(auto isa : isas) {
+		if(!isSupported(isa))
+			continue;
+
+		const KernelTable* k = getKernelTable(isa);
+		std::vector<float> result(count * 16);
+		unsigned int mismatches = 0;
+
+		if(isa != ISA::Scalar) {
+			for(size_t i = 0; i < count; i++) {
+				k->multiply(&general[i * 16], &general[((i + 1) % count) * 16], &result[i * 16]);
+			}
+			mismatches += memcmp(&result[0], &refMultiply[0], result.size() * sizeof(float)) != 0;
+
+			for(size_t i = 0; i < count; i++) {
+				k->transpose(&general[i * 16], &result[i * 16]);
+			}
+			mismatches += memcmp(&result[0], &refTranspose[0], result.size() * sizeof(float)) != 0;
+
+			for(size_t i = 0; i < count; i++) {
+				k->affineInverse(&affine[i * 16], &result[i * 16]);
+			}
+			mismatches += memcmp(&result[0], &refInverse[0], result.size() * sizeof(float)) != 0;
+		}
+
+		k->eulerToMatrix(&angles[0], &result[0], count);
+		float maxError = 0.0f;
+		for(size_t i = 0; i < result.size(); i++) {
+			maxError = std::max(maxError, std::fabs(result[i] - refEuler[i]));
+		}
+		mismatches += maxError > EulerTolerance;
+
+		os << getISAName(isa) << ": " << (mismatches ? "FAILED" : "ok")
+			<< " (Euler max error " << maxError << ")\n";
+		ok = ok && !mismatches;
+	}
+	return ok;
+}
+
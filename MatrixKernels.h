@@ -0,0 +1,40 @@
+#ifndef SCENE_MATRIXKERNELS_H
+#define SCENE_MATRIXKERNELS_H
+
+#include <cstddef>
+#include <ostream>
+
+/* 4x4 matrix kernels on row-major float[16] in the Matrix44 convention
+ * (points are row vectors, translation in m[12..14]). The SSE, AVX and
+ * NEON versions are picked at runtime from what the CPU supports; their
+ * multiply, transpose and affine inverse perform the same operations in
+ * the same order as the scalar ones and give identical results.
+ * eulerToMatrix uses a polynomial sincos and agrees with
+ * HelperFunctions::rotationMatrixFromEuler within EulerTolerance. */
+class MatrixKernels {
+	public:
+		enum class ISA {
+			Scalar,
+			SSE,
+			AVX,
+			NEON
+		};
+
+		static void multiply(const float* a, const float* b, float* out);
+		static void transpose(const float* a, float* out);
+		/* Inverse of a matrix whose last column is (0, 0, 0, 1). */
+		static void affineInverse(const float* a, float* out);
+		/* count rotation matrices from xyz Euler angle triples. */
+		static void eulerToMatrix(const float* angles, float* out, size_t count);
+
+		static ISA getISA();
+		static const char* getISAName(ISA isa);
+		static bool isSupported(ISA isa);
+		static bool setISA(ISA isa);
+		static bool validate(std::ostream& os);
+
+		static const float EulerTolerance;
+};
+
+#endif
+
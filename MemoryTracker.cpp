@@ -0,0 +1,310 @@
+#include "MemoryTracker.h"
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+
+static const int NumCategories = int(MemoryCategory::NumCategories);
+
+struct TrackedTexture {
+	MemoryCategory category;
+	int bytesPerPixel;
+	int width;
+	int height;
+	/* bytes by level */
+	std::map<int, size_t> levels;
+};
+
+static std::mutex gMutex;
+static MemoryStats gStats[NumCategories];
+static MemoryStats gCPUTotal;
+static MemoryStats gGPUTotal;
+static std::map<GLuint, std::pair<MemoryCategory, size_t>> gBuffers;
+static std::map<GLuint, TrackedTexture> gTextures;
+static std::map<GLuint, size_t> gRenderbuffers;
+static std::string gReportFile;
+
+MemoryStats::MemoryStats()
+	: current(0),
+	peak(0),
+	count(0)
+{
+}
+
+static void add(MemoryStats& s, size_t bytes, int count)
+{
+	s.current += bytes;
+	s.count += count;
+	s.peak = std::max(s.peak, s.current);
+}
+
+static void sub(MemoryStats& s, size_t bytes, int count)
+{
+	s.current -= std::min(s.current, bytes);
+	s.count -= std::min<unsigned int>(s.count, count);
+}
+
+/* must be called with gMutex held */
+static void change(MemoryCategory c, size_t added, size_t removed, int addedCount, int removedCount)
+{
+	MemoryStats& total = MemoryTracker::isGPUCategory(c) ? gGPUTotal : gCPUTotal;
+	sub(gStats[int(c)], removed, removedCount);
+	sub(total, removed, removedCount);
+	add(gStats[int(c)], added, addedCount);
+	add(total, added, addedCount);
+}
+
+const char* MemoryTracker::getCategoryName(MemoryCategory c)
+{
+	switch(c) {
+		case MemoryCategory::ModelData:
+			return "ModelData";
+		case MemoryCategory::AssimpScene:
+			return "AssimpScene";
+		case MemoryCategory::TextureMips:
+			return "TextureMips";
+		case MemoryCategory::VertexBuffers:
+			return "VertexBuffers";
+		case MemoryCategory::IndexBuffers:
+			return "IndexBuffers";
+		case MemoryCategory::StreamBuffers:
+			return "StreamBuffers";
+		case MemoryCategory::Textures:
+			return "Textures";
+		case MemoryCategory::RenderTargets:
+			return "RenderTargets";
+		case MemoryCategory::NumCategories:
+			break;
+	}
+	return "Unknown";
+}
+
+bool MemoryTracker::isGPUCategory(MemoryCategory c)
+{
+	return c >= MemoryCategory::VertexBuffers;
+}
+
+void MemoryTracker::allocate(MemoryCategory c, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	change(c, bytes, 0, 1, 0);
+}
+
+void MemoryTracker::release(MemoryCategory c, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	change(c, 0, bytes, 0, 1);
+}
+
+void MemoryTracker::setBufferSize(GLuint buffer, MemoryCategory c, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	auto it = gBuffers.find(buffer);
+	if(it != gBuffers.end()) {
+		change(it->second.first, 0, it->second.second, 0, 1);
+		gBuffers.erase(it);
+	}
+	change(c, bytes, 0, 1, 0);
+	gBuffers.insert({buffer, {c, bytes}});
+}
+
+void MemoryTracker::deleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	for(GLsizei i = 0; i < n; i++) {
+		auto it = gBuffers.find(buffers[i]);
+		if(it != gBuffers.end()) {
+			change(it->second.first, 0, it->second.second, 0, 1);
+			gBuffers.erase(it);
+		}
+	}
+}
+
+static void setLevel(TrackedTexture& t, int level, size_t bytes)
+{
+	auto it = t.levels.find(level);
+	if(it != t.levels.end()) {
+		change(t.category, 0, it->second, 0, 0);
+		t.levels.erase(it);
+	}
+	if(bytes) {
+		change(t.category, bytes, 0, 0, 0);
+		t.levels.insert({level, bytes});
+	}
+}
+
+void MemoryTracker::setTextureLevel(GLuint texture, int level, int width, int height,
+		int bytesPerPixel, MemoryCategory c)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	auto it = gTextures.find(texture);
+	if(it == gTextures.end()) {
+		TrackedTexture t;
+		t.category = c;
+		t.width = 0;
+		t.height = 0;
+		it = gTextures.insert({texture, t}).first;
+		change(c, 0, 0, 1, 0);
+	}
+
+	TrackedTexture& t = it->second;
+	t.bytesPerPixel = bytesPerPixel;
+	if(level == 0) {
+		t.width = width;
+		t.height = height;
+	}
+	setLevel(t, level, size_t(width) * height * bytesPerPixel);
+}
+
+void MemoryTracker::generateMipmaps(GLuint texture)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	auto it = gTextures.find(texture);
+	if(it == gTextures.end())
+		return;
+
+	TrackedTexture& t = it->second;
+	int w = t.width;
+	int h = t.height;
+	for(int level = 1; w > 1 || h > 1; level++) {
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+		setLevel(t, level, size_t(w) * h * t.bytesPerPixel);
+	}
+}
+
+void MemoryTracker::deleteTextures(GLsizei n, const GLuint* textures)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	for(GLsizei i = 0; i < n; i++) {
+		auto it = gTextures.find(textures[i]);
+		if(it == gTextures.end())
+			continue;
+		size_t bytes = 0;
+		for(auto& l : it->second.levels)
+			bytes += l.second;
+		change(it->second.category, 0, bytes, 0, 1);
+		gTextures.erase(it);
+	}
+}
+
+void MemoryTracker::setRenderbufferSize(GLuint renderbuffer, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	auto it = gRenderbuffers.find(renderbuffer);
+	if(it != gRenderbuffers.end()) {
+		change(MemoryCategory::RenderTargets, 0, it->second, 0, 1);
+		gRenderbuffers.erase(it);
+	}
+	change(MemoryCategory::RenderTargets, bytes, 0, 1, 0);
+	gRenderbuffers.insert({renderbuffer, bytes});
+}
+
+void MemoryTracker::deleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	for(GLsizei i = 0; i < n; i++) {
+		auto it = gRenderbuffers.find(renderbuffers[i]);
+		if(it != gRenderbuffers.end()) {
+			change(MemoryCategory::RenderTargets, 0, it->second, 0, 1);
+			gRenderbuffers.erase(it);
+		}
+	}
+}
+
+MemoryStats MemoryTracker::getStats(MemoryCategory c)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gStats[int(c)];
+}
+
+MemoryStats MemoryTracker::getCPUTotal()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gCPUTotal;
+}
+
+MemoryStats MemoryTracker::getGPUTotal()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	return gGPUTotal;
+}
+
+void MemoryTracker::resetPeaks()
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	for(auto& s : gStats)
+		s.peak = s.current;
+	gCPUTotal.peak = gCPUTotal.current;
+	gGPUTotal.peak = gGPUTotal.current;
+}
+
+void MemoryTracker::writeCSV(std::ostream& os)
+{
+	os << "category,type,current,peak,count\n";
+	for(int i = 0; i < NumCategories; i++) {
+		MemoryCategory c = MemoryCategory(i);
+		MemoryStats s = getStats(c);
+		os << getCategoryName(c) << "," << (isGPUCategory(c) ? "gpu" : "cpu") << ","
+			<< s.current << "," << s.peak << "," << s.count << "\n";
+	}
+	MemoryStats cpu = getCPUTotal();
+	MemoryStats gpu = getGPUTotal();
+	os << "Total,cpu," << cpu.current << "," << cpu.peak << "," << cpu.count << "\n";
+	os << "Total,gpu," << gpu.current << "," << gpu.peak << "," << gpu.count << "\n";
+}
+
+static void writeJSONStats(std::ostream& os, const MemoryStats& s)
+{
+	os << "{\"current\":" << s.current << ",\"peak\":" << s.peak
+		<< ",\"count\":" << s.count << "}";
+}
+
+void MemoryTracker::writeJSON(std::ostream& os)
+{
+	os << "{\n\"unit\":\"bytes\",\n\"categories\":{\n";
+	for(int i = 0; i < NumCategories; i++) {
+		MemoryCategory c = MemoryCategory(i);
+		os << (i ? ",\n" : "") << "\"" << getCategoryName(c) << "\":{\"type\":\""
+			<< (isGPUCategory(c) ? "gpu" : "cpu") << "\",\"stats\":";
+		writeJSONStats(os, getStats(c));
+		os << "}";
+	}
+	os << "\n},\n\"cpu\":";
+	writeJSONStats(os, getCPUTotal());
+	os << ",\n\"gpu\":";
+	writeJSONStats(os, getGPUTotal());
+	os << "\n}\n";
+}
+
+bool MemoryTracker::writeReport(const std::string& filename)
+{
+	std::ofstream out(filename.c_str());
+	if(!out.is_open()) {
+		std::cerr << "Unable to open " << filename << " for writing.\n";
+		return false;
+	}
+	bool json = filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+	if(json)
+		writeJSON(out);
+	else
+		writeCSV(out);
+	return bool(out);
+}
+
+static void writeReportAtExit()
+{
+	if(MemoryTracker::writeReport(gReportFile))
+		std::cout << "Wrote memory report to " << gReportFile << "\n";
+}
+
+void MemoryTracker::setReportAtExit(const std::string& filename)
+{
+	if(gReportFile.empty())
+		atexit(writeReportAtExit);
+	gReportFile = filename;
+}
+
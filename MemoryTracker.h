@@ -0,0 +1,73 @@
+#ifndef SCENE_MEMORYTRACKER_H
+#define SCENE_MEMORYTRACKER_H
+
+#include <string>
+#include <ostream>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+enum class MemoryCategory {
+	/* CPU heap */
+	ModelData,
+	AssimpScene,
+	TextureMips,
+	/* GPU, from the upload sizes */
+	VertexBuffers,
+	IndexBuffers,
+	StreamBuffers,
+	Textures,
+	RenderTargets,
+	NumCategories
+};
+
+struct MemoryStats {
+	MemoryStats();
+	size_t current;
+	size_t peak;
+	/* live allocations or GL objects */
+	unsigned int count;
+};
+
+/* Memory accounting by category. CPU memory is tagged by the code that
+ * holds it; GPU memory is tracked per buffer, texture level and
+ * renderbuffer, so respecifying an object replaces its old size and
+ * deleting it releases it. Totals have their own high-water marks. All
+ * functions may be called from any thread. */
+class MemoryTracker {
+	public:
+		static const char* getCategoryName(MemoryCategory c);
+		static bool isGPUCategory(MemoryCategory c);
+
+		static void allocate(MemoryCategory c, size_t bytes);
+		static void release(MemoryCategory c, size_t bytes);
+
+		static void setBufferSize(GLuint buffer, MemoryCategory c, size_t bytes);
+		static void deleteBuffers(GLsizei n, const GLuint* buffers);
+		/* A level of 0x0 releases it. */
+		static void setTextureLevel(GLuint texture, int level, int width, int height,
+				int bytesPerPixel, MemoryCategory c = MemoryCategory::Textures);
+		/* Adds the levels glGenerateMipmap creates from level 0. */
+		static void generateMipmaps(GLuint texture);
+		static void deleteTextures(GLsizei n, const GLuint* textures);
+		static void setRenderbufferSize(GLuint renderbuffer, size_t bytes);
+		static void deleteRenderbuffers(GLsizei n, const GLuint* renderbuffers);
+
+		static MemoryStats getStats(MemoryCategory c);
+		static MemoryStats getCPUTotal();
+		static MemoryStats getGPUTotal();
+		/* Sets the high-water marks of the categories and totals to
+		 * what is in use now, e.g. between benchmark runs. Reports
+		 * show the peaks since the last reset. */
+		static void resetPeaks();
+
+		/* One row per category and one per total, in bytes. */
+		static void writeCSV(std::ostream& os);
+		static void writeJSON(std::ostream& os);
+		/* JSON if the file name ends in .json, CSV otherwise. */
+		static bool writeReport(const std::string& filename);
+		static void setReportAtExit(const std::string& filename);
+};
+
+#endif
+
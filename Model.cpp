@@ -2,13 +2,44 @@
 
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
 
-#include "HelperFunctions.h"
+#include "AssetPack.h"
+#include "MemoryTracker.h"
 
 using namespace Common;
 
+/* An estimate of what the importer keeps: the vertex streams and faces
+ * of every mesh. */
+static size_t sceneBytes(const aiScene* scene)
+{
+	size_t bytes = sizeof(aiScene);
+	for(unsigned int i = 0; i < scene->mNumMeshes; i++) {
+		const aiMesh* mesh = scene->mMeshes[i];
+		size_t streams = 1 + mesh->HasNormals() + 2 * mesh->HasTangentsAndBitangents() +
+			mesh->GetNumUVChannels() + mesh->GetNumColorChannels();
+		bytes += sizeof(aiMesh) + mesh->mNumVertices * sizeof(aiVector3D) * streams;
+		for(unsigned int j = 0; j < mesh->mNumFaces; j++)
+			bytes += sizeof(aiFace) + mesh->mFaces[j].mNumIndices * sizeof(unsigned int);
+	}
+	return bytes;
+}
+
 Model::Model(const std::string& filename)
+	: mBoundingRadius(0.0f),
+	mDataBytes(0),
+	mSceneBytes(0),
+	mScene(nullptr)
 {
+	AssetPack* pack = AssetPack::getCurrent();
+	const AssetPackFormat::Entry* e = pack ? pack->find(filename, AssetPackFormat::AssetMesh) : nullptr;
+	if(e) {
+		loadCooked(*pack, *e);
+		mDataBytes = dataBytes();
+		MemoryTracker::allocate(MemoryCategory::ModelData, mDataBytes);
+		return;
+	}
+
 	mScene = mImporter.ReadFile(filename,
 			aiProcess_CalcTangentSpace |
 			aiProcess_Triangulate |
@@ -37,6 +68,8 @@ Model::Model(const std::string& filename)
 		mVertexCoords.push_back(vertex.x);
 		mVertexCoords.push_back(vertex.y);
 		mVertexCoords.push_back(vertex.z);
+		mBoundingRadius = std::max(mBoundingRadius,
+				Vector3(vertex.x, vertex.y, vertex.z).length());
 
 		const aiVector3D& texcoord = mesh->mTextureCoords[0][i];
 		mTexCoords.push_back(texcoord.x);
@@ -61,6 +94,43 @@ Model::Model(const std::string& filename)
 			}
 		}
 	}
+
+	mDataBytes = dataBytes();
+	mSceneBytes = sceneBytes(mScene);
+	MemoryTracker::allocate(MemoryCategory::ModelData, mDataBytes);
+	MemoryTracker::allocate(MemoryCategory::AssimpScene, mSceneBytes);
+}
+
+Model::~Model()
+{
+	MemoryTracker::release(MemoryCategory::ModelData, mDataBytes);
+	if(mScene)
+		MemoryTracker::release(MemoryCategory::AssimpScene, mSceneBytes);
+}
+
+size_t Model::dataBytes() const
+{
+	return (mVertexCoords.capacity() + mTexCoords.capacity() + mNormals.capacity()) * sizeof(GLfloat) +
+		mIndices.capacity() * sizeof(GLushort);
+}
+
+/* The cooked arrays are already in the layout of the vectors, so this
+ * is one copy per array and no parsing. */
+void Model::loadCooked(const AssetPack& pack, const AssetPackFormat::Entry& e)
+{
+	const AssetPackFormat::MeshHeader& h = pack.getMesh(e);
+	const unsigned char* blob = pack.getData(e);
+	const GLfloat* vertices = reinterpret_cast<const GLfloat*>(blob + h.vertexOffset);
+	const GLfloat* texcoords = reinterpret_cast<const GLfloat*>(blob + h.texCoordOffset);
+	const GLushort* indices = reinterpret_cast<const GLushort*>(blob + h.indexOffset);
+	mVertexCoords.assign(vertices, vertices + h.vertexCount * 3);
+	mTexCoords.assign(texcoords, texcoords + h.vertexCount * 2);
+	if(h.hasNormals) {
+		const GLfloat* normals = reinterpret_cast<const GLfloat*>(blob + h.normalOffset);
+		mNormals.assign(normals, normals + h.vertexCount * 3);
+	}
+	mIndices.assign(indices, indices + h.indexCount);
+	mBoundingRadius = h.boundingRadius;
 }
 
 const std::vector<GLfloat>& Model::getVertexCoords() const
@@ -73,7 +143,7 @@ const std::vector<GLfloat>& Model::getTexCoords() const
 	return mTexCoords;
 }
 
-const std::vector<GLushort> Model::getIndices() const
+const std::vector<GLushort>& Model::getIndices() const
 {
 	return mIndices;
 }
@@ -83,18 +153,26 @@ const std::vector<GLfloat>& Model::getNormals() const
 	return mNormals;
 }
 
+float Model::getBoundingRadius() const
+{
+	return mBoundingRadius;
+}
+
 Movable::Movable()
+	: mDirty(true)
 {
 }
 
 Movable::Movable(const Common::Vector3& pos)
-	: mPosition(pos)
+	: mPosition(pos),
+	mDirty(true)
 {
 }
 
 void Movable::setPosition(const Common::Vector3& p)
 {
 	mPosition = p;
+	mDirty = true;
 }
 
 const Common::Vector3& Movable::getPosition() const
@@ -105,27 +183,73 @@ const Common::Vector3& Movable::getPosition() const
 void Movable::move(const Common::Vector3& v)
 {
 	mPosition += v;
+	mDirty = true;
+}
+
+bool Movable::isDirty() const
+{
+	return mDirty;
+}
+
+void Movable::clearDirty()
+{
+	mDirty = false;
 }
 
 
 MeshInstance::MeshInstance(const Model& m)
-	: mModel(m)
+	: mModel(m),
+	mScale(1.0f),
+	mStatic(false)
 {
 }
 
-const Matrix44& MeshInstance::getRotation() const
+const Quaternion& MeshInstance::getOrientation() const
 {
-	return mRotation;
+	return mOrientation;
+}
+
+void MeshInstance::setOrientation(const Quaternion& q)
+{
+	mOrientation = q;
+	mDirty = true;
 }
 
 void MeshInstance::setRotationFromEuler(const Vector3& v)
 {
-	mRotation = HelperFunctions::rotationMatrixFromEuler(v);
+	mOrientation = Quaternion::fromEuler(v);
+	mDirty = true;
+}
+
+void MeshInstance::rotate(const Quaternion& q)
+{
+	mOrientation = (q * mOrientation).normalized();
+	mDirty = true;
+}
+
+float MeshInstance::getScale() const
+{
+	return mScale;
+}
+
+void MeshInstance::setScale(float s)
+{
+	mScale = s;
+	mDirty = true;
 }
 
-void MeshInstance::setRotation(const Matrix44& m)
+/* The scaled rotation with the position as the last row, i.e.
+ * scale * rotation * translation. */
+void MeshInstance::getModelMatrix(float* m) const
 {
-	mRotation = m;
+	mOrientation.toMatrix(m, mScale);
+	m[3] = 0.0f;
+	m[7] = 0.0f;
+	m[11] = 0.0f;
+	m[12] = mPosition.x;
+	m[13] = mPosition.y;
+	m[14] = mPosition.z;
+	m[15] = 1.0f;
 }
 
 const Model& MeshInstance::getModel() const
@@ -133,4 +257,15 @@ const Model& MeshInstance::getModel() const
 	return mModel;
 }
 
+void MeshInstance::setStatic(bool s)
+{
+	mStatic = s;
+	mDirty = true;
+}
+
+bool MeshInstance::isStatic() const
+{
+	return mStatic;
+}
+
 
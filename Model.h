@@ -13,19 +13,40 @@
 #include "libcommon/Vector3.h"
 #include "libcommon/Matrix44.h"
 
+#include "Quaternion.h"
+
+class AssetPack;
+namespace AssetPackFormat {
+struct Entry;
+}
+
+/* Loaded from the current asset pack if it has the file, otherwise
+ * from the file itself. */
 class Model {
 	public:
 		Model(const std::string& filename);
+		~Model();
 		const std::vector<GLfloat>& getVertexCoords() const;
 		const std::vector<GLfloat>& getTexCoords() const;
-		const std::vector<GLushort> getIndices() const;
+		const std::vector<GLushort>& getIndices() const;
 		const std::vector<GLfloat>& getNormals() const;
+		float getBoundingRadius() const;
 
 	private:
+		Model(const Model&) = delete;
+		Model& operator=(const Model&) = delete;
+
+		void loadCooked(const AssetPack& pack, const AssetPackFormat::Entry& e);
+		size_t dataBytes() const;
+
 		std::vector<GLfloat> mVertexCoords;
 		std::vector<GLfloat> mTexCoords;
 		std::vector<GLushort> mIndices;
 		std::vector<GLfloat> mNormals;
+		float mBoundingRadius;
+		/* as reported to the MemoryTracker */
+		size_t mDataBytes;
+		size_t mSceneBytes;
 
 		Assimp::Importer mImporter;
 		const aiScene* mScene;
@@ -38,22 +59,38 @@ class Movable {
 		void setPosition(const Common::Vector3& p);
 		const Common::Vector3& getPosition() const;
 		void move(const Common::Vector3& v);
+		bool isDirty() const;
+		void clearDirty();
 
 	protected:
 		Common::Vector3 mPosition;
+		/* set by anything that changes what is drawn */
+		bool mDirty;
 };
 
+/* The transform is kept as a unit quaternion, the position and a
+ * uniform scale; the matrix is only built for drawing. */
 class MeshInstance : public Movable {
 	public:
 		MeshInstance(const Model& m);
-		const Common::Matrix44& getRotation() const;
+		const Quaternion& getOrientation() const;
+		void setOrientation(const Quaternion& q);
 		void setRotationFromEuler(const Common::Vector3& v);
-		void setRotation(const Common::Matrix44& m);
+		void rotate(const Quaternion& q);
+		float getScale() const;
+		void setScale(float s);
+		void getModelMatrix(float* m) const;
 		const Model& getModel() const;
+		/* Static instances are merged with others by
+		 * Scene::bakeStaticGeometry. */
+		void setStatic(bool s);
+		bool isStatic() const;
 
 	private:
 		const Model& mModel;
-		Common::Matrix44 mRotation;
+		Quaternion mOrientation;
+		float mScale;
+		bool mStatic;
 };
 
 
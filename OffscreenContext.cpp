@@ -0,0 +1,100 @@
+#include "OffscreenContext.h"
+
+#include <iostream>
+#include <stdexcept>
+
+#include <EGL/eglext.h>
+
+static EGLDisplay getDisplay()
+{
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+		return display;
+
+	/* without a window system, try Mesa's surfaceless platform */
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+			eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if(getPlatformDisplay) {
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if(display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+			return display;
+	}
+
+	return EGL_NO_DISPLAY;
+}
+
+OffscreenContext::OffscreenContext(int width, int height)
+	: mDisplay(EGL_NO_DISPLAY),
+	mSurface(EGL_NO_SURFACE),
+	mContext(EGL_NO_CONTEXT),
+	mWidth(width),
+	mHeight(height)
+{
+	mDisplay = getDisplay();
+	if(mDisplay == EGL_NO_DISPLAY) {
+		std::cerr << "Unable to initialise EGL.\n";
+		throw std::runtime_error("Error creating offscreen context");
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if(!eglChooseConfig(mDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+		std::cerr << "No suitable EGL config found.\n";
+		eglTerminate(mDisplay);
+		throw std::runtime_error("Error creating offscreen context");
+	}
+
+	const EGLint surfaceAttribs[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE
+	};
+
+	mSurface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+	if(mSurface == EGL_NO_SURFACE) {
+		std::cerr << "Unable to create pbuffer surface: 0x" << std::hex << eglGetError() << std::dec << "\n";
+		eglTerminate(mDisplay);
+		throw std::runtime_error("Error creating offscreen context");
+	}
+
+	eglBindAPI(EGL_OPENGL_API);
+	mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, NULL);
+	if(mContext == EGL_NO_CONTEXT || !eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+		std::cerr << "Unable to create OpenGL context: 0x" << std::hex << eglGetError() << std::dec << "\n";
+		if(mContext != EGL_NO_CONTEXT)
+			eglDestroyContext(mDisplay, mContext);
+		eglDestroySurface(mDisplay, mSurface);
+		eglTerminate(mDisplay);
+		throw std::runtime_error("Error creating offscreen context");
+	}
+}
+
+OffscreenContext::~OffscreenContext()
+{
+	eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(mDisplay, mContext);
+	eglDestroySurface(mDisplay, mSurface);
+	eglTerminate(mDisplay);
+}
+
+int OffscreenContext::getWidth() const
+{
+	return mWidth;
+}
+
+int OffscreenContext::getHeight() const
+{
+	return mHeight;
+}
+
@@ -0,0 +1,25 @@
+#ifndef SCENE_OFFSCREENCONTEXT_H
+#define SCENE_OFFSCREENCONTEXT_H
+
+#include <EGL/egl.h>
+
+/* OpenGL context rendering to an EGL pbuffer, for running without a
+ * display, e.g. on Mesa llvmpipe. The context is current on the
+ * creating thread for its lifetime. */
+class OffscreenContext {
+	public:
+		OffscreenContext(int width, int height);
+		~OffscreenContext();
+		int getWidth() const;
+		int getHeight() const;
+
+	private:
+		EGLDisplay mDisplay;
+		EGLSurface mSurface;
+		EGLContext mContext;
+		int mWidth;
+		int mHeight;
+};
+
+#endif
+
@@ -0,0 +1,241 @@
+#include "Profiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "JSON.h"
+
+/* Events kept per thread; older ones are overwritten. */
+static const size_t EventsPerThread = 65536;
+
+/* Frames to wait before reading back a GPU timer query, so that
+ * reading it never stalls the pipeline. */
+static const unsigned int GPUReadbackLatency = 2;
+
+struct ProfileEvent {
+	const char* name;
+	double start;
+	double end;
+};
+
+struct ThreadEvents {
+	ThreadEvents(unsigned int id);
+	std::vector<ProfileEvent> events;
+	std::atomic<size_t> written;
+	unsigned int id;
+	std::string name;
+};
+
+ThreadEvents::ThreadEvents(unsigned int id_)
+	: events(EventsPerThread),
+	written(0),
+	id(id_)
+{
+}
+
+struct GPUQuery {
+	GLuint query;
+	const char* name;
+	double start;
+	unsigned int frame;
+};
+
+static std::atomic<bool> gEnabled(false);
+
+static std::mutex gThreadsMutex;
+static std::vector<std::unique_ptr<ThreadEvents>> gThreads;
+static thread_local ThreadEvents* tEvents = nullptr;
+
+/* GPU scopes are only used on the GL thread, so these need no locking. */
+static ThreadEvents* gGPUEvents = nullptr;
+static int gTimerQuerySupported = -1;
+static unsigned int gGPUDepth = 0;
+static bool gGPUQueryActive = false;
+static std::vector<GLuint> gFreeQueries;
+static std::deque<GPUQuery> gPendingQueries;
+static unsigned int gFrame = 0;
+static double gFrameStart = 0.0;
+
+static ThreadEvents* registerThread(const char* name)
+{
+	std::lock_guard<std::mutex> lock(gThreadsMutex);
+	ThreadEvents* te = new ThreadEvents(gThreads.size());
+	if(name) {
+		te->name = name;
+	} else {
+		std::ostringstream ss;
+		ss << "Thread " << te->id;
+		te->name = ss.str();
+	}
+	gThreads.push_back(std::unique_ptr<ThreadEvents>(te));
+	return te;
+}
+
+static void append(ThreadEvents* te, const char* name, double start, double end)
+{
+	size_t n = te->written.load(std::memory_order_relaxed);
+	ProfileEvent& ev = te->events[n % EventsPerThread];
+	ev.name = name;
+	ev.start = start;
+	ev.end = end;
+	te->written.store(n + 1, std::memory_order_release);
+}
+
+void Profiler::setEnabled(bool on)
+{
+	gEnabled.store(on, std::memory_order_relaxed);
+}
+
+bool Profiler::isEnabled()
+{
+	return gEnabled.load(std::memory_order_relaxed);
+}
+
+double Profiler::now()
+{
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::duration<double>>(t).count();
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	if(!tEvents) {
+		tEvents = registerThread(name);
+	} else {
+		std::lock_guard<std::mutex> lock(gThreadsMutex);
+		tEvents->name = name;
+	}
+}
+
+void Profiler::record(const char* name, double start, double end)
+{
+	if(!tEvents)
+		tEvents = registerThread(nullptr);
+	append(tEvents, name, start, end);
+}
+
+void Profiler::beginGPUScope(const char* name)
+{
+	if(gGPUDepth++ || !isEnabled())
+		return;
+
+	if(gTimerQuerySupported == -1) {
+		gTimerQuerySupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		if(!gTimerQuerySupported)
+			std::cerr << "Timer queries not supported, GPU scopes disabled.\n";
+	}
+	if(!gTimerQuerySupported)
+		return;
+
+	GPUQuery q;
+	if(gFreeQueries.empty()) {
+		glGenQueries(1, &q.query);
+	} else {
+		q.query = gFreeQueries.back();
+		gFreeQueries.pop_back();
+	}
+	q.name = name;
+	q.start = now();
+	q.frame = gFrame;
+	gPendingQueries.push_back(q);
+
+	glBeginQuery(GL_TIME_ELAPSED, q.query);
+	gGPUQueryActive = true;
+}
+
+void Profiler::endGPUScope()
+{
+	if(--gGPUDepth == 0 && gGPUQueryActive) {
+		glEndQuery(GL_TIME_ELAPSED);
+		gGPUQueryActive = false;
+	}
+}
+
+void Profiler::endFrame()
+{
+	double t = now();
+	if(isEnabled() && gFrameStart != 0.0)
+		record("Frame", gFrameStart, t);
+	gFrameStart = t;
+	gFrame++;
+
+	while(!gPendingQueries.empty()) {
+		const GPUQuery& q = gPendingQueries.front();
+		if(q.frame + GPUReadbackLatency > gFrame)
+			break;
+
+		GLint available = 0;
+		glGetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available)
+			break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+		if(!gGPUEvents)
+			gGPUEvents = registerThread("GPU");
+		/* GL_TIME_ELAPSED gives no start time; place the event where
+		 * the CPU issued it. */
+		append(gGPUEvents, q.name, q.start, q.start + elapsed * 1.0e-9);
+
+		gFreeQueries.push_back(q.query);
+		gPendingQueries.pop_front();
+	}
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename)
+{
+	std::ofstream out(filename.c_str());
+	if(!out.is_open()) {
+		std::cerr << "Unable to open " << filename << " for writing.\n";
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(gThreadsMutex);
+
+	double origin = 0.0;
+	for(auto& te : gThreads) {
+		size_t written = te->written.load(std::memory_order_acquire);
+		size_t first = written > EventsPerThread ? written - EventsPerThread : 0;
+		for(size_t i = first; i < written; i++) {
+			double start = te->events[i % EventsPerThread].start;
+			if(origin == 0.0 || start < origin)
+				origin = start;
+		}
+	}
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for(auto& te : gThreads) {
+		out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"pid\":0,\"tid\":" << te->id
+			<< ",\"name\":\"thread_name\",\"args\":{\"name\":";
+		writeJSONString(out, te->name);
+		out << "}}";
+		first = false;
+
+		size_t written = te->written.load(std::memory_order_acquire);
+		size_t begin = written > EventsPerThread ? written - EventsPerThread : 0;
+		for(size_t i = begin; i < written; i++) {
+			const ProfileEvent& ev = te->events[i % EventsPerThread];
+			out << ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":" << te->id << ",\"name\":";
+			writeJSONString(out, ev.name);
+			out << ",\"ts\":" << (ev.start - origin) * 1.0e6
+				<< ",\"dur\":" << (ev.end - ev.start) * 1.0e6 << "}";
+		}
+	}
+	out << "\n]}\n";
+
+	return true;
+}
+
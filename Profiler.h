@@ -0,0 +1,68 @@
+#ifndef SCENE_PROFILER_H
+#define SCENE_PROFILER_H
+
+#include <string>
+
+/* Frame profiler. CPU scopes are appended to a ring buffer owned by the
+ * recording thread, so recording takes no locks; only the first event
+ * of a thread registers its buffer. GPU scopes are GL_TIME_ELAPSED
+ * queries that are read back GPUReadbackLatency frames later, and may
+ * not nest. Nothing is recorded until the profiler is enabled. */
+class Profiler {
+	public:
+		static void setEnabled(bool on);
+		static bool isEnabled();
+		static double now();
+		static void setThreadName(const char* name);
+		static void record(const char* name, double start, double end);
+		static void beginGPUScope(const char* name);
+		static void endGPUScope();
+		static void endFrame();
+		static bool writeChromeTrace(const std::string& filename);
+};
+
+class ProfileScope {
+	public:
+		ProfileScope(const char* name);
+		~ProfileScope();
+
+	private:
+		const char* mName;
+		double mStart;
+};
+
+class GPUProfileScope {
+	public:
+		GPUProfileScope(const char* name);
+		~GPUProfileScope();
+};
+
+inline ProfileScope::ProfileScope(const char* name)
+	: mName(name),
+	mStart(Profiler::isEnabled() ? Profiler::now() : 0.0)
+{
+}
+
+inline ProfileScope::~ProfileScope()
+{
+	if(mStart != 0.0)
+		Profiler::record(mName, mStart, Profiler::now());
+}
+
+inline GPUProfileScope::GPUProfileScope(const char* name)
+{
+	Profiler::beginGPUScope(name);
+}
+
+inline GPUProfileScope::~GPUProfileScope()
+{
+	Profiler::endGPUScope();
+}
+
+#define PROFILE_CONCAT2(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GPUProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+#endif
+
@@ -0,0 +1,140 @@
+#include "Quaternion.h"
+
+#include <cmath>
+
+using namespace Common;
+
+Quaternion::Quaternion()
+	: w(1.0f),
+	x(0.0f),
+	y(0.0f),
+	z(0.0f)
+{
+}
+
+Quaternion::Quaternion(float w_, float x_, float y_, float z_)
+	: w(w_),
+	x(x_),
+	y(y_),
+	z(z_)
+{
+}
+
+Quaternion Quaternion::fromAxisAngle(const Vector3& axis, float angle)
+{
+	Vector3 a = axis.normalized();
+	float s = sin(angle * 0.5f);
+	return Quaternion(cos(angle * 0.5f), a.x * s, a.y * s, a.z * s);
+}
+
+Quaternion Quaternion::fromEuler(const Vector3& v)
+{
+	/* rotation about x, then y, then z */
+	float cx = cos(v.x * 0.5f);
+	float cy = cos(v.y * 0.5f);
+	float cz = cos(v.z * 0.5f);
+	float sx = sin(v.x * 0.5f);
+	float sy = sin(v.y * 0.5f);
+	float sz = sin(v.z * 0.5f);
+
+	return Quaternion(cx * cy * cz + sx * sy * sz,
+			sx * cy * cz - cx * sy * sz,
+			cx * sy * cz + sx * cy * sz,
+			cx * cy * sz - sx * sy * cz);
+}
+
+Quaternion Quaternion::slerp(const Quaternion& a, const Quaternion& b, float t)
+{
+	/* take the shorter way round */
+	Quaternion e(b);
+	float d = a.dot(b);
+	if(d < 0.0f) {
+		e = Quaternion(-b.w, -b.x, -b.y, -b.z);
+		d = -d;
+	}
+
+	float ka;
+	float kb;
+	if(d > 0.9995f) {
+		/* nearly parallel, interpolate linearly */
+		ka = 1.0f - t;
+		kb = t;
+	} else {
+		float theta = acos(d);
+		float s = sin(theta);
+		ka = sin((1.0f - t) * theta) / s;
+		kb = sin(t * theta) / s;
+	}
+
+	return Quaternion(a.w * ka + e.w * kb,
+			a.x * ka + e.x * kb,
+			a.y * ka + e.y * kb,
+			a.z * ka + e.z * kb).normalized();
+}
+
+Quaternion Quaternion::operator*(const Quaternion& q) const
+{
+	return Quaternion(w * q.w - x * q.x - y * q.y - z * q.z,
+			w * q.x + x * q.w + y * q.z - z * q.y,
+			w * q.y - x * q.z + y * q.w + z * q.x,
+			w * q.z + x * q.y - y * q.x + z * q.w);
+}
+
+float Quaternion::dot(const Quaternion& q) const
+{
+	return w * q.w + x * q.x + y * q.y + z * q.z;
+}
+
+Quaternion Quaternion::conjugate() const
+{
+	return Quaternion(w, -x, -y, -z);
+}
+
+Quaternion Quaternion::normalized() const
+{
+	float len = sqrt(dot(*this));
+	if(len == 0.0f)
+		return Quaternion();
+	float inv = 1.0f / len;
+	return Quaternion(w * inv, x * inv, y * inv, z * inv);
+}
+
+Vector3 Quaternion::rotate(const Vector3& v) const
+{
+	/* v + 2w(u x v) + 2u x (u x v) */
+	Vector3 u(x, y, z);
+	Vector3 t = u.cross(v) * 2.0f;
+	return v + t * w + u.cross(t);
+}
+
+void Quaternion::toMatrix(float* m, float scale) const
+{
+	float xx = x * x;
+	float yy = y * y;
+	float zz = z * z;
+	float xy = x * y;
+	float xz = x * z;
+	float yz = y * z;
+	float wx = w * x;
+	float wy = w * y;
+	float wz = w * z;
+
+	/* transpose of the usual column vector matrix */
+	m[0 * 4 + 0] = (1.0f - 2.0f * (yy + zz)) * scale;
+	m[0 * 4 + 1] = 2.0f * (xy + wz) * scale;
+	m[0 * 4 + 2] = 2.0f * (xz - wy) * scale;
+	m[1 * 4 + 0] = 2.0f * (xy - wz) * scale;
+	m[1 * 4 + 1] = (1.0f - 2.0f * (xx + zz)) * scale;
+	m[1 * 4 + 2] = 2.0f * (yz + wx) * scale;
+	m[2 * 4 + 0] = 2.0f * (xz + wy) * scale;
+	m[2 * 4 + 1] = 2.0f * (yz - wx) * scale;
+	m[2 * 4 + 2] = (1.0f - 2.0f * (xx + yy)) * scale;
+}
+
+Matrix44 Quaternion::toMatrix44() const
+{
+	Matrix44 m = Matrix44::Identity;
+	toMatrix(m.m);
+	return m;
+}
+
@@ -0,0 +1,36 @@
+#ifndef SCENE_QUATERNION_H
+#define SCENE_QUATERNION_H
+
+#include "libcommon/Vector3.h"
+#include "libcommon/Matrix44.h"
+
+/* Rotation as a unit quaternion. a * b rotates by b first and then by
+ * a, i.e. it corresponds to the matrix product
+ * b.toMatrix() * a.toMatrix() in the row vector convention of
+ * Matrix44. */
+class Quaternion {
+	public:
+		Quaternion();
+		Quaternion(float w_, float x_, float y_, float z_);
+		static Quaternion fromAxisAngle(const Common::Vector3& axis, float angle);
+		/* Same rotation as HelperFunctions::rotationMatrixFromEuler. */
+		static Quaternion fromEuler(const Common::Vector3& v);
+		static Quaternion slerp(const Quaternion& a, const Quaternion& b, float t);
+		Quaternion operator*(const Quaternion& q) const;
+		float dot(const Quaternion& q) const;
+		Quaternion conjugate() const;
+		Quaternion normalized() const;
+		Common::Vector3 rotate(const Common::Vector3& v) const;
+		/* Writes the rotation, scaled by scale, into the upper 3x3 of
+		 * the row-major 4x4 m; the rest of m is left untouched. */
+		void toMatrix(float* m, float scale = 1.0f) const;
+		Common::Matrix44 toMatrix44() const;
+
+		float w;
+		float x;
+		float y;
+		float z;
+};
+
+#endif
+
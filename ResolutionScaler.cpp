@@ -0,0 +1,241 @@
+#include "ResolutionScaler.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryTracker.h"
+
+namespace Scene {
+
+/* Frames averaged before each scale decision. */
+static const unsigned int SampleFrames = 8;
+
+/* The scale is left alone while the GPU time is between this fraction
+ * of the target and the target. */
+static const double LowerBand = 0.8;
+
+/* Largest and smallest change of the scale in one step. */
+static const float MaxScaleStep = 0.1f;
+static const float MinScaleStep = 0.02f;
+
+ResolutionScalerStats::ResolutionScalerStats()
+	: scale(1.0f),
+	width(0),
+	height(0),
+	gpuTime(0.0),
+	scaleChanges(0)
+{
+}
+
+bool ResolutionScaler::isSupported()
+{
+	return (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) &&
+		(GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+}
+
+ResolutionScaler::ResolutionScaler(int width, int height)
+	: mWidth(width),
+	mHeight(height),
+	mFramebuffer(0),
+	mColorTexture(0),
+	mDepthBuffer(0),
+	mTargetFramebuffer(0),
+	mQueryFrame(0),
+	mTargetFrameTime(1.0 / 60.0),
+	mMinScale(0.5f),
+	mMaxScale(1.0f),
+	mSampleSum(0.0),
+	mSamples(0)
+{
+	glGenTextures(1, &mColorTexture);
+	glBindTexture(GL_TEXTURE_2D, mColorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	MemoryTracker::setTextureLevel(mColorTexture, 0, width, height, 4, MemoryCategory::RenderTargets);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &mDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	/* 24 bit depth is stored in 32 bits */
+	MemoryTracker::setRenderbufferSize(mDepthBuffer, size_t(width) * height * 4);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if(status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Incomplete framebuffer for dynamic resolution: " << status << "\n";
+		glDeleteFramebuffers(1, &mFramebuffer);
+		glDeleteRenderbuffers(1, &mDepthBuffer);
+		glDeleteTextures(1, &mColorTexture);
+		MemoryTracker::deleteRenderbuffers(1, &mDepthBuffer);
+		MemoryTracker::deleteTextures(1, &mColorTexture);
+		throw std::runtime_error("Error creating framebuffer");
+	}
+
+	glGenQueries(QueryFrames * 2, &mQueries[0][0]);
+	for(int i = 0; i < QueryFrames; i++) {
+		mQueryScale[i] = 1.0f;
+		mQueryPending[i] = false;
+	}
+
+	mStats.width = width;
+	mStats.height = height;
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+	glDeleteQueries(QueryFrames * 2, &mQueries[0][0]);
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteRenderbuffers(1, &mDepthBuffer);
+	glDeleteTextures(1, &mColorTexture);
+	MemoryTracker::deleteRenderbuffers(1, &mDepthBuffer);
+	MemoryTracker::deleteTextures(1, &mColorTexture);
+}
+
+void ResolutionScaler::setTargetFrameTime(double seconds)
+{
+	mTargetFrameTime = seconds;
+	mSampleSum = 0.0;
+	mSamples = 0;
+}
+
+double ResolutionScaler::getTargetFrameTime() const
+{
+	return mTargetFrameTime;
+}
+
+void ResolutionScaler::setScaleRange(float minScale, float maxScale)
+{
+	mMinScale = std::max(0.1f, minScale);
+	mMaxScale = std::min(1.0f, std::max(mMinScale, maxScale));
+	updateScale(-1.0);
+}
+
+void ResolutionScaler::beginFrame()
+{
+	readQueries();
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &mTargetFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mStats.width, mStats.height);
+	glScissor(0, 0, mStats.width, mStats.height);
+	glEnable(GL_SCISSOR_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	glQueryCounter(mQueries[mQueryFrame][0], GL_TIMESTAMP);
+}
+
+void ResolutionScaler::endFrame()
+{
+	int w = mStats.width;
+	int h = mStats.height;
+
+	/* The bilinear blit also samples the texels just right of and above
+	 * the rendered region. Copy the last column and row there so that
+	 * the edges are clamped instead of blended with stale texels. */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mFramebuffer);
+	if(w < mWidth)
+		glBlitFramebuffer(w - 1, 0, w, h, w, 0, w + 1, h,
+				GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	if(h < mHeight)
+		glBlitFramebuffer(0, h - 1, std::min(w + 1, mWidth), h,
+				0, h, std::min(w + 1, mWidth), h + 1,
+				GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mTargetFramebuffer);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, mWidth, mHeight,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, mTargetFramebuffer);
+	glViewport(0, 0, mWidth, mHeight);
+
+	glQueryCounter(mQueries[mQueryFrame][1], GL_TIMESTAMP);
+	mQueryScale[mQueryFrame] = mStats.scale;
+	mQueryPending[mQueryFrame] = true;
+	mQueryFrame = (mQueryFrame + 1) % QueryFrames;
+}
+
+/* Reads the results that are ready, oldest first, without waiting. */
+void ResolutionScaler::readQueries()
+{
+	for(int i = 0; i < QueryFrames; i++) {
+		int slot = (mQueryFrame + i) % QueryFrames;
+		if(!mQueryPending[slot])
+			continue;
+
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(!available)
+			break;
+
+		GLuint64 start = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(mQueries[slot][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(mQueries[slot][1], GL_QUERY_RESULT, &end);
+		mQueryPending[slot] = false;
+
+		/* drawn before the last change */
+		if(mQueryScale[slot] != mStats.scale)
+			continue;
+
+		mSampleSum += (end - start) * 1.0e-9;
+		if(++mSamples == SampleFrames) {
+			updateScale(mSampleSum / mSamples);
+			mSampleSum = 0.0;
+			mSamples = 0;
+		}
+	}
+}
+
+/* The GPU time is taken to be proportional to the pixel count, i.e. to
+ * the square of the scale. A negative time only clamps to the range. */
+void ResolutionScaler::updateScale(double gpuTime)
+{
+	float scale = mStats.scale;
+	if(gpuTime > 0.0) {
+		mStats.gpuTime = gpuTime;
+		double ratio = gpuTime / mTargetFrameTime;
+		if(ratio <= 1.0 && ratio >= LowerBand)
+			return;
+
+		/* aim for the middle of the band */
+		float wanted = scale * sqrt((1.0 + LowerBand) * 0.5 / ratio);
+		scale += std::max(-MaxScaleStep, std::min(MaxScaleStep, wanted - scale));
+	}
+	scale = std::max(mMinScale, std::min(mMaxScale, scale));
+
+	if(fabs(scale - mStats.scale) < MinScaleStep &&
+			scale != mMinScale && scale != mMaxScale)
+		return;
+	if(scale == mStats.scale)
+		return;
+
+	mStats.scale = scale;
+	mStats.width = std::max(1, int(mWidth * scale + 0.5f));
+	mStats.height = std::max(1, int(mHeight * scale + 0.5f));
+	mStats.scaleChanges++;
+	mSampleSum = 0.0;
+	mSamples = 0;
+}
+
+float ResolutionScaler::getScale() const
+{
+	return mStats.scale;
+}
+
+const ResolutionScalerStats& ResolutionScaler::getStats() const
+{
+	return mStats;
+}
+
+}
+
@@ -0,0 +1,77 @@
+#ifndef SCENE_RESOLUTIONSCALER_H
+#define SCENE_RESOLUTIONSCALER_H
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+namespace Scene {
+
+struct ResolutionScalerStats {
+	ResolutionScalerStats();
+	float scale;
+	int width;
+	int height;
+	/* mean GPU time of the last full measuring window, in seconds */
+	double gpuTime;
+	unsigned int scaleChanges;
+};
+
+/* Renders into an offscreen framebuffer at a fraction of the output size
+ * and scales the result up with a bilinear blit. The GPU time between
+ * beginFrame() and endFrame() is measured with timestamp queries, which
+ * unlike GL_TIME_ELAPSED may be used inside a profiler GPU scope, and
+ * every few frames the scale is moved towards the target frame time.
+ *
+ * The framebuffer is allocated at the full size once and only its lower
+ * left corner is used, so changing the scale costs nothing; the edge
+ * texels are repeated one texel further so the blit does not filter in
+ * the unused area. Scale changes are damped: nothing happens while the
+ * frame time is within a band below the target, a single change is
+ * limited in size, and samples from frames drawn at a different scale
+ * are discarded. */
+class ResolutionScaler {
+	public:
+		ResolutionScaler(int width, int height);
+		~ResolutionScaler();
+		static bool isSupported();
+		void setTargetFrameTime(double seconds);
+		double getTargetFrameTime() const;
+		void setScaleRange(float minScale, float maxScale);
+		/* Binds the framebuffer, sets the viewport and clears the scaled
+		 * region. */
+		void beginFrame();
+		/* Blits to the framebuffer that was bound at beginFrame(). */
+		void endFrame();
+		float getScale() const;
+		const ResolutionScalerStats& getStats() const;
+
+	private:
+		static const int QueryFrames = 4;
+
+		void readQueries();
+		void updateScale(double gpuTime);
+
+		int mWidth;
+		int mHeight;
+		GLuint mFramebuffer;
+		GLuint mColorTexture;
+		GLuint mDepthBuffer;
+		GLint mTargetFramebuffer;
+
+		GLuint mQueries[QueryFrames][2];
+		float mQueryScale[QueryFrames];
+		bool mQueryPending[QueryFrames];
+		int mQueryFrame;
+
+		double mTargetFrameTime;
+		float mMinScale;
+		float mMaxScale;
+		double mSampleSum;
+		unsigned int mSamples;
+		ResolutionScalerStats mStats;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,135 @@
+#include "ResourceCache.h"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "AssetPack.h"
+#include "Hash.h"
+
+namespace Scene {
+
+ResourceStats::ResourceStats()
+	: loaded(0),
+	freed(0),
+	duplicates(0),
+	residentBytes(0),
+	savedBytes(0)
+{
+}
+
+ResourceStats& ResourceStats::operator+=(const ResourceStats& s)
+{
+	loaded += s.loaded;
+	freed += s.freed;
+	duplicates += s.duplicates;
+	residentBytes += s.residentBytes;
+	savedBytes += s.savedBytes;
+	return *this;
+}
+
+/* The bytes getKey() hashes: the asset pack entry or the file. */
+static bool readContent(const std::string& filename, std::vector<unsigned char>& data)
+{
+	AssetPack* pack = AssetPack::getCurrent();
+	if(pack) {
+		const AssetPackFormat::Entry* e = pack->find(filename, AssetPackFormat::AssetMesh);
+		if(!e)
+			e = pack->find(filename, AssetPackFormat::AssetTexture);
+		if(e) {
+			data.assign(pack->getData(*e), pack->getData(*e) + e->size);
+			return true;
+		}
+	}
+
+	std::ifstream f(filename.c_str(), std::ios::binary);
+	if(!f.is_open())
+		return false;
+	data.assign((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	return !f.bad();
+}
+
+ContentKeys::ContentKeys()
+	: mNextUniqueKey(0)
+{
+}
+
+uint64_t ContentKeys::getUniqueKey()
+{
+	while(mKeyOwners.count(mNextUniqueKey))
+		mNextUniqueKey++;
+	return mNextUniqueKey++;
+}
+
+/* Returns key if filename has the same content as the file that first
+ * got it, and a key of its own if the hashes merely collided. */
+uint64_t ContentKeys::claimKey(uint64_t key, const std::string& filename)
+{
+	auto it = mKeyOwners.find(key);
+	if(it == mKeyOwners.end()) {
+		mKeyOwners.insert({key, filename});
+		return key;
+	}
+	if(it->second == filename)
+		return key;
+
+	std::vector<unsigned char> a;
+	std::vector<unsigned char> b;
+	if(readContent(it->second, a) && readContent(filename, b) && a == b)
+		return key;
+
+	key = getUniqueKey();
+	mKeyOwners.insert({key, filename});
+	return key;
+}
+
+uint64_t ContentKeys::getKey(const std::string& filename)
+{
+	AssetPack* pack = AssetPack::getCurrent();
+	if(pack) {
+		const AssetPackFormat::Entry* e = pack->find(filename, AssetPackFormat::AssetMesh);
+		if(!e)
+			e = pack->find(filename, AssetPackFormat::AssetTexture);
+		if(e)
+			return claimKey(fnv1a(pack->getData(*e), e->size), filename);
+	}
+
+	/* files that can't be read are keyed by name and fail later when
+	 * they are loaded */
+	uint64_t key = fnv1a(filename.data(), filename.size());
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0)
+		return claimKey(key, filename);
+
+	FileId id(st.st_dev, st.st_ino, st.st_size,
+			uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec);
+	auto it = mFileKeys.find(id);
+	if(it != mFileKeys.end())
+		return it->second;
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		if(st.st_size == 0) {
+			key = fnv1a(nullptr, 0);
+		} else {
+			void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(p != MAP_FAILED) {
+				madvise(p, st.st_size, MADV_SEQUENTIAL);
+				key = fnv1a(p, st.st_size);
+				munmap(p, st.st_size);
+			}
+		}
+		close(fd);
+	}
+	key = claimKey(key, filename);
+	mFileKeys.insert({id, key});
+	return key;
+}
+
+}
+
@@ -0,0 +1,130 @@
+#ifndef SCENE_RESOURCECACHE_H
+#define SCENE_RESOURCECACHE_H
+
+#include <string>
+#include <map>
+#include <tuple>
+#include <cstdint>
+
+namespace Scene {
+
+struct ResourceStats {
+	ResourceStats();
+	ResourceStats& operator+=(const ResourceStats& s);
+	/* distinct resources loaded and freed again */
+	unsigned int loaded;
+	unsigned int freed;
+	/* requests served by a resource that was already loaded */
+	unsigned int duplicates;
+	size_t residentBytes;
+	/* what the duplicates would have taken if loaded again */
+	size_t savedBytes;
+};
+
+/* Keys files by their content, so that aliases and copies of a file get
+ * the same key. A file is hashed once per device, inode, size and
+ * modification time; assets in the current asset pack are keyed by
+ * their cooked data. The first file seen with a hash owns it; a later
+ * file with the same hash is compared to it byte by byte and gets a
+ * unique key if they differ. */
+class ContentKeys {
+	public:
+		ContentKeys();
+		uint64_t getKey(const std::string& filename);
+		/* A key shared with nothing else, for resources that mustn't
+		 * be shared. */
+		uint64_t getUniqueKey();
+
+	private:
+		uint64_t claimKey(uint64_t key, const std::string& filename);
+
+		typedef std::tuple<uint64_t, uint64_t, uint64_t, uint64_t> FileId;
+		std::map<FileId, uint64_t> mFileKeys;
+		/* the file each key was first given to */
+		std::map<uint64_t, std::string> mKeyOwners;
+		uint64_t mNextUniqueKey;
+};
+
+/* Reference counted resources by content key. get() and add() each add
+ * a reference; release() drops one and hands the resource back for
+ * freeing when it was the last. */
+template<typename T>
+class ResourceCache {
+	public:
+		bool get(uint64_t key, T& resource);
+		void add(uint64_t key, const T& resource, size_t bytes);
+		bool release(uint64_t key, T& resource);
+		bool contains(uint64_t key) const;
+		unsigned int getReferences(uint64_t key) const;
+		const ResourceStats& getStats() const;
+
+	private:
+		struct Entry {
+			T resource;
+			size_t bytes;
+			unsigned int references;
+		};
+
+		std::map<uint64_t, Entry> mEntries;
+		ResourceStats mStats;
+};
+
+template<typename T>
+bool ResourceCache<T>::get(uint64_t key, T& resource)
+{
+	auto it = mEntries.find(key);
+	if(it == mEntries.end())
+		return false;
+
+	it->second.references++;
+	mStats.duplicates++;
+	mStats.savedBytes += it->second.bytes;
+	resource = it->second.resource;
+	return true;
+}
+
+template<typename T>
+void ResourceCache<T>::add(uint64_t key, const T& resource, size_t bytes)
+{
+	mEntries[key] = Entry{resource, bytes, 1};
+	mStats.loaded++;
+	mStats.residentBytes += bytes;
+}
+
+template<typename T>
+bool ResourceCache<T>::release(uint64_t key, T& resource)
+{
+	auto it = mEntries.find(key);
+	if(it == mEntries.end() || --it->second.references > 0)
+		return false;
+
+	resource = it->second.resource;
+	mStats.freed++;
+	mStats.residentBytes -= it->second.bytes;
+	mEntries.erase(it);
+	return true;
+}
+
+template<typename T>
+bool ResourceCache<T>::contains(uint64_t key) const
+{
+	return mEntries.find(key) != mEntries.end();
+}
+
+template<typename T>
+unsigned int ResourceCache<T>::getReferences(uint64_t key) const
+{
+	auto it = mEntries.find(key);
+	return it == mEntries.end() ? 0 : it->second.references;
+}
+
+template<typename T>
+const ResourceStats& ResourceCache<T>::getStats() const
+{
+	return mStats;
+}
+
+}
+
+#endif
+
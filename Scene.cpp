@@ -1,8 +1,20 @@
 #include "Scene.h"
 
 #include <cassert>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <exception>
+#include <mutex>
+#include <algorithm>
+#include <set>
 
 #include "HelperFunctions.h"
+#include "Profiler.h"
+#include "MatrixKernels.h"
+#include "ShaderCache.h"
+#include "AssetPack.h"
+#include "MemoryTracker.h"
 
 #include "libcommon/Texture.h"
 #include "libcommon/Math.h"
@@ -14,6 +26,36 @@ namespace Scene {
 const Vector3 WorldForward = Vector3(1, 0, 0);
 const Vector3 WorldUp      = Vector3(0, 1, 0);
 
+RenderStats::RenderStats()
+	: instances(0),
+	drawCalls(0),
+	culledInstances(0),
+	triangles(0),
+	culledLights(0),
+	staticBatches(0),
+	prepassDrawCalls(0),
+	stateChanges(0),
+	shadedSamples(0),
+	resolutionScale(1.0f)
+{
+}
+
+static const float FieldOfView = 90.0f;
+
+/* Number of instances culled and transformed by one job. */
+static const size_t InstancesPerJob = 256;
+
+/* Light contributions below this are treated as zero when culling
+ * lights per instance. */
+static const float LightCutoff = 1.0f / 256.0f;
+
+/* Edge length of the grid cells static geometry is batched by; a
+ * batch is culled as a whole, so this trades draw calls for culling. */
+static const float StaticCellSize = 32.0f;
+
+/* Binding point and std140 layout of the DrawData block in scene.vert. */
+static const GLuint DrawDataBinding = 0;
+
 Camera::Camera()
 	: mTarget(WorldForward),
 	mUp(WorldUp),
@@ -43,9 +85,7 @@ void Camera::lookAt(const Common::Vector3& tgt, const Common::Vector3& right)
 void Camera::setMovementKey(const std::string& key, float forward,
 		float up, float sideways)
 {
-	std::tuple<float, float, float> t(forward, up, sideways);
-	mMovement[key] = t;
-	mMovementCache[t] = calculateMovement(t);
+	mMovement[key] = std::make_tuple(forward, up, sideways);
 }
 
 Vector3 Camera::calculateMovement(const std::tuple<float, float, float>& v)
@@ -59,17 +99,16 @@ Vector3 Camera::calculateMovement(const std::tuple<float, float, float>& v)
 
 void Camera::clearMovementKey(const std::string& key)
 {
-	auto t = mMovement[key];
-	mMovementCache[t].zero();
-	std::get<0>(t) = 0;
-	std::get<1>(t) = 0;
-	std::get<2>(t) = 0;
+	mMovement.erase(key);
 }
 
+/* The movement speeds are in units per second and coeff is the frame
+ * time, so the camera moves at the same speed at any frame rate. */
 void Camera::applyMovementKeys(float coeff)
 {
-	for(auto p : mMovement) {
-		mPosition += calculateMovement(p.second);
+	for(auto& p : mMovement) {
+		mPosition += calculateMovement(p.second) * coeff;
+		mDirty = true;
 	}
 }
 
@@ -114,10 +153,7 @@ void Camera::rotate(float yaw, float pitch)
 
 	mTarget = Math::rotate3D(view, -mVRot, haxis).normalized();
 	mUp = mTarget.cross(haxis).normalized();
-
-	for(auto p : mMovement) {
-		mMovementCache[p.second] = calculateMovement(p.second);
-	}
+	mDirty = true;
 }
 
 const Common::Vector3& Camera::getTargetVector() const
@@ -131,7 +167,8 @@ const Common::Vector3& Camera::getUpVector() const
 }
 
 Light::Light(const Common::Color& col, bool on)
-	: mOn(on)
+	: mDirty(true),
+	mOn(on)
 {
 	setColor(col);
 }
@@ -139,6 +176,7 @@ Light::Light(const Common::Color& col, bool on)
 void Light::setState(bool on)
 {
 	mOn = on;
+	mDirty = true;
 }
 
 bool Light::isOn() const
@@ -154,11 +192,23 @@ const Common::Vector3& Light::getColor() const
 void Light::setColor(const Common::Color& c)
 {
 	mColor = Vector3(c.r / 255.0f, c.g / 255.0f, c.b / 255.0f);
+	mDirty = true;
 }
 
 void Light::setColor(const Common::Vector3& c)
 {
 	mColor = c;
+	mDirty = true;
+}
+
+bool Light::isDirty() const
+{
+	return mDirty;
+}
+
+void Light::clearDirty()
+{
+	mDirty = false;
 }
 
 PointLight::PointLight(const Common::Vector3& pos, const Common::Vector3& attenuation, const Common::Color& col, bool on)
@@ -176,6 +226,38 @@ const Common::Vector3& PointLight::getAttenuation() const
 void PointLight::setAttenuation(const Common::Vector3& v)
 {
 	mAttenuation = v;
+	Light::mDirty = true;
+}
+
+/* Distance at which the attenuated light drops below LightCutoff,
+ * i.e. the positive root of c + l d + q d^2 = max(color) / LightCutoff.
+ * Infinite when the attenuation doesn't grow with distance. */
+float PointLight::getInfluenceRadius() const
+{
+	const Vector3& col = getColor();
+	float k = std::max(col.x, std::max(col.y, col.z)) / LightCutoff;
+	float c = mAttenuation.x - k;
+	float l = mAttenuation.y;
+	float q = mAttenuation.z;
+
+	if(c >= 0.0f)
+		return 0.0f;
+	if(q > 0.0f)
+		return (-l + sqrt(l * l - 4.0f * q * c)) / (2.0f * q);
+	if(l > 0.0f)
+		return -c / l;
+	return std::numeric_limits<float>::infinity();
+}
+
+bool PointLight::isDirty() const
+{
+	return Light::isDirty() || Movable::isDirty();
+}
+
+void PointLight::clearDirty()
+{
+	Light::clearDirty();
+	Movable::clearDirty();
 }
 
 DirectionalLight::DirectionalLight(const Common::Vector3& dir, const Common::Color& col, bool on)
@@ -192,6 +274,7 @@ const Common::Vector3& DirectionalLight::getDirection() const
 void DirectionalLight::setDirection(const Common::Vector3& dir)
 {
 	mDirection = dir.normalized();
+	mDirty = true;
 }
 
 
@@ -199,15 +282,26 @@ void DirectionalLight::setDirection(const Common::Vector3& dir)
 Scene::Scene(float screenWidth, float screenHeight)
 	: mScreenWidth(screenWidth),
 	mScreenHeight(screenHeight),
+	mCurrentProgram(0),
 	mAmbientLight(Color::White, false),
 	mDirectionalLight(Vector3(1, 0, 0), Color::White, false),
-	mPointLight(Vector3(), Vector3(), Color::White, false)
+	mPointLight(Vector3(), Vector3(), Color::White, false),
+	mTextureStreaming(false),
+	mResourceSharing(true),
+	mStaticBatchesChanged(false),
+	mNumPacketChunks(0),
+	mDepthPrepass(false),
+	mDynamicResolution(false),
+	mFrame(0),
+	mShadedSamples(0)
 {
-	GLuint vshader;
-	GLuint fshader;
-	GLint linked;
-
 	GLenum glewerr = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	/* GL entry points are loaded even when the context isn't GLX,
+	 * e.g. an OffscreenContext */
+	if (glewerr == GLEW_ERROR_NO_GLX_DISPLAY)
+		glewerr = GLEW_OK;
+#endif
 	if (glewerr != GLEW_OK) {
 		std::cerr << "Unable to initialise GLEW.\n";
 		throw std::runtime_error("Error initialising 3D");
@@ -217,123 +311,258 @@ Scene::Scene(float screenWidth, float screenHeight)
 		throw std::runtime_error("Error initialising 3D");
 	}
 
-	vshader = HelperFunctions::loadShaderFromFile(GL_VERTEX_SHADER, "scene.vert");
-	fshader = HelperFunctions::loadShaderFromFile(GL_FRAGMENT_SHADER, "scene.frag");
-
-	mProgramObject = glCreateProgram();
+	/* the variant with every light enabled is built up front, to find
+	 * out whether the shaders and the uniform block work at all */
+	const unsigned int allLights = NumShaderVariants - 1;
+	mShaderVariants.resize(NumShaderVariants);
+	mUseDrawBlock = GLEW_VERSION_3_1 || GLEW_ARB_uniform_buffer_object;
+	if(mUseDrawBlock && !finishShaderVariant(allLights)) {
+		std::cerr << "Unable to use uniform buffers, falling back to plain uniforms.\n";
+		mUseDrawBlock = false;
+		mShaderVariants.assign(NumShaderVariants, ShaderVariant());
+	}
 
-	if(mProgramObject == 0) {
-		std::cerr << "Unable to create program.\n";
+	if(!mUseDrawBlock && !finishShaderVariant(allLights)) {
 		throw std::runtime_error("Error initialising 3D");
 	}
 
-	glAttachShader(mProgramObject, vshader);
-	glAttachShader(mProgramObject, fshader);
-
-	bindAttributes();
-	glLinkProgram(mProgramObject);
-
-	glGetProgramiv(mProgramObject, GL_LINK_STATUS, &linked);
-
-	if(!linked) {
-		GLint infoLen = 0;
-		glGetProgramiv(mProgramObject, GL_INFO_LOG_LENGTH, &infoLen);
-		if(infoLen > 1) {
-			char* infoLog = new char[infoLen];
-			glGetProgramInfoLog(mProgramObject, infoLen, NULL, infoLog);
-			std::cerr << "Error linking program: " << infoLog << "\n";
-			delete[] infoLog;
-		} else {
-			std::cerr << "Unknown error when linking program.\n";
+	/* with parallel compilation the driver builds the other variants in
+	 * the background; otherwise they're compiled when first used */
+	if(ShaderCache::hasParallelCompile()) {
+		for(unsigned int i = 0; i < FeatureDepthOnly; i++) {
+			startShaderVariant(i);
 		}
+	}
 
-		glDeleteProgram(mProgramObject);
-		throw std::runtime_error("Error initialising 3D");
+	if(mUseDrawBlock) {
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		mDrawRing = boost::shared_ptr<UploadRing>(new UploadRing(GL_UNIFORM_BUFFER, alignment));
 	}
 
+	glGenQueries(2, mSampleQueries);
+	mSampleQueryIssued[0] = mSampleQueryIssued[1] = false;
+
 	HelperFunctions::enableDepthTest();
 	glEnable(GL_TEXTURE_2D);
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glViewport(0, 0, screenWidth, screenHeight);
 
-	glUseProgram(mProgramObject);
+	mCurrentProgram = mShaderVariants[allLights].program;
+	glUseProgram(mCurrentProgram);
+}
 
-	mUniformLocationMap["u_MVP"] = -1;
-	mUniformLocationMap["u_inverseMVP"] = -1;
+/* Frees the GL objects of the scene, so that another scene may be made
+ * in the same context without inheriting them. */
+Scene::~Scene()
+{
+	glUseProgram(0);
+	for(auto& v : mShaderVariants) {
+		/* a build still compiling has shaders to release too */
+		if(!v.program && v.build.program)
+			v.program = ShaderCache::finishProgram(v.build);
+		if(v.program)
+			glDeleteProgram(v.program);
+	}
 
-	mUniformLocationMap["s_texture"] = -1;
+	releaseStaticBatches();
+	for(auto& b : mModelBuffers) {
+		glDeleteBuffers(4, b.second.vbos);
+		MemoryTracker::deleteBuffers(4, b.second.vbos);
+	}
+	mModelBuffers.clear();
+
+	/* streamed textures go with mTextureStreamer */
+	for(auto& k : mTextureKeys) {
+		TextureResource t;
+		if(mTextureCache.release(k.second, t) && !t.streamed)
+			releaseTexture(t);
+	}
+
+	glDeleteQueries(2, mSampleQueries);
+}
+
+Scene::ShaderVariant::ShaderVariant()
+	: program(0),
+	failed(false)
+{
+	std::fill(uniforms, uniforms + NumShaderUniforms, -1);
+}
+
+std::string Scene::shaderDefines(unsigned int features) const
+{
+	std::string defines;
+	if(mUseDrawBlock)
+		defines += "#define DRAW_BLOCK\n";
+	if(features & FeatureDepthOnly)
+		defines += "#define DEPTH_ONLY\n";
+	if(features & FeatureAmbientLight)
+		defines += "#define AMBIENT_LIGHT\n";
+	if(features & FeatureDirectionalLight)
+		defines += "#define DIRECTIONAL_LIGHT\n";
+	if(features & FeaturePointLight)
+		defines += "#define POINT_LIGHT\n";
+	return defines;
+}
+
+void Scene::startShaderVariant(unsigned int features)
+{
+	ShaderVariant& v = mShaderVariants[features];
+	if(v.program || v.failed || v.build.program)
+		return;
+
+	if(!ShaderCache::startProgram("scene.vert", "scene.frag", shaderDefines(features),
+				[&] (GLuint program) { bindAttributes(program); }, v.build)) {
+		if(v.build.program)
+			glDeleteProgram(v.build.program);
+		v.build.program = 0;
+		v.failed = true;
+	}
+}
+
+bool Scene::finishShaderVariant(unsigned int features)
+{
+	/* in ShaderUniform order */
+	static const char* uniformNames[NumShaderUniforms] = {
+		"u_MVP",
+		"u_inverseMVP",
+		"s_texture",
+		"u_ambientLight",
+		"u_directionalLightDirection",
+		"u_directionalLightColor",
+		"u_pointLightPosition",
+		"u_pointLightAttenuation",
+		"u_pointLightColor"
+	};
+
+	ShaderVariant& v = mShaderVariants[features];
+	if(v.program)
+		return true;
 
-	mUniformLocationMap["u_ambientLight"] = -1;
+	startShaderVariant(features);
+	if(v.failed)
+		return false;
 
-	mUniformLocationMap["u_directionalLightDirection"] = -1;
-	mUniformLocationMap["u_directionalLightColor"] = -1;
+	v.program = ShaderCache::finishProgram(v.build);
+	if(!v.program) {
+		v.failed = true;
+		return false;
+	}
+
+	if(mUseDrawBlock) {
+		GLuint index = glGetUniformBlockIndex(v.program, "DrawData");
+		if(index == GL_INVALID_INDEX) {
+			glDeleteProgram(v.program);
+			v.program = 0;
+			v.failed = true;
+			return false;
+		}
+		glUniformBlockBinding(v.program, index, DrawDataBinding);
+	}
 
-	mUniformLocationMap["u_pointLightPosition"] = -1;
-	mUniformLocationMap["u_pointLightAttenuation"] = -1;
-	mUniformLocationMap["u_pointLightColor"] = -1;
+	for(int i = 0; i < NumShaderUniforms; i++) {
+		v.uniforms[i] = glGetUniformLocation(v.program, uniformNames[i]);
+	}
+	return true;
+}
 
-	mUniformLocationMap["u_ambientLightEnabled"] = -1;
-	mUniformLocationMap["u_directionalLightEnabled"] = -1;
-	mUniformLocationMap["u_pointLightEnabled"] = -1;
+/* Uniforms that are the same for every instance in the frame. */
+void Scene::uploadFrameUniforms(ShaderVariant& shader, unsigned int features)
+{
+	auto& uniforms = shader.uniforms;
+	glUniform1i(uniforms[UniformTexture], 0);
 
-	for(auto& p : mUniformLocationMap) {
-		p.second = glGetUniformLocation(mProgramObject, p.first);
+	if(features & FeatureAmbientLight) {
+		auto col = mAmbientLight.getColor();
+		glUniform3f(uniforms[UniformAmbientLight], col.x, col.y, col.z);
 	}
 
+	if(features & FeatureDirectionalLight) {
+		// inverse rotation matrix (normal matrix)
+		auto dir = mDirectionalLight.getDirection();
+		auto col = mDirectionalLight.getColor();
+		glUniform3f(uniforms[UniformDirectionalLightDirection], dir.x, dir.y, dir.z);
+		glUniform3f(uniforms[UniformDirectionalLightColor], col.x, col.y, col.z);
+	}
+
+	if(features & FeaturePointLight) {
+		auto at = mPointLight.getAttenuation();
+		auto col = mPointLight.getColor();
+		glUniform3f(uniforms[UniformPointLightAttenuation], at.x, at.y, at.z);
+		glUniform3f(uniforms[UniformPointLightColor], col.x, col.y, col.z);
+	}
 }
 
-void Scene::bindAttributes()
+Scene::ShaderVariant& Scene::getShaderVariant(unsigned int features)
+{
+	if(!finishShaderVariant(features)) {
+		std::cerr << "Unable to build shader variant:\n" << shaderDefines(features);
+		throw std::runtime_error("Error building shader variant");
+	}
+	return mShaderVariants[features];
+}
+
+void Scene::bindAttributes(GLuint program)
 {
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
-	glBindAttribLocation(mProgramObject, 0, "a_Position");
-	glBindAttribLocation(mProgramObject, 1, "a_Texcoord");
+	glBindAttribLocation(program, 0, "a_Position");
+	glBindAttribLocation(program, 1, "a_Texcoord");
 	glEnableVertexAttribArray(2);
-	glBindAttribLocation(mProgramObject, 2, "a_Normal");
+	glBindAttribLocation(program, 2, "a_Normal");
 }
 
-void Scene::setupModelData(const Model& model)
+static void uploadMeshBuffers(GLuint* vboids,
+		const std::vector<GLfloat>& positions,
+		const std::vector<GLfloat>& texcoords,
+		const std::vector<GLfloat>& normals,
+		const void* indices, size_t indexBytes)
 {
-	GLuint vboids[4];
 	glGenBuffers(4, vboids);
-	struct attrib {
-		const char* name;
-		int elems;
-		const std::vector<GLfloat>& data;
-	};
-
-
-	attrib attribs[] = { { "a_Position", 3, model.getVertexCoords() },
-		{ "a_Texcoord", 2, model.getTexCoords() },
-		{ "m_Normals", 3, model.getNormals() } };
-
-	int i = 0;
-	for(auto& a : attribs) {
+	const std::vector<GLfloat>* attribs[] = { &positions, &texcoords, &normals };
+	for(int i = 0; i < 3; i++) {
 		glBindBuffer(GL_ARRAY_BUFFER, vboids[i]);
-		glBufferData(GL_ARRAY_BUFFER, a.data.size() * sizeof(GLfloat), &a.data[0], GL_STATIC_DRAW);
-		glEnableVertexAttribArray(i);
-		glVertexAttribPointer(i, a.elems, GL_FLOAT, GL_FALSE, 0, NULL);
-		glBindAttribLocation(mProgramObject, i, a.name);
-		i++;
+		glBufferData(GL_ARRAY_BUFFER, attribs[i]->size() * sizeof(GLfloat), attribs[i]->data(), GL_STATIC_DRAW);
+		MemoryTracker::setBufferSize(vboids[i], MemoryCategory::VertexBuffers,
+				attribs[i]->size() * sizeof(GLfloat));
 	}
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboids[3]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.getIndices().size() * sizeof(GLushort),
-			&model.getIndices()[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+	MemoryTracker::setBufferSize(vboids[3], MemoryCategory::IndexBuffers, indexBytes);
 }
 
-boost::shared_ptr<Common::Texture> Scene::getModelTexture(const std::string& mname) const
+void Scene::setupModelData(const Model& model)
 {
-	auto it = mMeshInstanceTextures.find(mname);
-	if(it == mMeshInstanceTextures.end()) {
-		assert(0);
-		throw std::runtime_error("Couldn't find texture for model");
-	} else {
-		return it->second;
+	MeshBuffers& b = mModelBuffers[&model];
+	b.indexType = GL_UNSIGNED_SHORT;
+	uploadMeshBuffers(b.vbos, model.getVertexCoords(), model.getTexCoords(), model.getNormals(),
+			model.getIndices().data(), model.getIndices().size() * sizeof(GLushort));
+	bindMeshBuffers(b);
+}
+
+void Scene::releaseModelData(const Model& model)
+{
+	auto it = mModelBuffers.find(&model);
+	if(it != mModelBuffers.end()) {
+		glDeleteBuffers(4, it->second.vbos);
+		MemoryTracker::deleteBuffers(4, it->second.vbos);
+		mModelBuffers.erase(it);
 	}
 }
 
+void Scene::bindMeshBuffers(const MeshBuffers& buffers, int attributes)
+{
+	static const int elems[] = { 3, 2, 3 };
+	for(int i = 0; i < attributes; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffers.vbos[i]);
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, elems[i], GL_FLOAT, GL_FALSE, 0, NULL);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.vbos[3]);
+}
+
 Camera& Scene::getDefaultCamera()
 {
 	return mDefaultCamera;
@@ -368,111 +597,823 @@ void Scene::addQuad(const Vector3& p1,
 	/* TODO */
 }
 
-void Scene::calculateModelMatrix(const MeshInstance& mi)
+void Scene::updateFrameMatrices(const Camera& cam)
+{
+	mPerspectiveMatrix = HelperFunctions::perspectiveMatrix(FieldOfView, mScreenWidth, mScreenHeight);
+	auto camrot = HelperFunctions::cameraRotationMatrix(cam.getTargetVector(), cam.getUpVector());
+	auto camtrans = HelperFunctions::translationMatrix(cam.getPosition().negated());
+	mViewMatrix = camtrans * camrot;
+	mViewPerspectiveMatrix = mViewMatrix * mPerspectiveMatrix;
+
+	/* Frustum planes from the columns of the view-projection matrix;
+	 * points are row vectors, so clip = p * VP. */
+	const float* m = mViewPerspectiveMatrix.m;
+	for(int i = 0; i < 6; i++) {
+		int col = i / 2;
+		float sign = i % 2 ? -1.0f : 1.0f;
+		float len = 0.0f;
+		for(int j = 0; j < 4; j++) {
+			mFrustum[i][j] = m[j * 4 + 3] + sign * m[j * 4 + col];
+			if(j < 3)
+				len += mFrustum[i][j] * mFrustum[i][j];
+		}
+		len = sqrt(len);
+		for(int j = 0; j < 4; j++) {
+			mFrustum[i][j] /= len;
+		}
+	}
+}
+
+bool Scene::isVisible(const Vector3& center, float radius) const
 {
-	auto translation = HelperFunctions::translationMatrix(mi.getPosition());
-	auto rotation = mi.getRotation();
-	mModelMatrix = rotation * translation;
+	for(int i = 0; i < 6; i++) {
+		float dist = mFrustum[i][0] * center.x + mFrustum[i][1] * center.y +
+			mFrustum[i][2] * center.z + mFrustum[i][3];
+		if(dist < -radius)
+			return false;
+	}
+	return true;
+}
 
-	auto invTranslation(translation);
-	invTranslation.m[3] = -invTranslation.m[3];
-	invTranslation.m[7] = -invTranslation.m[7];
-	invTranslation.m[11] = -invTranslation.m[11];
+void Scene::buildDrawPackets(unsigned int features)
+{
+	/* baked batches come after the instances */
+	size_t numInstances = mInstanceList.size();
+	size_t count = numInstances + mStaticBatches.size();
+	size_t maxChunks = (count + InstancesPerJob - 1) / InstancesPerJob;
+	if(mPackets.size() < maxChunks) {
+		mPackets.resize(maxChunks);
+		mPacketData.resize(maxChunks);
+	}
 
-	auto invRotation = rotation.transposed();
+	unsigned char* drawBlock = nullptr;
+	size_t drawBlockOffset = 0;
+	size_t stride = 0;
+	if(mUseDrawBlock) {
+		stride = mDrawRing->alignedSize(sizeof(DrawData));
+		mDrawRing->beginFrame(count * stride);
+		drawBlock = static_cast<unsigned char*>(mDrawRing->allocate(count * stride, drawBlockOffset));
+		assert(drawBlock || !count);
+	}
 
-	mInverseModelMatrix = invTranslation * invRotation;
+	const Vector3 plpos(mPointLight.getPosition());
+	const float plradius = (features & FeaturePointLight) ? mPointLight.getInfluenceRadius() : 0.0f;
+
+	mNumPacketChunks = mJobs.parallelFor(count, InstancesPerJob, [&] (size_t chunk, size_t begin, size_t end) {
+		PROFILE_SCOPE("Scene::buildDrawPackets chunk");
+		auto& packets = mPackets[chunk];
+		auto& data = mPacketData[chunk];
+		packets.clear();
+		if(!drawBlock)
+			data.resize(end - begin);
+
+		for(size_t i = begin; i < end; i++) {
+			const MeshInstance* mi = nullptr;
+			const StaticBatch* batch = nullptr;
+			Vector3 center;
+			float radius;
+			if(i < numInstances) {
+				const InstanceEntry& e = mInstanceList[i];
+				if(e.batch >= 0 && mStaticBatches[e.batch].baked)
+					continue;
+				mi = e.instance;
+				center = mi->getPosition();
+				radius = mi->getModel().getBoundingRadius() * mi->getScale();
+			} else {
+				batch = &mStaticBatches[i - numInstances];
+				if(!batch->baked)
+					continue;
+				center = batch->center;
+				radius = batch->radius;
+			}
+
+			if(!isVisible(center, radius))
+				continue;
+
+			DrawPacket p;
+			if(mi) {
+				p.texture = mInstanceList[i].texture;
+				p.buffers = mInstanceList[i].buffers;
+				p.indexCount = mi->getModel().getIndices().size();
+				p.instanceCount = 1;
+				p.baked = false;
+			} else {
+				p.texture = batch->texture;
+				p.buffers = &batch->buffers;
+				p.indexCount = batch->indexCount;
+				p.instanceCount = batch->instances.size();
+				p.baked = true;
+			}
+			p.screenSize = mTextureStreaming ? projectedSize(center, radius) : 0.0f;
+			p.depth = (center - mDefaultCamera.getPosition()).length();
+			p.features = features;
+
+			/* leave out the point light if it can't reach the
+			 * bounding sphere */
+			if((features & FeaturePointLight) &&
+					(plpos - center).length() - radius > plradius) {
+				p.features &= ~FeaturePointLight;
+			}
+
+			DrawData* dd;
+			if(drawBlock) {
+				p.offset = drawBlockOffset + i * stride;
+				dd = reinterpret_cast<DrawData*>(drawBlock + i * stride);
+			} else {
+				p.offset = 0;
+				dd = &data[i - begin];
+			}
+			p.data = dd;
+
+			if(mi) {
+				float modelMatrix[16];
+				mi->getModelMatrix(modelMatrix);
+				MatrixKernels::multiply(modelMatrix, mViewPerspectiveMatrix.m, dd->mvp);
+				MatrixKernels::affineInverse(modelMatrix, dd->inverseMVP);
+			} else {
+				/* baked vertices and normals are in world space */
+				memcpy(dd->mvp, mViewPerspectiveMatrix.m, sizeof(dd->mvp));
+				for(int j = 0; j < 16; j++) {
+					dd->inverseMVP[j] = j % 5 ? 0.0f : 1.0f;
+				}
+			}
+
+			/* the light in the space of a_Position, i.e. through the
+			 * inverse model matrix, with the scale back to world
+			 * distances in w, so baked and unbaked instances are lit
+			 * the same */
+			if(p.features & FeaturePointLight) {
+				const float* inv = dd->inverseMVP;
+				for(int c = 0; c < 3; c++) {
+					dd->pointLightPosition[c] = plpos.x * inv[c] + plpos.y * inv[4 + c] +
+						plpos.z * inv[8 + c] + inv[12 + c];
+				}
+				dd->pointLightPosition[3] = mi ? mi->getScale() : 1.0f;
+			}
+
+			packets.push_back(p);
+		}
+	});
+
+	if(mUseDrawBlock) {
+		mDrawRing->commit();
+	}
 }
 
-void Scene::updateMVPMatrix(const MeshInstance& mi)
+/* Draws everything that passed culling into the depth buffer only,
+ * nearest first so that later draws are rejected early, and leaves the
+ * depth test set up for the main pass. */
+void Scene::renderDepthPrepass()
 {
-	calculateModelMatrix(mi);
-	auto mvp = mModelMatrix * mViewMatrix * mPerspectiveMatrix;
-	auto imvp = mInverseModelMatrix;
+	mDepthOrder.clear();
+	for(size_t c = 0; c < mNumPacketChunks; c++) {
+		for(auto& p : mPackets[c]) {
+			mDepthOrder.push_back(&p);
+		}
+	}
+	std::sort(mDepthOrder.begin(), mDepthOrder.end(),
+			[] (const DrawPacket* a, const DrawPacket* b) { return a->depth < b->depth; });
+
+	ShaderVariant& shader = getShaderVariant(FeatureDepthOnly);
+	if(shader.program != mCurrentProgram) {
+		glUseProgram(shader.program);
+		mCurrentProgram = shader.program;
+		mStats.stateChanges++;
+	}
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(2);
+
+	const MeshBuffers* boundBuffers = nullptr;
+	for(auto p : mDepthOrder) {
+		if(p->buffers != boundBuffers) {
+			bindMeshBuffers(*p->buffers, 1);
+			boundBuffers = p->buffers;
+			mStats.stateChanges++;
+		}
+
+		if(mUseDrawBlock) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, DrawDataBinding, mDrawRing->getBuffer(),
+					p->offset, sizeof(DrawData));
+		} else {
+			glUniformMatrix4fv(shader.uniforms[UniformMVP], 1, GL_FALSE, p->data->mvp);
+		}
 
-	glUniformMatrix4fv(mUniformLocationMap["u_MVP"], 1, GL_FALSE, mvp.m);
-	glUniformMatrix4fv(mUniformLocationMap["u_inverseMVP"], 1, GL_FALSE, imvp.m);
+		glDrawElements(GL_TRIANGLES, p->indexCount, p->buffers->indexType, NULL);
+		mStats.prepassDrawCalls++;
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
 }
 
-void Scene::updateFrameMatrices(const Camera& cam)
+/* Vertices are row vectors like everywhere else; normals go through the
+ * inverse the same way scene.vert applies u_inverseMVP. Together with
+ * the point light being given in model space, a baked instance is lit
+ * as it would be on its own. */
+static void bakeInstance(const MeshInstance& mi, GLuint firstVertex,
+		std::vector<GLfloat>& positions, std::vector<GLfloat>& texcoords,
+		std::vector<GLfloat>& normals, std::vector<GLuint>& indices)
 {
-	mPerspectiveMatrix = HelperFunctions::perspectiveMatrix(90.0f, mScreenWidth, mScreenHeight);
-	auto camrot = HelperFunctions::cameraRotationMatrix(cam.getTargetVector(), cam.getUpVector());
-	auto camtrans = HelperFunctions::translationMatrix(cam.getPosition().negated());
-	mViewMatrix = camtrans * camrot;
+	const Model& model = mi.getModel();
+	float m[16];
+	float inv[16];
+	mi.getModelMatrix(m);
+	MatrixKernels::affineInverse(m, inv);
+
+	const auto& v = model.getVertexCoords();
+	const auto& n = model.getNormals();
+	for(size_t i = 0; i + 2 < v.size(); i += 3) {
+		for(int c = 0; c < 3; c++) {
+			positions.push_back(v[i] * m[c] + v[i + 1] * m[4 + c] + v[i + 2] * m[8 + c] + m[12 + c]);
+		}
+	}
+	for(size_t i = 0; i + 2 < n.size(); i += 3) {
+		for(int c = 0; c < 3; c++) {
+			normals.push_back(n[i] * inv[c * 4] + n[i + 1] * inv[c * 4 + 1] + n[i + 2] * inv[c * 4 + 2]);
+		}
+	}
+	texcoords.insert(texcoords.end(), model.getTexCoords().begin(), model.getTexCoords().end());
+	for(auto i : model.getIndices()) {
+		indices.push_back(firstVertex + i);
+	}
 }
 
-void Scene::render()
+void Scene::bakeStaticGeometry()
 {
-	glUniform1i(mUniformLocationMap["u_ambientLightEnabled"], mAmbientLight.isOn());
-	glUniform1i(mUniformLocationMap["u_directionalLightEnabled"], mDirectionalLight.isOn());
-	glUniform1i(mUniformLocationMap["u_pointLightEnabled"], mPointLight.isOn());
+	PROFILE_SCOPE("Scene::bakeStaticGeometry");
+	releaseStaticBatches();
+
+	std::map<std::tuple<GLuint, int, int, int>, size_t> cells;
+	for(size_t i = 0; i < mInstanceList.size(); i++) {
+		InstanceEntry& e = mInstanceList[i];
+		if(!e.instance->isStatic())
+			continue;
+
+		const Vector3& pos = e.instance->getPosition();
+		auto key = std::make_tuple(e.texture, int(floor(pos.x / StaticCellSize)),
+				int(floor(pos.y / StaticCellSize)), int(floor(pos.z / StaticCellSize)));
+		auto it = cells.find(key);
+		if(it == cells.end()) {
+			it = cells.insert({key, mStaticBatches.size()}).first;
+			StaticBatch batch;
+			batch.texture = e.texture;
+			batch.indexCount = 0;
+			batch.radius = 0.0f;
+			batch.baked = false;
+			mStaticBatches.push_back(batch);
+		}
+		mStaticBatches[it->second].instances.push_back(i);
+		e.batch = it->second;
+	}
 
-	updateFrameMatrices(mDefaultCamera);
+	struct Geometry {
+		std::vector<GLfloat> positions;
+		std::vector<GLfloat> texcoords;
+		std::vector<GLfloat> normals;
+		std::vector<GLuint> indices;
+	};
+	std::vector<Geometry> geometry(mStaticBatches.size());
+
+	mJobs.parallelFor(mStaticBatches.size(), 1, [&] (size_t, size_t begin, size_t end) {
+		for(size_t b = begin; b < end; b++) {
+			StaticBatch& batch = mStaticBatches[b];
+			Geometry& g = geometry[b];
+			for(auto i : batch.instances) {
+				bakeInstance(*mInstanceList[i].instance, g.positions.size() / 3,
+						g.positions, g.texcoords, g.normals, g.indices);
+			}
+
+			/* bounding sphere around the centre of the bounding box */
+			Vector3 lo(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+					std::numeric_limits<float>::max());
+			Vector3 hi = lo.negated();
+			for(size_t v = 0; v + 2 < g.positions.size(); v += 3) {
+				lo = Vector3(std::min(lo.x, g.positions[v]), std::min(lo.y, g.positions[v + 1]),
+						std::min(lo.z, g.positions[v + 2]));
+				hi = Vector3(std::max(hi.x, g.positions[v]), std::max(hi.y, g.positions[v + 1]),
+						std::max(hi.z, g.positions[v + 2]));
+			}
+			batch.center = (lo + hi) * 0.5f;
+			float r2 = 0.0f;
+			for(size_t v = 0; v + 2 < g.positions.size(); v += 3) {
+				Vector3 d = Vector3(g.positions[v], g.positions[v + 1], g.positions[v + 2]) - batch.center;
+				r2 = std::max(r2, d.x * d.x + d.y * d.y + d.z * d.z);
+			}
+			batch.radius = sqrt(r2);
+			batch.indexCount = g.indices.size();
+		}
+	});
+
+	for(size_t b = 0; b < mStaticBatches.size(); b++) {
+		StaticBatch& batch = mStaticBatches[b];
+		Geometry& g = geometry[b];
+		batch.buffers.indexType = GL_UNSIGNED_INT;
+		uploadMeshBuffers(batch.buffers.vbos, g.positions, g.texcoords, g.normals,
+				g.indices.data(), g.indices.size() * sizeof(GLuint));
+		batch.baked = true;
+		for(auto i : batch.instances) {
+			mInstanceList[i].instance->clearDirty();
+		}
+	}
+	mStaticBatchesChanged = true;
+}
 
-	if(mPointLight.isOn()) {
-		auto at = mPointLight.getAttenuation();
-		auto col = mPointLight.getColor();
-		glUniform3f(mUniformLocationMap["u_pointLightAttenuation"], at.x, at.y, at.z);
-		glUniform3f(mUniformLocationMap["u_pointLightColor"], col.x, col.y, col.z);
+void Scene::releaseStaticBatches()
+{
+	for(auto& batch : mStaticBatches) {
+		glDeleteBuffers(4, batch.buffers.vbos);
+		MemoryTracker::deleteBuffers(4, batch.buffers.vbos);
 	}
+	mStaticBatches.clear();
+	for(auto& e : mInstanceList) {
+		e.batch = -1;
+	}
+}
 
-	if(mDirectionalLight.isOn()) {
-		auto col = mDirectionalLight.getColor();
-		glUniform3f(mUniformLocationMap["u_directionalLightColor"], col.x, col.y, col.z);
+/* Editing an instance would otherwise mean baking the whole batch again
+ * every frame it changes. */
+void Scene::unbakeEditedBatches()
+{
+	for(auto& batch : mStaticBatches) {
+		if(!batch.baked)
+			continue;
+		for(auto i : batch.instances) {
+			if(mInstanceList[i].instance->isDirty()) {
+				batch.baked = false;
+				break;
+			}
+		}
 	}
+}
 
-	if(mAmbientLight.isOn()) {
-		auto col = mAmbientLight.getColor();
-		glUniform3f(mUniformLocationMap["u_ambientLight"], col.x, col.y, col.z);
+void Scene::render()
+{
+	PROFILE_SCOPE("Scene::render");
+	PROFILE_GPU_SCOPE("Scene::render");
+
+	unsigned int features = 0;
+	if(mAmbientLight.isOn())
+		features |= FeatureAmbientLight;
+	if(mDirectionalLight.isOn())
+		features |= FeatureDirectionalLight;
+	if(mPointLight.isOn())
+		features |= FeaturePointLight;
+
+	{
+		PROFILE_SCOPE("Scene::updateFrameMatrices");
+		updateFrameMatrices(mDefaultCamera);
 	}
 
-	for(auto& mi : mMeshInstances) {
-		/* TODO: add support for vertex colors. */
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, getModelTexture(mi.first)->getTexture());
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glUniform1i(mUniformLocationMap["s_texture"], 0);
+	unbakeEditedBatches();
 
-		updateMVPMatrix(*mi.second);
+	{
+		PROFILE_SCOPE("Scene::buildDrawPackets");
+		buildDrawPackets(features);
+	}
 
-		if(mPointLight.isOn()) {
-			// inverse translation matrix
-			Vector3 plpos(mPointLight.getPosition());
-			Vector3 plposrel = mi.second->getPosition() - plpos;
-			glUniform3f(mUniformLocationMap["u_pointLightPosition"],
-					plposrel.x, plposrel.y, plposrel.z);
-		}
+	PROFILE_SCOPE("Scene::submit");
+	mStats = RenderStats();
+	mStats.instances = mInstanceList.size();
+	unsigned int drawnInstances = 0;
+
+	if(mDynamicResolution) {
+		mResolutionScaler->beginFrame();
+		mStats.resolutionScale = mResolutionScaler->getScale();
+	}
+
+	if(mDepthPrepass) {
+		PROFILE_SCOPE("Scene::renderDepthPrepass");
+		renderDepthPrepass();
+	}
 
-		if(mDirectionalLight.isOn()) {
-			// inverse rotation matrix (normal matrix)
-			Vector3 dir = mDirectionalLight.getDirection();
-			glUniform3f(mUniformLocationMap["u_directionalLightDirection"], dir.x, dir.y, dir.z);
+	/* the query used two frames ago is read if it's done; waiting for
+	 * it would stall the pipeline */
+	unsigned int querySlot = mFrame % 2;
+	if(mSampleQueryIssued[querySlot]) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(mSampleQueries[querySlot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+			glGetQueryObjectuiv(mSampleQueries[querySlot], GL_QUERY_RESULT, &mShadedSamples);
+	}
+	mStats.shadedSamples = mShadedSamples;
+	glBeginQuery(GL_SAMPLES_PASSED, mSampleQueries[querySlot]);
+
+	/* TODO: add support for vertex colors. */
+	glActiveTexture(GL_TEXTURE0);
+	GLuint boundTexture = 0;
+	const MeshBuffers* boundBuffers = nullptr;
+
+	/* instances out of the point light's reach are drawn after the
+	 * rest, with the variant without it */
+	const unsigned int variants[] = { features, features & ~FeaturePointLight };
+	const unsigned int numVariants = (features & FeaturePointLight) ? 2 : 1;
+
+	for(unsigned int v = 0; v < numVariants; v++) {
+		ShaderVariant* shader = nullptr;
+
+		for(size_t c = 0; c < mNumPacketChunks; c++) {
+			for(auto& p : mPackets[c]) {
+				if(p.features != variants[v])
+					continue;
+
+				if(!shader) {
+					shader = &getShaderVariant(variants[v]);
+					if(shader->program != mCurrentProgram) {
+						glUseProgram(shader->program);
+						mCurrentProgram = shader->program;
+						mStats.stateChanges++;
+					}
+					uploadFrameUniforms(*shader, variants[v]);
+				}
+				auto& uniforms = shader->uniforms;
+
+				if(p.texture != boundTexture) {
+					glBindTexture(GL_TEXTURE_2D, p.texture);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+					boundTexture = p.texture;
+					mStats.stateChanges++;
+				}
+
+				if(mUseDrawBlock) {
+					glBindBufferRange(GL_UNIFORM_BUFFER, DrawDataBinding, mDrawRing->getBuffer(),
+							p.offset, sizeof(DrawData));
+				} else {
+					glUniformMatrix4fv(uniforms[UniformMVP], 1, GL_FALSE, p.data->mvp);
+					if(p.features & FeatureDirectionalLight) {
+						glUniformMatrix4fv(uniforms[UniformInverseMVP], 1, GL_FALSE, p.data->inverseMVP);
+					}
+					if(p.features & FeaturePointLight) {
+						glUniform4fv(uniforms[UniformPointLightPosition], 1,
+								p.data->pointLightPosition);
+					}
+				}
+
+				if(p.buffers != boundBuffers) {
+					bindMeshBuffers(*p.buffers);
+					boundBuffers = p.buffers;
+					mStats.stateChanges++;
+				}
+
+				glDrawElements(GL_TRIANGLES, p.indexCount, p.buffers->indexType, NULL);
+				mStats.drawCalls++;
+				mStats.triangles += p.indexCount / 3;
+				drawnInstances += p.instanceCount;
+				if(p.baked) {
+					mStats.staticBatches++;
+				}
+				if(p.features != features) {
+					mStats.culledLights += p.instanceCount;
+				}
+
+				if(mTextureStreaming) {
+					mTextureStreamer.requestResolution(p.texture, p.screenSize);
+				}
+			}
 		}
+	}
+	mStats.culledInstances = mStats.instances - drawnInstances;
+
+	glEndQuery(GL_SAMPLES_PASSED);
+	mSampleQueryIssued[querySlot] = true;
+	mFrame++;
+
+	if(mDepthPrepass) {
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_TRUE);
+	}
+
+	if(mDynamicResolution) {
+		mResolutionScaler->endFrame();
+	}
+
+	if(mUseDrawBlock) {
+		mDrawRing->endFrame();
+	}
 
-		glDrawElements(GL_TRIANGLES, mi.second->getModel().getIndices().size(),
-				GL_UNSIGNED_SHORT, NULL);
+	if(mTextureStreaming) {
+		PROFILE_SCOPE("TextureStreamer::update");
+		mTextureStreamer.update();
+	}
+	clearDirty();
+}
+
+bool Scene::isDirty() const
+{
+	if(mDefaultCamera.isDirty() || mAmbientLight.isDirty() ||
+			mDirectionalLight.isDirty() || mPointLight.isDirty())
+		return true;
+
+	if(mTextureStreaming && mTextureStreamer.getStats().pendingUploads)
+		return true;
+
+	if(mStaticBatchesChanged)
+		return true;
+
+	for(auto& e : mInstanceList) {
+		if(e.instance->isDirty())
+			return true;
+	}
+	return false;
+}
+
+void Scene::clearDirty()
+{
+	mDefaultCamera.clearDirty();
+	mAmbientLight.clearDirty();
+	mDirectionalLight.clearDirty();
+	mPointLight.clearDirty();
+	mStaticBatchesChanged = false;
+	for(auto& e : mInstanceList) {
+		e.instance->clearDirty();
+	}
+}
+
+float Scene::projectedSize(const Vector3& center, float radius) const
+{
+	float dist = (center - mDefaultCamera.getPosition()).length();
+	if(dist <= radius)
+		return mScreenHeight;
+
+	return radius / (dist * tan(Math::degreesToRadians(FieldOfView * 0.5f))) * mScreenHeight;
+}
+
+/* Level 0 and the mips, if the min filter uses them. */
+static size_t textureBytes(GLuint texture)
+{
+	GLint width = 0, height = 0, filter = GL_LINEAR;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &filter);
+	size_t bytes = size_t(width) * height * 4;
+	if(filter != GL_LINEAR && filter != GL_NEAREST)
+		bytes += bytes / 3;
+	return bytes;
+}
+
+Scene::TextureResource Scene::loadTexture(const std::string& filename, size_t& bytes)
+{
+	AssetPack* pack = AssetPack::getCurrent();
+	const AssetPackFormat::Entry* packed = pack ? pack->find(filename, AssetPackFormat::AssetTexture) : nullptr;
+	TextureResource t;
+	t.streamed = mTextureStreaming;
+	if(mTextureStreaming) {
+		t.id = mTextureStreamer.addTexture(filename);
+		bytes = mTextureStreamer.getMemorySize(t.id);
+	} else if(packed) {
+		t.id = HelperFunctions::loadTexture(*pack, *packed);
+		bytes = textureBytes(t.id);
+	} else {
+		t.texture = HelperFunctions::loadTexture(filename);
+		t.id = t.texture->getTexture();
+		bytes = textureBytes(t.id);
+	}
+	return t;
+}
+
+void Scene::releaseTexture(const TextureResource& t)
+{
+	if(t.streamed) {
+		mTextureStreamer.removeTexture(t.id);
+	} else {
+		/* libcommon textures are deleted with the last reference */
+		if(!t.texture)
+			glDeleteTextures(1, &t.id);
+		MemoryTracker::deleteTextures(1, &t.id);
 	}
 }
 
 void Scene::addTexture(const std::string& name, const std::string& filename)
 {
-	if(mTextures.find(name) != mTextures.end()) {
+	if(mTextureIDs.find(name) != mTextureIDs.end()) {
 		throw std::runtime_error("Tried adding an already existing texture");
-	} else {
-		mTextures.insert({name, HelperFunctions::loadTexture(filename)});
 	}
+
+	uint64_t key = resourceKey(filename);
+	TextureResource t;
+	if(!mTextureCache.get(key, t)) {
+		size_t bytes = 0;
+		t = loadTexture(filename, bytes);
+		mTextureCache.add(key, t, bytes);
+	}
+	mTextureIDs.insert({name, t.id});
+	mTextureKeys[name] = key;
+	mTextureFiles[name] = filename;
+}
+
+void Scene::removeTexture(const std::string& name)
+{
+	auto it = mTextureIDs.find(name);
+	if(it == mTextureIDs.end()) {
+		throw std::runtime_error("Tried removing a non-existing texture");
+	}
+
+	uint64_t key = mTextureKeys[name];
+	if(mTextureCache.getReferences(key) == 1) {
+		for(auto& e : mInstanceList) {
+			if(e.texture == it->second)
+				throw std::runtime_error("Tried removing a texture that is in use");
+		}
+	}
+
+	TextureResource t;
+	if(mTextureCache.release(key, t))
+		releaseTexture(t);
+	mTextureIDs.erase(it);
+	mTextureKeys.erase(name);
+	mTextureFiles.erase(name);
+}
+
+void Scene::setTextureStreaming(bool on)
+{
+	mTextureStreaming = on;
+}
+
+void Scene::setDepthPrepass(bool on)
+{
+	if(on) {
+		/* build the program now rather than in the first frame */
+		getShaderVariant(FeatureDepthOnly);
+	}
+	mDepthPrepass = on;
+}
+
+bool Scene::getDepthPrepass() const
+{
+	return mDepthPrepass;
+}
+
+bool Scene::setDynamicResolution(double targetFrameTime)
+{
+	if(targetFrameTime <= 0.0) {
+		mDynamicResolution = false;
+		return true;
+	}
+
+	if(!ResolutionScaler::isSupported())
+		return false;
+
+	if(!mResolutionScaler) {
+		mResolutionScaler = boost::shared_ptr<ResolutionScaler>(new ResolutionScaler(mScreenWidth, mScreenHeight));
+	}
+	mResolutionScaler->setTargetFrameTime(targetFrameTime);
+	mDynamicResolution = true;
+	return true;
+}
+
+const ResolutionScalerStats* Scene::getResolutionStats() const
+{
+	return mDynamicResolution ? &mResolutionScaler->getStats() : nullptr;
+}
+
+TextureStreamer& Scene::getTextureStreamer()
+{
+	return mTextureStreamer;
+}
+
+static size_t modelBytes(const Model& m)
+{
+	return (m.getVertexCoords().size() + m.getTexCoords().size() + m.getNormals().size()) * sizeof(GLfloat) +
+		m.getIndices().size() * sizeof(GLushort);
 }
 
 void Scene::addModel(const std::string& name, const std::string& filename)
 {
 	if(mModels.find(name) != mModels.end()) {
 		throw std::runtime_error("Tried adding a model with an already existing name");
-	} else {
-		auto m = boost::shared_ptr<Model>(new Model(filename));
-		mModels.insert({name, m});
+	}
+
+	uint64_t key = resourceKey(filename);
+	boost::shared_ptr<Model> m;
+	if(!mModelCache.get(key, m)) {
+		m = boost::shared_ptr<Model>(new Model(filename));
 		setupModelData(*m);
+		mModelCache.add(key, m, modelBytes(*m));
+	}
+	mModels.insert({name, m});
+	mModelKeys[name] = key;
+	mModelFiles[name] = filename;
+}
+
+void Scene::removeModel(const std::string& name)
+{
+	auto it = mModels.find(name);
+	if(it == mModels.end()) {
+		throw std::runtime_error("Tried removing a non-existing model");
+	}
+
+	uint64_t key = mModelKeys[name];
+	if(mModelCache.getReferences(key) == 1) {
+		for(auto& e : mInstanceList) {
+			if(&e.instance->getModel() == it->second.get())
+				throw std::runtime_error("Tried removing a model that is in use");
+		}
+	}
+
+	boost::shared_ptr<Model> m;
+	if(mModelCache.release(key, m))
+		releaseModelData(*m);
+	mModels.erase(it);
+	mModelKeys.erase(name);
+	mModelFiles.erase(name);
+}
+
+void Scene::setResourceSharing(bool on)
+{
+	mResourceSharing = on;
+}
+
+uint64_t Scene::resourceKey(const std::string& filename)
+{
+	return mResourceSharing ? mContentKeys.getKey(filename) : mContentKeys.getUniqueKey();
+}
+
+ResourceStats Scene::getResourceStats() const
+{
+	ResourceStats stats = mModelCache.getStats();
+	stats += mTextureCache.getStats();
+	return stats;
+}
+
+const RenderStats& Scene::getRenderStats() const
+{
+	return mStats;
+}
+
+JobSystem& Scene::getJobSystem()
+{
+	return mJobs;
+}
+
+const UploadRingStats* Scene::getDrawRingStats() const
+{
+	return mDrawRing ? &mDrawRing->getStats() : nullptr;
+}
+
+void Scene::addModels(const std::vector<std::pair<std::string, std::string>>& models)
+{
+	std::set<std::string> names;
+	for(auto& p : models) {
+		if(mModels.find(p.first) != mModels.end() || !names.insert(p.first).second) {
+			throw std::runtime_error("Tried adding a model with an already existing name");
+		}
+	}
+
+	/* each distinct content is loaded once, by the first name that has it */
+	std::vector<uint64_t> keys(models.size());
+	std::map<uint64_t, size_t> loaders;
+	for(size_t i = 0; i < models.size(); i++) {
+		keys[i] = resourceKey(models[i].second);
+		if(!mModelCache.contains(keys[i]))
+			loaders.insert({keys[i], i});
+	}
+
+	/* import on the workers, upload on this thread */
+	std::vector<boost::shared_ptr<Model>> loaded(models.size());
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	Job* root = mJobs.create([] () { });
+	for(auto& l : loaders) {
+		size_t i = l.second;
+		mJobs.submit(mJobs.create([&, i] () {
+			try {
+				auto m = boost::shared_ptr<Model>(new Model(models[i].second));
+				loaded[i] = m;
+				mJobs.runOnMainThread([this, m] () { setupModelData(*m); });
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if(!error)
+					error = std::current_exception();
+			}
+		}, root));
+	}
+	mJobs.submit(root);
+	mJobs.wait(root);
+	mJobs.processMainThreadQueue();
+
+	if(error) {
+		for(auto& m : loaded) {
+			if(m)
+				releaseModelData(*m);
+		}
+		std::rethrow_exception(error);
+	}
+
+	for(size_t i = 0; i < models.size(); i++) {
+		auto l = loaders.find(keys[i]);
+		if(l != loaders.end() && l->second == i) {
+			mModelCache.add(keys[i], loaded[i], modelBytes(*loaded[i]));
+		} else {
+			mModelCache.get(keys[i], loaded[i]);
+		}
+		mModels.insert({models[i].first, loaded[i]});
+		mModelKeys[models[i].first] = keys[i];
+		mModelFiles[models[i].first] = models[i].second;
 	}
 }
 
@@ -497,17 +1438,150 @@ boost::shared_ptr<MeshInstance> Scene::addMeshInstance(const std::string& name,
 	if(modelit == mModels.end())
 		throw std::runtime_error("Tried getting a non-existing model\n");
 
-	auto textit = mTextures.find(texturename);
-	if(textit == mTextures.end())
+	auto textit = mTextureIDs.find(texturename);
+	if(textit == mTextureIDs.end())
 		throw std::runtime_error("Tried getting a non-existing texture\n");
 
 	auto mi = boost::shared_ptr<MeshInstance>(new MeshInstance(*modelit->second));
 	mMeshInstances.insert({name, mi});
 
-	mMeshInstanceTextures.insert({name, textit->second});
+	InstanceEntry ie;
+	ie.instance = mi.get();
+	ie.texture = textit->second;
+	ie.buffers = &mModelBuffers[modelit->second.get()];
+	ie.batch = -1;
+	mInstanceList.push_back(ie);
 
 	return mi;
 }
 
+static void setLight(Light& light, const SceneFileFormat::LightRecord& r)
+{
+	light.setState(r.on);
+	light.setColor(Vector3(r.color[0], r.color[1], r.color[2]));
+}
+
+static void getLight(const Light& light, SceneFileFormat::LightRecord& r)
+{
+	const Vector3& c = light.getColor();
+	r.on = light.isOn();
+	r.color[0] = c.x;
+	r.color[1] = c.y;
+	r.color[2] = c.z;
+}
+
+size_t Scene::loadScene(const std::string& filename)
+{
+	PROFILE_SCOPE("Scene::loadScene");
+	SceneFile file(filename);
+
+	std::vector<std::pair<std::string, std::string>> newModels;
+	for(uint32_t i = 0; i < file.getModelCount(); i++) {
+		if(mModels.find(file.getModelName(i)) == mModels.end())
+			newModels.push_back({file.getModelName(i), file.getModelPath(i)});
+	}
+	if(!newModels.empty())
+		addModels(newModels);
+	for(uint32_t i = 0; i < file.getTextureCount(); i++) {
+		if(mTextureIDs.find(file.getTextureName(i)) == mTextureIDs.end())
+			addTexture(file.getTextureName(i), file.getTexturePath(i));
+	}
+
+	std::vector<const Model*> models;
+	std::vector<const MeshBuffers*> buffers;
+	std::vector<GLuint> textures;
+	for(uint32_t i = 0; i < file.getModelCount(); i++) {
+		const Model* m = mModels[file.getModelName(i)].get();
+		models.push_back(m);
+		buffers.push_back(&mModelBuffers[m]);
+	}
+	for(uint32_t i = 0; i < file.getTextureCount(); i++) {
+		textures.push_back(mTextureIDs[file.getTextureName(i)]);
+	}
+
+	/* reserved up front, so the instances never move */
+	size_t count = file.getInstanceCount();
+	mInstanceBlocks.push_back(std::vector<MeshInstance>());
+	std::vector<MeshInstance>& block = mInstanceBlocks.back();
+	block.reserve(count);
+	mInstanceList.reserve(mInstanceList.size() + count);
+
+	const uint32_t* modelIndices = file.getModelIndices();
+	const uint32_t* textureIndices = file.getTextureIndices();
+	const float* positions = file.getPositions();
+	const float* orientations = file.getOrientations();
+	const float* scales = file.getScales();
+	const uint8_t* flags = file.getFlags();
+	for(size_t i = 0; i < count; i++) {
+		const float* p = positions + i * 3;
+		const float* q = orientations + i * 4;
+		block.emplace_back(*models[modelIndices[i]]);
+		MeshInstance& mi = block.back();
+		mi.setPosition(Vector3(p[0], p[1], p[2]));
+		mi.setOrientation(Quaternion(q[0], q[1], q[2], q[3]));
+		mi.setScale(scales[i]);
+		mi.setStatic(flags[i] & SceneFileFormat::InstanceStatic);
+
+		InstanceEntry ie;
+		ie.instance = &mi;
+		ie.texture = textures[textureIndices[i]];
+		ie.buffers = buffers[modelIndices[i]];
+		ie.batch = -1;
+		mInstanceList.push_back(ie);
+	}
+
+	const SceneFileFormat::LightRecord& dl = file.getDirectionalLight();
+	const SceneFileFormat::LightRecord& pl = file.getPointLight();
+	setLight(mAmbientLight, file.getAmbientLight());
+	setLight(mDirectionalLight, dl);
+	mDirectionalLight.setDirection(Vector3(dl.vector[0], dl.vector[1], dl.vector[2]));
+	setLight(mPointLight, pl);
+	mPointLight.setPosition(Vector3(pl.vector[0], pl.vector[1], pl.vector[2]));
+	mPointLight.setAttenuation(Vector3(pl.attenuation[0], pl.attenuation[1], pl.attenuation[2]));
+
+	return count;
+}
+
+void Scene::saveScene(const std::string& filename) const
+{
+	SceneDescription scene;
+	std::map<const Model*, uint32_t> modelIndices;
+	std::map<GLuint, uint32_t> textureIndices;
+	for(auto& m : mModels) {
+		auto file = mModelFiles.find(m.first);
+		modelIndices[m.second.get()] = scene.models.size();
+		scene.models.push_back({m.first, file == mModelFiles.end() ? "" : file->second});
+	}
+	for(auto& t : mTextureIDs) {
+		auto file = mTextureFiles.find(t.first);
+		textureIndices[t.second] = scene.textures.size();
+		scene.textures.push_back({t.first, file == mTextureFiles.end() ? "" : file->second});
+	}
+
+	for(auto& e : mInstanceList) {
+		const MeshInstance& mi = *e.instance;
+		scene.addInstance(modelIndices[&mi.getModel()], textureIndices[e.texture],
+				mi.getPosition(), mi.getOrientation(), mi.getScale(), mi.isStatic());
+	}
+
+	const Vector3& dir = mDirectionalLight.getDirection();
+	const Vector3& pos = mPointLight.getPosition();
+	const Vector3& at = mPointLight.getAttenuation();
+	getLight(mAmbientLight, scene.ambientLight);
+	getLight(mDirectionalLight, scene.directionalLight);
+	scene.directionalLight.vector[0] = dir.x;
+	scene.directionalLight.vector[1] = dir.y;
+	scene.directionalLight.vector[2] = dir.z;
+	getLight(mPointLight, scene.pointLight);
+	scene.pointLight.vector[0] = pos.x;
+	scene.pointLight.vector[1] = pos.y;
+	scene.pointLight.vector[2] = pos.z;
+	scene.pointLight.attenuation[0] = at.x;
+	scene.pointLight.attenuation[1] = at.y;
+	scene.pointLight.attenuation[2] = at.z;
+
+	SceneFile::write(filename, scene);
+}
+
 }
 
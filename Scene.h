@@ -15,6 +15,13 @@
 #include "libcommon/Texture.h"
 
 #include "Model.h"
+#include "TextureStreamer.h"
+#include "UploadRing.h"
+#include "JobSystem.h"
+#include "ShaderCache.h"
+#include "ResolutionScaler.h"
+#include "SceneFile.h"
+#include "ResourceCache.h"
 
 namespace Scene {
 
@@ -52,7 +59,6 @@ class Camera : public Movable {
 		Common::Vector3 mUp;
 
 		std::map<std::string, std::tuple<float, float, float>> mMovement;
-		std::map<std::tuple<float, float, float>, Common::Vector3> mMovementCache;
 
 		float mHRot;
 		float mVRot;
@@ -66,6 +72,11 @@ class Light {
 		const Common::Vector3& getColor() const;
 		void setColor(const Common::Color& c);
 		void setColor(const Common::Vector3& c);
+		bool isDirty() const;
+		void clearDirty();
+
+	protected:
+		bool mDirty;
 
 	private:
 		bool mOn;
@@ -77,6 +88,9 @@ class PointLight : public Light, public Movable {
 		PointLight(const Common::Vector3& pos, const Common::Vector3& attenuation, const Common::Color& col, bool on = true);
 		const Common::Vector3& getAttenuation() const;
 		void setAttenuation(const Common::Vector3& v);
+		float getInfluenceRadius() const;
+		bool isDirty() const;
+		void clearDirty();
 
 	private:
 		Common::Vector3 mAttenuation;
@@ -92,9 +106,31 @@ class DirectionalLight : public Light {
 		Common::Vector3 mDirection;
 };
 
+struct RenderStats {
+	RenderStats();
+	unsigned int instances;
+	unsigned int drawCalls;
+	unsigned int culledInstances;
+	unsigned int triangles;
+	/* point light evaluations left out of instances out of its reach */
+	unsigned int culledLights;
+	/* draw calls of baked static geometry */
+	unsigned int staticBatches;
+	unsigned int prepassDrawCalls;
+	/* program, texture and vertex buffer changes in both passes */
+	unsigned int stateChanges;
+	/* samples that passed the depth test in the main pass, from an
+	 * occlusion query a couple of frames old; divided by the pixel
+	 * count this is the overdraw */
+	unsigned int shadedSamples;
+	/* fraction of the screen size rendered at */
+	float resolutionScale;
+};
+
 class Scene {
 	public:
 		Scene(float screenWidth, float screenHeight);
+		~Scene();
 		Camera& getDefaultCamera();
 		void addSkyBox();
 		Light& getAmbientLight();
@@ -108,24 +144,170 @@ class Scene {
 		void render();
 		void addTexture(const std::string& name, const std::string& filename);
 		void addModel(const std::string& name, const std::string& filename);
+		/* Throws before loading anything if a name is already used or
+		 * appears twice in models. */
+		void addModels(const std::vector<std::pair<std::string, std::string>>& models);
+		/* Names whose files have the same content share one model or
+		 * texture, which is freed when the last of them is removed.
+		 * Throws if the last name is removed while instances use it. */
+		void removeTexture(const std::string& name);
+		void removeModel(const std::string& name);
+		ResourceStats getResourceStats() const;
+		/* When off, every name loads its own copy. On by default. */
+		void setResourceSharing(bool on);
 		boost::shared_ptr<Model> getModel(const std::string& name);
 		boost::shared_ptr<MeshInstance> addMeshInstance(const std::string& name,
 				const std::string& modelname,
 				const std::string& texturename);
+		/* Adds the instances and lights of a scene file, loading the
+		 * models and textures it names that aren't in the scene yet.
+		 * The instances are unnamed and stored in one block. Returns
+		 * the number of instances added. */
+		size_t loadScene(const std::string& filename);
+		void saveScene(const std::string& filename) const;
+		void setTextureStreaming(bool on);
+		/* Lays down depth front to back with a position-only pass and
+		 * then shades with an equal depth test, so each pixel is only
+		 * shaded once. */
+		void setDepthPrepass(bool on);
+		bool getDepthPrepass() const;
+		/* Renders at a lower resolution when the GPU time of a frame
+		 * goes over the target, and scales up to the screen size. A
+		 * target of 0 renders at the screen size again. Returns false
+		 * if not supported. */
+		bool setDynamicResolution(double targetFrameTime);
+		const ResolutionScalerStats* getResolutionStats() const;
+		TextureStreamer& getTextureStreamer();
+		const RenderStats& getRenderStats() const;
+		/* Merges the static instances into pre-transformed buffers, one
+		 * per texture and region of space. Editing a baked instance
+		 * puts its whole batch back to per-instance drawing until the
+		 * next bake. */
+		void bakeStaticGeometry();
+		/* Whether anything drawn has changed since the last render(). */
+		bool isDirty() const;
+		JobSystem& getJobSystem();
+		const UploadRingStats* getDrawRingStats() const;
 
 	private:
-		void calculateModelMatrix(const MeshInstance& mi);
-		void updateMVPMatrix(const MeshInstance& mi);
+		/* Per-draw uniforms; matches the std140 layout of the DrawData
+		 * block in scene.vert. */
+		struct DrawData {
+			GLfloat mvp[16];
+			GLfloat inverseMVP[16];
+			GLfloat pointLightPosition[4];
+		};
+
+		/* Position, texcoord, normal and index buffers. */
+		struct MeshBuffers {
+			GLuint vbos[4];
+			GLenum indexType;
+		};
+
+		struct DrawPacket {
+			GLuint texture;
+			const MeshBuffers* buffers;
+			GLsizei indexCount;
+			unsigned int instanceCount;
+			bool baked;
+			float screenSize;
+			/* distance from the camera to the bounding sphere centre */
+			float depth;
+			size_t offset;
+			unsigned int features;
+			const DrawData* data;
+		};
+
+		struct InstanceEntry {
+			MeshInstance* instance;
+			GLuint texture;
+			const MeshBuffers* buffers;
+			/* index to mStaticBatches or -1 */
+			int batch;
+		};
+
+		/* Static instances with the same texture in one cell of a grid,
+		 * in world space. */
+		struct StaticBatch {
+			GLuint texture;
+			MeshBuffers buffers;
+			GLsizei indexCount;
+			Common::Vector3 center;
+			float radius;
+			std::vector<size_t> instances;
+			/* cleared when one of the instances is edited */
+			bool baked;
+		};
+
+		/* Only textures loaded through libcommon have texture set. */
+		struct TextureResource {
+			GLuint id;
+			bool streamed;
+			boost::shared_ptr<Common::Texture> texture;
+		};
+
+		/* Bits of the shader variant index; each adds a #define to
+		 * scene.vert and scene.frag. */
+		enum ShaderFeature {
+			FeatureAmbientLight     = 1 << 0,
+			FeatureDirectionalLight = 1 << 1,
+			FeaturePointLight       = 1 << 2,
+			/* used alone, for the depth pre-pass */
+			FeatureDepthOnly        = 1 << 3,
+			NumShaderVariants       = 1 << 4
+		};
+
+		/* Indices into ShaderVariant::uniforms */
+		enum ShaderUniform {
+			UniformMVP,
+			UniformInverseMVP,
+			UniformTexture,
+			UniformAmbientLight,
+			UniformDirectionalLightDirection,
+			UniformDirectionalLightColor,
+			UniformPointLightPosition,
+			UniformPointLightAttenuation,
+			UniformPointLightColor,
+			NumShaderUniforms
+		};
+
+		struct ShaderVariant {
+			ShaderVariant();
+			ShaderBuild build;
+			GLuint program;
+			bool failed;
+			GLint uniforms[NumShaderUniforms];
+		};
+
+		void clearDirty();
 		void updateFrameMatrices(const Camera& cam);
-		void bindAttributes();
+		bool isVisible(const Common::Vector3& center, float radius) const;
+		void buildDrawPackets(unsigned int features);
+		void renderDepthPrepass();
+		void unbakeEditedBatches();
+		void releaseStaticBatches();
+		void bindMeshBuffers(const MeshBuffers& buffers, int attributes = 3);
+		std::string shaderDefines(unsigned int features) const;
+		void startShaderVariant(unsigned int features);
+		bool finishShaderVariant(unsigned int features);
+		ShaderVariant& getShaderVariant(unsigned int features);
+		void uploadFrameUniforms(ShaderVariant& shader, unsigned int features);
+		void bindAttributes(GLuint program);
 		void setupModelData(const Model& model);
-		boost::shared_ptr<Common::Texture> getModelTexture(const std::string& mname) const;
+		void releaseModelData(const Model& model);
+		uint64_t resourceKey(const std::string& filename);
+		TextureResource loadTexture(const std::string& filename, size_t& bytes);
+		void releaseTexture(const TextureResource& t);
+		float projectedSize(const Common::Vector3& center, float radius) const;
 
 		float mScreenWidth;
 		float mScreenHeight;
 
-		GLuint mProgramObject;
-		std::map<const char*, GLint> mUniformLocationMap;
+		std::vector<ShaderVariant> mShaderVariants;
+		GLuint mCurrentProgram;
+
+		bool mUseDrawBlock;
+		boost::shared_ptr<UploadRing> mDrawRing;
 
 		Camera mDefaultCamera;
 
@@ -133,17 +315,46 @@ class Scene {
 		DirectionalLight mDirectionalLight;
 		PointLight mPointLight;
 
-		std::map<std::string, boost::shared_ptr<Common::Texture>> mTextures;
-
-		Common::Matrix44 mInverseModelMatrix;
-		Common::Matrix44 mModelMatrix;
+		std::map<std::string, GLuint> mTextureIDs;
+		bool mTextureStreaming;
+		TextureStreamer mTextureStreamer;
 
 		Common::Matrix44 mViewMatrix;
 		Common::Matrix44 mPerspectiveMatrix;
+		Common::Matrix44 mViewPerspectiveMatrix;
+		float mFrustum[6][4];
 
 		std::map<std::string, boost::shared_ptr<Model>> mModels;
+		std::map<std::string, std::string> mModelFiles;
+		std::map<std::string, std::string> mTextureFiles;
+		std::map<const Model*, MeshBuffers> mModelBuffers;
+		ContentKeys mContentKeys;
+		ResourceCache<boost::shared_ptr<Model>> mModelCache;
+		ResourceCache<TextureResource> mTextureCache;
+		std::map<std::string, uint64_t> mModelKeys;
+		std::map<std::string, uint64_t> mTextureKeys;
+		bool mResourceSharing;
 		std::map<std::string, boost::shared_ptr<MeshInstance>> mMeshInstances;
-		std::map<std::string, boost::shared_ptr<Common::Texture>> mMeshInstanceTextures;
+		/* instances from scene files, one block per file */
+		std::vector<std::vector<MeshInstance>> mInstanceBlocks;
+		std::vector<InstanceEntry> mInstanceList;
+		std::vector<StaticBatch> mStaticBatches;
+		bool mStaticBatchesChanged;
+
+		JobSystem mJobs;
+		size_t mNumPacketChunks;
+		std::vector<std::vector<DrawPacket>> mPackets;
+		std::vector<std::vector<DrawData>> mPacketData;
+		RenderStats mStats;
+
+		bool mDepthPrepass;
+		boost::shared_ptr<ResolutionScaler> mResolutionScaler;
+		bool mDynamicResolution;
+		std::vector<const DrawPacket*> mDepthOrder;
+		GLuint mSampleQueries[2];
+		bool mSampleQueryIssued[2];
+		unsigned int mFrame;
+		unsigned int mShadedSamples;
 };
 
 }
@@ -0,0 +1,460 @@
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include "Scene.h"
+#include "OffscreenContext.h"
+#include "Benchmark.h"
+#include "ShaderCache.h"
+#include "FrameCapture.h"
+#include "AssetPack.h"
+#include "MemoryTracker.h"
+#include "JSON.h"
+
+#include "libcommon/Math.h"
+
+using namespace Common;
+
+/* Features that can be swept, as bits of a feature set */
+enum BenchFeature {
+	FeatureStatic  = 1 << 0,
+	FeaturePrepass = 1 << 1
+};
+
+struct SceneBenchOptions {
+	SceneBenchOptions();
+	int width;
+	int height;
+	unsigned int frames;
+	unsigned int warmupFrames;
+	std::vector<unsigned int> instanceCounts;
+	std::vector<unsigned int> lightCounts;
+	/* empty means just the set given by --static and --depth-prepass */
+	std::vector<unsigned int> featureSets;
+	unsigned int models;
+	std::string modelFile;
+	std::string textureFile;
+	std::string sceneFile;
+	std::string packFile;
+	size_t textureBudget;
+	bool bakeStatic;
+	bool depthPrepass;
+	double gpuTarget;
+	std::string capturePath;
+	std::string jsonOut;
+};
+
+SceneBenchOptions::SceneBenchOptions()
+	: width(800),
+	height(600),
+	frames(300),
+	warmupFrames(30),
+	instanceCounts(1, 1000),
+	lightCounts(1, 3),
+	models(1),
+	modelFile("textured-cube.obj"),
+	textureFile("snow.jpg"),
+	textureBudget(0),
+	bakeStatic(false),
+	depthPrepass(false),
+	gpuTarget(0.0)
+{
+}
+
+struct SceneBenchResult {
+	unsigned int instances;
+	unsigned int lights;
+	unsigned int features;
+	unsigned int models;
+	BenchmarkStats frameTime;
+	BenchmarkStats cpuTime;
+	Scene::RenderStats renderStats;
+	/* of the scene file */
+	double loadTime;
+	Scene::ResourceStats resourceStats;
+	/* high-water marks of the MemoryTracker during the run */
+	size_t peakCPUBytes;
+	size_t peakGPUBytes;
+};
+
+static const float InstanceSpacing = 3.0f;
+
+/* Places the camera on a circle around the instance grid, looking at
+ * its centre, so every run sees the same sequence of views. */
+static void moveCamera(Scene::Camera& camera, float& yaw, float radius,
+		const Vector3& center, unsigned int frame, unsigned int frames)
+{
+	float angle = 2.0f * PI * frame / frames;
+	camera.setPosition(center + Vector3(radius * cos(angle), 0.0f, radius * sin(angle)));
+
+	float targetYaw = atan2(sin(angle), -cos(angle));
+	camera.rotate(targetYaw - yaw, 0.0f);
+	yaw = targetYaw;
+}
+
+static std::string featureName(unsigned int features)
+{
+	std::string name;
+	if(features & FeatureStatic)
+		name += "static";
+	if(features & FeaturePrepass)
+		name += name.empty() ? "prepass" : "+prepass";
+	return name.empty() ? "none" : name;
+}
+
+static SceneBenchResult runScene(const SceneBenchOptions& options, unsigned int instances,
+		unsigned int lights, unsigned int features, FrameCapture* capture)
+{
+	bool bakeStatic = features & FeatureStatic;
+	SceneBenchResult result;
+	result.instances = instances;
+	result.lights = lights;
+	result.features = features;
+	result.models = options.models;
+	result.loadTime = 0.0;
+
+	/* the previous run's scene is gone by now */
+	MemoryTracker::resetPeaks();
+	Scene::Scene scene(options.width, options.height);
+	if(options.textureBudget) {
+		scene.setTextureStreaming(true);
+		scene.getTextureStreamer().setBudget(options.textureBudget);
+	}
+
+	if(!options.sceneFile.empty()) {
+		/* the camera path assumes the grid laid out below */
+		double start = Benchmark::now();
+		instances = scene.loadScene(options.sceneFile);
+		result.loadTime = Benchmark::now() - start;
+		result.instances = instances;
+		std::cout << "Loaded " << instances << " instances in "
+			<< result.loadTime * 1000.0 << " ms\n";
+		result.resourceStats = scene.getResourceStats();
+		std::cout << result.resourceStats.duplicates << " duplicate models and textures shared, "
+			<< result.resourceStats.savedBytes / 1024 << " kB saved\n";
+	} else {
+		/* every model has buffers of its own even when loaded from the same file */
+		scene.setResourceSharing(false);
+		std::vector<std::pair<std::string, std::string>> models;
+		for(unsigned int i = 0; i < options.models; i++) {
+			std::ostringstream name;
+			name << "Model" << i;
+			models.push_back(std::make_pair(name.str(), options.modelFile));
+		}
+		scene.addModels(models);
+		scene.addTexture("Texture", options.textureFile);
+
+		unsigned int side = std::max(1, int(ceil(cbrt(instances))));
+		for(unsigned int i = 0; i < instances; i++) {
+			std::ostringstream name;
+			name << "Instance" << i;
+			auto mi = scene.addMeshInstance(name.str(), models[i % models.size()].first, "Texture");
+			mi->setPosition(Vector3(i % side, (i / side) % side, i / (side * side)) * InstanceSpacing);
+			mi->setRotationFromEuler(Vector3(i * 0.1f, i * 0.2f, i * 0.3f));
+			mi->setStatic(bakeStatic);
+		}
+	}
+	unsigned int side = std::max(1, int(ceil(cbrt(instances))));
+
+	if(bakeStatic) {
+		scene.bakeStaticGeometry();
+	}
+	scene.setDepthPrepass(features & FeaturePrepass);
+	if(options.gpuTarget > 0.0 && !scene.setDynamicResolution(options.gpuTarget)) {
+		std::cerr << "Dynamic resolution not supported.\n";
+	}
+
+	scene.getAmbientLight().setState(lights > 0);
+	scene.getAmbientLight().setColor(Vector3(0.3, 0.3, 0.3));
+	scene.getDirectionalLight().setState(lights > 1);
+	scene.getDirectionalLight().setDirection(Vector3(1, 1, 1));
+	scene.getDirectionalLight().setColor(Vector3(1, 0.8, 0.0));
+	scene.getPointLight().setState(lights > 2);
+	scene.getPointLight().setAttenuation(Vector3(0, 0, 3));
+	scene.getPointLight().setColor(Vector3(0.9, 0.2, 0.4));
+
+	float extent = (side - 1) * InstanceSpacing;
+	Vector3 center(extent * 0.5f, extent * 0.5f, extent * 0.5f);
+	float radius = std::max(extent * 0.75f, 5.0f);
+	scene.getPointLight().setPosition(center);
+
+	Scene::Camera& camera = scene.getDefaultCamera();
+	float yaw = 0.0f;
+
+	std::vector<double> frameTimes;
+	std::vector<double> cpuTimes;
+	unsigned int total = options.warmupFrames + options.frames;
+	for(unsigned int i = 0; i < total; i++) {
+		moveCamera(camera, yaw, radius, center, i, total);
+
+		double start = Benchmark::now();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		scene.render();
+		if(capture && i >= options.warmupFrames)
+			capture->capture();
+		double submitted = Benchmark::now();
+		glFinish();
+		double end = Benchmark::now();
+
+		if(i >= options.warmupFrames) {
+			frameTimes.push_back(end - start);
+			cpuTimes.push_back(submitted - start);
+		}
+	}
+
+	result.frameTime = Benchmark::calculate(frameTimes);
+	result.cpuTime = Benchmark::calculate(cpuTimes);
+	result.renderStats = scene.getRenderStats();
+	result.peakCPUBytes = MemoryTracker::getCPUTotal().peak;
+	result.peakGPUBytes = MemoryTracker::getGPUTotal().peak;
+	return result;
+}
+
+static void writeStats(std::ostream& os, const BenchmarkStats& s)
+{
+	os << "{\"mean\":" << s.mean * 1000.0
+		<< ",\"stddev\":" << s.stddev * 1000.0
+		<< ",\"min\":" << s.min * 1000.0
+		<< ",\"max\":" << s.max * 1000.0
+		<< ",\"p50\":" << s.p50 * 1000.0
+		<< ",\"p95\":" << s.p95 * 1000.0
+		<< ",\"p99\":" << s.p99 * 1000.0 << "}";
+}
+
+static bool writeJSON(const SceneBenchOptions& options, const std::vector<SceneBenchResult>& results)
+{
+	std::ofstream out(options.jsonOut.c_str());
+	if(!out.is_open()) {
+		std::cerr << "Unable to open " << options.jsonOut << " for writing.\n";
+		return false;
+	}
+
+	out << std::fixed << std::setprecision(4);
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	out << "{\n\"renderer\":";
+	writeJSONString(out, renderer ? reinterpret_cast<const char*>(renderer) : "");
+	out << ",\n\"width\":" << options.width << ",\"height\":" << options.height
+		<< ",\"frames\":" << options.frames << ",\"warmupFrames\":" << options.warmupFrames
+		<< ",\"unit\":\"ms\",\n\"results\":[\n";
+	for(size_t i = 0; i < results.size(); i++) {
+		const auto& r = results[i];
+		out << (i ? ",\n" : "") << "{\"instances\":" << r.instances
+			<< ",\"features\":\"" << featureName(r.features) << "\""
+			<< ",\"static\":" << (r.features & FeatureStatic ? "true" : "false")
+			<< ",\"depthPrepass\":" << (r.features & FeaturePrepass ? "true" : "false")
+			<< ",\"models\":" << r.models
+			<< ",\"lights\":" << r.lights
+			<< ",\"drawCalls\":" << r.renderStats.drawCalls
+			<< ",\"culledInstances\":" << r.renderStats.culledInstances
+			<< ",\"triangles\":" << r.renderStats.triangles
+			<< ",\"culledLights\":" << r.renderStats.culledLights
+			<< ",\"staticBatches\":" << r.renderStats.staticBatches
+			<< ",\"prepassDrawCalls\":" << r.renderStats.prepassDrawCalls
+			<< ",\"overdraw\":" << r.renderStats.shadedSamples / (double(options.width * options.height) *
+					r.renderStats.resolutionScale * r.renderStats.resolutionScale)
+			<< ",\"resolutionScale\":" << r.renderStats.resolutionScale
+			<< ",\"loadTime\":" << r.loadTime * 1000.0
+			<< ",\"sharedResources\":" << r.resourceStats.duplicates
+			<< ",\"savedBytes\":" << r.resourceStats.savedBytes
+			<< ",\"peakCPUBytes\":" << r.peakCPUBytes
+			<< ",\"peakGPUBytes\":" << r.peakGPUBytes
+			<< ",\"frameTime\":";
+		writeStats(out, r.frameTime);
+		out << ",\"cpuTime\":";
+		writeStats(out, r.cpuTime);
+		out << "}";
+	}
+	out << "\n]}\n";
+	return true;
+}
+
+/* Feature sets such as "none,static,static+prepass" */
+static bool parseFeatureSets(const char* s, std::vector<unsigned int>& sets)
+{
+	std::istringstream ss(s);
+	std::string item;
+	while(std::getline(ss, item, ',')) {
+		unsigned int features = 0;
+		std::istringstream is(item);
+		std::string name;
+		while(std::getline(is, name, '+')) {
+			if(name == "static") {
+				features |= FeatureStatic;
+			} else if(name == "prepass") {
+				features |= FeaturePrepass;
+			} else if(name != "none") {
+				std::cerr << "Unknown feature " << name << ".\n";
+				return false;
+			}
+		}
+		sets.push_back(features);
+	}
+	return !sets.empty();
+}
+
+static std::vector<unsigned int> parseList(const char* s)
+{
+	std::vector<unsigned int> values;
+	std::istringstream ss(s);
+	std::string item;
+	while(std::getline(ss, item, ',')) {
+		values.push_back(atoi(item.c_str()));
+	}
+	return values;
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " [options]\n"
+		<< "\t--instances <n,...>   instance counts to sweep (default 1000)\n"
+		<< "\t--lights <n,...>      number of lights enabled, 0-3 (default 3)\n"
+		<< "\t--models <n>          number of distinct models (default 1)\n"
+		<< "\t--model <file>        model file (default textured-cube.obj)\n"
+		<< "\t--texture <file>      texture file (default snow.jpg)\n"
+		<< "\t--texture-budget <MB> enable texture streaming\n"
+		<< "\t--scene <file>        load the instances from a scene file instead\n"
+		<< "\t--pack <file>         read models, textures and shaders from an asset pack\n"
+		<< "\t--static              bake the instances into static batches\n"
+		<< "\t--depth-prepass       draw a depth-only pass before shading\n"
+		<< "\t--features <set,...>  feature sets to sweep instead, each none or\n"
+		<< "\t                      static and prepass joined by +, e.g. none,static+prepass\n"
+		<< "\t--dynamic-resolution <ms> scale the resolution to this GPU time\n"
+		<< "\t--capture <file>      write the measured frames to a .y4m file or\n"
+		<< "\t                      to PNGs named by a pattern like frame%05u.png\n"
+		<< "\t--frames <n>          measured frames per run (default 300)\n"
+		<< "\t--warmup <n>          frames rendered before measuring (default 30)\n"
+		<< "\t--size <w>x<h>        framebuffer size (default 800x600)\n"
+		<< "\t--json <file>         write results as JSON\n"
+		<< "\t--memory-report <file> write CPU and GPU memory use by category at exit,\n"
+		<< "\t                      as JSON if the name ends in .json, CSV otherwise\n"
+		<< "\t--no-shader-cache     always compile the shaders\n";
+}
+
+int main(int argc, char** argv)
+{
+	SceneBenchOptions options;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--instances") && i + 1 < argc) {
+			options.instanceCounts = parseList(argv[++i]);
+		} else if(!strcmp(argv[i], "--lights") && i + 1 < argc) {
+			options.lightCounts = parseList(argv[++i]);
+		} else if(!strcmp(argv[i], "--models") && i + 1 < argc) {
+			options.models = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--model") && i + 1 < argc) {
+			options.modelFile = argv[++i];
+		} else if(!strcmp(argv[i], "--texture") && i + 1 < argc) {
+			options.textureFile = argv[++i];
+		} else if(!strcmp(argv[i], "--texture-budget") && i + 1 < argc) {
+			options.textureBudget = size_t(strtoull(argv[++i], NULL, 10)) * 1024 * 1024;
+		} else if(!strcmp(argv[i], "--scene") && i + 1 < argc) {
+			options.sceneFile = argv[++i];
+			options.instanceCounts.assign(1, 0);
+		} else if(!strcmp(argv[i], "--pack") && i + 1 < argc) {
+			options.packFile = argv[++i];
+		} else if(!strcmp(argv[i], "--static")) {
+			options.bakeStatic = true;
+		} else if(!strcmp(argv[i], "--depth-prepass")) {
+			options.depthPrepass = true;
+		} else if(!strcmp(argv[i], "--features") && i + 1 < argc) {
+			if(!parseFeatureSets(argv[++i], options.featureSets)) {
+				usage(argv[0]);
+				exit(1);
+			}
+		} else if(!strcmp(argv[i], "--dynamic-resolution") && i + 1 < argc) {
+			options.gpuTarget = atof(argv[++i]) / 1000.0;
+		} else if(!strcmp(argv[i], "--capture") && i + 1 < argc) {
+			options.capturePath = argv[++i];
+		} else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+			options.frames = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			options.warmupFrames = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+			if(sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+				usage(argv[0]);
+				exit(1);
+			}
+		} else if(!strcmp(argv[i], "--json") && i + 1 < argc) {
+			options.jsonOut = argv[++i];
+		} else if(!strcmp(argv[i], "--memory-report") && i + 1 < argc) {
+			MemoryTracker::setReportAtExit(argv[++i]);
+		} else if(!strcmp(argv[i], "--no-shader-cache")) {
+			ShaderCache::setEnabled(false);
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if(options.featureSets.empty()) {
+		options.featureSets.push_back((options.bakeStatic ? FeatureStatic : 0) |
+				(options.depthPrepass ? FeaturePrepass : 0));
+	}
+
+	std::vector<SceneBenchResult> results;
+
+	try {
+		if(!options.packFile.empty())
+			AssetPack::setCurrent(boost::shared_ptr<AssetPack>(new AssetPack(options.packFile)));
+		OffscreenContext context(options.width, options.height);
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+
+		boost::shared_ptr<FrameCapture> capture;
+		if(!options.capturePath.empty()) {
+			const std::string& path = options.capturePath;
+			bool y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+			capture = boost::shared_ptr<FrameCapture>(new FrameCapture(options.width, options.height,
+						y4m ? CaptureFormat::Y4M : CaptureFormat::PNG, path));
+		}
+		std::cout << std::setw(10) << "instances" << std::setw(8) << "lights"
+			<< std::setw(16) << "features" << std::setw(10) << "drawn" << std::setw(10) << "p50 ms"
+			<< std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms"
+			<< std::setw(10) << "cpu ms" << "\n";
+
+		for(auto instances : options.instanceCounts) {
+			for(auto lights : options.lightCounts) {
+				for(auto features : options.featureSets) {
+					auto r = runScene(options, instances, lights, features, capture.get());
+					std::cout << std::fixed << std::setprecision(3)
+						<< std::setw(10) << r.instances << std::setw(8) << r.lights
+						<< std::setw(16) << featureName(r.features)
+						<< std::setw(10) << r.renderStats.drawCalls
+						<< std::setw(10) << r.frameTime.p50 * 1000.0
+						<< std::setw(10) << r.frameTime.p95 * 1000.0
+						<< std::setw(10) << r.frameTime.p99 * 1000.0
+						<< std::setw(10) << r.cpuTime.p50 * 1000.0 << "\n";
+					results.push_back(r);
+				}
+			}
+		}
+
+		ShaderCache::printStats(std::cout);
+		if(capture) {
+			capture->finish();
+			capture->printStats(std::cout);
+		}
+
+		if(!options.jsonOut.empty()) {
+			writeJSON(options, results);
+		}
+	} catch(std::exception& e) {
+		std::cerr << "std::exception: " << e.what() << "\n";
+		return 1;
+	} catch(...) {
+		std::cerr << "Unknown exception.\n";
+		return 1;
+	}
+
+	return 0;
+}
+
@@ -1,4 +1,19 @@
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #include "Scene.h"
+#include "TripleBuffer.h"
+#include "Profiler.h"
+#include "FramePacer.h"
+#include "ShaderCache.h"
+#include "FrameCapture.h"
+#include "GLTrace.h"
+#include "AssetPack.h"
+#include "MemoryTracker.h"
+#include "Hud.h"
 
 #include "libcommon/Math.h"
 #include "libcommon/Clock.h"
@@ -9,9 +24,91 @@ static int screenHeight = 600;
 
 using namespace Common;
 
+struct SceneCubeOptions {
+	SceneCubeOptions();
+	size_t textureBudget;
+	bool pipelined;
+	std::string profileOut;
+	double fps;
+	SwapMode swapMode;
+	bool onDemand;
+	double gpuTarget;
+	std::string capturePath;
+	std::string scenePath;
+	std::string saveScenePath;
+	std::string packPath;
+	/* written at exit, and on F6 */
+	std::string memoryReport;
+	/* F5 also starts a trace */
+	bool trace;
+	std::string tracePath;
+	unsigned int traceFrames;
+	/* F7 toggles the HUD */
+	bool hud;
+	std::string hudFont;
+	int hudFontSize;
+};
+
+SceneCubeOptions::SceneCubeOptions()
+	: textureBudget(0),
+	pipelined(false),
+	fps(0.0),
+	swapMode(SwapMode::Immediate),
+	onDemand(false),
+	gpuTarget(0.0),
+	memoryReport("SceneCube-memory.csv"),
+	trace(false),
+	tracePath("SceneCube.glt"),
+	traceFrames(10),
+	hud(false),
+	hudFont("/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"),
+	hudFontSize(12)
+{
+}
+
+struct InstanceTransform {
+	Vector3 position;
+	Quaternion orientation;
+};
+
+/* Everything the renderer needs from one simulation step. */
+struct SimulationSnapshot {
+	SimulationSnapshot();
+	Vector3 cameraPosition;
+	Vector3 ambientLight;
+	Vector3 pointLightPosition;
+	std::vector<InstanceTransform> instances;
+	unsigned int frame;
+	double time;
+};
+
+SimulationSnapshot::SimulationSnapshot()
+	: frame(0),
+	time(0.0)
+{
+}
+
+static bool equal(const Vector3& a, const Vector3& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool equal(const Quaternion& a, const Quaternion& b)
+{
+	return a.w == b.w && a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool inputPending()
+{
+	SDL_Event ev;
+	SDL_PumpEvents();
+	return SDL_PeepEvents(&ev, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) > 0;
+}
+
 class SceneCube : public Common::Driver {
 	public:
-		SceneCube();
+		SceneCube(const SceneCubeOptions& options);
+		~SceneCube();
 		virtual bool handleKeyDown(float frameTime, SDLKey key) override;
 		virtual bool handleKeyUp(float frameTime, SDLKey key) override;
 		virtual bool handleMouseMotion(float frameTime, const SDL_MouseMotionEvent& ev) override;
@@ -19,64 +116,258 @@ class SceneCube : public Common::Driver {
 		virtual void drawFrame() override;
 
 	private:
-		void handleMouseMove(float dx, float dy);
+		void markInput();
+		void latchInput();
+		void controlCamera(const std::function<void (Scene::Camera&)>& f);
+		void simulate(float frameTime, Scene::Camera& camera, SimulationSnapshot& snap);
+		void applySnapshot(const SimulationSnapshot& snap);
+		void simulationLoop();
+		void syncSimInstances();
+		void printFrameStats() const;
+		void toggleHud();
+
 		Scene::Scene mScene;
 		Scene::Camera& mCamera;
 		float mPosStep;
 		float mRotStep;
+
+		/* Mouse motion is summed up over the frame and applied to the
+		 * camera once, right before the scene is submitted. */
+		float mMouseX;
+		float mMouseY;
+		double mInputTime;
+		double mPresentedInputTime;
 		bool mAmbientLightEnabled;
 		bool mDirectionalLightEnabled;
 		bool mPointLightEnabled;
 		std::map<SDLKey, std::function<void (float)>> mControls;
+		std::vector<boost::shared_ptr<MeshInstance>> mInstances;
+
+		/* Pipelined mode: the simulation thread owns mSimCamera and
+		 * mSimInstances and publishes snapshots through mSnapshots. Input
+		 * is forwarded to it through mSimInput, and a new instance set
+		 * through mSimInstanceSync. mSimFrameTime sums up the frame times
+		 * of all ticks since the simulation last ran. */
+		bool mPipelined;
+		std::thread mSimThread;
+		std::mutex mSimMutex;
+		std::condition_variable mSimWake;
+		unsigned int mSimTick;
+		float mSimFrameTime;
+		bool mSimQuit;
+		std::vector<std::function<void (Scene::Camera&)>> mSimInput;
+		Scene::Camera mSimCamera;
+		std::vector<InstanceTransform> mSimInstances;
+		std::vector<InstanceTransform> mSimInstanceSync;
+		bool mSimInstancesChanged;
+		unsigned int mSimFrame;
+		Scene::TripleBuffer<SimulationSnapshot> mSnapshots;
+		SimulationSnapshot mSerialSnapshot;
+
+		double mLatencySum;
+		double mLatencyMax;
+		unsigned int mLatencyFrames;
+
+		double mInputLatencySum;
+		double mInputLatencyMax;
+		unsigned int mInputLatencyFrames;
+
+		FramePacer mPacer;
+		/* whether the last frame drawn showed a change */
+		bool mSceneChanged;
+		boost::shared_ptr<FrameCapture> mCapture;
+		std::string mTracePath;
+		unsigned int mTraceFrames;
+		bool mStartTrace;
+		std::string mMemoryReport;
+
+		/* created when first shown */
+		boost::shared_ptr<Scene::Hud> mHud;
+		std::string mHudFont;
+		int mHudFontSize;
+		bool mHudFailed;
 };
 
-SceneCube::SceneCube()
+SceneCube::SceneCube(const SceneCubeOptions& options)
 	: Common::Driver(screenWidth, screenHeight, "Cube"),
-	mScene(Scene::Scene(800, 600)),
+	mScene(800, 600),
 	mCamera(mScene.getDefaultCamera()),
-	mPosStep(0.1f),
+	mPosStep(6.0f),
 	mRotStep(0.02f),
+	mMouseX(0.0f),
+	mMouseY(0.0f),
+	mInputTime(0.0),
+	mPresentedInputTime(0.0),
 	mAmbientLightEnabled(true),
 	mDirectionalLightEnabled(true),
-	mPointLightEnabled(true)
+	mPointLightEnabled(true),
+	mPipelined(false),
+	mSimTick(0),
+	mSimFrameTime(0.0f),
+	mSimQuit(false),
+	mSimInstancesChanged(false),
+	mSimFrame(0),
+	mLatencySum(0.0),
+	mLatencyMax(0.0),
+	mLatencyFrames(0),
+	mInputLatencySum(0.0),
+	mInputLatencyMax(0.0),
+	mInputLatencyFrames(0),
+	mSceneChanged(true),
+	mTracePath(options.tracePath),
+	mTraceFrames(options.traceFrames),
+	mStartTrace(options.trace),
+	mMemoryReport(options.memoryReport),
+	mHudFont(options.hudFont),
+	mHudFontSize(options.hudFontSize),
+	mHudFailed(false)
 {
-	mControls[SDLK_UP] = [&] (float p) { mCamera.setForwardMovement(p); };
-	mControls[SDLK_PAGEUP] = [&] (float p) { mCamera.setUpwardsMovement(p); };
-	mControls[SDLK_RIGHT] = [&] (float p) { mCamera.setSidewaysMovement(p); };
-	mControls[SDLK_DOWN] = [&] (float p) { mCamera.setForwardMovement(-p); };
-	mControls[SDLK_PAGEDOWN] = [&] (float p) { mCamera.setUpwardsMovement(-p); };
-	mControls[SDLK_LEFT] = [&] (float p) { mCamera.setSidewaysMovement(-p); };
+	mControls[SDLK_UP] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setForwardMovement(p); }); };
+	mControls[SDLK_PAGEUP] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setUpwardsMovement(p); }); };
+	mControls[SDLK_RIGHT] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setSidewaysMovement(p); }); };
+	mControls[SDLK_DOWN] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setForwardMovement(-p); }); };
+	mControls[SDLK_PAGEDOWN] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setUpwardsMovement(-p); }); };
+	mControls[SDLK_LEFT] = [&] (float p) { controlCamera([=] (Scene::Camera& c) { c.setSidewaysMovement(-p); }); };
 
 	mCamera = mScene.getDefaultCamera();
 	mCamera.setPosition(Vector3(1.9f, 1.9f, -4.2f));
 	mCamera.rotate(Math::degreesToRadians(90), 0);
-	handleMouseMove(0, 0);
+	ShaderCache::printStats(std::cout);
+
+	mPacer.setTargetFPS(options.fps);
+	mPacer.setOnDemand(options.onDemand);
+	if(options.swapMode != SwapMode::Immediate && !mPacer.setSwapMode(options.swapMode)) {
+		std::cerr << "Requested swap interval not supported.\n";
+	}
 
-	mScene.addModel("Cube", "textured-cube.obj");
-	mScene.addTexture("Snow", "snow.jpg");
+	if(options.gpuTarget > 0.0 && !mScene.setDynamicResolution(options.gpuTarget)) {
+		std::cerr << "Dynamic resolution not supported.\n";
+	}
 
-	auto mi1 = mScene.addMeshInstance("Cube1", "Cube", "Snow");
-	mi1->setPosition(Vector3(-0.1, 0.0f, 0.0f));
+	if(!options.capturePath.empty()) {
+		const std::string& path = options.capturePath;
+		bool y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+		mCapture = boost::shared_ptr<FrameCapture>(new FrameCapture(screenWidth, screenHeight,
+					y4m ? CaptureFormat::Y4M : CaptureFormat::PNG, path));
+	}
 
-	auto mi2 = mScene.addMeshInstance("Cube2", "Cube", "Snow");
-	mi2->setPosition(Vector3(3.0f, 3.0f, 0.0f));
-	mi2->setRotationFromEuler(Vector3(Math::degreesToRadians(149),
-				Math::degreesToRadians(150),
-				Math::degreesToRadians(38)));
+	if(options.textureBudget) {
+		mScene.setTextureStreaming(true);
+		mScene.getTextureStreamer().setBudget(options.textureBudget);
+	}
 
-	mScene.getAmbientLight().setState(mAmbientLightEnabled);
-	mScene.getDirectionalLight().setState(mDirectionalLightEnabled);
-	mScene.getDirectionalLight().setDirection(Vector3(1, 1, 1));
-	mScene.getDirectionalLight().setColor(Vector3(1, 0.8, 0.0));
-	mScene.getPointLight().setState(mPointLightEnabled);
-	mScene.getPointLight().setAttenuation(Vector3(0, 0, 3));
-	mScene.getPointLight().setColor(Vector3(0.9, 0.2, 0.4));
+	if(!options.scenePath.empty()) {
+		/* the instances of a scene file aren't animated */
+		double start = Clock::getTime();
+		size_t count = mScene.loadScene(options.scenePath);
+		std::cout << "Loaded " << count << " instances from " << options.scenePath
+			<< " in " << (Clock::getTime() - start) * 1000.0 << " ms.\n";
+		auto resources = mScene.getResourceStats();
+		std::cout << resources.duplicates << " duplicate models and textures shared, "
+			<< resources.savedBytes / 1024 << " kB saved.\n";
+		mAmbientLightEnabled = mScene.getAmbientLight().isOn();
+		mDirectionalLightEnabled = mScene.getDirectionalLight().isOn();
+		mPointLightEnabled = mScene.getPointLight().isOn();
+	} else {
+		mScene.addModel("Cube", "textured-cube.obj");
+		mScene.addTexture("Snow", "snow.jpg");
+
+		auto mi1 = mScene.addMeshInstance("Cube1", "Cube", "Snow");
+		mi1->setPosition(Vector3(-0.1, 0.0f, 0.0f));
+
+		auto mi2 = mScene.addMeshInstance("Cube2", "Cube", "Snow");
+		mi2->setPosition(Vector3(3.0f, 3.0f, 0.0f));
+		mi2->setRotationFromEuler(Vector3(Math::degreesToRadians(149),
+					Math::degreesToRadians(150),
+					Math::degreesToRadians(38)));
+
+		mScene.getAmbientLight().setState(mAmbientLightEnabled);
+		mScene.getDirectionalLight().setState(mDirectionalLightEnabled);
+		mScene.getDirectionalLight().setDirection(Vector3(1, 1, 1));
+		mScene.getDirectionalLight().setColor(Vector3(1, 0.8, 0.0));
+		mScene.getPointLight().setState(mPointLightEnabled);
+		mScene.getPointLight().setAttenuation(Vector3(0, 0, 3));
+		mScene.getPointLight().setColor(Vector3(0.9, 0.2, 0.4));
+
+		mInstances.push_back(mi1);
+		mInstances.push_back(mi2);
+	}
+	if(!options.saveScenePath.empty()) {
+		mScene.saveScene(options.saveScenePath);
+	}
+
+	syncSimInstances();
+
+	if(options.pipelined) {
+		mSimCamera = mCamera;
+		SimulationSnapshot initial;
+		simulate(0.0f, mSimCamera, initial);
+		mSnapshots.reset(initial);
+		mPipelined = true;
+		mSimThread = std::thread(&SceneCube::simulationLoop, this);
+	}
+
+	if(options.hud) {
+		toggleHud();
+	}
+}
+
+SceneCube::~SceneCube()
+{
+	if(mPipelined) {
+		{
+			std::lock_guard<std::mutex> lock(mSimMutex);
+			mSimQuit = true;
+		}
+		mSimWake.notify_one();
+		mSimThread.join();
+	}
+	printFrameStats();
+	if(mCapture) {
+		mCapture->finish();
+		mCapture->printStats(std::cout);
+	}
+}
+
+void SceneCube::printFrameStats() const
+{
+	if(mLatencyFrames) {
+		std::cout << "Simulation to submission latency (" << (mPipelined ? "pipelined" : "serial") << "): "
+			<< mLatencySum / mLatencyFrames * 1000.0 << " ms average, "
+			<< mLatencyMax * 1000.0 << " ms max over " << mLatencyFrames << " frames\n";
+	}
+	if(mInputLatencyFrames) {
+		std::cout << "Input to present latency: "
+			<< mInputLatencySum / mInputLatencyFrames * 1000.0 << " ms average, "
+			<< mInputLatencyMax * 1000.0 << " ms max over " << mInputLatencyFrames << " frames\n";
+	}
+	mPacer.printStats(std::cout);
+}
+
+void SceneCube::toggleHud()
+{
+	if(!mHud && !mHudFailed) {
+		try {
+			mHud = boost::shared_ptr<Scene::Hud>(new Scene::Hud(mHudFont, mHudFontSize,
+						screenWidth, screenHeight));
+		} catch(std::exception& e) {
+			std::cerr << "HUD not available: " << e.what() << "\n";
+			mHudFailed = true;
+		}
+	}
+	if(mHud) {
+		mHud->setEnabled(!mHud->isEnabled());
+	}
 }
 
 bool SceneCube::handleKeyDown(float frameTime, SDLKey key)
 {
+	PROFILE_SCOPE("SceneCube::handleKeyDown");
+	/* most keys change what is drawn */
+	mPacer.requestRedraw();
 	auto it = mControls.find(key);
 	if(it != mControls.end()) {
+		markInput();
 		it->second(mPosStep);
 	} else {
 		if(key == SDLK_ESCAPE) {
@@ -86,6 +377,36 @@ bool SceneCube::handleKeyDown(float frameTime, SDLKey key)
 			std::cout << "Up: " << mCamera.getUpVector() << "\n";
 			std::cout << "Target: " << mCamera.getTargetVector() << "\n";
 			std::cout << "Position: " << mCamera.getPosition() << "\n";
+			const auto& rs = mScene.getRenderStats();
+			std::cout << "Instances: " << rs.instances << ", " << rs.drawCalls << " drawn, "
+				<< rs.culledInstances << " culled, " << rs.triangles << " triangles, "
+				<< rs.culledLights << " out of point light reach, "
+				<< rs.staticBatches << " static batches\n";
+			std::cout << "Depth pre-pass: " << (mScene.getDepthPrepass() ? "on" : "off") << ", "
+				<< rs.prepassDrawCalls << " draws, overdraw "
+				<< rs.shadedSamples / (screenWidth * screenHeight *
+						rs.resolutionScale * rs.resolutionScale) << "\n";
+			if(auto res = mScene.getResolutionStats()) {
+				std::cout << "Resolution: " << res->width << "x" << res->height << " ("
+					<< res->scale * 100.0f << "%), GPU " << res->gpuTime * 1000.0 << " ms, "
+					<< res->scaleChanges << " changes\n";
+			}
+			const auto& ts = mScene.getTextureStreamer().getStats();
+			std::cout << "Textures: " << ts.residentBytes << "/" << ts.budget << " bytes resident, "
+				<< ts.pendingUploads << " mips (" << ts.pendingBytes << " bytes) pending, "
+				<< ts.uploads << " uploads, " << ts.evictions << " evictions\n";
+			if(auto us = mScene.getDrawRingStats()) {
+				std::cout << "Draw data: " << us->lastFrameBytes << "/" << us->frameSize << " bytes, "
+					<< (us->persistent ? "persistent" : "orphaned") << ", "
+					<< us->fallbackFrames << "/" << us->frames << " frames fell back\n";
+			}
+			printFrameStats();
+			if(mHud && mHud->isEnabled()) {
+				std::cout << "HUD: " << mHud->getDrawTime() * 1000.0 << " ms\n";
+			}
+			if(mCapture) {
+				mCapture->printStats(std::cout);
+			}
 		} else if(key == SDLK_F1) {
 			mAmbientLightEnabled = !mAmbientLightEnabled;
 			mScene.getAmbientLight().setState(mAmbientLightEnabled);
@@ -95,6 +416,15 @@ bool SceneCube::handleKeyDown(float frameTime, SDLKey key)
 		} else if(key == SDLK_F3) {
 			mPointLightEnabled = !mPointLightEnabled;
 			mScene.getPointLight().setState(mPointLightEnabled);
+		} else if(key == SDLK_F4) {
+			mScene.setDepthPrepass(!mScene.getDepthPrepass());
+		} else if(key == SDLK_F5) {
+			mStartTrace = !GLTrace::isRecording();
+		} else if(key == SDLK_F6) {
+			if(MemoryTracker::writeReport(mMemoryReport))
+				std::cout << "Wrote memory report to " << mMemoryReport << "\n";
+		} else if(key == SDLK_F7) {
+			toggleHud();
 		}
 	}
 
@@ -105,6 +435,7 @@ bool SceneCube::handleKeyUp(float frameTime, SDLKey key)
 {
 	auto it = mControls.find(key);
 	if(it != mControls.end()) {
+		markInput();
 		it->second(0.0f);
 	}
 	return false;
@@ -112,48 +443,323 @@ bool SceneCube::handleKeyUp(float frameTime, SDLKey key)
 
 bool SceneCube::handleMouseMotion(float frameTime, const SDL_MouseMotionEvent& ev)
 {
+	PROFILE_SCOPE("SceneCube::handleMouseMotion");
 	if(SDL_GetMouseState(NULL, NULL) & SDL_BUTTON(1)) {
-		handleMouseMove(ev.xrel, ev.yrel);
+		markInput();
+		mMouseX += ev.xrel;
+		mMouseY += ev.yrel;
 	}
 	return false;
 }
 
-void SceneCube::handleMouseMove(float dx, float dy)
+void SceneCube::markInput()
 {
-	mCamera.rotate(dx * mRotStep, dy * mRotStep);
+	if(mInputTime == 0.0) {
+		mInputTime = Clock::getTime();
+	}
 }
 
-bool SceneCube::prerenderUpdate(float frameTime)
+/* Applies the mouse motion of this frame to the render camera just
+ * before submission. In pipelined mode the camera orientation is owned
+ * by the render thread and the simulation only gets a copy of the
+ * rotation for steering its movement. */
+void SceneCube::latchInput()
+{
+	if(mMouseX != 0.0f || mMouseY != 0.0f) {
+		float yaw = mMouseX * mRotStep;
+		float pitch = mMouseY * mRotStep;
+		mMouseX = 0.0f;
+		mMouseY = 0.0f;
+
+		mCamera.rotate(yaw, pitch);
+		if(mPipelined) {
+			std::lock_guard<std::mutex> lock(mSimMutex);
+			mSimInput.push_back([=] (Scene::Camera& c) { c.rotate(yaw, pitch); });
+		}
+	}
+
+	if(mInputTime != 0.0) {
+		mPresentedInputTime = mInputTime;
+		mInputTime = 0.0;
+	}
+}
+
+void SceneCube::controlCamera(const std::function<void (Scene::Camera&)>& f)
+{
+	if(mPipelined) {
+		std::lock_guard<std::mutex> lock(mSimMutex);
+		mSimInput.push_back(f);
+	} else {
+		f(mCamera);
+	}
+}
+
+void SceneCube::simulate(float frameTime, Scene::Camera& camera, SimulationSnapshot& snap)
 {
+	PROFILE_SCOPE("SceneCube::simulate");
 	double time = Clock::getTime();
+
+	float timePoint = Math::degreesToRadians(fmodl(time * 20.0f, 360));
+	float rvalue = 0.5f * (0.5f + 0.5f * sin(timePoint));
+	float gvalue = 0.5f * (0.5f + 0.5f * sin(timePoint + 2.0f * PI / 3.0f));
+	float bvalue = 0.5f * (0.5f + 0.5f * sin(timePoint + 4.0f * PI / 3.0f));
+	snap.ambientLight = Vector3(rvalue, gvalue, bvalue);
+
+	float pointLightTime = Math::degreesToRadians(fmodl(time * 80.0f, 360));
+	snap.pointLightPosition = Vector3(sin(pointLightTime), 0.5f, cos(pointLightTime));
+
+	camera.applyMovementKeys(frameTime);
+	snap.cameraPosition = camera.getPosition();
+
+	snap.instances = mSimInstances;
+	snap.frame = ++mSimFrame;
+	snap.time = Clock::getTime();
+}
+
+void SceneCube::applySnapshot(const SimulationSnapshot& snap)
+{
+	/* only what changed is set, so that the scene stays clean for
+	 * on-demand mode and static instances stay baked */
+	if(mPipelined && !equal(mCamera.getPosition(), snap.cameraPosition)) {
+		mCamera.setPosition(snap.cameraPosition);
+	}
+
 	if(mAmbientLightEnabled) {
-		float timePoint = Math::degreesToRadians(fmodl(time * 20.0f, 360));
-		float rvalue = 0.5f * (0.5f + 0.5f * sin(timePoint));
-		float gvalue = 0.5f * (0.5f + 0.5f * sin(timePoint + 2.0f * PI / 3.0f));
-		float bvalue = 0.5f * (0.5f + 0.5f * sin(timePoint + 4.0f * PI / 3.0f));
-		mScene.getAmbientLight().setColor(Color(rvalue * 255, gvalue * 255, bvalue * 255));
+		mScene.getAmbientLight().setColor(snap.ambientLight);
 	}
 
 	if(mPointLightEnabled) {
-		float pointLightTime = Math::degreesToRadians(fmodl(time * 80.0f, 360));
-		Vector3 plpos(sin(pointLightTime), 0.5f, cos(pointLightTime));
-		mScene.getPointLight().setPosition(plpos);
+		mScene.getPointLight().setPosition(snap.pointLightPosition);
 	}
 
-	mCamera.applyMovementKeys(frameTime);
+	for(unsigned int i = 0; i < mInstances.size() && i < snap.instances.size(); i++) {
+		const InstanceTransform& t = snap.instances[i];
+		if(!equal(mInstances[i]->getPosition(), t.position))
+			mInstances[i]->setPosition(t.position);
+		if(!equal(mInstances[i]->getOrientation(), t.orientation))
+			mInstances[i]->setOrientation(t.orientation);
+	}
+}
+
+void SceneCube::simulationLoop()
+{
+	Profiler::setThreadName("Simulation");
+	unsigned int tick = 0;
+	while(1) {
+		float frameTime;
+		std::vector<std::function<void (Scene::Camera&)>> input;
+		{
+			std::unique_lock<std::mutex> lock(mSimMutex);
+			mSimWake.wait(lock, [&] () { return mSimQuit || mSimTick != tick; });
+			if(mSimQuit)
+				return;
+			tick = mSimTick;
+			frameTime = mSimFrameTime;
+			mSimFrameTime = 0.0f;
+			input.swap(mSimInput);
+			if(mSimInstancesChanged) {
+				mSimInstances.swap(mSimInstanceSync);
+				mSimInstanceSync.clear();
+				mSimInstancesChanged = false;
+			}
+		}
+
+		for(auto& f : input) {
+			f(mSimCamera);
+		}
+		simulate(frameTime, mSimCamera, mSnapshots.getWriteBuffer());
+		mSnapshots.publish();
+	}
+}
+
+/* Rebuilds the simulated transforms from mInstances. Must be called
+ * whenever instances are added or removed. */
+void SceneCube::syncSimInstances()
+{
+	std::vector<InstanceTransform> instances;
+	for(auto& mi : mInstances) {
+		InstanceTransform it;
+		it.position = mi->getPosition();
+		it.orientation = mi->getOrientation();
+		instances.push_back(it);
+	}
+
+	if(mPipelined) {
+		std::lock_guard<std::mutex> lock(mSimMutex);
+		mSimInstanceSync.swap(instances);
+		mSimInstancesChanged = true;
+	} else {
+		mSimInstances.swap(instances);
+	}
+}
+
+bool SceneCube::prerenderUpdate(float frameTime)
+{
+	{
+		/* the driver has already polled input for this frame, so
+		 * this is the closest we get to waiting before the poll */
+		PROFILE_SCOPE("FramePacer::waitForNextFrame");
+		mPacer.waitForNextFrame();
+	}
+	if(mPacer.isOnDemand()) {
+		/* The driver swaps after every drawFrame(), so frames can't be
+		 * skipped. Once a frame has left the scene unchanged, wait here
+		 * for input instead; the frame drawn on waking still shows the
+		 * old scene and the input is handled in the one after it. */
+		if(mSceneChanged || mScene.isDirty() || mInputTime != 0.0)
+			mPacer.requestRedraw();
+		while(!mPacer.shouldDraw()) {
+			mPacer.idle();
+			if(inputPending())
+				mPacer.requestRedraw();
+		}
+	}
+	PROFILE_SCOPE("SceneCube::prerenderUpdate");
+
+	/* the driver has swapped the buffers of the previous frame by now */
+	if(mPresentedInputTime != 0.0) {
+		double latency = Clock::getTime() - mPresentedInputTime;
+		mInputLatencySum += latency;
+		mInputLatencyMax = std::max(mInputLatencyMax, latency);
+		mInputLatencyFrames++;
+		mPresentedInputTime = 0.0;
+	}
+
+	if(mPipelined) {
+		/* simulate the next frame while this one is submitted */
+		{
+			std::lock_guard<std::mutex> lock(mSimMutex);
+			mSimFrameTime += frameTime;
+			mSimTick++;
+		}
+		mSimWake.notify_one();
+	} else {
+		simulate(frameTime, mCamera, mSerialSnapshot);
+	}
 
 	return false;
 }
 
 void SceneCube::drawFrame()
 {
+	/* the driver swaps buffers after drawFrame() */
+	Profiler::endFrame();
+	GLTrace::endFrame();
+	if(mStartTrace) {
+		mStartTrace = false;
+		if(GLTrace::start(mTracePath, mTraceFrames, screenWidth, screenHeight))
+			std::cout << "Tracing " << mTraceFrames << " frames to " << mTracePath << ".\n";
+	}
+	PROFILE_SCOPE("SceneCube::drawFrame");
+
+	const SimulationSnapshot* snap = &mSerialSnapshot;
+	if(mPipelined) {
+		mSnapshots.update();
+		snap = &mSnapshots.getReadBuffer();
+	}
+	applySnapshot(*snap);
+	latchInput();
+	/* render() clears the scene's dirty flags */
+	mSceneChanged = mScene.isDirty();
+
 	mScene.render();
+	if(mHud) {
+		mHud->draw(mScene.getRenderStats());
+	}
+	if(mCapture) {
+		mCapture->capture();
+	}
+
+	double latency = Clock::getTime() - snap->time;
+	mLatencySum += latency;
+	mLatencyMax = std::max(mLatencyMax, latency);
+	mLatencyFrames++;
+	mPacer.frameDrawn();
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " [--texture-budget <MB>] [--pipelined] [--profile-out <file>]\n"
+		<< "\t[--fps <n>] [--vsync <off|on|adaptive>] [--on-demand] [--no-shader-cache]\n"
+		<< "\t[--dynamic-resolution <GPU ms>] [--capture <file.y4m|pattern%05u.png>]\n"
+		<< "\t[--trace <file>] [--trace-frames <n>] [--scene <file>] [--save-scene <file>]\n"
+		<< "\t[--pack <file>] [--memory-report <file.csv|file.json>]\n"
+		<< "\t[--hud] [--hud-font <file.ttf>] [--hud-font-size <points>]\n";
+}
+
+bool parseSwapMode(const char* s, SwapMode& mode)
+{
+	if(!strcmp(s, "off")) {
+		mode = SwapMode::Immediate;
+	} else if(!strcmp(s, "on")) {
+		mode = SwapMode::VSync;
+	} else if(!strcmp(s, "adaptive")) {
+		mode = SwapMode::AdaptiveVSync;
+	} else {
+		return false;
+	}
+	return true;
 }
 
 int main(int argc, char** argv)
 {
+	SceneCubeOptions options;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--texture-budget") && i + 1 < argc) {
+			options.textureBudget = size_t(strtoull(argv[++i], NULL, 10)) * 1024 * 1024;
+		} else if(!strcmp(argv[i], "--pipelined")) {
+			options.pipelined = true;
+		} else if(!strcmp(argv[i], "--profile-out") && i + 1 < argc) {
+			options.profileOut = argv[++i];
+		} else if(!strcmp(argv[i], "--fps") && i + 1 < argc) {
+			options.fps = atof(argv[++i]);
+		} else if(!strcmp(argv[i], "--on-demand")) {
+			options.onDemand = true;
+		} else if(!strcmp(argv[i], "--vsync") && i + 1 < argc && parseSwapMode(argv[i + 1], options.swapMode)) {
+			i++;
+		} else if(!strcmp(argv[i], "--dynamic-resolution") && i + 1 < argc) {
+			options.gpuTarget = atof(argv[++i]) / 1000.0;
+		} else if(!strcmp(argv[i], "--capture") && i + 1 < argc) {
+			options.capturePath = argv[++i];
+		} else if(!strcmp(argv[i], "--scene") && i + 1 < argc) {
+			options.scenePath = argv[++i];
+		} else if(!strcmp(argv[i], "--save-scene") && i + 1 < argc) {
+			options.saveScenePath = argv[++i];
+		} else if(!strcmp(argv[i], "--pack") && i + 1 < argc) {
+			options.packPath = argv[++i];
+		} else if(!strcmp(argv[i], "--memory-report") && i + 1 < argc) {
+			options.memoryReport = argv[++i];
+			MemoryTracker::setReportAtExit(options.memoryReport);
+		} else if(!strcmp(argv[i], "--hud")) {
+			options.hud = true;
+		} else if(!strcmp(argv[i], "--hud-font") && i + 1 < argc) {
+			options.hudFont = argv[++i];
+		} else if(!strcmp(argv[i], "--hud-font-size") && i + 1 < argc) {
+			options.hudFontSize = std::max(6, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			options.tracePath = argv[++i];
+			options.trace = true;
+		} else if(!strcmp(argv[i], "--trace-frames") && i + 1 < argc) {
+			options.traceFrames = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--no-shader-cache")) {
+			ShaderCache::setEnabled(false);
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if(!options.profileOut.empty()) {
+		Profiler::setThreadName("Main");
+		Profiler::setEnabled(true);
+	}
+
 	try {
-		SceneCube app;
+		if(!options.packPath.empty())
+			AssetPack::setCurrent(boost::shared_ptr<AssetPack>(new AssetPack(options.packPath)));
+		SceneCube app(options);
 		app.run();
 	} catch(std::exception& e) {
 		std::cerr << "std::exception: " << e.what() << "\n";
@@ -161,6 +767,10 @@ int main(int argc, char** argv)
 		std::cerr << "Unknown exception.\n";
 	}
 
+	if(!options.profileOut.empty()) {
+		Profiler::writeChromeTrace(options.profileOut);
+	}
+
 	return 0;
 }
 
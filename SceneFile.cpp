@@ -0,0 +1,394 @@
+#include "SceneFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Common;
+
+namespace Scene {
+
+using namespace SceneFileFormat;
+
+static const uint64_t ArrayAlignment = 16;
+
+SceneDescription::SceneDescription()
+{
+	memset(&ambientLight, 0, sizeof(ambientLight));
+	memset(&directionalLight, 0, sizeof(directionalLight));
+	memset(&pointLight, 0, sizeof(pointLight));
+}
+
+void SceneDescription::addInstance(uint32_t model, uint32_t texture, const Vector3& position,
+		const Quaternion& orientation, float scale, bool isStatic)
+{
+	modelIndices.push_back(model);
+	textureIndices.push_back(texture);
+	positions.push_back(position.x);
+	positions.push_back(position.y);
+	positions.push_back(position.z);
+	orientations.push_back(orientation.w);
+	orientations.push_back(orientation.x);
+	orientations.push_back(orientation.y);
+	orientations.push_back(orientation.z);
+	scales.push_back(scale);
+	flags.push_back(isStatic ? InstanceStatic : 0);
+}
+
+SceneFile::SceneFile(const std::string& filename)
+	: mData(nullptr),
+	mSize(0),
+	mHeader(nullptr)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		std::cerr << "Unable to open scene " << filename << ".\n";
+		throw std::runtime_error("Error loading scene");
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+		close(fd);
+		std::cerr << filename << " is too short for a scene file.\n";
+		throw std::runtime_error("Error loading scene");
+	}
+
+	mSize = st.st_size;
+	void* p = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) {
+		std::cerr << "Unable to map scene " << filename << ".\n";
+		throw std::runtime_error("Error loading scene");
+	}
+	/* the instance arrays are read front to back once; the advice
+	 * values aren't flags, so each takes a call of its own */
+	madvise(p, mSize, MADV_SEQUENTIAL);
+	madvise(p, mSize, MADV_WILLNEED);
+	mData = static_cast<const unsigned char*>(p);
+	mHeader = reinterpret_cast<const Header*>(mData);
+
+	try {
+		validate(filename);
+	} catch(...) {
+		munmap(const_cast<unsigned char*>(mData), mSize);
+		throw;
+	}
+}
+
+SceneFile::~SceneFile()
+{
+	munmap(const_cast<unsigned char*>(mData), mSize);
+}
+
+void SceneFile::validate(const std::string& filename) const
+{
+	const Header& h = *mHeader;
+	if(memcmp(h.magic, Magic, sizeof(Magic)) || h.version != Version) {
+		std::cerr << filename << " is not a scene file of version " << Version << ".\n";
+		throw std::runtime_error("Error loading scene");
+	}
+
+	/* every table must be inside the file */
+	uint64_t n = h.instanceCount;
+	uint64_t assets = uint64_t(h.modelCount) + h.textureCount;
+	const struct {
+		uint64_t offset;
+		uint64_t count;
+		uint64_t size;
+	} tables[] = {
+		{ h.assetOffset, assets, sizeof(AssetRecord) },
+		{ h.modelIndexOffset, n, sizeof(uint32_t) },
+		{ h.textureIndexOffset, n, sizeof(uint32_t) },
+		{ h.positionOffset, n, 3 * sizeof(float) },
+		{ h.orientationOffset, n, 4 * sizeof(float) },
+		{ h.scaleOffset, n, sizeof(float) },
+		{ h.flagsOffset, n, sizeof(uint8_t) },
+		{ h.stringOffset, h.stringSize, 1 }
+	};
+	for(auto& t : tables) {
+		if(t.offset % ArrayAlignment || t.offset > mSize ||
+				t.count > (mSize - t.offset) / t.size) {
+			std::cerr << filename << " is truncated or corrupt.\n";
+			throw std::runtime_error("Error loading scene");
+		}
+	}
+
+	if(h.stringSize == 0 || mData[h.stringOffset + h.stringSize - 1] != '\0') {
+		std::cerr << filename << " has a corrupt string table.\n";
+		throw std::runtime_error("Error loading scene");
+	}
+	for(uint64_t i = 0; i < assets; i++) {
+		const AssetRecord& a = array<AssetRecord>(h.assetOffset)[i];
+		if(a.name >= h.stringSize || a.path >= h.stringSize) {
+			std::cerr << filename << " has a corrupt asset table.\n";
+			throw std::runtime_error("Error loading scene");
+		}
+	}
+
+	const uint32_t* models = getModelIndices();
+	const uint32_t* textures = getTextureIndices();
+	for(uint64_t i = 0; i < n; i++) {
+		if(models[i] >= h.modelCount || textures[i] >= h.textureCount) {
+			std::cerr << filename << ": instance " << i << " refers to a missing asset.\n";
+			throw std::runtime_error("Error loading scene");
+		}
+	}
+}
+
+template<typename T>
+const T* SceneFile::array(uint64_t offset) const
+{
+	return reinterpret_cast<const T*>(mData + offset);
+}
+
+const char* SceneFile::string(uint32_t offset) const
+{
+	return array<char>(mHeader->stringOffset) + offset;
+}
+
+const AssetRecord& SceneFile::asset(uint32_t i) const
+{
+	return array<AssetRecord>(mHeader->assetOffset)[i];
+}
+
+uint32_t SceneFile::getModelCount() const
+{
+	return mHeader->modelCount;
+}
+
+const char* SceneFile::getModelName(uint32_t i) const
+{
+	return string(asset(i).name);
+}
+
+const char* SceneFile::getModelPath(uint32_t i) const
+{
+	return string(asset(i).path);
+}
+
+uint32_t SceneFile::getTextureCount() const
+{
+	return mHeader->textureCount;
+}
+
+const char* SceneFile::getTextureName(uint32_t i) const
+{
+	return string(asset(mHeader->modelCount + i).name);
+}
+
+const char* SceneFile::getTexturePath(uint32_t i) const
+{
+	return string(asset(mHeader->modelCount + i).path);
+}
+
+uint64_t SceneFile::getInstanceCount() const
+{
+	return mHeader->instanceCount;
+}
+
+const uint32_t* SceneFile::getModelIndices() const
+{
+	return array<uint32_t>(mHeader->modelIndexOffset);
+}
+
+const uint32_t* SceneFile::getTextureIndices() const
+{
+	return array<uint32_t>(mHeader->textureIndexOffset);
+}
+
+const float* SceneFile::getPositions() const
+{
+	return array<float>(mHeader->positionOffset);
+}
+
+const float* SceneFile::getOrientations() const
+{
+	return array<float>(mHeader->orientationOffset);
+}
+
+const float* SceneFile::getScales() const
+{
+	return array<float>(mHeader->scaleOffset);
+}
+
+const uint8_t* SceneFile::getFlags() const
+{
+	return array<uint8_t>(mHeader->flagsOffset);
+}
+
+const LightRecord& SceneFile::getAmbientLight() const
+{
+	return mHeader->ambientLight;
+}
+
+const LightRecord& SceneFile::getDirectionalLight() const
+{
+	return mHeader->directionalLight;
+}
+
+const LightRecord& SceneFile::getPointLight() const
+{
+	return mHeader->pointLight;
+}
+
+static void writeArray(std::ofstream& f, uint64_t& offset, const void* data, size_t bytes)
+{
+	static const char zeros[ArrayAlignment] = { 0 };
+	offset = (uint64_t(f.tellp()) + ArrayAlignment - 1) / ArrayAlignment * ArrayAlignment;
+	f.write(zeros, offset - f.tellp());
+	if(bytes)
+		f.write(static_cast<const char*>(data), bytes);
+}
+
+void SceneFile::write(const std::string& filename, const SceneDescription& scene)
+{
+	size_t n = scene.modelIndices.size();
+	if(scene.textureIndices.size() != n || scene.positions.size() != n * 3 ||
+			scene.orientations.size() != n * 4 || scene.scales.size() != n ||
+			scene.flags.size() != n) {
+		throw std::runtime_error("Inconsistent scene description");
+	}
+
+	std::string strings(1, '\0');
+	std::vector<AssetRecord> assets;
+	auto addString = [&] (const std::string& s) {
+		uint32_t offset = strings.size();
+		strings.append(s.c_str(), s.size() + 1);
+		return offset;
+	};
+	for(auto& m : scene.models)
+		assets.push_back(AssetRecord{ addString(m.first), addString(m.second) });
+	for(auto& t : scene.textures)
+		assets.push_back(AssetRecord{ addString(t.first), addString(t.second) });
+
+	std::ofstream f(filename.c_str(), std::ios::binary);
+	if(!f) {
+		std::cerr << "Unable to open " << filename << " for writing.\n";
+		throw std::runtime_error("Error saving scene");
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, Magic, sizeof(Magic));
+	h.version = Version;
+	h.modelCount = scene.models.size();
+	h.textureCount = scene.textures.size();
+	h.instanceCount = n;
+	h.stringSize = strings.size();
+	h.ambientLight = scene.ambientLight;
+	h.directionalLight = scene.directionalLight;
+	h.pointLight = scene.pointLight;
+
+	/* the header is written again once the offsets are known */
+	f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	writeArray(f, h.assetOffset, assets.data(), assets.size() * sizeof(AssetRecord));
+	writeArray(f, h.modelIndexOffset, scene.modelIndices.data(), n * sizeof(uint32_t));
+	writeArray(f, h.textureIndexOffset, scene.textureIndices.data(), n * sizeof(uint32_t));
+	writeArray(f, h.positionOffset, scene.positions.data(), n * 3 * sizeof(float));
+	writeArray(f, h.orientationOffset, scene.orientations.data(), n * 4 * sizeof(float));
+	writeArray(f, h.scaleOffset, scene.scales.data(), n * sizeof(float));
+	writeArray(f, h.flagsOffset, scene.flags.data(), n * sizeof(uint8_t));
+	writeArray(f, h.stringOffset, strings.data(), strings.size());
+	f.seekp(0);
+	f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+	if(!f) {
+		std::cerr << "Unable to write scene to " << filename << ".\n";
+		throw std::runtime_error("Error saving scene");
+	}
+}
+
+static void writeJSONString(std::ostream& os, const char* s)
+{
+	os << '"';
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			os << '\\' << *s;
+		else if((unsigned char)*s < 0x20)
+			os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(*s)
+				<< std::dec << std::setfill(' ');
+		else
+			os << *s;
+	}
+	os << '"';
+}
+
+static void writeJSONFloats(std::ostream& os, const float* v, int count)
+{
+	os << '[';
+	for(int i = 0; i < count; i++)
+		os << (i ? ", " : "") << v[i];
+	os << ']';
+}
+
+static void writeJSONLight(std::ostream& os, const char* name, const LightRecord& l,
+		const char* vectorName, bool attenuation)
+{
+	os << "\t\t\"" << name << "\": {\"on\": " << (l.on ? "true" : "false") << ", \"color\": ";
+	writeJSONFloats(os, l.color, 3);
+	if(vectorName) {
+		os << ", \"" << vectorName << "\": ";
+		writeJSONFloats(os, l.vector, 3);
+	}
+	if(attenuation) {
+		os << ", \"attenuation\": ";
+		writeJSONFloats(os, l.attenuation, 3);
+	}
+	os << "}";
+}
+
+void SceneFile::writeJSON(std::ostream& os) const
+{
+	/* enough digits to read back the same floats */
+	std::streamsize precision = os.precision(9);
+
+	const char* tables[] = { "models", "textures" };
+	for(int t = 0; t < 2; t++) {
+		uint32_t count = t == 0 ? getModelCount() : getTextureCount();
+		os << (t == 0 ? "{\n" : ",\n") << "\t\"" << tables[t] << "\": [";
+		for(uint32_t i = 0; i < count; i++) {
+			os << (i ? ",\n" : "\n") << "\t\t{\"name\": ";
+			writeJSONString(os, t == 0 ? getModelName(i) : getTextureName(i));
+			os << ", \"path\": ";
+			writeJSONString(os, t == 0 ? getModelPath(i) : getTexturePath(i));
+			os << "}";
+		}
+		os << "\n\t]";
+	}
+
+	os << ",\n\t\"lights\": {\n";
+	writeJSONLight(os, "ambient", getAmbientLight(), nullptr, false);
+	os << ",\n";
+	writeJSONLight(os, "directional", getDirectionalLight(), "direction", false);
+	os << ",\n";
+	writeJSONLight(os, "point", getPointLight(), "position", true);
+	os << "\n\t},\n\t\"instances\": [";
+
+	const uint32_t* models = getModelIndices();
+	const uint32_t* textures = getTextureIndices();
+	const float* positions = getPositions();
+	const float* orientations = getOrientations();
+	const float* scales = getScales();
+	const uint8_t* flags = getFlags();
+	for(uint64_t i = 0; i < getInstanceCount(); i++) {
+		os << (i ? ",\n" : "\n") << "\t\t{\"model\": " << models[i]
+			<< ", \"texture\": " << textures[i] << ", \"position\": ";
+		writeJSONFloats(os, positions + i * 3, 3);
+		os << ", \"orientation\": ";
+		writeJSONFloats(os, orientations + i * 4, 4);
+		os << ", \"scale\": " << scales[i]
+			<< ", \"static\": " << ((flags[i] & InstanceStatic) ? "true" : "false") << "}";
+	}
+	os << "\n\t]\n}\n";
+	os.precision(precision);
+}
+
+}
+
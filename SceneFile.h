@@ -0,0 +1,135 @@
+#ifndef SCENE_SCENEFILE_H
+#define SCENE_SCENEFILE_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+
+#include "libcommon/Vector3.h"
+
+#include "Quaternion.h"
+
+namespace Scene {
+
+/* Binary scene file: a header, the model and texture tables, one flat
+ * array per instance attribute and a string table. Arrays start at 16
+ * byte aligned offsets and are in native byte order, so the file can be
+ * used straight from a read-only mapping. */
+namespace SceneFileFormat {
+
+static const char Magic[4] = { 'S', 'C', 'N', '1' };
+static const uint32_t Version = 1;
+
+/* Fields a light type doesn't have are zero. */
+struct LightRecord {
+	float color[3];
+	/* the direction of a directional light, the position of a point light */
+	float vector[3];
+	float attenuation[3];
+	uint32_t on;
+};
+
+/* Offsets into the string table of NUL terminated strings. */
+struct AssetRecord {
+	uint32_t name;
+	uint32_t path;
+};
+
+enum InstanceFlag {
+	InstanceStatic = 1 << 0
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t modelCount;
+	uint32_t textureCount;
+	uint64_t instanceCount;
+	/* byte offsets from the start of the file */
+	uint64_t assetOffset;       /* models, then textures */
+	uint64_t modelIndexOffset;  /* uint32_t per instance */
+	uint64_t textureIndexOffset;/* uint32_t per instance */
+	uint64_t positionOffset;    /* 3 floats per instance */
+	uint64_t orientationOffset; /* w, x, y, z per instance */
+	uint64_t scaleOffset;       /* float per instance */
+	uint64_t flagsOffset;       /* uint8_t per instance */
+	uint64_t stringOffset;
+	uint64_t stringSize;
+	LightRecord ambientLight;
+	LightRecord directionalLight;
+	LightRecord pointLight;
+};
+
+}
+
+/* A scene in memory, for writing a scene file. */
+struct SceneDescription {
+	SceneDescription();
+	void addInstance(uint32_t model, uint32_t texture, const Common::Vector3& position,
+			const Quaternion& orientation, float scale, bool isStatic);
+
+	/* names and file names */
+	std::vector<std::pair<std::string, std::string>> models;
+	std::vector<std::pair<std::string, std::string>> textures;
+	std::vector<uint32_t> modelIndices;
+	std::vector<uint32_t> textureIndices;
+	std::vector<float> positions;
+	std::vector<float> orientations;
+	std::vector<float> scales;
+	std::vector<uint8_t> flags;
+	SceneFileFormat::LightRecord ambientLight;
+	SceneFileFormat::LightRecord directionalLight;
+	SceneFileFormat::LightRecord pointLight;
+};
+
+/* A scene file mapped into memory. The constructor checks that every
+ * table is inside the file and every index in range, so the accessors
+ * need no checks. */
+class SceneFile {
+	public:
+		SceneFile(const std::string& filename);
+		~SceneFile();
+		static void write(const std::string& filename, const SceneDescription& scene);
+
+		uint32_t getModelCount() const;
+		const char* getModelName(uint32_t i) const;
+		const char* getModelPath(uint32_t i) const;
+		uint32_t getTextureCount() const;
+		const char* getTextureName(uint32_t i) const;
+		const char* getTexturePath(uint32_t i) const;
+
+		uint64_t getInstanceCount() const;
+		const uint32_t* getModelIndices() const;
+		const uint32_t* getTextureIndices() const;
+		const float* getPositions() const;
+		const float* getOrientations() const;
+		const float* getScales() const;
+		const uint8_t* getFlags() const;
+
+		const SceneFileFormat::LightRecord& getAmbientLight() const;
+		const SceneFileFormat::LightRecord& getDirectionalLight() const;
+		const SceneFileFormat::LightRecord& getPointLight() const;
+
+		/* One instance per line, so that two dumps diff well. */
+		void writeJSON(std::ostream& os) const;
+
+	private:
+		SceneFile(const SceneFile&) = delete;
+		SceneFile& operator=(const SceneFile&) = delete;
+
+		void validate(const std::string& filename) const;
+		template<typename T>
+		const T* array(uint64_t offset) const;
+		const char* string(uint32_t offset) const;
+		const SceneFileFormat::AssetRecord& asset(uint32_t i) const;
+
+		const unsigned char* mData;
+		size_t mSize;
+		const SceneFileFormat::Header* mHeader;
+};
+
+}
+
+#endif
+
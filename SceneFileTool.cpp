@@ -0,0 +1,129 @@
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "SceneFile.h"
+#include "Benchmark.h"
+
+using namespace Common;
+
+static const float InstanceSpacing = 3.0f;
+
+static void setLight(Scene::SceneFileFormat::LightRecord& l, const Vector3& color,
+		const Vector3& v, const Vector3& attenuation)
+{
+	l.on = 1;
+	l.color[0] = color.x;
+	l.color[1] = color.y;
+	l.color[2] = color.z;
+	l.vector[0] = v.x;
+	l.vector[1] = v.y;
+	l.vector[2] = v.z;
+	l.attenuation[0] = attenuation.x;
+	l.attenuation[1] = attenuation.y;
+	l.attenuation[2] = attenuation.z;
+}
+
+/* The same grid of instances and lights as SceneBench builds. */
+static void generate(Scene::SceneDescription& scene, unsigned int instances,
+		unsigned int models, const std::string& modelFile,
+		const std::string& textureFile, bool isStatic)
+{
+	for(unsigned int i = 0; i < models; i++) {
+		std::ostringstream name;
+		name << "Model" << i;
+		scene.models.push_back(std::make_pair(name.str(), modelFile));
+	}
+	scene.textures.push_back(std::make_pair("Texture", textureFile));
+
+	unsigned int side = std::max(1, int(ceil(cbrt(instances))));
+	for(unsigned int i = 0; i < instances; i++) {
+		scene.addInstance(i % models, 0,
+				Vector3(i % side, (i / side) % side, i / (side * side)) * InstanceSpacing,
+				Quaternion::fromEuler(Vector3(i * 0.1f, i * 0.2f, i * 0.3f)),
+				1.0f, isStatic);
+	}
+
+	float extent = (side - 1) * InstanceSpacing;
+	Vector3 center(extent * 0.5f, extent * 0.5f, extent * 0.5f);
+	setLight(scene.ambientLight, Vector3(0.3, 0.3, 0.3), Vector3(), Vector3());
+	setLight(scene.directionalLight, Vector3(1, 0.8, 0.0), Vector3(1, 1, 1), Vector3());
+	setLight(scene.pointLight, Vector3(0.9, 0.2, 0.4), center, Vector3(0, 0, 3));
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " json <scene file> [<output file>]\n"
+		<< "       " << p << " generate <instances> <scene file> [options]\n"
+		<< "\t--models <n>          number of distinct models (default 1)\n"
+		<< "\t--model <file>        model file (default textured-cube.obj)\n"
+		<< "\t--texture <file>      texture file (default snow.jpg)\n"
+		<< "\t--static              mark the instances static\n";
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 3) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	try {
+		if(!strcmp(argv[1], "json") && argc <= 4) {
+			double start = Benchmark::now();
+			Scene::SceneFile file(argv[2]);
+			std::cerr << "Mapped " << file.getInstanceCount() << " instances in "
+				<< (Benchmark::now() - start) * 1000.0 << " ms\n";
+			if(argc == 4) {
+				std::ofstream out(argv[3]);
+				if(!out.is_open()) {
+					std::cerr << "Unable to open " << argv[3] << " for writing.\n";
+					return 1;
+				}
+				file.writeJSON(out);
+			} else {
+				file.writeJSON(std::cout);
+			}
+		} else if(!strcmp(argv[1], "generate") && argc >= 4) {
+			unsigned int instances = atoi(argv[2]);
+			const char* filename = argv[3];
+			unsigned int models = 1;
+			std::string modelFile = "textured-cube.obj";
+			std::string textureFile = "snow.jpg";
+			bool isStatic = false;
+			for(int i = 4; i < argc; i++) {
+				if(!strcmp(argv[i], "--models") && i + 1 < argc) {
+					models = std::max(1, atoi(argv[++i]));
+				} else if(!strcmp(argv[i], "--model") && i + 1 < argc) {
+					modelFile = argv[++i];
+				} else if(!strcmp(argv[i], "--texture") && i + 1 < argc) {
+					textureFile = argv[++i];
+				} else if(!strcmp(argv[i], "--static")) {
+					isStatic = true;
+				} else {
+					std::cerr << "Unknown parameters.\n";
+					usage(argv[0]);
+					exit(1);
+				}
+			}
+
+			Scene::SceneDescription scene;
+			generate(scene, instances, models, modelFile, textureFile, isStatic);
+			Scene::SceneFile::write(filename, scene);
+			std::cout << "Wrote " << instances << " instances to " << filename << "\n";
+		} else {
+			usage(argv[0]);
+			exit(1);
+		}
+	} catch(std::exception& e) {
+		std::cerr << "std::exception: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
+
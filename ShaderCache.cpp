@@ -0,0 +1,416 @@
+#include "ShaderCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <sys/stat.h>
+
+#include "AssetPack.h"
+#include "Hash.h"
+#include "Profiler.h"
+
+static const char CacheMagic[4] = { 'S', 'C', 'B', '1' };
+
+static std::string gDirectory = "shadercache";
+static bool gEnabled = true;
+static ShaderCacheStats gStats;
+static bool gParallelInit = false;
+static std::map<GLuint, std::pair<std::string, std::string>> gSources;
+
+/* The build keeps the source for the cache key, so a packed shader is
+ * copied once here. */
+static bool readFile(const char* filename, std::string& content)
+{
+	AssetPack* pack = AssetPack::getCurrent();
+	const AssetPackFormat::Entry* e = pack ? pack->find(filename, AssetPackFormat::AssetShader) : nullptr;
+	if(e) {
+		content.assign(reinterpret_cast<const char*>(pack->getData(*e)), e->size);
+		return true;
+	}
+
+	std::ifstream ifs(filename);
+	if(!ifs.is_open()) {
+		std::cerr << "Unable to open " << filename << ".\n";
+		return false;
+	}
+	content.assign((std::istreambuf_iterator<char>(ifs)),
+			(std::istreambuf_iterator<char>()));
+	return true;
+}
+
+static std::string glString(GLenum name)
+{
+	const GLubyte* s = glGetString(name);
+	return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+static bool binarySupported()
+{
+	if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+		return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static std::string cacheFilename(const std::string& key)
+{
+	std::ostringstream ss;
+	ss << gDirectory << "/" << std::hex << std::setw(16) << std::setfill('0')
+		<< fnv1a(key.data(), key.size()) << ".bin";
+	return ss.str();
+}
+
+static void write32(std::ostream& os, uint32_t v)
+{
+	os.write(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static bool read32(std::istream& is, uint32_t& v)
+{
+	return bool(is.read(reinterpret_cast<char*>(&v), sizeof(v)));
+}
+
+/* The whole key is stored in the file as well, so a hash collision
+ * is a miss rather than a wrong program. */
+static bool readBinary(const std::string& key, GLenum& format, std::vector<char>& binary)
+{
+	std::ifstream in(cacheFilename(key).c_str(), std::ios::binary);
+	if(!in.is_open())
+		return false;
+
+	char magic[4];
+	uint32_t keyLength;
+	if(!in.read(magic, sizeof(magic)) || memcmp(magic, CacheMagic, sizeof(magic)) ||
+			!read32(in, keyLength) || keyLength != key.size())
+		return false;
+
+	std::string storedKey(keyLength, '\0');
+	uint32_t storedFormat;
+	uint32_t length;
+	if(!in.read(&storedKey[0], keyLength) || storedKey != key ||
+			!read32(in, storedFormat) || !read32(in, length) || !length)
+		return false;
+
+	binary.resize(length);
+	if(!in.read(&binary[0], length))
+		return false;
+
+	format = storedFormat;
+	return true;
+}
+
+static void saveBinary(GLuint program, const std::string& key)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, &binary[0]);
+	if(written <= 0)
+		return;
+
+	mkdir(gDirectory.c_str(), 0755);
+
+	/* write to a temporary file and rename it into place so that a
+	 * concurrent launch never sees a partial binary */
+	std::string filename = cacheFilename(key);
+	std::string tmpname = filename + ".tmp";
+	{
+		std::ofstream out(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+		if(!out.is_open()) {
+			std::cerr << "Unable to write shader cache entry " << tmpname << ".\n";
+			return;
+		}
+		out.write(CacheMagic, sizeof(CacheMagic));
+		write32(out, key.size());
+		out.write(key.data(), key.size());
+		write32(out, format);
+		write32(out, written);
+		out.write(&binary[0], written);
+		if(!out.good()) {
+			out.close();
+			remove(tmpname.c_str());
+			return;
+		}
+	}
+	if(rename(tmpname.c_str(), filename.c_str())) {
+		remove(tmpname.c_str());
+	}
+}
+
+static void printShaderLog(GLuint shader, const char* type)
+{
+	GLint compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if(compiled)
+		return;
+
+	GLint infoLen = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+	if(infoLen > 1) {
+		char* infoLog = new char[infoLen];
+		glGetShaderInfoLog(shader, infoLen, NULL, infoLog);
+		std::cerr << "Error compiling " << type << " shader: " << infoLog << "\n";
+		delete[] infoLog;
+	}
+}
+
+static void printProgramLog(GLuint program)
+{
+	GLint infoLen = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
+	if(infoLen > 1) {
+		char* infoLog = new char[infoLen];
+		glGetProgramInfoLog(program, infoLen, NULL, infoLog);
+		std::cerr << "Error linking program: " << infoLog << "\n";
+		delete[] infoLog;
+	} else {
+		std::cerr << "Unknown error when linking program.\n";
+	}
+}
+
+static GLuint submitShader(GLenum type, const std::string& src)
+{
+	GLuint shader = glCreateShader(type);
+	if(shader) {
+		const char* s = src.c_str();
+		glShaderSource(shader, 1, &s, NULL);
+		glCompileShader(shader);
+	}
+	return shader;
+}
+
+/* Compile status isn't queried here as that would wait for the
+ * compiler; errors are picked up from the link status. */
+static void submitLink(ShaderBuild& build, bool retrievable)
+{
+	build.vertexShader = submitShader(GL_VERTEX_SHADER, build.vertexSource);
+	build.fragmentShader = submitShader(GL_FRAGMENT_SHADER, build.fragmentSource);
+	glAttachShader(build.program, build.vertexShader);
+	glAttachShader(build.program, build.fragmentShader);
+	if(retrievable) {
+		glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(build.program);
+}
+
+static void releaseShaders(ShaderBuild& build)
+{
+	if(build.vertexShader) {
+		glDetachShader(build.program, build.vertexShader);
+		glDeleteShader(build.vertexShader);
+		build.vertexShader = 0;
+	}
+	if(build.fragmentShader) {
+		glDetachShader(build.program, build.fragmentShader);
+		glDeleteShader(build.fragmentShader);
+		build.fragmentShader = 0;
+	}
+}
+
+ShaderCacheStats::ShaderCacheStats()
+	: hits(0),
+	misses(0),
+	rejected(0),
+	loadTime(0.0),
+	compileTime(0.0)
+{
+}
+
+void ShaderCache::setDirectory(const std::string& dir)
+{
+	gDirectory = dir;
+}
+
+void ShaderCache::setEnabled(bool on)
+{
+	gEnabled = on;
+}
+
+bool ShaderCache::isEnabled()
+{
+	return gEnabled;
+}
+
+ShaderBuild::ShaderBuild()
+	: program(0),
+	vertexShader(0),
+	fragmentShader(0),
+	fromCache(false)
+{
+}
+
+bool ShaderCache::hasParallelCompile()
+{
+	return GLEW_KHR_parallel_shader_compile;
+}
+
+/* A #version line must stay in front of the defines. */
+static std::string addDefines(const std::string& defines, const std::string& source)
+{
+	if(defines.empty() || source.compare(0, 8, "#version") != 0)
+		return defines + source;
+	size_t eol = source.find('\n');
+	if(eol == std::string::npos)
+		return source + "\n" + defines;
+	return source.substr(0, eol + 1) + defines + source.substr(eol + 1);
+}
+
+bool ShaderCache::startProgram(const char* vertexShader, const char* fragmentShader,
+		const std::string& defines,
+		const std::function<void (GLuint)>& bindAttributes,
+		ShaderBuild& build)
+{
+	double start = Profiler::now();
+
+	if(!readFile(vertexShader, build.vertexSource) || !readFile(fragmentShader, build.fragmentSource))
+		return false;
+	build.vertexSource = addDefines(defines, build.vertexSource);
+	build.fragmentSource = addDefines(defines, build.fragmentSource);
+	build.bindAttributes = bindAttributes;
+
+	if(hasParallelCompile() && !gParallelInit) {
+		/* let the driver pick the number of threads */
+		glMaxShaderCompilerThreadsKHR(0xffffffff);
+		gParallelInit = true;
+	}
+
+	build.program = glCreateProgram();
+	if(build.program == 0) {
+		std::cerr << "Unable to create program.\n";
+		return false;
+	}
+	bindAttributes(build.program);
+
+	bool useCache = gEnabled && binarySupported();
+	build.key.clear();
+	build.fromCache = false;
+	if(useCache) {
+		build.key = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" +
+			glString(GL_VERSION) + "\n" + build.vertexSource + '\0' + build.fragmentSource;
+		GLenum format;
+		std::vector<char> binary;
+		if(readBinary(build.key, format, binary)) {
+			glProgramBinary(build.program, format, &binary[0], binary.size());
+			build.fromCache = true;
+		}
+	}
+
+	if(!build.fromCache) {
+		submitLink(build, useCache);
+	}
+
+	double t = Profiler::now() - start;
+	(build.fromCache ? gStats.loadTime : gStats.compileTime) += t;
+	return true;
+}
+
+bool ShaderCache::isReady(const ShaderBuild& build)
+{
+	if(!hasParallelCompile() || !build.program)
+		return true;
+	GLint done = GL_TRUE;
+	glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+GLuint ShaderCache::finishProgram(ShaderBuild& build)
+{
+	if(!build.program)
+		return 0;
+
+	double start = Profiler::now();
+	GLint linked = 0;
+	glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+
+	if(build.fromCache) {
+		if(linked) {
+			gStats.hits++;
+			gStats.loadTime += Profiler::now() - start;
+			gSources[build.program] = std::make_pair(build.vertexSource, build.fragmentSource);
+			return build.program;
+		}
+
+		/* e.g. after a driver update; start over with a fresh
+		 * program as the failed load left this one unlinked */
+		gStats.rejected++;
+		glDeleteProgram(build.program);
+		build.program = glCreateProgram();
+		build.bindAttributes(build.program);
+		build.fromCache = false;
+		submitLink(build, true);
+		glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+	}
+
+	if(!linked) {
+		printShaderLog(build.vertexShader, "vertex");
+		printShaderLog(build.fragmentShader, "fragment");
+		printProgramLog(build.program);
+		releaseShaders(build);
+		glDeleteProgram(build.program);
+		build.program = 0;
+		gStats.compileTime += Profiler::now() - start;
+		return 0;
+	}
+
+	releaseShaders(build);
+	if(!build.key.empty()) {
+		saveBinary(build.program, build.key);
+	}
+	gStats.misses++;
+	gStats.compileTime += Profiler::now() - start;
+	gSources[build.program] = std::make_pair(build.vertexSource, build.fragmentSource);
+	return build.program;
+}
+
+GLuint ShaderCache::loadProgram(const char* vertexShader, const char* fragmentShader,
+		const std::string& defines,
+		const std::function<void (GLuint)>& bindAttributes)
+{
+	ShaderBuild build;
+	if(!startProgram(vertexShader, fragmentShader, defines, bindAttributes, build)) {
+		if(build.program)
+			glDeleteProgram(build.program);
+		return 0;
+	}
+	return finishProgram(build);
+}
+
+bool ShaderCache::getSources(GLuint program, std::string& vertexSource,
+		std::string& fragmentSource)
+{
+	auto it = gSources.find(program);
+	if(it == gSources.end())
+		return false;
+	vertexSource = it->second.first;
+	fragmentSource = it->second.second;
+	return true;
+}
+
+const ShaderCacheStats& ShaderCache::getStats()
+{
+	return gStats;
+}
+
+void ShaderCache::printStats(std::ostream& os)
+{
+	os << "Shader programs: " << gStats.hits << " loaded from cache in "
+		<< gStats.loadTime * 1000.0 << " ms, " << gStats.misses << " compiled in "
+		<< gStats.compileTime * 1000.0 << " ms";
+	if(gStats.rejected)
+		os << ", " << gStats.rejected << " cached binaries rejected";
+	os << "\n";
+}
+
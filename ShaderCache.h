@@ -0,0 +1,69 @@
+#ifndef SCENE_SHADERCACHE_H
+#define SCENE_SHADERCACHE_H
+
+#include <string>
+#include <functional>
+#include <ostream>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+struct ShaderCacheStats {
+	ShaderCacheStats();
+	unsigned int hits;
+	unsigned int misses;
+	/* binaries the driver refused, e.g. after a driver update */
+	unsigned int rejected;
+	double loadTime;
+	double compileTime;
+};
+
+/* A program being built, from startProgram until finishProgram. */
+struct ShaderBuild {
+	ShaderBuild();
+	GLuint program;
+	GLuint vertexShader;
+	GLuint fragmentShader;
+	std::string vertexSource;
+	std::string fragmentSource;
+	std::string key;
+	std::function<void (GLuint)> bindAttributes;
+	bool fromCache;
+};
+
+/* Links programs from a vertex and a fragment shader file and keeps the
+ * linked binaries on disk. The cache key covers the shader sources, the
+ * defines prepended to them and the GL vendor, renderer and version, so
+ * editing a shader or changing the driver makes a new entry. Without
+ * program binary support every program is compiled.
+ *
+ * startProgram only submits the compile and link; nothing waits for
+ * the driver until finishProgram. With KHR_parallel_shader_compile the
+ * driver compiles on its own threads in between and isReady() tells
+ * when finishProgram won't block. */
+class ShaderCache {
+	public:
+		static void setDirectory(const std::string& dir);
+		static void setEnabled(bool on);
+		static bool isEnabled();
+		/* bindAttributes is called with the new program before it's
+		 * linked or loaded. Returns 0 on failure. */
+		static GLuint loadProgram(const char* vertexShader, const char* fragmentShader,
+				const std::string& defines,
+				const std::function<void (GLuint)>& bindAttributes);
+		static bool startProgram(const char* vertexShader, const char* fragmentShader,
+				const std::string& defines,
+				const std::function<void (GLuint)>& bindAttributes,
+				ShaderBuild& build);
+		static bool isReady(const ShaderBuild& build);
+		static GLuint finishProgram(ShaderBuild& build);
+		static bool hasParallelCompile();
+		/* The sources, with the defines, of a program built here. */
+		static bool getSources(GLuint program, std::string& vertexSource,
+				std::string& fragmentSource);
+		static const ShaderCacheStats& getStats();
+		static void printStats(std::ostream& os);
+};
+
+#endif
+
@@ -0,0 +1,393 @@
+#include "TextureStreamer.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <utility>
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include "AssetPack.h"
+#include "MemoryTracker.h"
+
+namespace Scene {
+
+/* Textures are initially made resident from the first mip no larger
+ * than this. */
+static const int StartSize = 64;
+
+TextureStreamerStats::TextureStreamerStats()
+	: budget(0),
+	residentBytes(0),
+	pendingUploads(0),
+	pendingBytes(0),
+	uploads(0),
+	evictions(0)
+{
+}
+
+TextureStreamer::TextureStreamer(size_t budget)
+	: mUploadLimit(4 * 1024 * 1024),
+	mFrame(0)
+{
+	mStats.budget = budget;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for(auto& p : mTextures) {
+		glDeleteTextures(1, &p.second.texture);
+		MemoryTracker::deleteTextures(1, &p.second.texture);
+		MemoryTracker::release(MemoryCategory::TextureMips, getMemorySize(p.first));
+	}
+	if(!mPBOs.empty()) {
+		glDeleteBuffers(mPBOs.size(), &mPBOs[0]);
+		MemoryTracker::deleteBuffers(mPBOs.size(), &mPBOs[0]);
+	}
+}
+
+static void loadImage(const std::string& filename, int& width, int& height,
+		std::vector<unsigned char>& pixels)
+{
+	SDL_Surface* img = IMG_Load(filename.c_str());
+	if(!img) {
+		std::cerr << "Unable to load texture " << filename << ": " << IMG_GetError() << "\n";
+		throw std::runtime_error("Error while loading texture");
+	}
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+	SDL_Surface* fmt = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+			0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+#else
+	SDL_Surface* fmt = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+			0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+#endif
+	SDL_Surface* rgba = fmt ? SDL_ConvertSurface(img, fmt->format, SDL_SWSURFACE) : nullptr;
+	SDL_FreeSurface(img);
+	if(fmt)
+		SDL_FreeSurface(fmt);
+	if(!rgba) {
+		std::cerr << "Unable to convert texture " << filename << ": " << SDL_GetError() << "\n";
+		throw std::runtime_error("Error while loading texture");
+	}
+
+	width = rgba->w;
+	height = rgba->h;
+	pixels.resize(width * height * 4);
+	SDL_LockSurface(rgba);
+	for(int y = 0; y < height; y++) {
+		memcpy(&pixels[y * width * 4],
+				static_cast<const unsigned char*>(rgba->pixels) + y * rgba->pitch,
+				width * 4);
+	}
+	SDL_UnlockSurface(rgba);
+	SDL_FreeSurface(rgba);
+}
+
+void TextureStreamer::buildMipChain(StreamedTexture& st, const std::string& filename)
+{
+	MipLevel base;
+	AssetPack* pack = AssetPack::getCurrent();
+	const AssetPackFormat::Entry* e = pack ? pack->find(filename, AssetPackFormat::AssetTexture) : nullptr;
+	if(e) {
+		/* cooked textures are already RGBA8 */
+		const AssetPackFormat::TextureHeader& h = pack->getTexture(*e);
+		const unsigned char* pixels = pack->getData(*e) + h.pixelOffset;
+		base.width = h.width;
+		base.height = h.height;
+		base.pixels.assign(pixels, pixels + size_t(h.width) * h.height * 4);
+	} else {
+		loadImage(filename, base.width, base.height, base.pixels);
+	}
+	st.mips.push_back(base);
+
+	/* box filter down to 1x1, clamping at the edges for odd sizes */
+	while(st.mips.back().width > 1 || st.mips.back().height > 1) {
+		const MipLevel& src = st.mips.back();
+		MipLevel dst;
+		dst.width = std::max(1, src.width / 2);
+		dst.height = std::max(1, src.height / 2);
+		dst.pixels.resize(dst.width * dst.height * 4);
+		for(int y = 0; y < dst.height; y++) {
+			int y0 = std::min(y * 2, src.height - 1);
+			int y1 = std::min(y * 2 + 1, src.height - 1);
+			for(int x = 0; x < dst.width; x++) {
+				int x0 = std::min(x * 2, src.width - 1);
+				int x1 = std::min(x * 2 + 1, src.width - 1);
+				for(int c = 0; c < 4; c++) {
+					int sum = src.pixels[(y0 * src.width + x0) * 4 + c] +
+						src.pixels[(y0 * src.width + x1) * 4 + c] +
+						src.pixels[(y1 * src.width + x0) * 4 + c] +
+						src.pixels[(y1 * src.width + x1) * 4 + c];
+					dst.pixels[(y * dst.width + x) * 4 + c] = (sum + 2) / 4;
+				}
+			}
+		}
+		st.mips.push_back(dst);
+	}
+}
+
+size_t TextureStreamer::levelSize(const StreamedTexture& st, int level) const
+{
+	return st.mips[level].width * st.mips[level].height * 4;
+}
+
+void TextureStreamer::uploadLevel(const StreamedTexture& st, int level, const void* data)
+{
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+			st.mips[level].width, st.mips[level].height, 0,
+			GL_RGBA, GL_UNSIGNED_BYTE, data);
+	MemoryTracker::setTextureLevel(st.texture, level, st.mips[level].width, st.mips[level].height, 4);
+}
+
+void TextureStreamer::setBaseLevel(int level)
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+GLuint TextureStreamer::addTexture(const std::string& filename)
+{
+	StreamedTexture st;
+	buildMipChain(st, filename);
+
+	int numLevels = st.mips.size();
+	st.minimumLevel = numLevels - 1;
+	for(int i = 0; i < numLevels; i++) {
+		if(std::max(st.mips[i].width, st.mips[i].height) <= StartSize) {
+			st.minimumLevel = i;
+			break;
+		}
+	}
+	st.residentLevel = st.minimumLevel;
+	st.wantedLevel = st.minimumLevel;
+	st.uploading = false;
+	st.lastUsed = mFrame;
+
+	glGenTextures(1, &st.texture);
+	glBindTexture(GL_TEXTURE_2D, st.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	for(int i = numLevels - 1; i >= st.minimumLevel; i--) {
+		uploadLevel(st, i, &st.mips[i].pixels[0]);
+		mStats.residentBytes += levelSize(st, i);
+	}
+	setBaseLevel(st.minimumLevel);
+
+	GLuint texture = st.texture;
+	mTextures.insert({texture, std::move(st)});
+	MemoryTracker::allocate(MemoryCategory::TextureMips, getMemorySize(texture));
+	return texture;
+}
+
+void TextureStreamer::removeTexture(GLuint texture)
+{
+	auto it = mTextures.find(texture);
+	if(it == mTextures.end())
+		return;
+
+	for(auto pu = mStaged.begin(); pu != mStaged.end(); ) {
+		if(pu->texture == texture) {
+			mFreePBOs.push_back(pu->pbo);
+			pu = mStaged.erase(pu);
+		} else {
+			++pu;
+		}
+	}
+
+	StreamedTexture& st = it->second;
+	for(int i = st.residentLevel; i < int(st.mips.size()); i++)
+		mStats.residentBytes -= levelSize(st, i);
+	MemoryTracker::release(MemoryCategory::TextureMips, getMemorySize(texture));
+	glDeleteTextures(1, &st.texture);
+	MemoryTracker::deleteTextures(1, &st.texture);
+	mTextures.erase(it);
+}
+
+size_t TextureStreamer::getMemorySize(GLuint texture) const
+{
+	auto it = mTextures.find(texture);
+	if(it == mTextures.end())
+		return 0;
+
+	size_t bytes = 0;
+	for(size_t i = 0; i < it->second.mips.size(); i++)
+		bytes += levelSize(it->second, i);
+	return bytes;
+}
+
+void TextureStreamer::requestResolution(GLuint texture, float screenSize)
+{
+	auto it = mTextures.find(texture);
+	if(it == mTextures.end())
+		return;
+
+	StreamedTexture& st = it->second;
+	st.lastUsed = mFrame;
+	if(screenSize < 1.0f)
+		return;
+
+	float largest = std::max(st.mips[0].width, st.mips[0].height);
+	int level = std::max(0, int(floor(log2(largest / screenSize))));
+	st.wantedLevel = std::min(st.wantedLevel, std::min(level, st.minimumLevel));
+}
+
+GLuint TextureStreamer::getPBO()
+{
+	if(mFreePBOs.empty()) {
+		GLuint pbo;
+		glGenBuffers(1, &pbo);
+		mPBOs.push_back(pbo);
+		return pbo;
+	} else {
+		GLuint pbo = mFreePBOs.back();
+		mFreePBOs.pop_back();
+		return pbo;
+	}
+}
+
+void TextureStreamer::commitStagedUploads()
+{
+	if(mStaged.empty())
+		return;
+
+	for(auto& pu : mStaged) {
+		StreamedTexture& st = mTextures[pu.texture];
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pu.pbo);
+		glBindTexture(GL_TEXTURE_2D, st.texture);
+		uploadLevel(st, pu.level, nullptr);
+		setBaseLevel(pu.level);
+		st.residentLevel = pu.level;
+		st.uploading = false;
+		mStats.residentBytes += levelSize(st, pu.level);
+		mStats.uploads++;
+		mFreePBOs.push_back(pu.pbo);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	mStaged.clear();
+}
+
+bool TextureStreamer::evict(size_t bytes, unsigned int protectedFrame)
+{
+	size_t freed = 0;
+	while(freed < bytes) {
+		StreamedTexture* victim = nullptr;
+		for(auto& p : mTextures) {
+			StreamedTexture& st = p.second;
+			if(st.residentLevel >= st.minimumLevel || st.uploading ||
+					st.lastUsed >= protectedFrame)
+				continue;
+			if(!victim || st.lastUsed < victim->lastUsed ||
+					(st.lastUsed == victim->lastUsed && st.residentLevel < victim->residentLevel)) {
+				victim = &st;
+			}
+		}
+
+		if(!victim)
+			return false;
+
+		int level = victim->residentLevel;
+		glBindTexture(GL_TEXTURE_2D, victim->texture);
+		setBaseLevel(level + 1);
+		/* respecifying the level as empty releases its storage */
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0,
+				GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		MemoryTracker::setTextureLevel(victim->texture, level, 0, 0, 4);
+		victim->residentLevel++;
+		size_t sz = levelSize(*victim, level);
+		mStats.residentBytes -= sz;
+		mStats.evictions++;
+		freed += sz;
+	}
+	return true;
+}
+
+void TextureStreamer::stageUploads()
+{
+	std::vector<StreamedTexture*> wanted;
+	mStats.pendingUploads = 0;
+	mStats.pendingBytes = 0;
+	for(auto& p : mTextures) {
+		StreamedTexture& st = p.second;
+		for(int i = st.wantedLevel; i < st.residentLevel; i++) {
+			mStats.pendingUploads++;
+			mStats.pendingBytes += levelSize(st, i);
+		}
+		if(st.wantedLevel < st.residentLevel && !st.uploading)
+			wanted.push_back(&st);
+	}
+
+	/* textures furthest from their wanted resolution first */
+	std::sort(wanted.begin(), wanted.end(), [] (const StreamedTexture* a, const StreamedTexture* b) {
+			return a->residentLevel - a->wantedLevel > b->residentLevel - b->wantedLevel; });
+
+	size_t staged = 0;
+	for(auto st : wanted) {
+		int level = st->residentLevel - 1;
+		size_t sz = levelSize(*st, level);
+		if(staged && staged + sz > mUploadLimit)
+			break;
+
+		if(mStats.residentBytes + staged + sz > mStats.budget) {
+			if(!evict(mStats.residentBytes + staged + sz - mStats.budget, mFrame))
+				continue;
+		}
+
+		PendingUpload pu;
+		pu.texture = st->texture;
+		pu.level = level;
+		pu.pbo = getPBO();
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pu.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, sz, nullptr, GL_STREAM_DRAW);
+		MemoryTracker::setBufferSize(pu.pbo, MemoryCategory::StreamBuffers, sz);
+		void* ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if(!ptr) {
+			mFreePBOs.push_back(pu.pbo);
+			continue;
+		}
+		memcpy(ptr, &st->mips[level].pixels[0], sz);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		st->uploading = true;
+		mStaged.push_back(pu);
+		staged += sz;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::update()
+{
+	commitStagedUploads();
+	stageUploads();
+
+	if(mStats.residentBytes > mStats.budget) {
+		evict(mStats.residentBytes - mStats.budget, mFrame);
+	}
+
+	for(auto& p : mTextures) {
+		p.second.wantedLevel = p.second.minimumLevel;
+	}
+	mFrame++;
+}
+
+void TextureStreamer::setBudget(size_t bytes)
+{
+	mStats.budget = bytes;
+}
+
+void TextureStreamer::setUploadLimit(size_t bytesPerFrame)
+{
+	mUploadLimit = bytesPerFrame;
+}
+
+const TextureStreamerStats& TextureStreamer::getStats() const
+{
+	return mStats;
+}
+
+}
+
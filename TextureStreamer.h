@@ -0,0 +1,89 @@
+#ifndef SCENE_TEXTURESTREAMER_H
+#define SCENE_TEXTURESTREAMER_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+namespace Scene {
+
+struct TextureStreamerStats {
+	TextureStreamerStats();
+	size_t budget;
+	size_t residentBytes;
+	size_t pendingUploads;
+	size_t pendingBytes;
+	unsigned int uploads;
+	unsigned int evictions;
+};
+
+/* Keeps the full mip chain of each texture in system memory and only
+ * a subset of it resident on the GPU. Textures start out at a coarse
+ * mip; finer mips are requested with requestResolution() and uploaded
+ * through pixel buffer objects in update(), one frame staging the data
+ * and the next frame committing it to the texture. When the resident
+ * size exceeds the budget, the finest mips of the least recently used
+ * textures are dropped again. */
+class TextureStreamer {
+	public:
+		TextureStreamer(size_t budget = 64 * 1024 * 1024);
+		~TextureStreamer();
+		GLuint addTexture(const std::string& filename);
+		/* Deletes the texture and drops its pending uploads. */
+		void removeTexture(GLuint texture);
+		/* The size of the mip chain kept in system memory. */
+		size_t getMemorySize(GLuint texture) const;
+		void requestResolution(GLuint texture, float screenSize);
+		void update();
+		void setBudget(size_t bytes);
+		void setUploadLimit(size_t bytesPerFrame);
+		const TextureStreamerStats& getStats() const;
+
+	private:
+		struct MipLevel {
+			int width;
+			int height;
+			std::vector<unsigned char> pixels;
+		};
+
+		struct StreamedTexture {
+			GLuint texture;
+			std::vector<MipLevel> mips;
+			int residentLevel;
+			int minimumLevel;
+			int wantedLevel;
+			bool uploading;
+			unsigned int lastUsed;
+		};
+
+		struct PendingUpload {
+			GLuint texture;
+			int level;
+			GLuint pbo;
+		};
+
+		void buildMipChain(StreamedTexture& st, const std::string& filename);
+		void uploadLevel(const StreamedTexture& st, int level, const void* data);
+		void setBaseLevel(int level);
+		void commitStagedUploads();
+		void stageUploads();
+		bool evict(size_t bytes, unsigned int protectedFrame);
+		size_t levelSize(const StreamedTexture& st, int level) const;
+		GLuint getPBO();
+
+		std::map<GLuint, StreamedTexture> mTextures;
+		std::vector<PendingUpload> mStaged;
+		std::vector<GLuint> mFreePBOs;
+		std::vector<GLuint> mPBOs;
+		size_t mUploadLimit;
+		unsigned int mFrame;
+		TextureStreamerStats mStats;
+};
+
+}
+
+#endif
+
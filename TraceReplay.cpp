@@ -0,0 +1,828 @@
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "GLTrace.h"
+#include "OffscreenContext.h"
+#include "Benchmark.h"
+#include "HelperFunctions.h"
+
+using namespace GLTraceFormat;
+
+typedef void (GLAPIENTRY *GenNamesFunc)(GLsizei, GLuint*);
+
+/* Runs the records of a trace, mapping the recorded object names to
+ * objects created on first reference. */
+class TraceReplayer {
+	public:
+		TraceReplayer(const std::vector<unsigned char>& data);
+		~TraceReplayer();
+		/* Runs the whole trace once, timing each frame. The setup
+		 * records are only run when setup is set. */
+		void run(bool setup, std::vector<double>& frameTimes,
+				std::vector<double>& cpuTimes);
+		unsigned int getCalls() const;
+
+	private:
+		template<typename T>
+		T get();
+		const unsigned char* getBlob(uint32_t& size);
+		std::string getString();
+		GLuint name(std::map<GLuint, GLuint>& names, GLuint recorded, GenNamesFunc gen);
+		GLuint buffer(GLuint recorded);
+		GLuint texture(GLuint recorded);
+		GLuint query(GLuint recorded);
+		GLuint framebuffer(GLuint recorded);
+		GLuint renderbuffer(GLuint recorded);
+		GLint location(GLint recorded);
+		void deleteNames(std::map<GLuint, GLuint>& names, const unsigned char* p,
+				uint32_t size, void (GLAPIENTRY *del)(GLsizei, const GLuint*));
+		void buildProgram(GLuint recorded, const std::string& vertexSource,
+				const std::string& fragmentSource,
+				const std::vector<std::pair<std::string, GLint>>& attributes,
+				const std::vector<std::pair<std::string, GLint>>& blocks,
+				const std::vector<std::pair<std::string, GLint>>& uniforms);
+
+		const std::vector<unsigned char>& mData;
+		size_t mPos;
+		unsigned int mCalls;
+		std::map<GLuint, GLuint> mBuffers;
+		std::map<GLuint, GLuint> mTextures;
+		std::map<GLuint, GLuint> mQueries;
+		std::map<GLuint, GLuint> mFramebuffers;
+		std::map<GLuint, GLuint> mRenderbuffers;
+		std::map<GLuint, GLuint> mPrograms;
+		/* recorded uniform locations per recorded program */
+		std::map<GLuint, std::map<GLint, GLint>> mLocations;
+		GLuint mCurrentProgram;
+};
+
+TraceReplayer::TraceReplayer(const std::vector<unsigned char>& data)
+	: mData(data),
+	mPos(0),
+	mCalls(0),
+	mCurrentProgram(0)
+{
+}
+
+TraceReplayer::~TraceReplayer()
+{
+	for(auto& p : mBuffers)
+		glDeleteBuffers(1, &p.second);
+	for(auto& p : mTextures)
+		glDeleteTextures(1, &p.second);
+	for(auto& p : mQueries)
+		glDeleteQueries(1, &p.second);
+	for(auto& p : mFramebuffers)
+		glDeleteFramebuffers(1, &p.second);
+	for(auto& p : mRenderbuffers)
+		glDeleteRenderbuffers(1, &p.second);
+	for(auto& p : mPrograms) {
+		if(p.second)
+			glDeleteProgram(p.second);
+	}
+}
+
+template<typename T>
+T TraceReplayer::get()
+{
+	if(mPos + sizeof(T) > mData.size())
+		throw std::runtime_error("Truncated trace");
+	T v;
+	memcpy(&v, &mData[mPos], sizeof(T));
+	mPos += sizeof(T);
+	return v;
+}
+
+const unsigned char* TraceReplayer::getBlob(uint32_t& size)
+{
+	size = get<uint32_t>();
+	if(mPos + size > mData.size())
+		throw std::runtime_error("Truncated trace");
+	const unsigned char* p = size ? &mData[mPos] : nullptr;
+	mPos += size;
+	return p;
+}
+
+std::string TraceReplayer::getString()
+{
+	uint32_t size;
+	const unsigned char* p = getBlob(size);
+	return std::string(reinterpret_cast<const char*>(p), size);
+}
+
+GLuint TraceReplayer::name(std::map<GLuint, GLuint>& names, GLuint recorded, GenNamesFunc gen)
+{
+	if(!recorded)
+		return 0;
+	auto it = names.find(recorded);
+	if(it != names.end())
+		return it->second;
+	GLuint n = 0;
+	gen(1, &n);
+	names[recorded] = n;
+	return n;
+}
+
+GLuint TraceReplayer::buffer(GLuint recorded)
+{
+	return name(mBuffers, recorded, glGenBuffers);
+}
+
+GLuint TraceReplayer::texture(GLuint recorded)
+{
+	return name(mTextures, recorded, glGenTextures);
+}
+
+GLuint TraceReplayer::query(GLuint recorded)
+{
+	return name(mQueries, recorded, glGenQueries);
+}
+
+GLuint TraceReplayer::framebuffer(GLuint recorded)
+{
+	return name(mFramebuffers, recorded, glGenFramebuffers);
+}
+
+GLuint TraceReplayer::renderbuffer(GLuint recorded)
+{
+	return name(mRenderbuffers, recorded, glGenRenderbuffers);
+}
+
+GLint TraceReplayer::location(GLint recorded)
+{
+	auto it = mLocations.find(mCurrentProgram);
+	if(it == mLocations.end())
+		return recorded;
+	auto loc = it->second.find(recorded);
+	return loc == it->second.end() ? -1 : loc->second;
+}
+
+void TraceReplayer::deleteNames(std::map<GLuint, GLuint>& names, const unsigned char* p,
+		uint32_t size, void (GLAPIENTRY *del)(GLsizei, const GLuint*))
+{
+	for(uint32_t i = 0; i + sizeof(GLuint) <= size; i += sizeof(GLuint)) {
+		GLuint recorded;
+		memcpy(&recorded, p + i, sizeof(GLuint));
+		auto it = names.find(recorded);
+		if(it != names.end()) {
+			del(1, &it->second);
+			names.erase(it);
+		}
+	}
+}
+
+void TraceReplayer::buildProgram(GLuint recorded, const std::string& vertexSource,
+		const std::string& fragmentSource,
+		const std::vector<std::pair<std::string, GLint>>& attributes,
+		const std::vector<std::pair<std::string, GLint>>& blocks,
+		const std::vector<std::pair<std::string, GLint>>& uniforms)
+{
+	mPrograms[recorded] = 0;
+	if(vertexSource.empty() || fragmentSource.empty()) {
+		std::cerr << "No sources for program " << recorded << "; its draws are skipped.\n";
+		return;
+	}
+
+	GLuint vs = HelperFunctions::loadShader(GL_VERTEX_SHADER, vertexSource.c_str());
+	GLuint fs = HelperFunctions::loadShader(GL_FRAGMENT_SHADER, fragmentSource.c_str());
+	if(!vs || !fs) {
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+		throw std::runtime_error("Error compiling traced program");
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	for(auto& a : attributes) {
+		if(a.second >= 0)
+			glBindAttribLocation(program, a.second, a.first.c_str());
+	}
+	glLinkProgram(program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if(!linked) {
+		std::cerr << "Unable to link traced program " << recorded << ".\n";
+		glDeleteProgram(program);
+		throw std::runtime_error("Error linking traced program");
+	}
+
+	for(auto& b : blocks) {
+		GLuint index = glGetUniformBlockIndex(program, b.first.c_str());
+		if(index != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, index, b.second);
+	}
+
+	std::map<GLint, GLint>& locations = mLocations[recorded];
+	for(auto& u : uniforms) {
+		if(u.second >= 0)
+			locations[u.second] = glGetUniformLocation(program, u.first.c_str());
+	}
+	mPrograms[recorded] = program;
+}
+
+void TraceReplayer::run(bool setup, std::vector<double>& frameTimes,
+		std::vector<double>& cpuTimes)
+{
+	mPos = 0;
+	mCalls = 0;
+	double start = Benchmark::now();
+
+	while(mPos < mData.size()) {
+		uint16_t code = get<uint16_t>();
+		bool execute = setup || !(code & SetupFlag);
+		Op op = Op(code & ~SetupFlag);
+		if(execute)
+			mCalls++;
+
+		switch(op) {
+			case Op::EndFrame:
+				{
+					double submitted = Benchmark::now();
+					glFinish();
+					double end = Benchmark::now();
+					frameTimes.push_back(end - start);
+					cpuTimes.push_back(submitted - start);
+					start = end;
+				}
+				break;
+
+			case Op::Program:
+				{
+					GLuint recorded = get<GLuint>();
+					std::string vertexSource = getString();
+					std::string fragmentSource = getString();
+					std::vector<std::pair<std::string, GLint>> lists[3];
+					for(int l = 0; l < 3; l++) {
+						uint32_t count = get<uint32_t>();
+						for(uint32_t i = 0; i < count; i++) {
+							std::string n = getString();
+							lists[l].push_back(std::make_pair(n, get<GLint>()));
+						}
+					}
+					if(execute)
+						buildProgram(recorded, vertexSource, fragmentSource,
+								lists[0], lists[1], lists[2]);
+				}
+				break;
+
+			case Op::UseProgram:
+				{
+					GLuint recorded = get<GLuint>();
+					if(execute) {
+						mCurrentProgram = recorded;
+						auto it = mPrograms.find(recorded);
+						glUseProgram(it == mPrograms.end() ? 0 : it->second);
+					}
+				}
+				break;
+
+			case Op::Uniform1i:
+				{
+					GLint loc = get<GLint>();
+					GLint v = get<GLint>();
+					if(execute)
+						glUniform1i(location(loc), v);
+				}
+				break;
+
+			case Op::Uniform1f:
+				{
+					GLint loc = get<GLint>();
+					GLfloat v = get<GLfloat>();
+					if(execute)
+						glUniform1f(location(loc), v);
+				}
+				break;
+
+			case Op::Uniform2fv:
+			case Op::Uniform3fv:
+			case Op::Uniform4fv:
+			case Op::UniformMatrix4fv:
+				{
+					GLint loc = get<GLint>();
+					GLsizei count = get<GLsizei>();
+					GLboolean transpose = op == Op::UniformMatrix4fv ? get<GLboolean>() : GL_FALSE;
+					size_t components = op == Op::Uniform2fv ? 2 : op == Op::Uniform3fv ? 3 :
+						op == Op::Uniform4fv ? 4 : 16;
+					std::vector<GLfloat> v(components * count);
+					for(auto& f : v)
+						f = get<GLfloat>();
+					if(!execute || v.empty())
+						break;
+					if(op == Op::Uniform2fv)
+						glUniform2fv(location(loc), count, &v[0]);
+					else if(op == Op::Uniform3fv)
+						glUniform3fv(location(loc), count, &v[0]);
+					else if(op == Op::Uniform4fv)
+						glUniform4fv(location(loc), count, &v[0]);
+					else
+						glUniformMatrix4fv(location(loc), count, transpose, &v[0]);
+				}
+				break;
+
+			case Op::Clear:
+				{
+					GLbitfield mask = get<GLbitfield>();
+					if(execute)
+						glClear(mask);
+				}
+				break;
+
+			case Op::ClearColor:
+				{
+					GLfloat c[4];
+					for(int i = 0; i < 4; i++)
+						c[i] = get<GLfloat>();
+					if(execute)
+						glClearColor(c[0], c[1], c[2], c[3]);
+				}
+				break;
+
+			case Op::Viewport:
+			case Op::Scissor:
+				{
+					GLint v[4];
+					for(int i = 0; i < 4; i++)
+						v[i] = get<GLint>();
+					if(!execute)
+						break;
+					if(op == Op::Viewport)
+						glViewport(v[0], v[1], v[2], v[3]);
+					else
+						glScissor(v[0], v[1], v[2], v[3]);
+				}
+				break;
+
+			case Op::Enable:
+			case Op::Disable:
+				{
+					GLenum cap = get<GLenum>();
+					if(!execute)
+						break;
+					if(op == Op::Enable)
+						glEnable(cap);
+					else
+						glDisable(cap);
+				}
+				break;
+
+			case Op::DepthFunc:
+				{
+					GLenum func = get<GLenum>();
+					if(execute)
+						glDepthFunc(func);
+				}
+				break;
+
+			case Op::BlendFunc:
+				{
+					GLenum sfactor = get<GLenum>();
+					GLenum dfactor = get<GLenum>();
+					if(execute)
+						glBlendFunc(sfactor, dfactor);
+				}
+				break;
+
+			case Op::DepthMask:
+				{
+					GLboolean flag = get<GLboolean>();
+					if(execute)
+						glDepthMask(flag);
+				}
+				break;
+
+			case Op::ColorMask:
+				{
+					GLboolean m[4];
+					for(int i = 0; i < 4; i++)
+						m[i] = get<GLboolean>();
+					if(execute)
+						glColorMask(m[0], m[1], m[2], m[3]);
+				}
+				break;
+
+			case Op::PixelStorei:
+				{
+					GLenum pname = get<GLenum>();
+					GLint param = get<GLint>();
+					if(execute)
+						glPixelStorei(pname, param);
+				}
+				break;
+
+			case Op::ActiveTexture:
+				{
+					GLenum unit = get<GLenum>();
+					if(execute)
+						glActiveTexture(unit);
+				}
+				break;
+
+			case Op::BindTexture:
+				{
+					GLenum target = get<GLenum>();
+					GLuint t = get<GLuint>();
+					if(execute)
+						glBindTexture(target, texture(t));
+				}
+				break;
+
+			case Op::TexParameteri:
+				{
+					GLenum target = get<GLenum>();
+					GLenum pname = get<GLenum>();
+					GLint param = get<GLint>();
+					if(execute)
+						glTexParameteri(target, pname, param);
+				}
+				break;
+
+			case Op::TexParameterf:
+				{
+					GLenum target = get<GLenum>();
+					GLenum pname = get<GLenum>();
+					GLfloat param = get<GLfloat>();
+					if(execute)
+						glTexParameterf(target, pname, param);
+				}
+				break;
+
+			case Op::TexImage2D:
+				{
+					GLenum target = get<GLenum>();
+					GLint level = get<GLint>();
+					GLint internalFormat = get<GLint>();
+					GLsizei width = get<GLsizei>();
+					GLsizei height = get<GLsizei>();
+					GLint border = get<GLint>();
+					GLenum format = get<GLenum>();
+					GLenum type = get<GLenum>();
+					uint32_t size;
+					const unsigned char* pixels = getBlob(size);
+					if(!execute)
+						break;
+					/* the pixels are always in the trace */
+					GLint unpack = 0;
+					glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack);
+					if(unpack)
+						glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+					glTexImage2D(target, level, internalFormat, width, height, border,
+							format, type, pixels);
+					if(unpack)
+						glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack);
+				}
+				break;
+
+			case Op::DeleteTextures:
+			case Op::DeleteBuffers:
+				{
+					uint32_t size;
+					const unsigned char* p = getBlob(size);
+					if(!execute)
+						break;
+					if(op == Op::DeleteTextures)
+						deleteNames(mTextures, p, size, glDeleteTextures);
+					else
+						deleteNames(mBuffers, p, size, glDeleteBuffers);
+				}
+				break;
+
+			case Op::BindBuffer:
+				{
+					GLenum target = get<GLenum>();
+					GLuint b = get<GLuint>();
+					if(execute)
+						glBindBuffer(target, buffer(b));
+				}
+				break;
+
+			case Op::BufferData:
+				{
+					GLenum target = get<GLenum>();
+					uint64_t size = get<uint64_t>();
+					uint32_t dataSize;
+					const unsigned char* data = getBlob(dataSize);
+					GLenum usage = get<GLenum>();
+					if(execute)
+						glBufferData(target, size, data, usage);
+				}
+				break;
+
+			case Op::BufferSubData:
+				{
+					GLenum target = get<GLenum>();
+					uint64_t offset = get<uint64_t>();
+					uint32_t size;
+					const unsigned char* data = getBlob(size);
+					if(execute)
+						glBufferSubData(target, offset, size, data);
+				}
+				break;
+
+			case Op::BindBufferRange:
+				{
+					GLenum target = get<GLenum>();
+					GLuint index = get<GLuint>();
+					GLuint b = get<GLuint>();
+					uint64_t offset = get<uint64_t>();
+					uint64_t size = get<uint64_t>();
+					if(execute)
+						glBindBufferRange(target, index, buffer(b), offset, size);
+				}
+				break;
+
+			case Op::EnableVertexAttribArray:
+			case Op::DisableVertexAttribArray:
+				{
+					GLuint index = get<GLuint>();
+					if(!execute)
+						break;
+					if(op == Op::EnableVertexAttribArray)
+						glEnableVertexAttribArray(index);
+					else
+						glDisableVertexAttribArray(index);
+				}
+				break;
+
+			case Op::VertexAttribPointer:
+				{
+					GLuint index = get<GLuint>();
+					GLint size = get<GLint>();
+					GLenum type = get<GLenum>();
+					GLboolean normalized = get<GLboolean>();
+					GLsizei stride = get<GLsizei>();
+					uint64_t offset = get<uint64_t>();
+					if(execute)
+						glVertexAttribPointer(index, size, type, normalized, stride,
+								reinterpret_cast<const GLvoid*>(offset));
+				}
+				break;
+
+			case Op::DrawElements:
+				{
+					GLenum mode = get<GLenum>();
+					GLsizei count = get<GLsizei>();
+					GLenum type = get<GLenum>();
+					uint64_t offset = get<uint64_t>();
+					auto it = mPrograms.find(mCurrentProgram);
+					if(execute && (it == mPrograms.end() || it->second))
+						glDrawElements(mode, count, type, reinterpret_cast<const GLvoid*>(offset));
+				}
+				break;
+
+			case Op::DrawArrays:
+				{
+					GLenum mode = get<GLenum>();
+					GLint first = get<GLint>();
+					GLsizei count = get<GLsizei>();
+					auto it = mPrograms.find(mCurrentProgram);
+					if(execute && (it == mPrograms.end() || it->second))
+						glDrawArrays(mode, first, count);
+				}
+				break;
+
+			case Op::BeginQuery:
+				{
+					GLenum target = get<GLenum>();
+					GLuint id = get<GLuint>();
+					if(execute)
+						glBeginQuery(target, query(id));
+				}
+				break;
+
+			case Op::EndQuery:
+				{
+					GLenum target = get<GLenum>();
+					if(execute)
+						glEndQuery(target);
+				}
+				break;
+
+			case Op::QueryCounter:
+				{
+					GLuint id = get<GLuint>();
+					GLenum target = get<GLenum>();
+					if(execute)
+						glQueryCounter(query(id), target);
+				}
+				break;
+
+			case Op::BindFramebuffer:
+				{
+					GLenum target = get<GLenum>();
+					GLuint f = get<GLuint>();
+					if(execute)
+						glBindFramebuffer(target, framebuffer(f));
+				}
+				break;
+
+			case Op::BindRenderbuffer:
+				{
+					GLenum target = get<GLenum>();
+					GLuint r = get<GLuint>();
+					if(execute)
+						glBindRenderbuffer(target, renderbuffer(r));
+				}
+				break;
+
+			case Op::RenderbufferStorage:
+				{
+					GLenum target = get<GLenum>();
+					GLenum internalFormat = get<GLenum>();
+					GLsizei width = get<GLsizei>();
+					GLsizei height = get<GLsizei>();
+					if(execute)
+						glRenderbufferStorage(target, internalFormat, width, height);
+				}
+				break;
+
+			case Op::FramebufferTexture2D:
+				{
+					GLenum target = get<GLenum>();
+					GLenum attachment = get<GLenum>();
+					GLenum textarget = get<GLenum>();
+					GLuint t = get<GLuint>();
+					GLint level = get<GLint>();
+					if(execute)
+						glFramebufferTexture2D(target, attachment, textarget, texture(t), level);
+				}
+				break;
+
+			case Op::FramebufferRenderbuffer:
+				{
+					GLenum target = get<GLenum>();
+					GLenum attachment = get<GLenum>();
+					GLenum renderbufferTarget = get<GLenum>();
+					GLuint r = get<GLuint>();
+					if(execute)
+						glFramebufferRenderbuffer(target, attachment, renderbufferTarget,
+								renderbuffer(r));
+				}
+				break;
+
+			case Op::BlitFramebuffer:
+				{
+					GLint v[8];
+					for(int i = 0; i < 8; i++)
+						v[i] = get<GLint>();
+					GLbitfield mask = get<GLbitfield>();
+					GLenum filter = get<GLenum>();
+					if(execute)
+						glBlitFramebuffer(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+								mask, filter);
+				}
+				break;
+
+			case Op::GenerateMipmap:
+				{
+					GLenum target = get<GLenum>();
+					if(execute)
+						glGenerateMipmap(target);
+				}
+				break;
+
+			default:
+				std::cerr << "Unknown trace record " << code << ".\n";
+				throw std::runtime_error("Error reading trace");
+		}
+	}
+}
+
+unsigned int TraceReplayer::getCalls() const
+{
+	return mCalls;
+}
+
+static bool loadTrace(const char* filename, int& width, int& height,
+		unsigned int& frames, std::vector<unsigned char>& data)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if(!f) {
+		std::cerr << "Unable to open " << filename << ".\n";
+		return false;
+	}
+
+	char magic[4];
+	uint32_t header[4];
+	uint64_t size = 0;
+	f.read(magic, sizeof(magic));
+	f.read(reinterpret_cast<char*>(header), sizeof(header));
+	f.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if(!f || memcmp(magic, Magic, sizeof(Magic)) || header[0] != Version) {
+		std::cerr << filename << " is not a GL trace of version " << Version << ".\n";
+		return false;
+	}
+	width = header[1];
+	height = header[2];
+	frames = header[3];
+
+	std::vector<unsigned char> compressed((std::istreambuf_iterator<char>(f)),
+			std::istreambuf_iterator<char>());
+	data.resize(size);
+	uLongf dataSize = size;
+	if(size && (uncompress(&data[0], &dataSize, compressed.empty() ? nullptr : &compressed[0],
+				compressed.size()) != Z_OK || dataSize != size)) {
+		std::cerr << "Unable to uncompress " << filename << ".\n";
+		return false;
+	}
+	return true;
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " [options] <trace file>\n"
+		<< "\t--loops <n>           measured runs of the trace (default 10)\n"
+		<< "\t--warmup <n>          runs before measuring (default 1)\n";
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int loops = 10;
+	unsigned int warmup = 1;
+	const char* filename = nullptr;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--loops") && i + 1 < argc) {
+			loops = std::max(1, atoi(argv[++i]));
+		} else if(!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if(argv[i][0] != '-' && !filename) {
+			filename = argv[i];
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+	if(!filename) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	int width = 0;
+	int height = 0;
+	unsigned int frames = 0;
+	std::vector<unsigned char> data;
+	if(!loadTrace(filename, width, height, frames, data))
+		return 1;
+
+	try {
+		OffscreenContext context(width, height);
+		GLenum glewerr = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		if (glewerr == GLEW_ERROR_NO_GLX_DISPLAY)
+			glewerr = GLEW_OK;
+#endif
+		if (glewerr != GLEW_OK) {
+			std::cerr << "Unable to initialise GLEW.\n";
+			return 1;
+		}
+		std::cout << "Renderer: " << glGetString(GL_RENDERER) << "\n";
+		std::cout << "Trace: " << frames << " frames at " << width << "x" << height
+			<< ", " << data.size() / 1024 << " kB of records\n";
+
+		TraceReplayer replayer(data);
+		std::vector<double> frameTimes;
+		std::vector<double> cpuTimes;
+		for(unsigned int i = 0; i < warmup; i++) {
+			replayer.run(i == 0, frameTimes, cpuTimes);
+		}
+		frameTimes.clear();
+		cpuTimes.clear();
+
+		double start = Benchmark::now();
+		for(unsigned int i = 0; i < loops; i++) {
+			replayer.run(warmup == 0 && i == 0, frameTimes, cpuTimes);
+		}
+		double total = Benchmark::now() - start;
+
+		GLenum err = glGetError();
+		if(err != GL_NO_ERROR)
+			std::cerr << "GL error " << err << " while replaying.\n";
+
+		Benchmark::print(std::cout, "frame", Benchmark::calculate(frameTimes), 1000.0, "ms");
+		Benchmark::print(std::cout, "submit", Benchmark::calculate(cpuTimes), 1000.0, "ms");
+		std::cout << std::fixed << std::setprecision(0)
+			<< replayer.getCalls() << " calls per run, "
+			<< replayer.getCalls() * loops / total << " calls/s\n";
+	} catch(std::exception& e) {
+		std::cerr << "std::exception: " << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,67 @@
+#ifndef SCENE_TRIPLEBUFFER_H
+#define SCENE_TRIPLEBUFFER_H
+
+#include <atomic>
+
+namespace Scene {
+
+/* Lock-free single producer, single consumer exchange of the latest
+ * value. The producer fills getWriteBuffer() and publishes it; the
+ * consumer calls update() to pick up the newest published value, if
+ * any, which stays valid in getReadBuffer() until the next update(). */
+template<typename T>
+class TripleBuffer {
+	public:
+		TripleBuffer()
+			: mWrite(0),
+			mMiddle(1),
+			mRead(2)
+		{
+		}
+
+		void reset(const T& v)
+		{
+			for(int i = 0; i < 3; i++)
+				mBuffers[i] = v;
+		}
+
+		T& getWriteBuffer()
+		{
+			return mBuffers[mWrite];
+		}
+
+		void publish()
+		{
+			unsigned int old = mMiddle.exchange(mWrite | NewFlag, std::memory_order_acq_rel);
+			mWrite = old & IndexMask;
+		}
+
+		bool update()
+		{
+			if(!(mMiddle.load(std::memory_order_relaxed) & NewFlag))
+				return false;
+
+			unsigned int old = mMiddle.exchange(mRead, std::memory_order_acq_rel);
+			mRead = old & IndexMask;
+			return true;
+		}
+
+		const T& getReadBuffer() const
+		{
+			return mBuffers[mRead];
+		}
+
+	private:
+		static const unsigned int IndexMask = 3;
+		static const unsigned int NewFlag = 4;
+
+		T mBuffers[3];
+		unsigned int mWrite;
+		std::atomic<unsigned int> mMiddle;
+		unsigned int mRead;
+};
+
+}
+
+#endif
+
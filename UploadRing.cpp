@@ -0,0 +1,170 @@
+#include "UploadRing.h"
+
+#include <iostream>
+
+#include "GLTrace.h"
+#include "MemoryTracker.h"
+
+namespace Scene {
+
+UploadRingStats::UploadRingStats()
+	: persistent(false),
+	frameSize(0),
+	lastFrameBytes(0),
+	frames(0),
+	fallbackFrames(0)
+{
+}
+
+UploadRing::UploadRing(GLenum target, size_t alignment)
+	: mTarget(target),
+	mAlignment(alignment ? alignment : 1),
+	mOffset(0),
+	mRegion(0),
+	mFallback(true),
+	mBuffer(0),
+	mOrphanBuffer(0),
+	mMapped(nullptr)
+{
+	for(int i = 0; i < Regions; i++)
+		mFences[i] = 0;
+
+	mStats.persistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) &&
+		(GLEW_VERSION_3_2 || GLEW_ARB_sync);
+	glGenBuffers(1, &mOrphanBuffer);
+}
+
+UploadRing::~UploadRing()
+{
+	for(int i = 0; i < Regions; i++) {
+		if(mFences[i])
+			glDeleteSync(mFences[i]);
+	}
+	if(mBuffer) {
+		glBindBuffer(mTarget, mBuffer);
+		glUnmapBuffer(mTarget);
+		glDeleteBuffers(1, &mBuffer);
+		MemoryTracker::deleteBuffers(1, &mBuffer);
+	}
+	glDeleteBuffers(1, &mOrphanBuffer);
+	MemoryTracker::deleteBuffers(1, &mOrphanBuffer);
+}
+
+void UploadRing::resize(size_t bytes)
+{
+	/* leave some room for growth to avoid reallocating every frame */
+	bytes += bytes / 2;
+	mStats.frameSize = (bytes + mAlignment - 1) / mAlignment * mAlignment;
+	mStaging.resize(mStats.frameSize);
+
+	if(!mStats.persistent)
+		return;
+
+	for(int i = 0; i < Regions; i++) {
+		if(mFences[i]) {
+			glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+	}
+
+	if(mBuffer) {
+		glBindBuffer(mTarget, mBuffer);
+		glUnmapBuffer(mTarget);
+		glDeleteBuffers(1, &mBuffer);
+		MemoryTracker::deleteBuffers(1, &mBuffer);
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(mTarget, mBuffer);
+	glBufferStorage(mTarget, mStats.frameSize * Regions, nullptr, flags);
+	mMapped = static_cast<unsigned char*>(glMapBufferRange(mTarget, 0,
+				mStats.frameSize * Regions, flags));
+	if(!mMapped) {
+		std::cerr << "Unable to map upload buffer persistently, falling back to orphaning.\n";
+		glDeleteBuffers(1, &mBuffer);
+		mBuffer = 0;
+		mStats.persistent = false;
+	} else {
+		MemoryTracker::setBufferSize(mBuffer, MemoryCategory::StreamBuffers, mStats.frameSize * Regions);
+	}
+}
+
+void UploadRing::beginFrame(size_t bytes)
+{
+	mOffset = 0;
+	if(bytes > mStats.frameSize)
+		resize(bytes);
+
+	/* writes through the mapping can't be traced */
+	mFallback = true;
+	if(mStats.persistent && !GLTrace::isRecording()) {
+		mRegion = (mRegion + 1) % Regions;
+		if(mFences[mRegion]) {
+			GLenum res = glClientWaitSync(mFences[mRegion], 0, 0);
+			if(res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED) {
+				glDeleteSync(mFences[mRegion]);
+				mFences[mRegion] = 0;
+				mFallback = false;
+			}
+		} else {
+			mFallback = false;
+		}
+	}
+
+	mStats.frames++;
+	if(mFallback && mStats.persistent)
+		mStats.fallbackFrames++;
+}
+
+void* UploadRing::allocate(size_t size, size_t& offset)
+{
+	size_t start = (mOffset + mAlignment - 1) / mAlignment * mAlignment;
+	if(start + size > mStats.frameSize)
+		return nullptr;
+
+	mOffset = start + size;
+	if(mFallback) {
+		offset = start;
+		return &mStaging[start];
+	} else {
+		offset = mRegion * mStats.frameSize + start;
+		return mMapped + offset;
+	}
+}
+
+size_t UploadRing::alignedSize(size_t size) const
+{
+	return (size + mAlignment - 1) / mAlignment * mAlignment;
+}
+
+void UploadRing::commit()
+{
+	mStats.lastFrameBytes = mOffset;
+	if(mFallback && mOffset) {
+		glBindBuffer(mTarget, mOrphanBuffer);
+		glBufferData(mTarget, mStats.frameSize, nullptr, GL_STREAM_DRAW);
+		MemoryTracker::setBufferSize(mOrphanBuffer, MemoryCategory::StreamBuffers, mStats.frameSize);
+		glBufferSubData(mTarget, 0, mOffset, &mStaging[0]);
+	}
+}
+
+void UploadRing::endFrame()
+{
+	if(!mFallback) {
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+GLuint UploadRing::getBuffer() const
+{
+	return mFallback ? mOrphanBuffer : mBuffer;
+}
+
+const UploadRingStats& UploadRing::getStats() const
+{
+	return mStats;
+}
+
+}
+
@@ -0,0 +1,63 @@
+#ifndef SCENE_UPLOADRING_H
+#define SCENE_UPLOADRING_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+namespace Scene {
+
+struct UploadRingStats {
+	UploadRingStats();
+	bool persistent;
+	size_t frameSize;
+	size_t lastFrameBytes;
+	unsigned int frames;
+	unsigned int fallbackFrames;
+};
+
+/* Buffer for data that is rewritten every frame. When buffer storage and
+ * sync objects are available, the buffer is mapped persistently and split
+ * into one region per frame in flight, each guarded by a fence. If the
+ * region to be written is still in use by the GPU, or persistent mapping
+ * isn't supported, the frame is written to system memory instead and
+ * uploaded to an orphaned buffer with glBufferSubData, so the CPU never
+ * waits on the GPU.
+ *
+ * Usage per frame: beginFrame(), allocate() for all data, commit(), bind
+ * ranges of getBuffer() for drawing, endFrame(). */
+class UploadRing {
+	public:
+		UploadRing(GLenum target, size_t alignment);
+		~UploadRing();
+		void beginFrame(size_t bytes);
+		void* allocate(size_t size, size_t& offset);
+		size_t alignedSize(size_t size) const;
+		void commit();
+		void endFrame();
+		GLuint getBuffer() const;
+		const UploadRingStats& getStats() const;
+
+	private:
+		static const int Regions = 3;
+
+		void resize(size_t bytes);
+
+		GLenum mTarget;
+		size_t mAlignment;
+		size_t mOffset;
+		int mRegion;
+		bool mFallback;
+		GLuint mBuffer;
+		GLuint mOrphanBuffer;
+		unsigned char* mMapped;
+		GLsync mFences[Regions];
+		std::vector<unsigned char> mStaging;
+		UploadRingStats mStats;
+};
+
+}
+
+#endif
+
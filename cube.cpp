@@ -1,5 +1,6 @@
 #include <unistd.h>
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -23,6 +24,8 @@
 #include "Model.h"
 #include "App.h"
 #include "HelperFunctions.h"
+#include "MatrixKernels.h"
+#include "Profiler.h"
 
 using namespace Common;
 
@@ -35,10 +38,11 @@ class Camera : public App {
 		virtual bool handleEvent(const SDL_Event& ev) override;
 		virtual const char* getVertexShaderFilename() override;
 		virtual const char* getFragmentShaderFilename() override;
+		virtual std::string getShaderDefines() override;
 		virtual void postInit() override;
 		virtual void bindAttributes() override;
 		virtual void draw() override;
-
+		virtual bool needsRedraw() override;
 
 	protected:
 		void calculateModelMatrix(const MeshInstance& mi);
@@ -94,18 +98,8 @@ void Camera::enableDepthTest()
 
 void Camera::calculateModelMatrix(const MeshInstance& mi)
 {
-	auto translation = HelperFunctions::translationMatrix(mi.getPosition());
-	auto rotation = mi.getRotation();
-	mModelMatrix = rotation * translation;
-
-	auto invTranslation(translation);
-	invTranslation.m[3] = -invTranslation.m[3];
-	invTranslation.m[7] = -invTranslation.m[7];
-	invTranslation.m[11] = -invTranslation.m[11];
-
-	auto invRotation = rotation.transposed();
-
-	mInverseModelMatrix = invTranslation * invRotation;
+	mi.getModelMatrix(mModelMatrix.m);
+	MatrixKernels::affineInverse(mModelMatrix.m, mInverseModelMatrix.m);
 }
 
 void Camera::updateMVPMatrix(const MeshInstance& mi)
@@ -130,7 +124,7 @@ Camera::Camera()
 	mRotStep(0.02f),
 	mHRot(0.0f),
 	mVRot(0.0f),
-	mModel(Model("textured-cube.obj")),
+	mModel("textured-cube.obj"),
 	mAmbientLightEnabled(true),
 	mDirectionalLightEnabled(true),
 	mPointLightEnabled(true)
@@ -150,7 +144,7 @@ Camera::Camera()
 
 	MeshInstance m(mModel);
 	m.setPosition(Vector3(-0.1f, 0.0f, 0.1f));
-	m.setRotation(Matrix44::Identity);
+	m.setOrientation(Quaternion());
 	mMeshInstances.push_back(m);
 
 	MeshInstance m2(mModel);
@@ -173,10 +167,6 @@ Camera::Camera()
 	mUniformLocationMap["u_pointLightPosition"] = -1;
 	mUniformLocationMap["u_pointLightAttenuation"] = -1;
 	mUniformLocationMap["u_pointLightColor"] = -1;
-
-	mUniformLocationMap["u_ambientLightEnabled"] = -1;
-	mUniformLocationMap["u_directionalLightEnabled"] = -1;
-	mUniformLocationMap["u_pointLightEnabled"] = -1;
 }
 
 void Camera::updateFrameMatrices()
@@ -225,6 +215,13 @@ bool Camera::handleEvent(const SDL_Event& ev)
 						std::cout << "Up: " << mUp << "\n";
 						std::cout << "Target: " << mTarget << "\n";
 						std::cout << "Position: " << mCamPos << "\n";
+						const auto& il = getInputLatency();
+						if(il.frames) {
+							std::cout << "Input to present latency: "
+								<< il.total / il.frames * 1000.0 << " ms average, "
+								<< il.max * 1000.0 << " ms max over " << il.frames << " frames\n";
+						}
+						getFramePacer().printStats(std::cout);
 					} else if(ev.key.keysym.sym == SDLK_F1) {
 						mAmbientLightEnabled = !mAmbientLightEnabled;
 					} else if(ev.key.keysym.sym == SDLK_F2) {
@@ -277,6 +274,16 @@ void Camera::handleMouseMove(int xdiff, int ydiff)
 	mUp = mTarget.cross(haxis).normalized();
 }
 
+/* Only camera movement animates in on-demand mode. */
+bool Camera::needsRedraw()
+{
+	for(auto& p : mCamPosDelta) {
+		if(!p.second.null())
+			return true;
+	}
+	return false;
+}
+
 void Camera::setupTexturing()
 {
 	mTexture = HelperFunctions::loadTexture("snow.jpg");
@@ -293,6 +300,11 @@ const char* Camera::getFragmentShaderFilename()
 	return "scene.frag";
 }
 
+std::string Camera::getShaderDefines()
+{
+	return "#define AMBIENT_LIGHT\n#define DIRECTIONAL_LIGHT\n#define POINT_LIGHT\n";
+}
+
 void Camera::postInit()
 {
 	GLuint vboids[4];
@@ -338,28 +350,27 @@ void Camera::bindAttributes()
 
 void Camera::draw()
 {
-	glUniform1i(mUniformLocationMap["u_ambientLightEnabled"], mAmbientLightEnabled);
-	glUniform1i(mUniformLocationMap["u_directionalLightEnabled"], mDirectionalLightEnabled);
-	glUniform1i(mUniformLocationMap["u_pointLightEnabled"], mPointLightEnabled);
-
 	double time = Clock::getTime();
 	updateFrameMatrices();
 
 	float pointLightTime = Math::degreesToRadians(fmodl(time * 160.0f, 360));
-	if(mPointLightEnabled) {
-		glUniform3f(mUniformLocationMap["u_pointLightAttenuation"], 0.0f, 0.0f, 6.0f);
-		glUniform3f(mUniformLocationMap["u_pointLightColor"], 1.0f, 1.0f, 1.0f);
-	}
+	/* a disabled light is drawn black */
+	float pointLightColor = mPointLightEnabled ? 1.0f : 0.0f;
+	glUniform3f(mUniformLocationMap["u_pointLightAttenuation"], 0.0f, 0.0f, 6.0f);
+	glUniform3f(mUniformLocationMap["u_pointLightColor"], pointLightColor, pointLightColor, pointLightColor);
 
-	if(mDirectionalLightEnabled) {
-		glUniform3f(mUniformLocationMap["u_directionalLightColor"], 1.0f, 1.0f, 1.0f);
-	}
+	float directionalLightColor = mDirectionalLightEnabled ? 1.0f : 0.0f;
+	glUniform3f(mUniformLocationMap["u_directionalLightColor"], directionalLightColor,
+			directionalLightColor, directionalLightColor);
 
 	{
 		float timePoint = Math::degreesToRadians(fmodl(time * 20.0f, 360));
 		float rvalue = sin(timePoint) * 0.5f;
 		float gvalue = sin(timePoint + 2.0f * PI / 3.0f) * 0.5f;
 		float bvalue = sin(timePoint + 4.0f * PI / 3.0f) * 0.5f;
+		if(!mAmbientLightEnabled) {
+			rvalue = gvalue = bvalue = 0.0f;
+		}
 		glUniform3f(mUniformLocationMap["u_ambientLight"], rvalue, gvalue, bvalue);
 	}
 
@@ -385,7 +396,6 @@ void Camera::draw()
 			// inverse rotation matrix (normal matrix)
 			Vector3 dir(-1, -1, -1);
 			glUniform3f(mUniformLocationMap["u_directionalLightDirection"], dir.x, dir.y, dir.z);
-			glUniform3f(mUniformLocationMap["u_directionalLightColor"], 1.0f, 1.0f, 1.0f);
 		}
 
 		glDrawElements(GL_TRIANGLES, mi.getModel().getIndices().size(),
@@ -395,13 +405,55 @@ void Camera::draw()
 
 void usage(const char* p)
 {
-	std::cerr << "Usage: " << p << " [--colors]\n";
+	std::cerr << "Usage: " << p << " [options]\n"
+		<< "\t--profile-out <file>           write a Chrome trace\n"
+		<< "\t--fps <n>                      limit the frame rate\n"
+		<< "\t--on-demand                    only redraw on input or camera movement\n"
+		<< "\t--vsync <off|on|adaptive>      swap interval (default off)\n";
+}
+
+bool parseSwapMode(const char* s, SwapMode& mode)
+{
+	if(!strcmp(s, "off")) {
+		mode = SwapMode::Immediate;
+	} else if(!strcmp(s, "on")) {
+		mode = SwapMode::VSync;
+	} else if(!strcmp(s, "adaptive")) {
+		mode = SwapMode::AdaptiveVSync;
+	} else {
+		return false;
+	}
+	return true;
 }
 
 int main(int argc, char** argv)
 {
+	std::string profileOut;
+	double fps = 0.0;
+	bool onDemand = false;
+	SwapMode swapMode = SwapMode::Immediate;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--profile-out") && i + 1 < argc) {
+			profileOut = argv[++i];
+		} else if(!strcmp(argv[i], "--fps") && i + 1 < argc) {
+			fps = atof(argv[++i]);
+		} else if(!strcmp(argv[i], "--on-demand")) {
+			onDemand = true;
+		} else if(!strcmp(argv[i], "--vsync") && i + 1 < argc && parseSwapMode(argv[i + 1], swapMode)) {
+			i++;
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
 	App* app = nullptr;
 	app = new Camera();
+	app->getFramePacer().setTargetFPS(fps);
+	app->getFramePacer().setOnDemand(onDemand);
+	app->setSwapMode(swapMode);
+	Profiler::setEnabled(!profileOut.empty());
 
 	try {
 		app->run();
@@ -411,8 +463,13 @@ int main(int argc, char** argv)
 		std::cerr << "Unknown exception.\n";
 	}
 
+	app->getFramePacer().printStats(std::cout);
 	delete app;
 
+	if(!profileOut.empty()) {
+		Profiler::writeChromeTrace(profileOut);
+	}
+
 	return 0;
 }
 
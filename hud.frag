@@ -0,0 +1,11 @@
+#version 120
+
+varying vec2 v_Texcoord;
+varying vec4 v_Color;
+
+uniform sampler2D u_atlas;
+
+void main()
+{
+    gl_FragColor = vec4(v_Color.rgb, v_Color.a * texture2D(u_atlas, v_Texcoord).a);
+}
@@ -0,0 +1,19 @@
+#version 120
+
+attribute vec2 a_Position;
+attribute vec2 a_Texcoord;
+attribute vec4 a_Color;
+
+/* positions are in pixels from the top left corner */
+uniform vec2 u_screenSize;
+
+varying vec2 v_Texcoord;
+varying vec4 v_Color;
+
+void main()
+{
+    vec2 p = a_Position / u_screenSize * 2.0 - 1.0;
+    gl_Position = vec4(p.x, -p.y, 0.0, 1.0);
+    v_Texcoord = a_Texcoord;
+    v_Color = a_Color;
+}
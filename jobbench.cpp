@@ -0,0 +1,115 @@
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Benchmark.h"
+
+using namespace Scene;
+
+/* Creating, scheduling and running empty jobs. */
+static BenchmarkStats emptyJobs(JobSystem& js, int samples, int jobs)
+{
+	return Benchmark::measure(samples, 1, [&] (unsigned int) {
+			Job* root = js.create([] () { });
+			for(int i = 0; i < jobs; i++) {
+				js.submit(js.create([] () { }, root));
+			}
+			js.submit(root);
+			js.wait(root);
+			});
+}
+
+/* A chain of jobs where each depends on the previous one. */
+static BenchmarkStats dependencyChain(JobSystem& js, int samples, int jobs)
+{
+	return Benchmark::measure(samples, 1, [&] (unsigned int) {
+			std::vector<Job*> chain;
+			for(int i = 0; i < jobs; i++) {
+				chain.push_back(js.create([] () { }));
+				if(i)
+					js.addDependency(chain[i - 1], chain[i]);
+			}
+			for(int i = jobs - 1; i >= 0; i--) {
+				js.submit(chain[i]);
+			}
+			js.wait(chain.back());
+			});
+}
+
+/* parallelFor over a CPU bound loop. */
+static BenchmarkStats parallelWork(JobSystem& js, int samples, std::vector<float>& data)
+{
+	return Benchmark::measure(samples, 1, [&] (unsigned int) {
+			js.parallelFor(data.size(), 1024, [&] (size_t chunk, size_t begin, size_t end) {
+				for(size_t i = begin; i < end; i++) {
+					float v = data[i];
+					for(int j = 0; j < 32; j++)
+						v = sqrtf(v * v + 1.0f);
+					data[i] = v;
+				}
+			});
+			});
+}
+
+void usage(const char* p)
+{
+	std::cerr << "Usage: " << p << " [--threads <max>] [--samples <n>]\n";
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int maxThreads = std::thread::hardware_concurrency();
+	int samples = 20;
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			maxThreads = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "--samples") && i + 1 < argc) {
+			samples = atoi(argv[++i]);
+		} else {
+			std::cerr << "Unknown parameters.\n";
+			usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if(maxThreads < 1)
+		maxThreads = 1;
+
+	const int numJobs = 2000;
+	const int chainLength = 1000;
+	std::vector<float> data(1 << 20, 1.0f);
+	double serialWork = 0.0;
+
+	/* powers of two, and the maximum if it isn't one */
+	std::vector<unsigned int> threadCounts;
+	for(unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	if(threadCounts.back() != maxThreads)
+		threadCounts.push_back(maxThreads);
+
+	for(unsigned int threads : threadCounts) {
+		JobSystem js(threads);
+		std::ostringstream prefix;
+		prefix << threads << " thread" << (threads > 1 ? "s" : "") << ": ";
+
+		auto empty = emptyJobs(js, samples, numJobs);
+		Benchmark::print(std::cout, prefix.str() + "empty job", empty, 1.0e9 / numJobs, "ns");
+
+		auto chain = dependencyChain(js, samples, chainLength);
+		Benchmark::print(std::cout, prefix.str() + "dependent job", chain, 1.0e9 / chainLength, "ns");
+
+		auto work = parallelWork(js, samples, data);
+		Benchmark::print(std::cout, prefix.str() + "parallelFor 1M elements", work, 1.0e3, "ms");
+		if(threads == 1)
+			serialWork = work.p50;
+		std::cout << prefix.str() << "speedup " << serialWork / work.p50 << "x\n";
+	}
+
+	return 0;
+}
+
@@ -1,20 +1,53 @@
+#version 120
+
+#ifdef DRAW_BLOCK
+#extension GL_ARB_uniform_buffer_object : require
+#endif
+
 attribute vec3 a_Position;
-attribute vec2 a_texCoord;
+attribute vec2 a_Texcoord;
 attribute vec3 a_Normal;
 
+#ifdef DRAW_BLOCK
+layout(std140) uniform DrawData {
+    mat4 u_MVP;
+    mat4 u_inverseMVP;
+    vec4 u_pointLightPosition;
+};
+#else
 uniform mat4 u_MVP;
+#ifdef DIRECTIONAL_LIGHT
 uniform mat4 u_inverseMVP;
-uniform vec3 u_pointLightPosition;
+#endif
+#ifdef POINT_LIGHT
+/* in model space, with the model scale in w */
+uniform vec4 u_pointLightPosition;
+#endif
+#endif
 
 varying vec2 v_texCoord;
+#ifdef DIRECTIONAL_LIGHT
 varying vec3 v_Normal;
+#endif
+#ifdef POINT_LIGHT
 varying float v_PointLightDistance;
+#endif
+
+/* the depth pre-pass draws with DEPTH_ONLY and the main pass tests for
+ * equal depth, which only holds across programs for invariant output */
+invariant gl_Position;
 
 void main()
 {
     gl_Position = u_MVP * vec4(a_Position, 1.0);
-    v_texCoord = a_texCoord;
+#ifndef DEPTH_ONLY
+    v_texCoord = a_Texcoord;
+#endif
+#ifdef DIRECTIONAL_LIGHT
     v_Normal = vec3(vec4(a_Normal, 1.0) * u_inverseMVP);
-    v_PointLightDistance = distance(a_Position, u_pointLightPosition);
+#endif
+#ifdef POINT_LIGHT
+    v_PointLightDistance = distance(a_Position, u_pointLightPosition.xyz) * u_pointLightPosition.w;
+#endif
 }
 
@@ -27,6 +27,7 @@
 #include "Model.h"
 #include "App.h"
 #include "HelperFunctions.h"
+#include "Profiler.h"
 
 using namespace Common;
 
@@ -502,7 +503,7 @@ void Camera::handleMouseMove(int xdiff, int ydiff)
 }
 
 Textures::Textures()
-	: mModel(Model("textured-cube.obj")),
+	: mModel("textured-cube.obj"),
 	mUseVBOs(false)
 {
 	assert(mModel.getVertexCoords().size());
@@ -717,33 +718,38 @@ void PointLight::draw()
 
 void usage(const char* p)
 {
-	std::cerr << "Usage: " << p << " [--colors]\n";
+	std::cerr << "Usage: " << p << " [--colors] [--profile-out <file>]\n";
 }
 
 int main(int argc, char** argv)
 {
 	App* app = nullptr;
-	if(argc != 1) {
-		if(argc != 2) {
+	std::string profileOut;
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "--profile-out") && i + 1 < argc) {
+			profileOut = argv[++i];
+			continue;
+		}
+		if(app) {
 			std::cerr << "Unknown parameters.\n";
 			usage(argv[0]);
 			exit(1);
 		}
-		if(!strcmp(argv[1], "--colors")) {
+		if(!strcmp(argv[i], "--colors")) {
 			app = new Colors();
-		} else if(!strcmp(argv[1], "--rotate")) {
+		} else if(!strcmp(argv[i], "--rotate")) {
 			app = new Rotate();
-		} else if(!strcmp(argv[1], "--perspective")) {
+		} else if(!strcmp(argv[i], "--perspective")) {
 			app = new Perspective();
-		} else if(!strcmp(argv[1], "--camera")) {
+		} else if(!strcmp(argv[i], "--camera")) {
 			app = new Camera();
-		} else if(!strcmp(argv[1], "--textures")) {
+		} else if(!strcmp(argv[i], "--textures")) {
 			app = new Textures();
-		} else if(!strcmp(argv[1], "--ambient")) {
+		} else if(!strcmp(argv[i], "--ambient")) {
 			app = new AmbientLight();
-		} else if(!strcmp(argv[1], "--directional")) {
+		} else if(!strcmp(argv[i], "--directional")) {
 			app = new DirectionalLight();
-		} else if(!strcmp(argv[1], "--pointlight")) {
+		} else if(!strcmp(argv[i], "--pointlight")) {
 			app = new PointLight();
 		} else {
 			std::cerr << "Unknown parameters.\n";
@@ -756,6 +762,8 @@ int main(int argc, char** argv)
 		app = new Triangle();
 	}
 
+	Profiler::setEnabled(!profileOut.empty());
+
 	try {
 		app->run();
 	} catch(std::exception& e) {
@@ -766,6 +774,10 @@ int main(int argc, char** argv)
 
 	delete app;
 
+	if(!profileOut.empty()) {
+		Profiler::writeChromeTrace(profileOut);
+	}
+
 	return 0;
 }
 